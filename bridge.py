@@ -2,14 +2,19 @@
 """
 screen2cam virtual camera bridge (macOS)
 
-Reads raw YUV420P frames from stdin and sends them to a virtual camera
-via pyvirtualcam (OBS Virtual Camera backend).
+Reads raw frames from stdin and sends them to a virtual camera via
+pyvirtualcam (OBS Virtual Camera backend).
 
 Usage:
-    ./screen2cam | python3 bridge.py WIDTH HEIGHT [FPS]
+    ./screen2cam --format rgb24 | python3 bridge.py WIDTH HEIGHT [FPS] [FORMAT]
+
+FORMAT is what screen2cam writes:
+    rgb24    (fast) frames are read straight into one preallocated buffer
+             and handed to pyvirtualcam as they are, no conversion
+    yuv420p  (default, slow) converted to RGB with NumPy on every frame
 
 Example:
-    ./screen2cam --fps 15 | python3 bridge.py 3024 1964 15
+    ./screen2cam --fps 15 --format rgb24 | python3 bridge.py 3024 1964 15 rgb24
 """
 
 import sys
@@ -42,31 +47,58 @@ def yuv420p_to_rgba(data, w, h):
     rgb = np.stack([r, g, b], axis=2)
     return rgb
 
+def read_exact(stream, view):
+    """Fill view from stream (pipes return short reads). False at EOF."""
+    got = 0
+    while got < len(view):
+        n = stream.readinto(view[got:])
+        if not n:
+            return False
+        got += n
+    return True
+
 def main():
     if len(sys.argv) < 3:
-        print("Usage: ./screen2cam | python3 bridge.py WIDTH HEIGHT [FPS]", file=sys.stderr)
+        print("Usage: ./screen2cam | python3 bridge.py WIDTH HEIGHT [FPS] [rgb24|yuv420p]",
+              file=sys.stderr)
         sys.exit(1)
 
     w = int(sys.argv[1])
     h = int(sys.argv[2])
     fps = int(sys.argv[3]) if len(sys.argv) > 3 else 15
-    frame_size = w * h * 3 // 2
+    fmt = sys.argv[4] if len(sys.argv) > 4 else "yuv420p"
+    if fmt == "rgb":
+        fmt = "rgb24"
+    if fmt not in ("rgb24", "yuv420p"):
+        print(f"bridge: unsupported format {fmt} (use rgb24 or yuv420p)", file=sys.stderr)
+        sys.exit(1)
 
     signal.signal(signal.SIGINT, lambda *_: sys.exit(0))
 
-    print(f"bridge: waiting for {w}x{h} YUV420P frames ({frame_size} bytes each) @ {fps} fps", file=sys.stderr)
+    if fmt == "rgb24":
+        # The frame pyvirtualcam gets is this very buffer: nothing is
+        # allocated or converted per frame
+        frame = np.empty((h, w, 3), np.uint8)
+        view = memoryview(frame).cast("B")
+        frame_size = len(view)
+    else:
+        frame_size = w * h * 3 // 2
+        data = bytearray(frame_size)
+        view = memoryview(data)
+
+    print(f"bridge: waiting for {w}x{h} {fmt.upper()} frames ({frame_size} bytes each) @ {fps} fps",
+          file=sys.stderr)
 
     cam = pyvirtualcam.Camera(width=w, height=h, fps=fps, print_fps=True)
     print(f"bridge: virtual camera -> {cam.device}", file=sys.stderr)
 
+    stdin = sys.stdin.buffer
     frames = 0
-    while True:
-        data = sys.stdin.buffer.read(frame_size)
-        if len(data) < frame_size:
-            break
-
-        rgba = yuv420p_to_rgba(data, w, h)
-        cam.send(rgba)
+    while read_exact(stdin, view):
+        if fmt == "rgb24":
+            cam.send(frame)
+        else:
+            cam.send(yuv420p_to_rgba(data, w, h))
         cam.sleep_until_next_frame()
 
         frames += 1
@@ -110,8 +110,8 @@ run_vcam() {
     info "Press Ctrl+C to stop."
     echo ""
 
-    "$SCRIPT_DIR/screen2cam" --fps "$fps" 2>/dev/null \
-        | python3 "$SCRIPT_DIR/bridge.py" "$WIDTH" "$HEIGHT" "$fps"
+    "$SCRIPT_DIR/screen2cam" --fps "$fps" --format rgb24 2>/dev/null \
+        | python3 "$SCRIPT_DIR/bridge.py" "$WIDTH" "$HEIGHT" "$fps" rgb24
 }
 
 # --- Run: preview mode (ffplay) ---
@@ -105,7 +105,7 @@ function Run-VCam {
     Write-Host ""
 
     # Pipe screen2cam output through bridge.py to OBS virtual camera
-    & $exe --fps $fps 2>$null | python $bridge $Width $Height $fps
+    & $exe --fps $fps --format rgb24 2>$null | python $bridge $Width $Height $fps rgb24
 }
 
 # --- Run: preview mode (ffplay) ---
@@ -75,6 +75,9 @@ install_deps() {
         build-essential \
         libx11-dev \
         libxext-dev \
+        libpipewire-0.3-dev \
+        libdbus-1-dev \
+        libsrt-openssl-dev \
         v4l2loopback-dkms \
         v4l2loopback-utils \
         v4l-utils
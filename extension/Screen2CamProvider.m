@@ -9,8 +9,9 @@
  *   Screen2CamDeviceSource    — CMIOExtensionDeviceSource (one virtual camera)
  *   Screen2CamStreamSource    — CMIOExtensionStreamSource (one video stream)
  *
- * The stream source polls shared memory for new frames and serves them
- * to consuming apps (Teams, Zoom, FaceTime, etc.).
+ * The stream source wakes on the host's frame semaphore, reads the new
+ * frame from shared memory and serves it to consuming apps (Teams, Zoom,
+ * FaceTime, etc.).  A slow timer reconnects when the host (re)starts.
  *
  * Build: Requires Xcode, must be code-signed and embedded in a host .app.
  *        See extension/README.md for build instructions.
@@ -23,29 +24,52 @@
 #import <CoreVideo/CoreVideo.h>
 #import <Foundation/Foundation.h>
 
+#include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <errno.h>
+#include <semaphore.h>
 
 #include "shm_protocol.h"
 
 /* ── Shared memory reader ──────────────────────────────────── */
 
+/*
+ * Frames wrapped without copying keep the mapping alive, so the reader is
+ * reference counted: one reference for the stream, one per CVPixelBuffer
+ * still pointing into a slot.
+ */
 typedef struct {
     int             fd;
-    shm_header_t   *hdr;
+    shm_header_t   *hdr;          /* v1 segments: only the common fields */
     size_t          mapped_size;
+    uint32_t        version;
+    int             writable;     /* can mark slots as held (zero-copy) */
     uint64_t        last_seq;
+    _Atomic int     refs;
 } shm_reader_t;
 
+typedef struct {
+    shm_reader_t   *reader;
+    int             slot;
+} shm_hold_t;
+
 static shm_reader_t *shm_reader_open(void)
 {
-    int fd = shm_open(SHM_NAME, O_RDONLY, 0);
+    /* Read-write so slots can be held; fall back to copying */
+    int writable = 1;
+    int fd = shm_open(SHM_NAME, O_RDWR, 0);
+    if (fd < 0) {
+        writable = 0;
+        fd = shm_open(SHM_NAME, O_RDONLY, 0);
+    }
     if (fd < 0)
         return NULL;
 
-    /* Map just the header first to read dimensions */
+    /* Map just the header first to read version and dimensions */
     shm_header_t *hdr = mmap(NULL, sizeof(shm_header_t),
                               PROT_READ, MAP_SHARED, fd, 0);
     if (hdr == MAP_FAILED) {
@@ -53,17 +77,23 @@ static shm_reader_t *shm_reader_open(void)
         return NULL;
     }
 
-    if (hdr->magic != SHM_MAGIC || hdr->version != SHM_VERSION) {
-        munmap(hdr, sizeof(shm_header_t));
+    uint32_t version = hdr->version;
+    size_t total = 0;
+    if (hdr->magic == SHM_MAGIC && version == 1)
+        total = sizeof(shm_header_v1_t) + (size_t)hdr->width * hdr->height * 4;
+    else if (hdr->magic == SHM_MAGIC && version == SHM_VERSION &&
+             hdr->slot_count == SHM_SLOTS && hdr->total_size >= sizeof(shm_header_t))
+        total = hdr->total_size;
+    munmap(hdr, sizeof(shm_header_t));
+
+    if (total == 0) {
         close(fd);
         return NULL;
     }
 
-    /* Remap with full frame size */
-    size_t total = shm_total_size(hdr->width, hdr->height);
-    munmap(hdr, sizeof(shm_header_t));
-
-    hdr = mmap(NULL, total, PROT_READ, MAP_SHARED, fd, 0);
+    /* Remap the whole segment */
+    int prot = PROT_READ | (writable && version >= 2 ? PROT_WRITE : 0);
+    hdr = mmap(NULL, total, prot, MAP_SHARED, fd, 0);
     if (hdr == MAP_FAILED) {
         close(fd);
         return NULL;
@@ -73,25 +103,73 @@ static shm_reader_t *shm_reader_open(void)
     r->fd = fd;
     r->hdr = hdr;
     r->mapped_size = total;
+    r->version = version;
+    r->writable = writable && version >= 2;
     r->last_seq = 0;
+    atomic_init(&r->refs, 1);
     return r;
 }
 
 static void shm_reader_close(shm_reader_t *r)
 {
     if (!r) return;
+    if (atomic_fetch_sub(&r->refs, 1) != 1)
+        return;   /* wrapped frames still in flight; last one closes */
     if (r->hdr) munmap(r->hdr, r->mapped_size);
     if (r->fd >= 0) close(r->fd);
     free(r);
 }
 
+static void shm_release_hold(void *refCon, const void *baseAddress)
+{
+    (void)baseAddress;
+    shm_hold_t *hold = refCon;
+    shm_release_slot(hold->reader->hdr, hold->slot);
+    shm_reader_close(hold->reader);
+    free(hold);
+}
+
+/*
+ * Frame wakeups.  A waiter thread blocks on the host's semaphore and owns
+ * this struct; the stream sets `stop` and posts to make it exit.
+ */
+typedef struct {
+    sem_t          *sem;
+    _Atomic int     stop;
+} shm_notify_t;
+
+static shm_notify_t *shm_notify_open(void)
+{
+    sem_t *sem = sem_open(SHM_NOTIFY_NAME, 0);
+    if (sem == SEM_FAILED)
+        return NULL;   /* v1 host, or not started yet */
+
+    shm_notify_t *n = calloc(1, sizeof(*n));
+    n->sem = sem;
+    atomic_init(&n->stop, 0);
+    return n;
+}
+
+static void shm_notify_stop(shm_notify_t *n)
+{
+    if (!n) return;
+    atomic_store(&n->stop, 1);
+    sem_post(n->sem);
+}
+
+/* Watchdog period while frames arrive through the semaphore */
+#define WATCHDOG_NSEC   (500 * NSEC_PER_MSEC)
+
 /* ── Stream Source ─────────────────────────────────────────── */
 
 @interface Screen2CamStreamSource : NSObject <CMIOExtensionStreamSource>
 {
     shm_reader_t        *_reader;
     CMIOExtensionStream *_stream;
-    dispatch_source_t    _timer;
+    shm_notify_t        *_notify;
+    dispatch_queue_t     _queue;      /* serialises all frame handling */
+    dispatch_source_t    _timer;      /* watchdog, or poll without _notify */
+    uint64_t             _interval;
     uint32_t             _width;
     uint32_t             _height;
     int                  _fps;
@@ -100,93 +178,123 @@ static void shm_reader_close(shm_reader_t *r)
 @property (nonatomic, strong) CMIOExtensionStreamFormat *activeFormat;
 
 - (instancetype)initWithWidth:(uint32_t)w height:(uint32_t)h fps:(int)fps;
-- (void)startStreamingToStream:(CMIOExtensionStream *)stream;
-- (void)stopStreaming;
+- (void)startStreamingToStream:(CMIOExtensionStream *)stream
+{
+    _stream = stream;
+    _queue = dispatch_queue_create("screen2cam.stream", DISPATCH_QUEUE_SERIAL);
+    dispatch_set_target_queue(_queue,
+                              dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0));
 
-@end
+    /* Watchdog: reconnects, and polls at the target FPS until a wakeup
+     * semaphore is available (older hosts have none) */
+    _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+    _interval = 0;
+
+    __weak typeof(self) weakSelf = self;
+    dispatch_source_set_event_handler(_timer, ^{
+        [weakSelf watchdog];
+    });
 
-@implementation Screen2CamStreamSource
+    [self setTimerInterval:(uint64_t)(1000000000.0 / _fps)];
+    dispatch_resume(_timer);
 
-- (instancetype)initWithWidth:(uint32_t)w height:(uint32_t)h fps:(int)fps
-{
-    self = [super init];
-    if (self) {
-        _width = w;
-        _height = h;
-        _fps = fps;
-
-        CMVideoFormatDescriptionRef desc = NULL;
-        CMVideoFormatDescriptionCreate(kCFAllocatorDefault,
-                                        kCVPixelFormatType_32BGRA,
-                                        w, h, NULL, &desc);
-
-        CMIOExtensionStreamFormat *fmt =
-            [[CMIOExtensionStreamFormat alloc] initWithFormatDescription:desc
-                                                       maxFrameDuration:CMTimeMake(1, fps)
-                                                       minFrameDuration:CMTimeMake(1, fps)
-                                                            validFrameDurations:nil];
-        self.activeFormat = fmt;
-        CFRelease(desc);
-    }
-    return self;
+    dispatch_async(_queue, ^{
+        [self connect];
+        if (!self->_reader)
+            NSLog(@"screen2cam-ext: shared memory not available yet, will retry");
+    });
 }
 
-- (NSArray<CMIOExtensionStreamFormat *> *)formats
+- (void)stopStreaming
 {
-    return @[self.activeFormat];
-}
+    if (!_queue)
+        return;
 
-- (CMIOExtensionStreamFormat *)activeFormatIndex
-{
-    return self.activeFormat;
+    dispatch_sync(_queue, ^{
+        if (self->_timer) {
+            dispatch_source_cancel(self->_timer);
+            self->_timer = nil;
+        }
+        [self disconnect];
+        self->_stream = nil;
+    });
+    _queue = nil;
 }
 
-- (CMTime)frameDuration
+- (void)setTimerInterval:(uint64_t)interval
 {
-    return CMTimeMake(1, _fps);
+    if (!_timer || interval == _interval)
+        return;
+    _interval = interval;
+    dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, interval),
+                              interval, interval / 10);
 }
 
-- (void)startStreamingToStream:(CMIOExtensionStream *)stream
+/* On _queue.  Open the segment and, if the host offers one, the semaphore. */
+- (void)connect
 {
-    _stream = stream;
-    _reader = shm_reader_open();
-
-    if (!_reader) {
-        NSLog(@"screen2cam-ext: shared memory not available yet, will retry");
-    }
-
-    /* Timer fires at target FPS to poll shared memory */
-    _timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0,
-                                    dispatch_get_global_queue(QOS_CLASS_USER_INTERACTIVE, 0));
+    if (!_reader)
+        _reader = shm_reader_open();
+    if (!_reader || _notify)
+        return;
 
-    uint64_t interval = (uint64_t)(1000000000.0 / _fps);
-    dispatch_source_set_timer(_timer, DISPATCH_TIME_NOW, interval, interval / 10);
+    _notify = shm_notify_open();
+    if (!_notify)
+        return;
 
+    /* The waiter owns n; it only touches self through the queue */
+    shm_notify_t *n = _notify;
+    dispatch_queue_t queue = _queue;
     __weak typeof(self) weakSelf = self;
-    dispatch_source_set_event_handler(_timer, ^{
-        [weakSelf pollAndSendFrame];
-    });
+    [NSThread detachNewThreadWithBlock:^{
+        [NSThread currentThread].qualityOfService = NSQualityOfServiceUserInteractive;
+        while (!atomic_load(&n->stop)) {
+            if (sem_wait(n->sem) != 0) {
+                if (errno == EINTR) continue;
+                break;
+            }
+            while (sem_trywait(n->sem) == 0)
+                ;   /* coalesce a backlog into one wakeup */
+            if (atomic_load(&n->stop))
+                break;
+            dispatch_sync(queue, ^{
+                [weakSelf pollAndSendFrame];
+            });
+        }
+        sem_close(n->sem);
+        free(n);
+    }];
 
-    dispatch_resume(_timer);
+    [self setTimerInterval:WATCHDOG_NSEC];
 }
 
-- (void)stopStreaming
+/* On _queue */
+- (void)disconnect
 {
-    if (_timer) {
-        dispatch_source_cancel(_timer);
-        _timer = nil;
-    }
+    shm_notify_stop(_notify);
+    _notify = NULL;
     shm_reader_close(_reader);
     _reader = NULL;
-    _stream = nil;
+    [self setTimerInterval:(uint64_t)(1000000000.0 / _fps)];
 }
 
+/* On _queue.  Also catches a frame whose wakeup was missed. */
+- (void)watchdog
+{
+    [self connect];
+    [self pollAndSendFrame];
+}
+
+/* On _queue */
 - (void)pollAndSendFrame
 {
-    /* Retry connection if not yet open */
-    if (!_reader) {
-        _reader = shm_reader_open();
-        if (!_reader) return;
+    if (!_reader)
+        return;
+
+    /* The host clears version on exit; drop the old segment and reconnect */
+    if (_reader->hdr->version == 0) {
+        [self disconnect];
+        return;
     }
 
     /* Check for new frame */
@@ -197,34 +305,13 @@ static void shm_reader_close(shm_reader_t *r)
 
     _reader->last_seq = seq;
 
-    /* Create CVPixelBuffer from shared memory data */
-    CVPixelBufferRef pixbuf = NULL;
-    CVReturn status = CVPixelBufferCreate(kCFAllocatorDefault,
-                                           _width, _height,
-                                           kCVPixelFormatType_32BGRA,
-                                           NULL, &pixbuf);
-    if (status != kCVReturnSuccess || !pixbuf)
+    /* v2: hand out the slot itself, else copy (v1, or all slots busy) */
+    CVPixelBufferRef pixbuf = [self wrapLatestSlot];
+    if (!pixbuf)
+        pixbuf = [self copyLatestFrame];
+    if (!pixbuf)
         return;
 
-    CVPixelBufferLockBaseAddress(pixbuf, 0);
-    void *dest = CVPixelBufferGetBaseAddress(pixbuf);
-    size_t destStride = CVPixelBufferGetBytesPerRow(pixbuf);
-    size_t srcStride = _width * 4;
-
-    const uint8_t *src = shm_frame_ptr_const(_reader->hdr);
-
-    if (destStride == srcStride) {
-        memcpy(dest, src, srcStride * _height);
-    } else {
-        for (uint32_t row = 0; row < _height; row++) {
-            memcpy((uint8_t *)dest + row * destStride,
-                   src + row * srcStride,
-                   srcStride);
-        }
-    }
-
-    CVPixelBufferUnlockBaseAddress(pixbuf, 0);
-
     /* Wrap in CMSampleBuffer and send */
     CMVideoFormatDescriptionRef fmtDesc = NULL;
     CMVideoFormatDescriptionCreateForImageBuffer(kCFAllocatorDefault,
@@ -252,6 +339,81 @@ static void shm_reader_close(shm_reader_t *r)
     CVPixelBufferRelease(pixbuf);
 }
 
+/* Zero-copy: a CVPixelBuffer pointing at the slot, held until released */
+- (CVPixelBufferRef)wrapLatestSlot
+{
+    if (!_reader->writable)
+        return NULL;
+
+    shm_header_t *hdr = _reader->hdr;
+    int slot = shm_hold_latest(hdr);
+    if (slot < 0)
+        return NULL;
+
+    const shm_slot_t *s = &hdr->slots[slot];
+    if (s->pixel_fmt != kCVPixelFormatType_32BGRA ||
+        s->width != (int32_t)_width || s->height != (int32_t)_height) {
+        shm_release_slot(hdr, slot);
+        return NULL;
+    }
+
+    shm_hold_t *hold = malloc(sizeof(*hold));
+    if (!hold) {
+        shm_release_slot(hdr, slot);
+        return NULL;
+    }
+    hold->reader = _reader;
+    hold->slot   = slot;
+    atomic_fetch_add(&_reader->refs, 1);
+
+    CVPixelBufferRef pixbuf = NULL;
+    CVReturn status = CVPixelBufferCreateWithBytes(kCFAllocatorDefault,
+                                                   _width, _height,
+                                                   kCVPixelFormatType_32BGRA,
+                                                   shm_slot_ptr(hdr, (uint32_t)slot),
+                                                   s->stride,
+                                                   shm_release_hold, hold,
+                                                   NULL, &pixbuf);
+    if (status != kCVReturnSuccess || !pixbuf) {
+        shm_release_hold(hold, NULL);
+        return NULL;
+    }
+    return pixbuf;
+}
+
+/* Copy into a new buffer; v2 copies retry until they are not torn */
+- (CVPixelBufferRef)copyLatestFrame
+{
+    CVPixelBufferRef pixbuf = NULL;
+    CVReturn status = CVPixelBufferCreate(kCFAllocatorDefault,
+                                           _width, _height,
+                                           kCVPixelFormatType_32BGRA,
+                                           NULL, &pixbuf);
+    if (status != kCVReturnSuccess || !pixbuf)
+        return NULL;
+
+    CVPixelBufferLockBaseAddress(pixbuf, 0);
+    uint8_t *dest = CVPixelBufferGetBaseAddress(pixbuf);
+    size_t destStride = CVPixelBufferGetBytesPerRow(pixbuf);
+    size_t rowBytes = (size_t)_width * 4;
+    int ok = 1;
+
+    if (_reader->version >= 2) {
+        ok = shm_copy_latest(_reader->hdr, dest, destStride, rowBytes) >= 0;
+    } else {
+        const uint8_t *src = (const uint8_t *)_reader->hdr + sizeof(shm_header_v1_t);
+        for (uint32_t row = 0; row < _height; row++)
+            memcpy(dest + row * destStride, src + row * rowBytes, rowBytes);
+    }
+
+    CVPixelBufferUnlockBaseAddress(pixbuf, 0);
+    if (!ok) {
+        CVPixelBufferRelease(pixbuf);
+        return NULL;
+    }
+    return pixbuf;
+}
+
 /* Required CMIOExtensionStreamSource methods */
 
 - (CMIOExtensionStreamProperties *)propertiesForProperties:(NSSet<CMIOExtensionProperty> *)properties
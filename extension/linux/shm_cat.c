@@ -0,0 +1,123 @@
+/*
+ * screen2cam-shm-cat: write the frames of --device shm:NAME to stdout
+ *
+ * A minimal shm_reader.h consumer, and a bridge to anything that reads
+ * raw video from a pipe:
+ *
+ *   ./screen2cam --device shm:desk &
+ *   ./screen2cam-shm-cat desk | ffplay -f rawvideo -pix_fmt yuv420p -video_size WxH -
+ *   ./screen2cam-shm-cat desk | gst-launch-1.0 fdsrc ! rawvideoparse ... ! autovideosink
+ *
+ * Every new frame goes out once, straight from the segment; the stream
+ * format is printed on stderr first.  Waits for the host to (re)start.
+ */
+
+#include "shm_reader.h"
+#include "../shm_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+static const char *fmt_name(uint32_t fourcc)
+{
+    switch (fourcc) {
+    case SHM_FMT_I420:  return "yuv420p";
+    case SHM_FMT_NV12:  return "nv12";
+    case SHM_FMT_YUYV:  return "yuyv422";
+    case SHM_FMT_BGRA:  return "bgra";
+    case SHM_FMT_RGB24: return "rgb24";
+    case SHM_FMT_RGBA:  return "rgba";
+    default:            return "unknown";
+    }
+}
+
+static int write_all(const uint8_t *data, size_t len)
+{
+    while (len) {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        data += n;
+        len  -= (size_t)n;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *name = argc > 1 ? argv[1] : NULL;
+    if (argc > 2 || (name && name[0] == '-')) {
+        fprintf(stderr, "Usage: %s [NAME]   (as in screen2cam --device shm:NAME)\n", argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    shm_reader_t *r = NULL;
+    uint8_t *copy = NULL;
+    size_t copy_size = 0;
+    int waiting = 0, described = 0;
+
+    for (;;) {
+        if (!r) {
+            r = shm_reader_open(name);
+            if (!r) {
+                if (!waiting++)
+                    fprintf(stderr, "shm-cat: waiting for screen2cam --device shm%s%s\n",
+                            name ? ":" : "", name ? name : "");
+                sleep(1);
+                continue;
+            }
+            waiting = 0;
+        }
+
+        int rc = shm_reader_wait(r, 1000);
+        if (rc < 0) {
+            fprintf(stderr, "shm-cat: host gone, reconnecting\n");
+            shm_reader_close(r);
+            r = NULL;
+            continue;
+        }
+        if (rc == 0)
+            continue;
+
+        shm_reader_frame_t f = { 0 };
+        const uint8_t *data;
+        int held = shm_reader_hold(r, &f) == 0;
+        if (held) {
+            data = f.data;
+        } else {
+            if (shm_reader_copy(r, copy, copy_size, &f) < 0) {
+                if (f.size <= copy_size)
+                    continue;   /* overwritten while copying: take the next */
+                free(copy);
+                copy = malloc(f.size);
+                copy_size = copy ? f.size : 0;
+                if (!copy || shm_reader_copy(r, copy, copy_size, &f) < 0)
+                    continue;
+            }
+            data = copy;
+        }
+
+        if (!described) {
+            fprintf(stderr, "shm-cat: %dx%d %s (-f rawvideo -pix_fmt %s -video_size %dx%d)\n",
+                    f.width, f.height, fmt_name(f.pixel_fmt), fmt_name(f.pixel_fmt),
+                    f.width, f.height);
+            described = 1;
+        }
+        int ok = write_all(data, f.size) == 0;
+        if (held)
+            shm_reader_release(r, &f);
+        if (!ok)
+            break;
+    }
+
+    shm_reader_close(r);
+    free(copy);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * screen2cam shared-memory reader (Linux), see shm_reader.h
+ */
+
+#include "shm_reader.h"
+#include "../shm_protocol.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+struct shm_reader {
+    int           fd;
+    shm_header_t *hdr;
+    size_t        size;
+    int           writable;            /* mapped read-write: may block on the futex */
+    int           held[SHM_MAX_HELD];  /* slots held (read locked), or -1 */
+    uint64_t      seen;                /* frame_seq last held or copied */
+};
+
+static void describe(const shm_reader_t *r, int slot, shm_reader_frame_t *f)
+{
+    const shm_slot_t *s = &r->hdr->slots[slot];
+    f->pixel_fmt    = s->pixel_fmt;
+    f->width        = s->width;
+    f->height       = s->height;
+    f->stride       = s->stride;
+    f->size         = shm_frame_bytes(s);
+    f->data         = NULL;
+    f->frame_seq    = s->frame_seq;
+    f->timestamp_ns = s->timestamp_ns;
+    f->slot         = slot;
+}
+
+shm_reader_t *shm_reader_open(const char *name)
+{
+    char path[64];
+    if (name && strncmp(name, "shm:", 4) == 0)
+        name += 4;
+    if (!name || !*name || strcmp(name, "shm") == 0)
+        snprintf(path, sizeof(path), "%s", SHM_NAME);
+    else
+        snprintf(path, sizeof(path), "%s.%s", SHM_NAME, name);
+
+    shm_reader_t *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+    for (int i = 0; i < SHM_MAX_HELD; i++)
+        r->held[i] = -1;
+
+    /* Waiting on the futex counts this reader in the header; without write
+     * access it polls instead */
+    r->writable = 1;
+    r->fd = shm_open(path, O_RDWR, 0);
+    if (r->fd < 0) {
+        r->writable = 0;
+        r->fd = shm_open(path, O_RDONLY, 0);
+    }
+    struct stat st;
+    if (r->fd < 0 || fstat(r->fd, &st) < 0 || (size_t)st.st_size < sizeof(shm_header_t))
+        goto fail;
+
+    r->size = (size_t)st.st_size;
+    r->hdr  = mmap(NULL, r->size, r->writable ? PROT_READ | PROT_WRITE : PROT_READ,
+                   MAP_SHARED, r->fd, 0);
+    if (r->hdr == MAP_FAILED) {
+        r->hdr = NULL;
+        goto fail;
+    }
+    atomic_thread_fence(memory_order_acquire);
+    if (r->hdr->magic != SHM_MAGIC || r->hdr->version != SHM_VERSION ||
+        r->hdr->slot_count != SHM_SLOTS || r->hdr->total_size > r->size)
+        goto fail;
+    return r;
+
+fail:
+    shm_reader_close(r);
+    return NULL;
+}
+
+int shm_reader_wait(shm_reader_t *r, int timeout_ms)
+{
+    shm_header_t *hdr = r->hdr;
+    if (r->writable) {
+        if (atomic_load(&hdr->frame_seq) == r->seen && hdr->version == SHM_VERSION)
+            shm_wait_frame(hdr, r->seen, timeout_ms);
+    } else {
+        /* Read-only: look every 2 ms, as the Windows media source does */
+        struct timespec tick = { 0, 2000000 };
+        for (int t = 0; t < timeout_ms && atomic_load(&hdr->frame_seq) == r->seen &&
+                        hdr->version == SHM_VERSION; t += 2)
+            nanosleep(&tick, NULL);
+    }
+
+    if (hdr->version != SHM_VERSION)
+        return -1;
+    if (atomic_load(&hdr->frame_seq) != r->seen)
+        return 1;
+
+    /* A crashed host leaves the segment to its successor, which unlinks it */
+    struct stat st;
+    if (fstat(r->fd, &st) < 0 || st.st_nlink == 0)
+        return -1;
+    return 0;
+}
+
+int shm_reader_hold(shm_reader_t *r, shm_reader_frame_t *frame)
+{
+    int free_index = -1;
+    for (int i = 0; i < SHM_MAX_HELD; i++) {
+        if (r->held[i] < 0)
+            free_index = i;
+    }
+    if (free_index < 0 || atomic_load(&r->hdr->frame_seq) == 0)
+        return -1;
+
+    int slot = shm_lock_latest(r->hdr, r->fd);
+    if (slot < 0)
+        return -1;
+    r->held[free_index] = slot;
+    describe(r, slot, frame);
+    frame->data = shm_slot_ptr_const(r->hdr, (uint32_t)slot);
+    r->seen = frame->frame_seq;
+    return 0;
+}
+
+void shm_reader_release(shm_reader_t *r, shm_reader_frame_t *frame)
+{
+    /* One lock per slot: keep it while the slot is held twice */
+    int holds = 0, index = -1;
+    for (int i = 0; i < SHM_MAX_HELD; i++) {
+        if (r->held[i] == frame->slot) {
+            holds++;
+            index = i;
+        }
+    }
+    if (index >= 0) {
+        r->held[index] = -1;
+        if (holds == 1)
+            shm_unlock_slot(r->fd, frame->slot);
+    }
+    frame->data = NULL;
+}
+
+int shm_reader_copy(shm_reader_t *r, uint8_t *dst, size_t size, shm_reader_frame_t *frame)
+{
+    const shm_header_t *hdr = r->hdr;
+    if (atomic_load((_Atomic uint64_t *)&hdr->frame_seq) == 0)
+        return -1;
+
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t slot = atomic_load((_Atomic uint32_t *)&hdr->latest);
+        const shm_slot_t *s = &hdr->slots[slot];
+
+        uint32_t seq = atomic_load_explicit((_Atomic uint32_t *)&s->seq,
+                                            memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        describe(r, (int)slot, frame);
+        if (frame->size > size)
+            return -1;
+        memcpy(dst, shm_slot_ptr_const(hdr, slot), frame->size);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit((_Atomic uint32_t *)&s->seq,
+                                 memory_order_relaxed) == seq) {
+            r->seen = frame->frame_seq;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void shm_reader_close(shm_reader_t *r)
+{
+    if (!r)
+        return;
+    if (r->hdr)
+        munmap(r->hdr, r->size);
+    if (r->fd >= 0)
+        close(r->fd);   /* drops the slot locks */
+    free(r);
+}
@@ -0,0 +1,82 @@
+/*
+ * screen2cam shared-memory reader (Linux)
+ *
+ * Reads the frames `screen2cam --device shm:NAME` publishes, from any
+ * number of processes at once.  Build it into a consumer (a GStreamer
+ * or OBS source, a recorder) directly or link libscreen2cam_shm.so
+ * (make shm-reader).  One reader per thread; the rest is the protocol
+ * in ../shm_protocol.h.
+ *
+ *   shm_reader_t *r = shm_reader_open("NAME");
+ *   for (;;) {
+ *       if (shm_reader_wait(r, 1000) < 0) {      // host gone: reopen
+ *           shm_reader_close(r);
+ *           while (!(r = shm_reader_open("NAME")))
+ *               sleep(1);
+ *           continue;
+ *       }
+ *       shm_reader_frame_t f;
+ *       if (shm_reader_hold(r, &f) == 0) {       // zero-copy
+ *           use(f.data, f.size);
+ *           shm_reader_release(r, &f);
+ *       }
+ *   }
+ *
+ * A held frame stays untouched until released, however long that takes;
+ * keep holds short all the same: while readers hold every slot, the
+ * host drops frames.  Holds are file locks, so a reader that crashes or
+ * is killed while holding releases them with its descriptors.  Without
+ * write access to the segment, shm_reader_wait() polls instead of
+ * blocking on the futex.
+ */
+
+#ifndef SHM_READER_H
+#define SHM_READER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct shm_reader shm_reader_t;
+
+typedef struct {
+    uint32_t       pixel_fmt;     /* SHM_FMT_* FourCC */
+    int            width;
+    int            height;
+    uint32_t       stride;        /* bytes per row of the first plane */
+    size_t         size;          /* bytes of all planes, back to back */
+    const uint8_t *data;          /* hold: in the segment; copy: NULL */
+    uint64_t       frame_seq;     /* 1, 2, ... per frame published */
+    uint64_t       timestamp_ns;  /* capture time, CLOCK_MONOTONIC */
+    int            slot;
+} shm_reader_frame_t;
+
+/*
+ * Map the segment of --device shm:NAME ("NAME" or "shm:NAME"; NULL or
+ * "shm" for plain --device shm).  Returns NULL if no host has it open.
+ */
+shm_reader_t *shm_reader_open(const char *name);
+
+/*
+ * Wait up to timeout_ms for a frame newer than the last one held or
+ * copied.  Returns 1 when there is one, 0 on timeout, -1 once the host
+ * has gone (exited or replaced the segment): close and open again.
+ */
+int shm_reader_wait(shm_reader_t *r, int timeout_ms);
+
+/*
+ * Take the newest frame in place, at most two at a time.  Returns 0,
+ * or -1 with nothing published yet or two held.
+ */
+int  shm_reader_hold(shm_reader_t *r, shm_reader_frame_t *frame);
+void shm_reader_release(shm_reader_t *r, shm_reader_frame_t *frame);
+
+/*
+ * Copy the newest frame into dst (size bytes; frame->size is the need).
+ * Returns 0, or -1 with nothing published yet, dst too small (frame->size
+ * set) or the frame overwritten throughout.
+ */
+int shm_reader_copy(shm_reader_t *r, uint8_t *dst, size_t size, shm_reader_frame_t *frame);
+
+void shm_reader_close(shm_reader_t *r);
+
+#endif /* SHM_READER_H */
@@ -2,55 +2,408 @@
  * screen2cam Shared Memory Protocol
  *
  * IPC between the host process (screen2cam) and the Camera Extension.
- * Host writes BGRA frames; extension reads and serves them to apps.
+ * Host writes frames; extension reads and serves them to apps.
  *
- * Layout:
- *   [shm_header_t][frame data (width * height * 4 bytes)]
+ * Version 2 layout:
+ *   [shm_header_t, padded to SHM_ALIGN][slot 0][slot 1]...[slot N-1]
  *
- * Synchronization: atomic frame_seq counter. Extension polls and
- * compares against its last-seen sequence number.
+ * Each slot is a complete frame with its own format, size and stride, so
+ * the host never overwrites the frame the extension is reading:
+ *
+ *   - `latest` is the index of the newest complete slot.
+ *   - The reader sets its bit in `reader_held` for every slot it still
+ *     uses (e.g. wrapped in a CVPixelBuffer without copying); the writer
+ *     only fills slots that are neither latest nor held.
+ *   - Every slot also carries a seqlock (odd while being written), so a
+ *     reader that copies instead of holding can detect a torn frame.
+ *
+ * Each publish also posts the named semaphore SHM_NOTIFY_NAME, so the
+ * reader can block until a frame arrives instead of polling frame_seq.
+ * Posts are hints: the reader drains the count and then looks at
+ * frame_seq.  On exit the host sets version to 0 and posts once more, so
+ * a waiting reader notices and reconnects.
+ *
+ * On Windows (extension/windows/) the segment is a temporary file,
+ * SHM_WIN_FILE under %ProgramData%, mapped by both sides: the media
+ * source runs inside the Frame Server service, in another session, where
+ * the host's named objects are out of reach.  There is no semaphore; the
+ * source polls frame_seq.  Slots hold NV12 (SHM_FMT_NV12), the chroma
+ * plane right after `height` rows of luma with the same stride.
+ *
+ * On Linux (--device shm:NAME, src/vcam_shm.c) the segment is the POSIX
+ * shared memory object "/screen2cam.NAME" and any number of local readers
+ * map it at once (extension/linux/shm_reader.h).  One bitmask cannot
+ * tell whose hold a bit is, so those readers hold a slot with an open
+ * file description (OFD) read lock on its entry in the slot table
+ * instead of using `reader_held`, and the host probes for such locks.
+ * The kernel drops them when the reader closes the segment or dies, so
+ * a crashed reader holds nothing.  Slots may all be held: the host drops
+ * frames until one is let go, rather than waiting for a reader.
+ * Wakeups are a futex on `wake`, bumped per published frame and woken
+ * for every reader counted in `waiters`, instead of the semaphore, which
+ * wakes only one.
+ * Slots hold any output format (the FourCCs below, planes back to back
+ * with proportional strides), and fps is 0: frames come as produced.
+ *
+ * Version 1 (single frame after a header without the slot table) is
+ * recognised through `version`; magic, version, width, height, fps and
+ * frame_seq sit at the same offsets in both.
  */
 
 #ifndef SHM_PROTOCOL_H
 #define SHM_PROTOCOL_H
 
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 #include <stdatomic.h>
 
 #define SHM_NAME         "/screen2cam"
+#define SHM_NOTIFY_NAME  "/screen2cam.frame"   /* named POSIX semaphore */
+#define SHM_WIN_DIR      L"screen2cam"                /* under %ProgramData% */
+#define SHM_WIN_FILE     L"screen2cam\\frames.shm"
+#define SHM_WIN_CLSID    L"{94F47435-176A-4433-A673-BA0376E9F597}"  /* media source */
 #define SHM_MAX_WIDTH    7680   /* 8K */
 #define SHM_MAX_HEIGHT   4320
 
+#define SHM_MAGIC        0x5332434D   /* 'S2CM' */
+#define SHM_VERSION      2
+#define SHM_SLOTS        4            /* latest + 2 held + 1 being written */
+#define SHM_MAX_HELD     (SHM_SLOTS - 2)
+#define SHM_ALIGN        16384        /* arm64 page size */
+
+/* CoreVideo FourCCs, spelled out so compilers without 'ABCD' constants agree */
+#define SHM_FOURCC(a, b, c, d) \
+    ((uint32_t)(a) << 24 | (uint32_t)(b) << 16 | (uint32_t)(c) << 8 | (uint32_t)(d))
+#define SHM_FMT_BGRA     SHM_FOURCC('B', 'G', 'R', 'A')
+#define SHM_FMT_NV12     SHM_FOURCC('4', '2', '0', 'v')   /* 420YpCbCr8BiPlanarVideoRange */
+#define SHM_FMT_I420     SHM_FOURCC('y', '4', '2', '0')   /* 420YpCbCr8Planar */
+#define SHM_FMT_YUYV     SHM_FOURCC('y', 'u', 'v', 's')   /* 422YpCbCr8_yuvs */
+#define SHM_FMT_RGB24    0x00000018u                      /* 24RGB */
+#define SHM_FMT_RGBA     SHM_FOURCC('R', 'G', 'B', 'A')
+
 typedef struct {
-    uint32_t             magic;       /* 'S2CM' = 0x5332434D */
-    uint32_t             version;     /* protocol version (1) */
+    _Atomic uint32_t     seq;         /* seqlock: odd while being written */
+    uint32_t             pixel_fmt;   /* CoreVideo FourCC: SHM_FMT_BGRA or SHM_FMT_NV12 */
     int32_t              width;
     int32_t              height;
+    uint32_t             stride;      /* bytes per row */
+    uint32_t             _pad;
+    uint64_t             offset;      /* of the pixels from the segment start */
+    uint64_t             frame_seq;   /* header frame_seq when published */
+    uint64_t             timestamp_ns;
+} shm_slot_t;
+
+typedef struct {
+    uint32_t             magic;       /* SHM_MAGIC */
+    uint32_t             version;     /* SHM_VERSION */
+    int32_t              width;       /* stream size */
+    int32_t              height;
     int32_t              fps;
-    uint32_t             stride;      /* bytes per row (width * 4 for BGRA) */
-    _Atomic uint64_t     frame_seq;   /* incremented each frame write */
-    uint32_t             pixel_fmt;   /* kCVPixelFormatType_32BGRA = 'BGRA' */
-    uint32_t             _reserved[5];
+    uint32_t             slot_count;
+    _Atomic uint64_t     frame_seq;   /* incremented each frame published */
+    _Atomic uint32_t     latest;      /* newest complete slot */
+    _Atomic uint32_t     reader_held; /* bitmask of slots the reader uses */
+    uint64_t             total_size;  /* bytes in the whole segment */
+    _Atomic uint32_t     wake;        /* Linux: futex, bumped per frame */
+    _Atomic uint32_t     waiters;     /* Linux: readers blocked on wake */
+    uint32_t             _reserved[6];
+    shm_slot_t           slots[SHM_SLOTS];
 } shm_header_t;
 
-#define SHM_MAGIC   0x5332434D
-#define SHM_VERSION 1
+/* Version 1 header, followed by one width * height * 4 BGRA frame. */
+typedef struct {
+    uint32_t             magic;
+    uint32_t             version;     /* 1 */
+    int32_t              width;
+    int32_t              height;
+    int32_t              fps;
+    uint32_t             stride;
+    _Atomic uint64_t     frame_seq;
+    uint32_t             pixel_fmt;
+    uint32_t             _reserved[5];
+} shm_header_v1_t;
+
+static inline size_t shm_align(size_t n)
+{
+    return (n + SHM_ALIGN - 1) / SHM_ALIGN * SHM_ALIGN;
+}
+
+/* Bytes reserved per slot: a BGRA frame, the largest format we publish */
+static inline size_t shm_slot_size(int width, int height)
+{
+    return shm_align((size_t)width * height * 4);
+}
 
 /* Total shared memory size for given dimensions */
 static inline size_t shm_total_size(int width, int height)
 {
-    return sizeof(shm_header_t) + (size_t)width * height * 4;
+    return shm_align(sizeof(shm_header_t)) + SHM_SLOTS * shm_slot_size(width, height);
+}
+
+/* Bytes of the frame in a slot, from its format, height and stride */
+static inline size_t shm_frame_bytes(const shm_slot_t *s)
+{
+    size_t luma   = (size_t)s->stride * s->height;
+    size_t chroma = (size_t)((s->stride + 1) / 2) * ((s->height + 1) / 2);
+
+    switch (s->pixel_fmt) {
+    case SHM_FMT_I420:
+    case SHM_FMT_NV12: return luma + 2 * chroma;
+    default:           return luma;
+    }
+}
+
+static inline uint8_t *shm_slot_ptr(shm_header_t *hdr, uint32_t slot)
+{
+    return (uint8_t *)hdr + hdr->slots[slot].offset;
 }
 
-/* Pointer to frame data region */
-static inline uint8_t *shm_frame_ptr(shm_header_t *hdr)
+static inline const uint8_t *shm_slot_ptr_const(const shm_header_t *hdr, uint32_t slot)
 {
-    return (uint8_t *)hdr + sizeof(shm_header_t);
+    return (const uint8_t *)hdr + hdr->slots[slot].offset;
 }
 
-static inline const uint8_t *shm_frame_ptr_const(const shm_header_t *hdr)
+/* ── Host side ─────────────────────────────────────────────── */
+
+/* Lay out the slot table of a freshly created segment. */
+static inline void shm_init_slots(shm_header_t *hdr, int width, int height)
+{
+    size_t base = shm_align(sizeof(shm_header_t));
+    size_t size = shm_slot_size(width, height);
+
+    hdr->slot_count = SHM_SLOTS;
+    hdr->total_size = shm_total_size(width, height);
+    for (uint32_t i = 0; i < SHM_SLOTS; i++) {
+        atomic_store_explicit(&hdr->slots[i].seq, 0, memory_order_relaxed);
+        hdr->slots[i].offset = base + i * size;
+    }
+    atomic_store(&hdr->latest, 0);
+    atomic_store(&hdr->reader_held, 0);
+    atomic_store(&hdr->frame_seq, 0);
+    atomic_store(&hdr->wake, 0);
+    atomic_store(&hdr->waiters, 0);
+}
+
+/*
+ * A slot that is neither the latest nor held by the reader, oldest first,
+ * or -1 if every one is held.
+ */
+static inline int shm_free_slot(shm_header_t *hdr)
+{
+    uint32_t latest = atomic_load(&hdr->latest);
+    uint32_t held   = atomic_load(&hdr->reader_held);
+
+    for (uint32_t i = 1; i < SHM_SLOTS; i++) {
+        uint32_t s = (latest + i) % SHM_SLOTS;
+        if (!(held & (1u << s)))
+            return (int)s;
+    }
+    return -1;
+}
+
+/* Mark slot as being written (seqlock odd). */
+static inline void shm_begin_slot(shm_header_t *hdr, uint32_t slot)
+{
+    uint32_t seq = atomic_load_explicit(&hdr->slots[slot].seq, memory_order_relaxed);
+    atomic_store_explicit(&hdr->slots[slot].seq, seq | 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/*
+ * Pick a slot that is neither the latest nor held by the reader and mark
+ * it as being written.  The reader re-checks `latest` after setting its
+ * held bit, so with sequentially consistent accesses on both sides one of
+ * them always sees the other.  A single reader holds at most
+ * SHM_MAX_HELD slots, so a free slot always exists; with several, use
+ * shm_free_slot() and shm_begin_slot() instead.
+ */
+static inline uint32_t shm_begin_write(shm_header_t *hdr)
+{
+    int free_slot = shm_free_slot(hdr);
+    uint32_t slot = free_slot >= 0 ? (uint32_t)free_slot
+                                   : (atomic_load(&hdr->latest) + 1) % SHM_SLOTS;
+    shm_begin_slot(hdr, slot);
+    return slot;
+}
+
+/* Finish writing slot.  publish = 0 leaves latest/frame_seq untouched. */
+static inline void shm_end_write(shm_header_t *hdr, uint32_t slot, int publish,
+                                 uint64_t timestamp_ns)
+{
+    shm_slot_t *s = &hdr->slots[slot];
+
+    if (publish) {
+        s->frame_seq    = atomic_load_explicit(&hdr->frame_seq, memory_order_relaxed) + 1;
+        s->timestamp_ns = timestamp_ns;
+    }
+    uint32_t seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_release);
+
+    if (publish) {
+        atomic_store(&hdr->latest, slot);
+        atomic_fetch_add_explicit(&hdr->frame_seq, 1, memory_order_release);
+    }
+}
+
+/* ── Reader side ───────────────────────────────────────────── */
+
+/*
+ * Take the latest slot for zero-copy use.  Returns its index, or -1 if
+ * the reader already holds SHM_MAX_HELD slots or that very slot (copy
+ * with shm_copy_latest() instead).  Pair with shm_release_slot().
+ */
+static inline int shm_hold_latest(shm_header_t *hdr)
+{
+    for (;;) {
+        uint32_t held = atomic_load(&hdr->reader_held);
+        if (__builtin_popcount(held) >= SHM_MAX_HELD)
+            return -1;
+
+        uint32_t slot = atomic_load(&hdr->latest);
+        if (held & (1u << slot))
+            return -1;          /* still in use from before: copy it */
+
+        atomic_fetch_or(&hdr->reader_held, 1u << slot);
+        if (atomic_load(&hdr->latest) == slot)
+            return (int)slot;
+
+        /* A newer frame was published meanwhile: let go and retry */
+        atomic_fetch_and(&hdr->reader_held, ~(1u << slot));
+    }
+}
+
+static inline void shm_release_slot(shm_header_t *hdr, int slot)
+{
+    atomic_fetch_and(&hdr->reader_held, ~(1u << slot));
+}
+
+/*
+ * Copy the latest slot (rows of `row_bytes`) into dst with the given
+ * stride.  Returns the slot index, or -1 if the frame kept being
+ * overwritten while copying.
+ */
+static inline int shm_copy_latest(const shm_header_t *hdr, uint8_t *dst,
+                                  size_t dst_stride, size_t row_bytes)
+{
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t slot = atomic_load((_Atomic uint32_t *)&hdr->latest);
+        const shm_slot_t *s = &hdr->slots[slot];
+
+        uint32_t seq = atomic_load_explicit((_Atomic uint32_t *)&s->seq,
+                                            memory_order_acquire);
+        if (seq & 1)
+            continue;
+
+        const uint8_t *src = shm_slot_ptr_const(hdr, slot);
+        for (int32_t row = 0; row < s->height; row++)
+            memcpy(dst + row * dst_stride, src + row * (size_t)s->stride, row_bytes);
+
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit((_Atomic uint32_t *)&s->seq,
+                                 memory_order_relaxed) == seq)
+            return (int)slot;
+    }
+    return -1;
+}
+
+/* ── Linux wakeups ─────────────────────────────────────────── */
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#ifndef F_OFD_GETLK             /* glibc only defines them with _GNU_SOURCE */
+#define F_OFD_GETLK  36
+#define F_OFD_SETLK  37
+#endif
+
+/* Lock (F_RDLCK), unlock (F_UNLCK) or probe the slot's table entry. */
+static inline int shm_slot_lock(int fd, uint32_t slot, int cmd, short type)
+{
+    struct flock fl = {
+        .l_type   = type,
+        .l_whence = SEEK_SET,
+        .l_start  = (off_t)(offsetof(shm_header_t, slots) + slot * sizeof(shm_slot_t)),
+        .l_len    = (off_t)sizeof(shm_slot_t),
+    };
+    if (fcntl(fd, cmd, &fl) < 0)
+        return -1;
+    return cmd == F_OFD_GETLK ? fl.l_type != F_UNLCK : 0;
+}
+
+/* Host: non-zero if some reader holds slot (an error counts as held). */
+static inline int shm_slot_locked(int fd, uint32_t slot)
+{
+    return shm_slot_lock(fd, slot, F_OFD_GETLK, F_WRLCK) != 0;
+}
+
+/* Host: shm_free_slot(), also skipping slots readers hold locked. */
+static inline int shm_free_unlocked_slot(shm_header_t *hdr, int fd)
+{
+    uint32_t latest = atomic_load(&hdr->latest);
+
+    for (uint32_t i = 1; i < SHM_SLOTS; i++) {
+        uint32_t s = (latest + i) % SHM_SLOTS;
+        if (!shm_slot_locked(fd, s))
+            return (int)s;
+    }
+    return -1;
+}
+
+/*
+ * Reader with its own open of the segment: hold the latest slot with a
+ * read lock, which the kernel drops if the reader dies.  Re-checks
+ * `latest` after locking, as shm_hold_latest() does after setting its
+ * bit.  Returns the slot, or -1 if locking fails.  Release with
+ * shm_unlock_slot() (one lock per slot and open file description).
+ */
+static inline int shm_lock_latest(shm_header_t *hdr, int fd)
+{
+    for (;;) {
+        uint32_t slot = atomic_load(&hdr->latest);
+        if (shm_slot_lock(fd, slot, F_OFD_SETLK, F_RDLCK) < 0)
+            return -1;
+        if (atomic_load(&hdr->latest) == slot)
+            return (int)slot;
+        shm_slot_lock(fd, slot, F_OFD_SETLK, F_UNLCK);
+    }
+}
+
+static inline void shm_unlock_slot(int fd, int slot)
+{
+    shm_slot_lock(fd, (uint32_t)slot, F_OFD_SETLK, F_UNLCK);
+}
+
+/* Host, after shm_end_write(): wake every reader waiting for a frame. */
+static inline void shm_wake_readers(shm_header_t *hdr)
+{
+    atomic_fetch_add(&hdr->wake, 1);
+    /* Pairs with the fence in shm_wait_frame(): the reader sees frame_seq or we see it */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&hdr->waiters))
+        syscall(SYS_futex, &hdr->wake, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+/*
+ * Reader: block until frame_seq moves past seen, the host wakes readers
+ * otherwise (on exit) or timeout_ms passes.  Returns at once if it has.
+ */
+static inline void shm_wait_frame(shm_header_t *hdr, uint64_t seen, int timeout_ms)
 {
-    return (const uint8_t *)hdr + sizeof(shm_header_t);
+    uint32_t wake = atomic_load(&hdr->wake);
+    atomic_fetch_add(&hdr->waiters, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&hdr->frame_seq) == seen && hdr->version == SHM_VERSION) {
+        struct timespec ts = { timeout_ms / 1000, (long)(timeout_ms % 1000) * 1000000 };
+        syscall(SYS_futex, &hdr->wake, FUTEX_WAIT, wake, &ts, NULL, 0);
+    }
+    atomic_fetch_sub(&hdr->waiters, 1);
 }
+#endif
 
 #endif /* SHM_PROTOCOL_H */
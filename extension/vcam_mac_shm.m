@@ -10,7 +10,11 @@
  *
  *   2. Extension mode ("shm"): Writes BGRA frames to POSIX shared memory
  *      for the screen2cam Camera Extension (CMIOExtension) to read.
- *      This eliminates the need for OBS and bridge.py.
+ *      This eliminates the need for OBS and bridge.py.  The backend asks
+ *      for BGRA (vcam_format) and lends out the shm frame slots themselves
+ *      (protocol v2, see shm_protocol.h), so the pipeline copies only the
+ *      changed tiles of each captured frame into a slot the extension is
+ *      not reading — no color conversion and no tearing.
  *
  * Usage:
  *   ./screen2cam --device -   --fps 15 | python3 bridge.py W H 15   # pipe mode (existing)
@@ -31,6 +35,8 @@
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <stdatomic.h>
+#include <semaphore.h>
+#include <time.h>
 
 #include "../extension/shm_protocol.h"
 
@@ -44,16 +50,21 @@ struct vcam_ctx {
     int         width;
     int         height;
     int         fd;
+    pix_fmt_t   format;       /* of the frames passed to vcam_write() */
     size_t      frame_size;
+    uint8_t    *scratch;      /* pipe: packed copy of frames with padded rows */
 
     /* Shared memory (extension mode only) */
     shm_header_t *shm_hdr;
     size_t        shm_size;
+    int           shm_slot;   /* slot from vcam_acquire(), or -1 */
+    frame_t       shm_frame;  /* describes that slot */
+    sem_t        *notify;     /* posted per frame, or NULL (reader polls) */
 };
 
 /* ── Pipe mode (unchanged from original) ──────────────────── */
 
-static vcam_ctx_t *pipe_open(const char *device, int width, int height)
+static vcam_ctx_t *pipe_open(const char *device, int width, int height, pix_fmt_t format)
 {
     vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx) return NULL;
@@ -61,7 +72,8 @@ static vcam_ctx_t *pipe_open(const char *device, int width, int height)
     ctx->mode       = VCAM_MODE_PIPE;
     ctx->width      = width;
     ctx->height     = height;
-    ctx->frame_size = (size_t)width * height * 3 / 2;
+    ctx->format     = format == PIX_FMT_AUTO ? PIX_FMT_YUV420P : format;
+    ctx->frame_size = pix_fmt_frame_size(ctx->format, width, height);
 
     if (strcmp(device, "-") == 0 || strcmp(device, "/dev/stdout") == 0) {
         ctx->fd = STDOUT_FILENO;
@@ -75,18 +87,32 @@ static vcam_ctx_t *pipe_open(const char *device, int width, int height)
     }
 
     signal(SIGPIPE, SIG_IGN);
-    fprintf(stderr, "vcam: output %dx%d yuv420p -> %s\n", width, height, device);
+    fprintf(stderr, "vcam: output %dx%d %s -> %s\n",
+            width, height, pix_fmt_name(ctx->format), device);
     return ctx;
 }
 
-static int pipe_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+static int pipe_write(vcam_ctx_t *ctx, const frame_t *frame)
 {
-    if (len < ctx->frame_size)
-        return -1;
+    /* The pipe carries packed frames; repack padded rows first */
+    const uint8_t *data = frame->planes[0];
+    if (!frame_is_packed(frame)) {
+        if (!ctx->scratch) {
+            ctx->scratch = malloc(ctx->frame_size);
+            if (!ctx->scratch) {
+                perror("vcam: malloc");
+                return -1;
+            }
+        }
+        frame_t dst;
+        frame_init(&dst, ctx->format, ctx->width, ctx->height, ctx->scratch);
+        frame_copy(&dst, frame);
+        data = ctx->scratch;
+    }
 
     size_t written = 0;
     while (written < ctx->frame_size) {
-        ssize_t n = write(ctx->fd, yuv420p + written, ctx->frame_size - written);
+        ssize_t n = write(ctx->fd, data + written, ctx->frame_size - written);
         if (n < 0) {
             if (errno == EINTR) continue;
             if (errno == EPIPE) return -1;
@@ -102,6 +128,7 @@ static void pipe_close(vcam_ctx_t *ctx)
 {
     if (ctx->fd >= 0 && ctx->fd != STDOUT_FILENO)
         close(ctx->fd);
+    free(ctx->scratch);
 }
 
 /* ── Shared memory mode (Camera Extension) ────────────────── */
@@ -130,17 +157,34 @@ static vcam_ctx_t *shm_open_ctx(int width, int height, int fps)
         return NULL;
     }
 
-    hdr->magic     = SHM_MAGIC;
-    hdr->version   = SHM_VERSION;
-    hdr->width     = width;
-    hdr->height    = height;
-    hdr->fps       = fps;
-    hdr->stride    = width * 4;
-    hdr->pixel_fmt = 'BGRA';
-    atomic_store_explicit(&hdr->frame_seq, 0, memory_order_release);
+    hdr->version = 0;
+    hdr->magic   = SHM_MAGIC;
+    hdr->width   = width;
+    hdr->height  = height;
+    hdr->fps     = fps;
+    shm_init_slots(hdr, width, height);
+    for (uint32_t i = 0; i < SHM_SLOTS; i++) {
+        hdr->slots[i].pixel_fmt = 'BGRA';
+        hdr->slots[i].width     = width;
+        hdr->slots[i].height    = height;
+        hdr->slots[i].stride    = width * 4;
+    }
+    /* A fresh semaphore: a stale count would only cause spurious wakeups */
+    sem_unlink(SHM_NOTIFY_NAME);
+    sem_t *notify = sem_open(SHM_NOTIFY_NAME, O_CREAT, 0644, 0);
+    if (notify == SEM_FAILED) {
+        fprintf(stderr, "vcam: sem_open(%s): %s, extension will poll\n",
+                SHM_NOTIFY_NAME, strerror(errno));
+        notify = NULL;
+    }
+
+    /* Version last: readers ignore the segment until it is complete */
+    atomic_thread_fence(memory_order_release);
+    hdr->version = SHM_VERSION;
 
     vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx) {
+        if (notify) sem_close(notify);
         munmap(hdr, total);
         close(fd);
         return NULL;
@@ -150,72 +194,63 @@ static vcam_ctx_t *shm_open_ctx(int width, int height, int fps)
     ctx->width      = width;
     ctx->height     = height;
     ctx->fd         = fd;
+    ctx->format     = PIX_FMT_BGRA;   /* captured pixels, unconverted */
     ctx->frame_size = (size_t)width * height * 4;
     ctx->shm_hdr    = hdr;
     ctx->shm_size   = total;
+    ctx->shm_slot   = -1;
+    ctx->notify     = notify;
 
-    fprintf(stderr, "vcam: output %dx%d bgra -> shared memory (%s)\n",
-            width, height, SHM_NAME);
+    fprintf(stderr, "vcam: output %dx%d bgra -> shared memory (%s, %d slots)\n",
+            width, height, SHM_NAME, SHM_SLOTS);
     fprintf(stderr, "vcam: Camera Extension can now read frames\n");
     return ctx;
 }
 
-/*
- * YUV420P → BGRA (BT.601 inverse) — reverse of convert.c
- *
- * TODO: Eliminate double conversion by passing BGRA directly from
- * capture when in extension mode. Requires a vcam_write_bgra() path
- * or a flag in main.c to skip bgra_to_yuv420p().
- */
-static void yuv420p_to_bgra(const uint8_t *yuv, uint8_t *bgra, int w, int h)
-{
-    const uint8_t *y_plane = yuv;
-    const uint8_t *u_plane = yuv + w * h;
-    const uint8_t *v_plane = u_plane + (w / 2) * (h / 2);
-
-    for (int j = 0; j < h; j++) {
-        for (int i = 0; i < w; i++) {
-            int y = y_plane[j * w + i];
-            int u = u_plane[(j / 2) * (w / 2) + (i / 2)];
-            int v = v_plane[(j / 2) * (w / 2) + (i / 2)];
-
-            int c = y - 16;
-            int d = u - 128;
-            int e = v - 128;
-
-            int r = (298 * c + 409 * e + 128) >> 8;
-            int g = (298 * c - 100 * d - 208 * e + 128) >> 8;
-            int b = (298 * c + 516 * d + 128) >> 8;
-
-            if (r < 0) r = 0; if (r > 255) r = 255;
-            if (g < 0) g = 0; if (g > 255) g = 255;
-            if (b < 0) b = 0; if (b > 255) b = 255;
-
-            uint8_t *px = bgra + (j * w + i) * 4;
-            px[0] = (uint8_t)b;
-            px[1] = (uint8_t)g;
-            px[2] = (uint8_t)r;
-            px[3] = 255;
-        }
-    }
+static frame_t *shm_acquire(vcam_ctx_t *ctx, int *index)
+{
+    ctx->shm_slot = (int)shm_begin_write(ctx->shm_hdr);
+    *index = ctx->shm_slot;
+    frame_init(&ctx->shm_frame, PIX_FMT_BGRA, ctx->width, ctx->height,
+               shm_slot_ptr(ctx->shm_hdr, (uint32_t)ctx->shm_slot));
+    return &ctx->shm_frame;
 }
 
-static int shm_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+static int shm_submit(vcam_ctx_t *ctx, int repeat)
 {
-    size_t yuv_size = (size_t)ctx->width * ctx->height * 3 / 2;
-    if (len < yuv_size)
+    if (ctx->shm_slot < 0)
         return -1;
 
-    uint8_t *frame = shm_frame_ptr(ctx->shm_hdr);
-    yuv420p_to_bgra(yuv420p, frame, ctx->width, ctx->height);
+    /* A repeat completes the slot but announces nothing new */
+    shm_end_write(ctx->shm_hdr, (uint32_t)ctx->shm_slot, !repeat,
+                  clock_gettime_nsec_np(CLOCK_UPTIME_RAW));
+    ctx->shm_slot = -1;
 
-    atomic_fetch_add_explicit(&ctx->shm_hdr->frame_seq, 1,
-                               memory_order_release);
+    /* Wake the extension; EOVERFLOW just means nobody is draining yet */
+    if (!repeat && ctx->notify)
+        sem_post(ctx->notify);
     return 0;
 }
 
+static int shm_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    int index;
+    frame_copy(shm_acquire(ctx, &index), frame);
+    return shm_submit(ctx, 0);
+}
+
 static void shm_close(vcam_ctx_t *ctx)
 {
+    /* Tell a waiting extension the segment is gone so it reconnects */
+    if (ctx->shm_hdr) {
+        atomic_thread_fence(memory_order_release);
+        ctx->shm_hdr->version = 0;
+    }
+    if (ctx->notify) {
+        sem_post(ctx->notify);
+        sem_close(ctx->notify);
+        sem_unlink(SHM_NOTIFY_NAME);
+    }
     if (ctx->shm_hdr)
         munmap(ctx->shm_hdr, ctx->shm_size);
     if (ctx->fd >= 0) {
@@ -226,22 +261,59 @@ static void shm_close(vcam_ctx_t *ctx)
 
 /* ── Public interface (vcam.h) ─────────────────────────────── */
 
-vcam_ctx_t *vcam_open(const char *device, int width, int height)
+vcam_ctx_t *vcam_open(const char *device, int width, int height, pix_fmt_t format)
 {
-    if (strcmp(device, "shm") == 0)
+    if (strcmp(device, "shm") == 0) {
+        if (format != PIX_FMT_AUTO && format != PIX_FMT_BGRA)
+            fprintf(stderr, "vcam: shm output is always bgra, ignoring --format\n");
         return shm_open_ctx(width, height, 15);
-    return pipe_open(device, width, height);
+    }
+    return pipe_open(device, width, height, format);
+}
+
+pix_fmt_t vcam_format(const vcam_ctx_t *ctx)
+{
+    return ctx->format;
+}
+
+int vcam_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    switch (ctx->mode) {
+    case VCAM_MODE_SHM:  return shm_write(ctx, frame);
+    case VCAM_MODE_PIPE: return pipe_write(ctx, frame);
+    }
+    return -1;
 }
 
-int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+int vcam_repeat(vcam_ctx_t *ctx, const frame_t *frame)
 {
     switch (ctx->mode) {
-    case VCAM_MODE_SHM:  return shm_write(ctx, yuv420p, len);
-    case VCAM_MODE_PIPE: return pipe_write(ctx, yuv420p, len);
+    case VCAM_MODE_SHM:  return 0;   /* leave frame_seq alone: nothing new */
+    case VCAM_MODE_PIPE: return pipe_write(ctx, frame);
     }
     return -1;
 }
 
+/* Shm mode lends out its frame slots; pipes have nothing to lend */
+int vcam_buffer_count(const vcam_ctx_t *ctx)
+{
+    return ctx->mode == VCAM_MODE_SHM ? SHM_SLOTS : 0;
+}
+
+frame_t *vcam_acquire(vcam_ctx_t *ctx, int *index)
+{
+    if (ctx->mode != VCAM_MODE_SHM)
+        return NULL;
+    return shm_acquire(ctx, index);
+}
+
+int vcam_submit(vcam_ctx_t *ctx, int repeat)
+{
+    if (ctx->mode != VCAM_MODE_SHM)
+        return -1;
+    return shm_submit(ctx, repeat);
+}
+
 void vcam_close(vcam_ctx_t *ctx)
 {
     if (!ctx) return;
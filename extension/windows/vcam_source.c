@@ -0,0 +1,1052 @@
+/*
+ * screen2cam virtual camera media source (Windows 11)
+ *
+ * COM in-process server loaded by the Windows Camera Frame Server for the
+ * camera that `screen2cam --device vcam` registers with
+ * MFCreateVirtualCamera.  Apps (Teams, Zoom, the Camera app) open it like
+ * any webcam; the Frame Server shares it between them.
+ *
+ *   source (IMFMediaSourceEx + IKsControl)
+ *     └── stream 0 (IMFMediaStream2): NV12, the host's size, 30 fps
+ *
+ * Frames come from the host's shared-memory ring (../shm_protocol.h),
+ * a temporary file under %ProgramData% since the Frame Server runs in
+ * session 0.  A stream thread wakes every 2 ms on a high-resolution
+ * timer and answers RequestSample() as soon as the host publishes a new
+ * frame, or with the last one again once a frame interval passed, so apps
+ * see a steady rate.  Frames are copied out under the slot's seqlock;
+ * without a host (or after it changed size) the stream shows black.
+ *
+ * Build: make vcam-dll (MinGW), then once, elevated:
+ *        regsvr32 screen2cam_vcam.dll
+ *
+ * COM usage: Plain C with COBJMACROS (no C++), as in src/encode_win.c.
+ * Libraries: mfplat, mfuuid, ole32, advapi32
+ */
+
+#define COBJMACROS
+#define CINTERFACE
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mferror.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <wchar.h>
+
+#include "../shm_protocol.h"
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+#define SOURCE_TICK_MS   2
+#define SOURCE_TOKENS    16    /* RequestSample() calls we keep track of */
+#define DEFAULT_WIDTH    1280  /* advertised when no host is running */
+#define DEFAULT_HEIGHT   720
+
+/* {94F47435-176A-4433-A673-BA0376E9F597}, SHM_WIN_CLSID */
+static const GUID clsid_source =
+    { 0x94f47435, 0x176a, 0x4433, { 0xa6, 0x73, 0xba, 0x03, 0x76, 0xe9, 0xf5, 0x97 } };
+
+/* Interfaces and attributes that not every MinGW release declares */
+static const GUID iid_media_source_ex =
+    { 0x3c9b2eb9, 0x86d5, 0x4514, { 0xa3, 0x94, 0xf5, 0x66, 0x64, 0xf9, 0xf0, 0xd8 } };
+static const GUID iid_media_stream2 =
+    { 0xc5bc37d6, 0x75c7, 0x46a1, { 0xa1, 0x32, 0x81, 0xb5, 0xf7, 0x23, 0xc2, 0x0f } };
+static const GUID iid_ks_control =
+    { 0x28f54685, 0x06fd, 0x11d2, { 0xb2, 0x7a, 0x00, 0xa0, 0xc9, 0x22, 0x31, 0x96 } };
+static const GUID attr_stream_category =      /* MF_DEVICESTREAM_STREAM_CATEGORY */
+    { 0x2939e7b8, 0xa62e, 0x4579, { 0xb6, 0x74, 0xd4, 0x07, 0x3d, 0xfa, 0xbb, 0xba } };
+static const GUID attr_stream_id =            /* MF_DEVICESTREAM_STREAM_ID */
+    { 0x11bd5120, 0xd124, 0x446b, { 0x88, 0xe6, 0x17, 0x06, 0x02, 0x57, 0xff, 0xf9 } };
+static const GUID attr_frameserver_shared =   /* MF_DEVICESTREAM_FRAMESERVER_SHARED */
+    { 0x1cb378e9, 0xb279, 0x41d4, { 0xaf, 0x97, 0x34, 0xa2, 0x43, 0xe6, 0x83, 0x20 } };
+static const GUID pin_video_capture =         /* PINNAME_VIDEO_CAPTURE */
+    { 0xfb6c4281, 0x0353, 0x11d1, { 0x90, 0x5f, 0x00, 0x00, 0xc0, 0xcc, 0x16, 0xba } };
+
+static HMODULE       module;
+static volatile LONG server_refs;   /* live objects + LockServer() */
+
+/* ── Shared-memory ring ────────────────────────────────────── */
+
+typedef struct {
+    HANDLE        file;
+    HANDLE        mapping;
+    shm_header_t *hdr;
+    DWORD         retry_at;   /* GetTickCount() of the next open attempt */
+} ring_reader_t;
+
+static void ring_close(ring_reader_t *r)
+{
+    if (r->hdr)
+        UnmapViewOfFile(r->hdr);
+    if (r->mapping)
+        CloseHandle(r->mapping);
+    if (r->file)
+        CloseHandle(r->file);
+    r->hdr     = NULL;
+    r->mapping = NULL;
+    r->file    = NULL;
+}
+
+/* Map the host's ring.  Returns 0 once it is there and complete. */
+static int ring_open(ring_reader_t *r)
+{
+    WCHAR path[MAX_PATH];
+    DWORD n = GetEnvironmentVariableW(L"ProgramData", path, MAX_PATH);
+    if (n == 0 || n + 1 + wcslen(SHM_WIN_FILE) >= MAX_PATH)
+        return -1;
+    wcscat(path, L"\\");
+    wcscat(path, SHM_WIN_FILE);
+
+    /* FILE_SHARE_DELETE: the host's delete-on-close handle must not stop us */
+    r->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE,
+                          FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                          NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (r->file == INVALID_HANDLE_VALUE) {
+        r->file = NULL;
+        return -1;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(r->file, &size) || (uint64_t)size.QuadPart < sizeof(shm_header_t))
+        goto fail;
+    r->mapping = CreateFileMappingW(r->file, NULL, PAGE_READWRITE, 0, 0, NULL);
+    if (!r->mapping)
+        goto fail;
+    r->hdr = MapViewOfFile(r->mapping, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (!r->hdr)
+        goto fail;
+
+    if (r->hdr->magic != SHM_MAGIC || r->hdr->version != SHM_VERSION ||
+        r->hdr->total_size > (uint64_t)size.QuadPart ||
+        r->hdr->slots[0].pixel_fmt != SHM_FMT_NV12)
+        goto fail;
+    atomic_thread_fence(memory_order_acquire);
+    return 0;
+
+fail:
+    ring_close(r);
+    return -1;
+}
+
+/*
+ * Copy the latest NV12 frame (stride == width) into dst; its seqlock
+ * rejects a slot the host overwrote meanwhile.  Returns 0 or -1.
+ */
+static int ring_copy_latest(const shm_header_t *hdr, uint8_t *dst, size_t size)
+{
+    for (int attempt = 0; attempt < 4; attempt++) {
+        uint32_t slot = atomic_load((_Atomic uint32_t *)&hdr->latest);
+        const shm_slot_t *s = &hdr->slots[slot];
+
+        uint32_t seq = atomic_load_explicit((_Atomic uint32_t *)&s->seq,
+                                            memory_order_acquire);
+        if (seq & 1)
+            continue;
+        memcpy(dst, shm_slot_ptr_const(hdr, slot), size);
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit((_Atomic uint32_t *)&s->seq, memory_order_relaxed) == seq)
+            return 0;
+    }
+    return -1;
+}
+
+/* ── Objects ───────────────────────────────────────────────── */
+
+typedef struct source source_t;
+typedef struct stream stream_t;
+
+/*
+ * Our own vtable layouts (IMFMediaSourceEx, IMFMediaStream2, IKsControl),
+ * in declaration order; callers only ever see them through the SDK
+ * interface types.
+ */
+typedef struct {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(source_t *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(source_t *);
+    ULONG   (STDMETHODCALLTYPE *Release)(source_t *);
+    HRESULT (STDMETHODCALLTYPE *GetEvent)(source_t *, DWORD, IMFMediaEvent **);
+    HRESULT (STDMETHODCALLTYPE *BeginGetEvent)(source_t *, IMFAsyncCallback *, IUnknown *);
+    HRESULT (STDMETHODCALLTYPE *EndGetEvent)(source_t *, IMFAsyncResult *, IMFMediaEvent **);
+    HRESULT (STDMETHODCALLTYPE *QueueEvent)(source_t *, MediaEventType, REFGUID, HRESULT,
+                                            const PROPVARIANT *);
+    HRESULT (STDMETHODCALLTYPE *GetCharacteristics)(source_t *, DWORD *);
+    HRESULT (STDMETHODCALLTYPE *CreatePresentationDescriptor)(source_t *,
+                                                              IMFPresentationDescriptor **);
+    HRESULT (STDMETHODCALLTYPE *Start)(source_t *, IMFPresentationDescriptor *, const GUID *,
+                                       const PROPVARIANT *);
+    HRESULT (STDMETHODCALLTYPE *Stop)(source_t *);
+    HRESULT (STDMETHODCALLTYPE *Pause)(source_t *);
+    HRESULT (STDMETHODCALLTYPE *Shutdown)(source_t *);
+    HRESULT (STDMETHODCALLTYPE *GetSourceAttributes)(source_t *, IMFAttributes **);
+    HRESULT (STDMETHODCALLTYPE *GetStreamAttributes)(source_t *, DWORD, IMFAttributes **);
+    HRESULT (STDMETHODCALLTYPE *SetD3DManager)(source_t *, IUnknown *);
+} source_vtbl_t;
+
+typedef struct ks_control ks_control_t;
+typedef struct {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(ks_control_t *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(ks_control_t *);
+    ULONG   (STDMETHODCALLTYPE *Release)(ks_control_t *);
+    HRESULT (STDMETHODCALLTYPE *KsProperty)(ks_control_t *, void *, ULONG, void *, ULONG, ULONG *);
+    HRESULT (STDMETHODCALLTYPE *KsMethod)(ks_control_t *, void *, ULONG, void *, ULONG, ULONG *);
+    HRESULT (STDMETHODCALLTYPE *KsEvent)(ks_control_t *, void *, ULONG, void *, ULONG, ULONG *);
+} ks_control_vtbl_t;
+struct ks_control {
+    const ks_control_vtbl_t *lpVtbl;
+};
+
+typedef struct {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(stream_t *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(stream_t *);
+    ULONG   (STDMETHODCALLTYPE *Release)(stream_t *);
+    HRESULT (STDMETHODCALLTYPE *GetEvent)(stream_t *, DWORD, IMFMediaEvent **);
+    HRESULT (STDMETHODCALLTYPE *BeginGetEvent)(stream_t *, IMFAsyncCallback *, IUnknown *);
+    HRESULT (STDMETHODCALLTYPE *EndGetEvent)(stream_t *, IMFAsyncResult *, IMFMediaEvent **);
+    HRESULT (STDMETHODCALLTYPE *QueueEvent)(stream_t *, MediaEventType, REFGUID, HRESULT,
+                                            const PROPVARIANT *);
+    HRESULT (STDMETHODCALLTYPE *GetMediaSource)(stream_t *, IMFMediaSource **);
+    HRESULT (STDMETHODCALLTYPE *GetStreamDescriptor)(stream_t *, IMFStreamDescriptor **);
+    HRESULT (STDMETHODCALLTYPE *RequestSample)(stream_t *, IUnknown *);
+    HRESULT (STDMETHODCALLTYPE *SetStreamState)(stream_t *, MF_STREAM_STATE);
+    HRESULT (STDMETHODCALLTYPE *GetStreamState)(stream_t *, MF_STREAM_STATE *);
+} stream_vtbl_t;
+
+struct stream {
+    const stream_vtbl_t *lpVtbl;
+    volatile LONG        refs;
+    source_t            *source;    /* counted; Shutdown() breaks the cycle */
+    IMFMediaEventQueue  *queue;
+    IMFStreamDescriptor *desc;
+    IMFAttributes       *attributes;
+    MF_STREAM_STATE      state;
+
+    IUnknown            *tokens[SOURCE_TOKENS];   /* pending RequestSample() */
+    int                  ntokens;
+    uint64_t             last_seq;   /* frame_seq of the last frame sent */
+    LONGLONG             last_sent;  /* MFGetSystemTime() of it */
+
+    HANDLE               thread;
+    volatile LONG        quit;
+};
+
+struct source {
+    const source_vtbl_t     *lpVtbl;
+    ks_control_t             ks;
+    volatile LONG            refs;
+    CRITICAL_SECTION         lock;   /* source and stream state */
+    int                      shutdown;
+    IMFMediaEventQueue      *queue;
+    IMFAttributes           *attributes;
+    IMFPresentationDescriptor *pd;
+    stream_t                *stream;
+    int                      width;
+    int                      height;
+    int                      fps;
+    int                      started;   /* MENewStream sent */
+    ring_reader_t            ring;
+};
+
+static source_t *source_from_ks(ks_control_t *ks)
+{
+    return (source_t *)((char *)ks - offsetof(source_t, ks));
+}
+
+/* ── Stream ────────────────────────────────────────────────── */
+
+static void clear_tokens(stream_t *s)
+{
+    for (int i = 0; i < s->ntokens; i++) {
+        if (s->tokens[i])
+            IUnknown_Release(s->tokens[i]);
+    }
+    s->ntokens = 0;
+}
+
+/* Fill one NV12 sample: the latest frame, or black.  Lock held. */
+static IMFSample *make_sample(source_t *src, stream_t *s, uint64_t seq)
+{
+    DWORD size = (DWORD)((size_t)src->width * src->height * 3 / 2);
+    IMFMediaBuffer *buf = NULL;
+    IMFSample *sample = NULL;
+    BYTE *data = NULL;
+
+    if (FAILED(MFCreateMemoryBuffer(size, &buf)))
+        return NULL;
+    if (FAILED(IMFMediaBuffer_Lock(buf, &data, NULL, NULL))) {
+        IMFMediaBuffer_Release(buf);
+        return NULL;
+    }
+
+    const shm_header_t *hdr = src->ring.hdr;
+    if (!hdr || hdr->width != src->width || hdr->height != src->height ||
+        ring_copy_latest(hdr, data, size) < 0) {
+        size_t luma = (size_t)src->width * src->height;
+        memset(data, 16, luma);
+        memset(data + luma, 128, size - luma);
+    }
+    IMFMediaBuffer_Unlock(buf);
+    IMFMediaBuffer_SetCurrentLength(buf, size);
+
+    if (SUCCEEDED(MFCreateSample(&sample))) {
+        IMFSample_AddBuffer(sample, buf);
+        IMFSample_SetSampleTime(sample, MFGetSystemTime());
+        IMFSample_SetSampleDuration(sample, 10000000 / src->fps);
+    }
+    IMFMediaBuffer_Release(buf);
+    s->last_seq = seq;
+    return sample;
+}
+
+/* One timer tick: answer the oldest request if there is something to send. */
+static void stream_tick(stream_t *s)
+{
+    source_t *src = s->source;
+    EnterCriticalSection(&src->lock);
+
+    ring_reader_t *ring = &src->ring;
+    if (ring->hdr && ring->hdr->version != SHM_VERSION)
+        ring_close(ring);   /* host exited: let it delete the file */
+    if (!ring->hdr && (LONG)(GetTickCount() - ring->retry_at) >= 0) {
+        if (ring_open(ring) < 0)
+            ring->retry_at = GetTickCount() + 1000;
+    }
+
+    if (src->shutdown || s->state != MF_STREAM_STATE_RUNNING || s->ntokens == 0) {
+        LeaveCriticalSection(&src->lock);
+        return;
+    }
+
+    uint64_t seq = ring->hdr ? atomic_load(&ring->hdr->frame_seq) : 0;
+    LONGLONG now = MFGetSystemTime();
+    if (seq == s->last_seq && now - s->last_sent < 10000000 / src->fps) {
+        LeaveCriticalSection(&src->lock);
+        return;
+    }
+
+    IMFSample *sample = make_sample(src, s, seq);
+    if (sample) {
+        IUnknown *token = s->tokens[0];
+        memmove(s->tokens, s->tokens + 1, (size_t)(s->ntokens - 1) * sizeof(s->tokens[0]));
+        s->ntokens--;
+        if (token) {
+            IMFSample_SetUnknown(sample, &MFSampleExtension_Token, token);
+            IUnknown_Release(token);
+        }
+        IMFMediaEventQueue_QueueEventParamUnk(s->queue, MEMediaSample, &GUID_NULL, S_OK,
+                                              (IUnknown *)sample);
+        IMFSample_Release(sample);
+        s->last_sent = now;
+    }
+    LeaveCriticalSection(&src->lock);
+}
+
+static DWORD WINAPI stream_main(void *arg)
+{
+    stream_t *s = arg;
+
+    /* Plain waitable timers tick at 15.6 ms before Windows 10 1803 */
+    HANDLE timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                          TIMER_ALL_ACCESS);
+    if (!timer)
+        timer = CreateWaitableTimerW(NULL, FALSE, NULL);
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)SOURCE_TICK_MS * 10000;
+    SetWaitableTimer(timer, &due, SOURCE_TICK_MS, NULL, NULL, FALSE);
+
+    while (!s->quit) {
+        WaitForSingleObject(timer, 100);
+        stream_tick(s);
+    }
+    CancelWaitableTimer(timer);
+    CloseHandle(timer);
+    return 0;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_QueryInterface(stream_t *s, REFIID riid, void **ppv)
+{
+    if (!ppv)
+        return E_POINTER;
+    if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IMFMediaEventGenerator) ||
+        IsEqualIID(riid, &IID_IMFMediaStream) || IsEqualIID(riid, &iid_media_stream2)) {
+        *ppv = s;
+        InterlockedIncrement(&s->refs);
+        return S_OK;
+    }
+    *ppv = NULL;
+    return E_NOINTERFACE;
+}
+
+static ULONG STDMETHODCALLTYPE stream_AddRef(stream_t *s)
+{
+    return (ULONG)InterlockedIncrement(&s->refs);
+}
+
+static ULONG STDMETHODCALLTYPE stream_Release(stream_t *s)
+{
+    LONG refs = InterlockedDecrement(&s->refs);
+    if (refs == 0) {
+        clear_tokens(s);
+        if (s->queue)
+            IMFMediaEventQueue_Release(s->queue);
+        if (s->desc)
+            IMFStreamDescriptor_Release(s->desc);
+        if (s->attributes)
+            IMFAttributes_Release(s->attributes);
+        s->source->lpVtbl->Release(s->source);
+        CoTaskMemFree(s);
+        InterlockedDecrement(&server_refs);
+    }
+    return (ULONG)refs;
+}
+
+/* Event generator calls go to the queue outside the lock: GetEvent blocks. */
+static IMFMediaEventQueue *stream_queue(stream_t *s)
+{
+    IMFMediaEventQueue *q = NULL;
+    EnterCriticalSection(&s->source->lock);
+    if (!s->source->shutdown && s->queue) {
+        q = s->queue;
+        IMFMediaEventQueue_AddRef(q);
+    }
+    LeaveCriticalSection(&s->source->lock);
+    return q;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_GetEvent(stream_t *s, DWORD flags, IMFMediaEvent **ev)
+{
+    IMFMediaEventQueue *q = stream_queue(s);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_GetEvent(q, flags, ev);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_BeginGetEvent(stream_t *s, IMFAsyncCallback *cb,
+                                                      IUnknown *state)
+{
+    IMFMediaEventQueue *q = stream_queue(s);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_BeginGetEvent(q, cb, state);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_EndGetEvent(stream_t *s, IMFAsyncResult *result,
+                                                    IMFMediaEvent **ev)
+{
+    IMFMediaEventQueue *q = stream_queue(s);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_EndGetEvent(q, result, ev);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_QueueEvent(stream_t *s, MediaEventType type,
+                                                   REFGUID ext, HRESULT status,
+                                                   const PROPVARIANT *value)
+{
+    IMFMediaEventQueue *q = stream_queue(s);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_QueueEventParamVar(q, type, ext, status, value);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_GetMediaSource(stream_t *s, IMFMediaSource **out)
+{
+    if (!out)
+        return E_POINTER;
+    *out = (IMFMediaSource *)s->source;
+    s->source->lpVtbl->AddRef(s->source);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_GetStreamDescriptor(stream_t *s,
+                                                            IMFStreamDescriptor **out)
+{
+    if (!out)
+        return E_POINTER;
+    *out = s->desc;
+    IMFStreamDescriptor_AddRef(s->desc);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_RequestSample(stream_t *s, IUnknown *token)
+{
+    source_t *src = s->source;
+    HRESULT hr = S_OK;
+    EnterCriticalSection(&src->lock);
+    if (src->shutdown)
+        hr = MF_E_SHUTDOWN;
+    else if (s->state != MF_STREAM_STATE_RUNNING)
+        hr = MF_E_MEDIA_SOURCE_WRONGSTATE;
+    else if (s->ntokens == SOURCE_TOKENS)
+        hr = MF_E_SAMPLEALLOCATOR_EMPTY;
+    else {
+        if (token)
+            IUnknown_AddRef(token);
+        s->tokens[s->ntokens++] = token;
+    }
+    LeaveCriticalSection(&src->lock);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_SetStreamState(stream_t *s, MF_STREAM_STATE state)
+{
+    EnterCriticalSection(&s->source->lock);
+    s->state = state;
+    if (state != MF_STREAM_STATE_RUNNING)
+        clear_tokens(s);
+    LeaveCriticalSection(&s->source->lock);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE stream_GetStreamState(stream_t *s, MF_STREAM_STATE *state)
+{
+    if (!state)
+        return E_POINTER;
+    EnterCriticalSection(&s->source->lock);
+    *state = s->state;
+    LeaveCriticalSection(&s->source->lock);
+    return S_OK;
+}
+
+static const stream_vtbl_t stream_vtbl = {
+    stream_QueryInterface, stream_AddRef, stream_Release,
+    stream_GetEvent, stream_BeginGetEvent, stream_EndGetEvent, stream_QueueEvent,
+    stream_GetMediaSource, stream_GetStreamDescriptor, stream_RequestSample,
+    stream_SetStreamState, stream_GetStreamState,
+};
+
+static IMFMediaType *nv12_type(int width, int height, int fps)
+{
+    IMFMediaType *t = NULL;
+    if (FAILED(MFCreateMediaType(&t)))
+        return NULL;
+    IMFMediaType_SetGUID(t, &MF_MT_MAJOR_TYPE, &MFMediaType_Video);
+    IMFMediaType_SetGUID(t, &MF_MT_SUBTYPE, &MFVideoFormat_NV12);
+    IMFMediaType_SetUINT64(t, &MF_MT_FRAME_SIZE, (UINT64)width << 32 | (UINT32)height);
+    IMFMediaType_SetUINT64(t, &MF_MT_FRAME_RATE, (UINT64)fps << 32 | 1);
+    IMFMediaType_SetUINT64(t, &MF_MT_PIXEL_ASPECT_RATIO, (UINT64)1 << 32 | 1);
+    IMFMediaType_SetUINT32(t, &MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+    IMFMediaType_SetUINT32(t, &MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE);
+    IMFMediaType_SetUINT32(t, &MF_MT_DEFAULT_STRIDE, (UINT32)width);
+    IMFMediaType_SetUINT32(t, &MF_MT_SAMPLE_SIZE, (UINT32)((size_t)width * height * 3 / 2));
+    return t;
+}
+
+static stream_t *stream_create(source_t *src)
+{
+    stream_t *s = CoTaskMemAlloc(sizeof(*s));
+    if (!s)
+        return NULL;
+    memset(s, 0, sizeof(*s));
+    s->lpVtbl = &stream_vtbl;
+    s->refs   = 1;
+    s->source = src;
+    s->state  = MF_STREAM_STATE_STOPPED;
+    src->lpVtbl->AddRef(src);
+    InterlockedIncrement(&server_refs);
+
+    IMFMediaType *type = nv12_type(src->width, src->height, src->fps);
+    IMFMediaTypeHandler *handler = NULL;
+    HRESULT hr = type ? S_OK : E_OUTOFMEMORY;
+    if (SUCCEEDED(hr))
+        hr = MFCreateEventQueue(&s->queue);
+    if (SUCCEEDED(hr))
+        hr = MFCreateStreamDescriptor(0, 1, &type, &s->desc);
+    if (SUCCEEDED(hr))
+        hr = IMFStreamDescriptor_GetMediaTypeHandler(s->desc, &handler);
+    if (SUCCEEDED(hr))
+        hr = IMFMediaTypeHandler_SetCurrentMediaType(handler, type);
+
+    /* What the Frame Server looks for on a camera's stream */
+    if (SUCCEEDED(hr))
+        hr = MFCreateAttributes(&s->attributes, 4);
+    if (SUCCEEDED(hr)) {
+        IMFAttributes *sets[2] = { s->attributes, (IMFAttributes *)s->desc };
+        for (int i = 0; i < 2; i++) {
+            IMFAttributes_SetGUID(sets[i], &attr_stream_category, &pin_video_capture);
+            IMFAttributes_SetUINT32(sets[i], &attr_stream_id, 0);
+            IMFAttributes_SetUINT32(sets[i], &attr_frameserver_shared, 1);
+        }
+    }
+
+    if (handler)
+        IMFMediaTypeHandler_Release(handler);
+    if (type)
+        IMFMediaType_Release(type);
+    if (FAILED(hr)) {
+        stream_Release(s);
+        return NULL;
+    }
+    return s;
+}
+
+/* ── Source ────────────────────────────────────────────────── */
+
+static HRESULT STDMETHODCALLTYPE source_QueryInterface(source_t *src, REFIID riid, void **ppv)
+{
+    if (!ppv)
+        return E_POINTER;
+    if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IMFMediaEventGenerator) ||
+        IsEqualIID(riid, &IID_IMFMediaSource) || IsEqualIID(riid, &iid_media_source_ex)) {
+        *ppv = src;
+    } else if (IsEqualIID(riid, &iid_ks_control)) {
+        *ppv = &src->ks;
+    } else {
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+    InterlockedIncrement(&src->refs);
+    return S_OK;
+}
+
+static ULONG STDMETHODCALLTYPE source_AddRef(source_t *src)
+{
+    return (ULONG)InterlockedIncrement(&src->refs);
+}
+
+static HRESULT STDMETHODCALLTYPE source_Shutdown(source_t *src);
+
+static ULONG STDMETHODCALLTYPE source_Release(source_t *src)
+{
+    LONG refs = InterlockedDecrement(&src->refs);
+    if (refs == 0) {
+        source_Shutdown(src);
+        DeleteCriticalSection(&src->lock);
+        MFShutdown();
+        CoTaskMemFree(src);
+        InterlockedDecrement(&server_refs);
+    }
+    return (ULONG)refs;
+}
+
+static IMFMediaEventQueue *source_queue(source_t *src)
+{
+    IMFMediaEventQueue *q = NULL;
+    EnterCriticalSection(&src->lock);
+    if (!src->shutdown && src->queue) {
+        q = src->queue;
+        IMFMediaEventQueue_AddRef(q);
+    }
+    LeaveCriticalSection(&src->lock);
+    return q;
+}
+
+static HRESULT STDMETHODCALLTYPE source_GetEvent(source_t *src, DWORD flags, IMFMediaEvent **ev)
+{
+    IMFMediaEventQueue *q = source_queue(src);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_GetEvent(q, flags, ev);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_BeginGetEvent(source_t *src, IMFAsyncCallback *cb,
+                                                      IUnknown *state)
+{
+    IMFMediaEventQueue *q = source_queue(src);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_BeginGetEvent(q, cb, state);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_EndGetEvent(source_t *src, IMFAsyncResult *result,
+                                                    IMFMediaEvent **ev)
+{
+    IMFMediaEventQueue *q = source_queue(src);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_EndGetEvent(q, result, ev);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_QueueEvent(source_t *src, MediaEventType type,
+                                                   REFGUID ext, HRESULT status,
+                                                   const PROPVARIANT *value)
+{
+    IMFMediaEventQueue *q = source_queue(src);
+    if (!q)
+        return MF_E_SHUTDOWN;
+    HRESULT hr = IMFMediaEventQueue_QueueEventParamVar(q, type, ext, status, value);
+    IMFMediaEventQueue_Release(q);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_GetCharacteristics(source_t *src, DWORD *flags)
+{
+    (void)src;
+    if (!flags)
+        return E_POINTER;
+    *flags = MFMEDIASOURCE_IS_LIVE;
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE source_CreatePresentationDescriptor(
+    source_t *src, IMFPresentationDescriptor **out)
+{
+    if (!out)
+        return E_POINTER;
+    EnterCriticalSection(&src->lock);
+    HRESULT hr = src->shutdown ? MF_E_SHUTDOWN : IMFPresentationDescriptor_Clone(src->pd, out);
+    LeaveCriticalSection(&src->lock);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_Start(source_t *src, IMFPresentationDescriptor *pd,
+                                              const GUID *time_format, const PROPVARIANT *start)
+{
+    if (!pd)
+        return E_INVALIDARG;
+    if (time_format && !IsEqualGUID(time_format, &GUID_NULL))
+        return MF_E_UNSUPPORTED_TIME_FORMAT;
+    if (start && start->vt != VT_EMPTY && start->vt != VT_I8)
+        return MF_E_UNSUPPORTED_TIME_FORMAT;
+
+    EnterCriticalSection(&src->lock);
+    if (src->shutdown) {
+        LeaveCriticalSection(&src->lock);
+        return MF_E_SHUTDOWN;
+    }
+
+    stream_t *s = src->stream;
+    PROPVARIANT now;
+    PropVariantInit(&now);
+    now.vt            = VT_I8;
+    now.hVal.QuadPart = MFGetSystemTime();
+
+    /* A live source always starts "now", whatever position was asked for */
+    IMFMediaEventQueue_QueueEventParamUnk(src->queue, src->started ? MEUpdatedStream
+                                                                   : MENewStream,
+                                          &GUID_NULL, S_OK, (IUnknown *)s);
+    src->started = 1;
+    s->state = MF_STREAM_STATE_RUNNING;
+    IMFMediaEventQueue_QueueEventParamVar(s->queue, MEStreamStarted, &GUID_NULL, S_OK, &now);
+    IMFMediaEventQueue_QueueEventParamVar(src->queue, MESourceStarted, &GUID_NULL, S_OK, &now);
+
+    if (!s->thread) {
+        s->quit   = 0;
+        s->thread = CreateThread(NULL, 0, stream_main, s, 0, NULL);
+    }
+    LeaveCriticalSection(&src->lock);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE source_Stop(source_t *src)
+{
+    EnterCriticalSection(&src->lock);
+    if (src->shutdown) {
+        LeaveCriticalSection(&src->lock);
+        return MF_E_SHUTDOWN;
+    }
+    stream_t *s = src->stream;
+    s->state = MF_STREAM_STATE_STOPPED;
+    clear_tokens(s);
+    IMFMediaEventQueue_QueueEventParamVar(s->queue, MEStreamStopped, &GUID_NULL, S_OK, NULL);
+    IMFMediaEventQueue_QueueEventParamVar(src->queue, MESourceStopped, &GUID_NULL, S_OK, NULL);
+    LeaveCriticalSection(&src->lock);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE source_Pause(source_t *src)
+{
+    (void)src;
+    return MF_E_INVALID_STATE_TRANSITION;   /* live sources do not pause */
+}
+
+static HRESULT STDMETHODCALLTYPE source_Shutdown(source_t *src)
+{
+    EnterCriticalSection(&src->lock);
+    if (src->shutdown) {
+        LeaveCriticalSection(&src->lock);
+        return MF_E_SHUTDOWN;
+    }
+    src->shutdown = 1;
+    stream_t *s = src->stream;
+    LeaveCriticalSection(&src->lock);
+
+    /* The stream thread takes the lock on every tick: join it unlocked */
+    if (s && s->thread) {
+        s->quit = 1;
+        WaitForSingleObject(s->thread, INFINITE);
+        CloseHandle(s->thread);
+        s->thread = NULL;
+    }
+
+    EnterCriticalSection(&src->lock);
+    if (s) {
+        clear_tokens(s);
+        IMFMediaEventQueue_Shutdown(s->queue);
+        src->stream = NULL;
+    }
+    if (src->queue)
+        IMFMediaEventQueue_Shutdown(src->queue);
+    ring_close(&src->ring);
+    LeaveCriticalSection(&src->lock);
+
+    if (src->queue)
+        IMFMediaEventQueue_Release(src->queue);
+    if (src->pd)
+        IMFPresentationDescriptor_Release(src->pd);
+    if (src->attributes)
+        IMFAttributes_Release(src->attributes);
+    src->queue      = NULL;
+    src->pd         = NULL;
+    src->attributes = NULL;
+
+    /* Last: the stream's reference may be what keeps us alive */
+    if (s)
+        stream_Release(s);
+    return S_OK;
+}
+
+static HRESULT STDMETHODCALLTYPE source_GetSourceAttributes(source_t *src, IMFAttributes **out)
+{
+    if (!out)
+        return E_POINTER;
+    EnterCriticalSection(&src->lock);
+    HRESULT hr = src->shutdown ? MF_E_SHUTDOWN : S_OK;
+    if (SUCCEEDED(hr)) {
+        *out = src->attributes;
+        IMFAttributes_AddRef(*out);
+    }
+    LeaveCriticalSection(&src->lock);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_GetStreamAttributes(source_t *src, DWORD id,
+                                                            IMFAttributes **out)
+{
+    if (!out)
+        return E_POINTER;
+    if (id != 0)
+        return MF_E_INVALIDSTREAMNUMBER;
+    EnterCriticalSection(&src->lock);
+    HRESULT hr = src->shutdown ? MF_E_SHUTDOWN : S_OK;
+    if (SUCCEEDED(hr)) {
+        *out = src->stream->attributes;
+        IMFAttributes_AddRef(*out);
+    }
+    LeaveCriticalSection(&src->lock);
+    return hr;
+}
+
+static HRESULT STDMETHODCALLTYPE source_SetD3DManager(source_t *src, IUnknown *manager)
+{
+    (void)src;
+    (void)manager;
+    return S_OK;   /* samples live in system memory */
+}
+
+static const source_vtbl_t source_vtbl = {
+    source_QueryInterface, source_AddRef, source_Release,
+    source_GetEvent, source_BeginGetEvent, source_EndGetEvent, source_QueueEvent,
+    source_GetCharacteristics, source_CreatePresentationDescriptor,
+    source_Start, source_Stop, source_Pause, source_Shutdown,
+    source_GetSourceAttributes, source_GetStreamAttributes, source_SetD3DManager,
+};
+
+/* IKsControl: the Frame Server insists on it; there are no controls. */
+static HRESULT STDMETHODCALLTYPE ks_QueryInterface(ks_control_t *ks, REFIID riid, void **ppv)
+{
+    source_t *src = source_from_ks(ks);
+    return src->lpVtbl->QueryInterface(src, riid, ppv);
+}
+
+static ULONG STDMETHODCALLTYPE ks_AddRef(ks_control_t *ks)
+{
+    source_t *src = source_from_ks(ks);
+    return src->lpVtbl->AddRef(src);
+}
+
+static ULONG STDMETHODCALLTYPE ks_Release(ks_control_t *ks)
+{
+    source_t *src = source_from_ks(ks);
+    return src->lpVtbl->Release(src);
+}
+
+static HRESULT STDMETHODCALLTYPE ks_NotFound(ks_control_t *ks, void *id, ULONG id_len,
+                                             void *data, ULONG data_len, ULONG *returned)
+{
+    (void)ks;
+    (void)id;
+    (void)id_len;
+    (void)data;
+    (void)data_len;
+    if (returned)
+        *returned = 0;
+    return HRESULT_FROM_WIN32(ERROR_SET_NOT_FOUND);
+}
+
+static const ks_control_vtbl_t ks_vtbl = {
+    ks_QueryInterface, ks_AddRef, ks_Release, ks_NotFound, ks_NotFound, ks_NotFound,
+};
+
+static HRESULT source_create(REFIID riid, void **ppv)
+{
+    source_t *src = CoTaskMemAlloc(sizeof(*src));
+    if (!src)
+        return E_OUTOFMEMORY;
+    memset(src, 0, sizeof(*src));
+    src->lpVtbl    = &source_vtbl;
+    src->ks.lpVtbl = &ks_vtbl;
+    src->refs      = 1;
+    InitializeCriticalSection(&src->lock);
+    InterlockedIncrement(&server_refs);
+    MFStartup(MF_VERSION, MFSTARTUP_LITE);
+
+    /* Advertise the host's size; it registers the camera after the ring */
+    src->width  = DEFAULT_WIDTH;
+    src->height = DEFAULT_HEIGHT;
+    src->fps    = 30;
+    if (ring_open(&src->ring) == 0) {
+        src->width  = src->ring.hdr->width;
+        src->height = src->ring.hdr->height;
+        if (src->ring.hdr->fps > 0)
+            src->fps = src->ring.hdr->fps;
+    }
+
+    HRESULT hr = MFCreateEventQueue(&src->queue);
+    if (SUCCEEDED(hr))
+        hr = MFCreateAttributes(&src->attributes, 1);
+    if (SUCCEEDED(hr)) {
+        src->stream = stream_create(src);
+        hr = src->stream ? S_OK : E_OUTOFMEMORY;
+    }
+    if (SUCCEEDED(hr))
+        hr = MFCreatePresentationDescriptor(1, &src->stream->desc, &src->pd);
+    if (SUCCEEDED(hr))
+        hr = IMFPresentationDescriptor_SelectStream(src->pd, 0);
+    if (SUCCEEDED(hr))
+        hr = source_QueryInterface(src, riid, ppv);
+    if (FAILED(hr))
+        source_Shutdown(src);   /* frees the stream and its reference */
+
+    source_Release(src);   /* drop the creation reference */
+    return hr;
+}
+
+/* ── Class factory and DLL entry points ───────────────────── */
+
+static HRESULT STDMETHODCALLTYPE factory_QueryInterface(IClassFactory *f, REFIID riid, void **ppv)
+{
+    if (!ppv)
+        return E_POINTER;
+    if (IsEqualIID(riid, &IID_IUnknown) || IsEqualIID(riid, &IID_IClassFactory)) {
+        *ppv = f;
+        return S_OK;
+    }
+    *ppv = NULL;
+    return E_NOINTERFACE;
+}
+
+static ULONG STDMETHODCALLTYPE factory_AddRef(IClassFactory *f)
+{
+    (void)f;
+    return 2;   /* static object */
+}
+
+static ULONG STDMETHODCALLTYPE factory_Release(IClassFactory *f)
+{
+    (void)f;
+    return 1;
+}
+
+static HRESULT STDMETHODCALLTYPE factory_CreateInstance(IClassFactory *f, IUnknown *outer,
+                                                        REFIID riid, void **ppv)
+{
+    (void)f;
+    if (!ppv)
+        return E_POINTER;
+    *ppv = NULL;
+    if (outer)
+        return CLASS_E_NOAGGREGATION;
+    return source_create(riid, ppv);
+}
+
+static HRESULT STDMETHODCALLTYPE factory_LockServer(IClassFactory *f, BOOL lock)
+{
+    (void)f;
+    if (lock)
+        InterlockedIncrement(&server_refs);
+    else
+        InterlockedDecrement(&server_refs);
+    return S_OK;
+}
+
+static IClassFactoryVtbl factory_vtbl = {
+    factory_QueryInterface, factory_AddRef, factory_Release,
+    factory_CreateInstance, factory_LockServer,
+};
+static IClassFactory factory = { &factory_vtbl };
+
+BOOL WINAPI DllMain(HINSTANCE instance, DWORD reason, LPVOID reserved)
+{
+    (void)reserved;
+    if (reason == DLL_PROCESS_ATTACH) {
+        module = instance;
+        DisableThreadLibraryCalls(instance);
+    }
+    return TRUE;
+}
+
+STDAPI DllGetClassObject(REFCLSID clsid, REFIID riid, void **ppv)
+{
+    if (!IsEqualCLSID(clsid, &clsid_source))
+        return CLASS_E_CLASSNOTAVAILABLE;
+    return factory_QueryInterface(&factory, riid, ppv);
+}
+
+STDAPI DllCanUnloadNow(void)
+{
+    return server_refs == 0 ? S_OK : S_FALSE;
+}
+
+#define CLSID_KEY L"Software\\Classes\\CLSID\\" SHM_WIN_CLSID
+
+/* HKLM, so the Frame Server's service account finds us too. */
+STDAPI DllRegisterServer(void)
+{
+    WCHAR path[MAX_PATH];
+    DWORD n = GetModuleFileNameW(module, path, MAX_PATH);
+    if (n == 0 || n == MAX_PATH)
+        return HRESULT_FROM_WIN32(GetLastError());
+
+    HKEY key;
+    LSTATUS rc = RegCreateKeyExW(HKEY_LOCAL_MACHINE, CLSID_KEY L"\\InprocServer32", 0, NULL,
+                                 0, KEY_WRITE, NULL, &key, NULL);
+    if (rc != ERROR_SUCCESS)
+        return HRESULT_FROM_WIN32(rc);
+    static const WCHAR model[] = L"Both";
+    rc = RegSetValueExW(key, NULL, 0, REG_SZ, (const BYTE *)path,
+                        (DWORD)((n + 1) * sizeof(WCHAR)));
+    if (rc == ERROR_SUCCESS)
+        rc = RegSetValueExW(key, L"ThreadingModel", 0, REG_SZ, (const BYTE *)model,
+                            sizeof(model));
+    RegCloseKey(key);
+    return HRESULT_FROM_WIN32(rc);
+}
+
+STDAPI DllUnregisterServer(void)
+{
+    LSTATUS rc = RegDeleteTreeW(HKEY_LOCAL_MACHINE, CLSID_KEY);
+    return rc == ERROR_FILE_NOT_FOUND ? S_OK : HRESULT_FROM_WIN32(rc);
+}
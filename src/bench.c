@@ -0,0 +1,1410 @@
+/*
+ * screen2cam-bench: conversion and capture benchmark
+ *
+ *   make bench                              every kernel, 720p to 8K, as a table
+ *   ./screen2cam-bench --json >> runs.jsonl one JSON object per result
+ *   ./screen2cam-bench --capture            grab latency of each capture backend
+ *
+ * Conversion cases, for every frame size:
+ *   avx2, sse4.1, neon, scalar   each kernel this build and CPU have, one thread
+ *   threads                      the detected kernel on the worker pool (--threads)
+ *   scaled                       frame_scale_convert() to half width and height,
+ *                                on the pool
+ *
+ * Frames are synthetic and seeded (--pattern), so every run on every host
+ * converts the same pixels, or come from a raw BGRA file (--input), such
+ * as one recorded with --capture --record.
+ *
+ * Each case converts for at least --time seconds after a warm-up frame
+ * and reports the median frame: megapixels per second, cycles per pixel
+ * and the bytes read plus written per frame.  Cycles are time-stamp
+ * counter ticks (x86 only), which run at the nominal clock whatever the
+ * boost, so they compare code rather than machines.
+ *
+ * --verify checks instead of timing: every kernel, on one thread and on
+ * the pool, with padded rows and through frame_convert_rects(), must
+ * produce exactly the output of the BT.601 reference math
+ * (convert_kernels.h) applied pixel by pixel, into every output format.
+ * The "concurrent" path converts every format at once from its own thread
+ * through the shared pool, as one convert thread per output does.
+ * Scaled output is checked against a box average taken pixel by pixel,
+ * then the same reference conversion, and frame_upscale2x() (the
+ * governor's half-resolution path, "half") against nearest-neighbour
+ * enlargement into odd and padded frames; frame_blend_cursor() ("cursor")
+ * against straight-alpha blending of the BT.601 values, pixel by pixel,
+ * with the cursor box hanging off the frame at odd positions.  Frames are
+ * random, edge cases (black, white, saturated primaries, 0/255 patterns)
+ * and odd sizes around the SIMD widths; the maximum error per plane is
+ * reported and any difference fails the run.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include "platform.h"
+#include "getopt_win.h"
+#else
+#include <getopt.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_CYCLES 1
+#else
+#define HAVE_CYCLES 0
+#endif
+
+#include "capture.h"
+#include "convert.h"
+#include "convert_kernels.h"
+#include "stats.h"
+#include "workers.h"
+
+#define MAX_INPUT_FRAMES 16
+
+#if defined(__x86_64__)
+#define ARCH "x86_64"
+#elif defined(__i386__)
+#define ARCH "x86"
+#elif defined(__aarch64__)
+#define ARCH "arm64"
+#else
+#define ARCH "other"
+#endif
+
+static const struct {
+    const char *name;
+    int         width;
+    int         height;
+} presets[] = {
+    { "720p",  1280,  720 },
+    { "1080p", 1920, 1080 },
+    { "1440p", 2560, 1440 },
+    { "4k",    3840, 2160 },
+    { "8k",    7680, 4320 },
+};
+
+#define NPRESETS  (int)(sizeof(presets) / sizeof(presets[0]))
+#define MAX_SIZES 16
+
+static const char *kernel_names[] = { "avx2", "sse4.1", "neon", "scalar" };
+
+#if defined(_WIN32)
+static const char *backends[] = { "dxgi" };
+#elif defined(__APPLE__)
+static const char *backends[] = { "screencapturekit" };
+#else
+static const char *backends[] = { "x11", "pipewire" };
+#endif
+
+typedef struct {
+    int         sizes[MAX_SIZES][2];
+    int         nsizes;
+    pix_fmt_t   format;
+    const char *pattern;     /* "noise", "desktop", "gradient" or "all" */
+    const char *input;       /* raw BGRA frames instead of a pattern */
+    int         threads;
+    double      seconds;     /* per case */
+    int         json;
+
+    int         verify;      /* golden-output check instead of timing */
+    int         capture;     /* capture-only mode */
+    const char *backend;     /* Linux: just this one */
+    const char *record;      /* write the grabbed frames here */
+    int         frames;      /* grabs per backend, random frames per check */
+} bench_opts_t;
+
+/* A frame's cost, as measured */
+typedef struct {
+    uint64_t ns;
+    uint64_t cycles;
+} sample_t;
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint64_t cycles_now(void)
+{
+#if HAVE_CYCLES
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* ── Frame corpora ─────────────────────────────────────────── */
+
+static uint32_t xorshift(uint32_t *s)
+{
+    *s ^= *s << 13;
+    *s ^= *s >> 17;
+    *s ^= *s << 5;
+    return *s;
+}
+
+static void put(uint8_t *px, uint32_t rgb)
+{
+    px[0] = (uint8_t)rgb;
+    px[1] = (uint8_t)(rgb >> 8);
+    px[2] = (uint8_t)(rgb >> 16);
+    px[3] = 255;
+}
+
+/*
+ * Fill a width x height BGRA frame with a reproducible picture:
+ *   noise     every pixel random (nothing for caches or predictors to win)
+ *   desktop   flat windows over a backdrop, with runs of dark/light "text"
+ *   gradient  smooth ramps in all three channels
+ */
+static void fill_pattern(uint8_t *buf, int width, int height, const char *pattern)
+{
+    uint32_t seed = 0x5eed2cafu;
+    size_t stride = (size_t)width * 4;
+
+    if (strcmp(pattern, "noise") == 0) {
+        for (size_t i = 0; i < stride * height; i += 4)
+            put(buf + i, xorshift(&seed));
+        return;
+    }
+    if (strcmp(pattern, "gradient") == 0) {
+        for (int j = 0; j < height; j++) {
+            for (int i = 0; i < width; i++) {
+                uint32_t r = (uint32_t)(i * 255 / (width - 1));
+                uint32_t g = (uint32_t)(j * 255 / (height - 1));
+                uint32_t b = (uint32_t)((i + j) * 255 / (width + height - 2));
+                put(buf + (size_t)j * stride + (size_t)i * 4, r << 16 | g << 8 | b);
+            }
+        }
+        return;
+    }
+
+    /* desktop */
+    for (size_t i = 0; i < stride * height; i += 4)
+        put(buf + i, 0x204060);
+    for (int n = 0; n < 12; n++) {
+        int w = width / 8 + (int)(xorshift(&seed) % (uint32_t)(width / 3));
+        int h = height / 8 + (int)(xorshift(&seed) % (uint32_t)(height / 3));
+        int x = (int)(xorshift(&seed) % (uint32_t)(width - w));
+        int y = (int)(xorshift(&seed) % (uint32_t)(height - h));
+        uint32_t fill = 0xc0c0c0 | (xorshift(&seed) & 0x3f3f3f);
+        for (int j = y; j < y + h; j++) {
+            /* Every other line of 16 rows carries text: short random runs */
+            int text = ((j - y) / 16) % 2 && (j - y) % 16 < 12;
+            uint32_t run = 0, ink = 0;
+            for (int i = x; i < x + w; i++) {
+                if (text && run-- == 0) {
+                    run = xorshift(&seed) % 4;
+                    ink = xorshift(&seed) & 1;
+                }
+                put(buf + (size_t)j * stride + (size_t)i * 4, text && ink ? 0x101010 : fill);
+            }
+        }
+    }
+}
+
+/* Up to MAX_INPUT_FRAMES frames of width x height BGRA from path. */
+static int load_input(const char *path, int width, int height, uint8_t **frames)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    size_t size = (size_t)width * height * 4;
+    int n = 0;
+    while (n < MAX_INPUT_FRAMES) {
+        uint8_t *buf = malloc(size);
+        if (!buf || fread(buf, 1, size, f) != size) {
+            free(buf);
+            break;
+        }
+        frames[n++] = buf;
+    }
+    fclose(f);
+    if (n == 0)
+        fprintf(stderr, "bench: %s holds no whole %dx%d BGRA frame\n", path, width, height);
+    return n > 0 ? n : -1;
+}
+
+/* ── Conversion cases ──────────────────────────────────────── */
+
+static int cmp_sample(const void *a, const void *b)
+{
+    uint64_t x = ((const sample_t *)a)->ns, y = ((const sample_t *)b)->ns;
+    return x < y ? -1 : x > y;
+}
+
+typedef struct {
+    const char *impl;
+    const char *detected;    /* what convert_init() picked */
+    const char *pattern;
+    int         threads;
+    frame_t    *src;         /* corpus */
+    int         nsrc;
+    frame_t     dst;
+    scaler_t   *scaler;      /* "scaled" case */
+} convert_case_t;
+
+static void print_header(const bench_opts_t *o)
+{
+    if (o->json)
+        return;
+    printf("%-8s %-8s %-9s %-9s %-23s %3s %9s %7s %8s %12s\n", "bench", "format",
+           "pattern", "impl", "size", "thr", "MP/s", "cyc/px", "ms", "bytes/frame");
+}
+
+static void run_convert(const bench_opts_t *o, convert_case_t *c)
+{
+    int w = c->src[0].width, h = c->src[0].height;
+    size_t cap = 64, n = 0;
+    sample_t *s = malloc(cap * sizeof(*s));
+    if (!s)
+        return;
+
+    /* One warm-up frame: page faults, pool wakeup, scaler tables */
+    uint64_t start = now_ns(), end = start + (uint64_t)(o->seconds * 1e9);
+    for (int i = -1; i < 3 || now_ns() < end; i++) {
+        const frame_t *src = &c->src[(i < 0 ? 0 : i) % c->nsrc];
+        uint64_t t0 = now_ns(), c0 = cycles_now();
+        if (c->scaler)
+            frame_scale_convert(c->scaler, src, &c->dst);
+        else
+            frame_convert(src, &c->dst);
+        uint64_t c1 = cycles_now(), t1 = now_ns();
+        if (i < 0)
+            continue;
+
+        if (n == cap) {
+            sample_t *grown = realloc(s, 2 * cap * sizeof(*s));
+            if (!grown)
+                break;
+            s = grown;
+            cap *= 2;
+        }
+        s[n++] = (sample_t){ t1 - t0, c1 - c0 };
+    }
+
+    qsort(s, n, sizeof(*s), cmp_sample);
+    sample_t med = s[n / 2];
+    double ms    = (double)med.ns / 1e6;
+    double mps   = (double)w * h / ((double)med.ns / 1e9) / 1e6;
+    double cpp   = (double)med.cycles / ((double)w * h);
+    size_t bytes = (size_t)w * h * 4 +
+                   pix_fmt_frame_size(o->format, c->dst.width, c->dst.height);
+
+    if (o->json) {
+        printf("{\"bench\":\"convert\",\"impl\":\"%s\",\"format\":\"%s\",\"pattern\":\"%s\","
+               "\"arch\":\"" ARCH "\",\"detected\":\"%s\",\"width\":%d,\"height\":%d,"
+               "\"out_width\":%d,\"out_height\":%d,\"threads\":%d,\"frames\":%lu,"
+               "\"ms_median\":%.4f,\"ms_min\":%.4f,\"mps\":%.1f,",
+               c->impl, pix_fmt_name(o->format), c->pattern, c->detected,
+               w, h, c->dst.width, c->dst.height, c->threads, (unsigned long)n,
+               ms, (double)s[0].ns / 1e6, mps);
+        if (HAVE_CYCLES)
+            printf("\"cycles_per_px\":%.3f,", cpp);
+        else
+            printf("\"cycles_per_px\":null,");
+        printf("\"bytes_per_frame\":%lu}\n", (unsigned long)bytes);
+    } else {
+        char size[32];
+        if (c->scaler)
+            snprintf(size, sizeof(size), "%dx%d->%dx%d", w, h, c->dst.width, c->dst.height);
+        else
+            snprintf(size, sizeof(size), "%dx%d", w, h);
+        printf("%-8s %-8s %-9s %-9s %-23s %3d %9.1f ", "convert", pix_fmt_name(o->format),
+               c->pattern, c->impl, size, c->threads, mps);
+        if (HAVE_CYCLES)
+            printf("%7.2f", cpp);
+        else
+            printf("%7s", "-");
+        printf(" %8.3f %12lu\n", ms, (unsigned long)bytes);
+    }
+    fflush(stdout);
+    free(s);
+}
+
+/* Every case for one corpus of width x height frames. */
+static int bench_size(const bench_opts_t *o, frame_t *src, int nsrc, const char *pattern,
+                      const char *detected)
+{
+    int w = src[0].width, h = src[0].height;
+    int sw = (w / 2) & ~1, sh = (h / 2) & ~1;
+    uint8_t *out = malloc(pix_fmt_frame_size(o->format, w, h));
+    if (!out) {
+        fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+        return -1;
+    }
+
+    convert_case_t c = { .detected = detected, .pattern = pattern, .src = src,
+                         .nsrc = nsrc, .threads = 1 };
+    frame_init(&c.dst, o->format, w, h, out);
+
+    /* Each kernel on its own, one thread */
+    convert_set_threads(1);
+    for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); k++) {
+        if (convert_use_kernel(kernel_names[k]) < 0)
+            continue;
+        c.impl = kernel_names[k];
+        run_convert(o, &c);
+    }
+    convert_use_kernel(detected);
+
+    /* The detected kernel on the pool, then scaling on the pool */
+    if (convert_set_threads(o->threads) < 0)
+        goto out;
+    c.threads = o->threads;
+    if (o->threads > 1) {
+        c.impl = "threads";
+        run_convert(o, &c);
+    }
+
+    c.impl = "scaled";
+    c.scaler = scaler_create(w, h, sw, sh);
+    if (c.scaler) {
+        frame_init(&c.dst, o->format, sw, sh, out);
+        run_convert(o, &c);
+        scaler_free(c.scaler);
+    }
+
+out:
+    free(out);
+    return 0;
+}
+
+static int bench_convert(const bench_opts_t *o)
+{
+    const char *detected = convert_kernel_name();
+    const char *patterns[] = { "desktop", "noise", "gradient" };
+    int all = strcmp(o->pattern, "all") == 0;
+
+    print_header(o);
+    for (int i = 0; i < o->nsizes; i++) {
+        int w = o->sizes[i][0], h = o->sizes[i][1];
+        uint8_t *bufs[MAX_INPUT_FRAMES];
+        frame_t src[MAX_INPUT_FRAMES];
+
+        if (o->input) {
+            int n = load_input(o->input, w, h, bufs);
+            if (n < 0)
+                return 1;
+            for (int j = 0; j < n; j++)
+                frame_init(&src[j], PIX_FMT_BGRA, w, h, bufs[j]);
+            bench_size(o, src, n, "input", detected);
+            for (int j = 0; j < n; j++)
+                free(bufs[j]);
+            continue;
+        }
+
+        bufs[0] = malloc((size_t)w * h * 4);
+        if (!bufs[0]) {
+            fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+            return 1;
+        }
+        frame_init(&src[0], PIX_FMT_BGRA, w, h, bufs[0]);
+        for (int p = 0; p < 3; p++) {
+            if (!all && strcmp(o->pattern, patterns[p]) != 0)
+                continue;
+            fill_pattern(bufs[0], w, h, patterns[p]);
+            bench_size(o, src, 1, patterns[p], detected);
+        }
+        free(bufs[0]);
+    }
+    return 0;
+}
+
+/* ── Capture-only mode ─────────────────────────────────────── */
+
+/* Write the w x h BGRA pixels of f, tightly packed (a --input corpus). */
+static void record_frame(FILE *out, const frame_t *f)
+{
+    for (int j = 0; j < f->height; j++)
+        fwrite(f->planes[0] + (size_t)j * f->strides[0], 4, (size_t)f->width, out);
+}
+
+static int bench_capture(const bench_opts_t *o)
+{
+    FILE *rec = NULL;
+    if (o->record) {
+        rec = fopen(o->record, "wb");
+        if (!rec) {
+            perror(o->record);
+            return 1;
+        }
+    }
+
+    if (!o->json)
+        printf("%-8s %-17s %-11s %7s %9s %8s %8s %8s %12s\n", "bench", "backend", "size",
+               "frames", "MP/s", "p50 ms", "p99 ms", "max ms", "bytes/frame");
+
+    int ran = 0;
+    for (size_t b = 0; b < sizeof(backends) / sizeof(backends[0]); b++) {
+#if !defined(_WIN32) && !defined(__APPLE__)
+        if (o->backend && strcmp(o->backend, backends[b]) != 0)
+            continue;
+        capture_target_t target = { .monitor = -1, .backend = backends[b] };
+#else
+        capture_target_t target = { .monitor = -1 };
+#endif
+        capture_ctx_t *cap = capture_init(&target);
+        if (!cap) {
+            fprintf(stderr, "bench: %s capture unavailable, skipped\n", backends[b]);
+            continue;
+        }
+
+        int w = capture_width(cap), h = capture_height(cap);
+        static stats_hist_t hist;
+        static stats_dist_t d;
+        stats_init(&hist);
+
+        int n = 0;
+        capture_grab(cap);   /* warm-up: first frame, buffer setup */
+        for (int i = 0; i < o->frames; i++) {
+            uint64_t t0 = now_ns();
+            const frame_t *f = capture_grab(cap);
+            uint64_t t1 = now_ns();
+            if (!f)
+                continue;
+            stats_record(&hist, t1 - t0);
+            n++;
+            if (rec && f->format == PIX_FMT_BGRA)
+                record_frame(rec, f);
+        }
+        capture_free(cap);
+        ran = 1;
+
+        stats_read(&hist, &d);
+        double mean = d.count ? (double)d.sum_ns / (double)d.count : 0;
+        double mps  = mean > 0 ? (double)w * h / (mean / 1e9) / 1e6 : 0;
+        double p50  = stats_quantile(&d, 0.5) / 1e6;
+        double p99  = stats_quantile(&d, 0.99) / 1e6;
+        double max  = stats_quantile(&d, 1.0) / 1e6;
+        unsigned long bytes = (unsigned long)w * h * 4;
+
+        if (o->json) {
+            printf("{\"bench\":\"capture\",\"impl\":\"%s\",\"arch\":\"" ARCH "\","
+                   "\"width\":%d,\"height\":%d,\"frames\":%d,\"ms_mean\":%.4f,"
+                   "\"ms_p50\":%.4f,\"ms_p99\":%.4f,\"ms_max\":%.4f,\"mps\":%.1f,"
+                   "\"bytes_per_frame\":%lu}\n",
+                   backends[b], w, h, n, mean / 1e6, p50, p99, max, mps, bytes);
+        } else {
+            char size[24];
+            snprintf(size, sizeof(size), "%dx%d", w, h);
+            printf("%-8s %-17s %-11s %7d %9.1f %8.3f %8.3f %8.3f %12lu\n", "capture",
+                   backends[b], size, n, mps, p50, p99, max, bytes);
+        }
+        fflush(stdout);
+    }
+
+    if (rec) {
+        fclose(rec);
+        fprintf(stderr, "bench: frames recorded to %s (use with --input and --sizes)\n",
+                o->record);
+    }
+    return ran ? 0 : 1;
+}
+
+/* ── Golden-output check (--verify) ────────────────────────── */
+
+#define GUARD  64     /* bytes after every output buffer that must stay untouched */
+#define POISON 0xa5
+
+static const pix_fmt_t verify_formats[] = {
+    PIX_FMT_YUV420P, PIX_FMT_NV12, PIX_FMT_YUYV, PIX_FMT_BGRA, PIX_FMT_RGB24, PIX_FMT_RGBA
+};
+#define NFORMATS (int)(sizeof(verify_formats) / sizeof(verify_formats[0]))
+
+/* Sizes every check runs on: tiny, odd, and around SIMD and chunk widths */
+static const int verify_sizes[][2] = {
+    { 1, 1 }, { 2, 2 }, { 3, 1 }, { 1, 3 }, { 3, 3 }, { 15, 7 }, { 16, 2 }, { 17, 5 },
+    { 31, 9 }, { 32, 32 }, { 33, 17 }, { 63, 3 }, { 64, 64 }, { 65, 11 }, { 511, 4 },
+    { 512, 3 }, { 513, 6 }, { 1023, 5 }, { 1025, 2 }, { 1920, 1080 },
+};
+#define NVSIZES (int)(sizeof(verify_sizes) / sizeof(verify_sizes[0]))
+
+#define NPATTERNS 6
+
+/* Results of one kernel, path and format over all frames */
+typedef struct {
+    const char *impl;
+    const char *path;
+    pix_fmt_t   format;
+    int         cases;
+    int         failed;
+    int         max_err[3];
+    char        first[80];   /* the first failing frame */
+} verify_row_t;
+
+typedef struct {
+    verify_row_t rows[192];
+    int          nrows;
+} verify_t;
+
+static verify_row_t *verify_row(verify_t *v, const char *impl, const char *path,
+                                pix_fmt_t fmt)
+{
+    for (int i = 0; i < v->nrows; i++) {
+        verify_row_t *r = &v->rows[i];
+        if (r->format == fmt && strcmp(r->impl, impl) == 0 && strcmp(r->path, path) == 0)
+            return r;
+    }
+    if (v->nrows == (int)(sizeof(v->rows) / sizeof(v->rows[0])))
+        return NULL;
+    verify_row_t *r = &v->rows[v->nrows++];
+    *r = (verify_row_t){ .impl = impl, .path = path, .format = fmt };
+    return r;
+}
+
+/* Frame `index` of a check: fixed sizes first, then random ones. */
+static void verify_size(int index, int *w, int *h)
+{
+    if (index < NVSIZES) {
+        *w = verify_sizes[index][0];
+        *h = verify_sizes[index][1];
+        return;
+    }
+    uint32_t seed = 0x9e3779b9u * (uint32_t)(index + 1);
+    *w = 1 + (int)(xorshift(&seed) % 300);
+    *h = 1 + (int)(xorshift(&seed) % 80);
+}
+
+static const char *verify_pattern_name(int p)
+{
+    static const char *names[NPATTERNS] = {
+        "random", "black", "white", "primaries", "checker", "extremes"
+    };
+    return names[p];
+}
+
+/*
+ * BGRA pixels for pattern p: random, black, white, saturated primaries
+ * and secondaries, a 0/255 checkerboard, and random 0-or-255 channels
+ * (where clamping and rounding go wrong first).
+ */
+static void verify_fill(const frame_t *f, int p, uint32_t seed)
+{
+    static const uint32_t primaries[] = {
+        0xff0000, 0x00ff00, 0x0000ff, 0xffff00, 0xff00ff, 0x00ffff, 0xffffff, 0x000000
+    };
+    seed |= 1;
+    for (int j = 0; j < f->height; j++) {
+        uint8_t *row = f->planes[0] + (size_t)j * f->strides[0];
+        for (int i = 0; i < f->width; i++) {
+            uint8_t *px = row + (size_t)i * 4;
+            uint32_t r = xorshift(&seed);
+            switch (p) {
+            case 0: memcpy(px, &r, 4); continue;
+            case 1: put(px, 0x000000); break;
+            case 2: put(px, 0xffffff); break;
+            case 3: put(px, primaries[(i / 3 + j) % 8]); break;
+            case 4: put(px, (i + j) & 1 ? 0xffffff : 0x000000); break;
+            default:
+                px[0] = r & 1 ? 255 : 0;
+                px[1] = r & 2 ? 255 : 0;
+                px[2] = r & 4 ? 255 : 0;
+                px[3] = r & 8 ? 255 : 0;
+                continue;
+            }
+        }
+    }
+}
+
+/* The reference: BT.601 per pixel, chroma from the top-left of each pair/block. */
+static void golden_convert(const frame_t *src, frame_t *dst)
+{
+    int w = src->width, h = src->height;
+
+    for (int j = 0; j < h; j++) {
+        const uint8_t *row = src->planes[0] + (size_t)j * src->strides[0];
+        uint8_t *out = dst->planes[0] + (size_t)j * dst->strides[0];
+        for (int i = 0; i < w; i++) {
+            const uint8_t *px = row + (size_t)i * 4;
+            int r = px[2], g = px[1], b = px[0];
+            int c420 = !(i & 1) && !(j & 1);
+
+            switch (dst->format) {
+            case PIX_FMT_YUV420P:
+                out[i] = bt601_y(r, g, b);
+                if (c420) {
+                    dst->planes[1][(size_t)(j / 2) * dst->strides[1] + i / 2] = bt601_u(r, g, b);
+                    dst->planes[2][(size_t)(j / 2) * dst->strides[2] + i / 2] = bt601_v(r, g, b);
+                }
+                break;
+            case PIX_FMT_NV12:
+                out[i] = bt601_y(r, g, b);
+                if (c420) {
+                    uint8_t *uv = dst->planes[1] + (size_t)(j / 2) * dst->strides[1] + i;
+                    uv[0] = bt601_u(r, g, b);
+                    uv[1] = bt601_v(r, g, b);
+                }
+                break;
+            case PIX_FMT_YUYV:
+                out[2 * i] = bt601_y(r, g, b);
+                if (i & 1)
+                    out[2 * i + 1] = bt601_v(px[-2], px[-3], px[-4]);
+                else
+                    out[2 * i + 1] = i + 1 < w ? bt601_u(r, g, b) : 128;
+                break;
+            case PIX_FMT_BGRA:
+                memcpy(out + 4 * i, px, 4);
+                break;
+            case PIX_FMT_RGBA:
+                out[4 * i] = px[2], out[4 * i + 1] = px[1];
+                out[4 * i + 2] = px[0], out[4 * i + 3] = px[3];
+                break;
+            default:
+                out[3 * i] = px[2], out[3 * i + 1] = px[1], out[3 * i + 2] = px[0];
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * Box-average src (BGRA) into dst (BGRA) the way the scaler defines it:
+ * output pixel i covers source [i * src / dst, (i + 1) * src / dst), at
+ * least one pixel, and the sum is divided by the 16-bit fixed-point
+ * reciprocal of the pixel count, rounded.  Sums every box afresh.
+ */
+static void golden_scale(const frame_t *src, frame_t *dst)
+{
+    for (int j = 0; j < dst->height; j++) {
+        int y0 = (int)((long long)j * src->height / dst->height);
+        int y1 = (int)((long long)(j + 1) * src->height / dst->height);
+        if (y1 <= y0)
+            y1 = y0 + 1;
+        for (int i = 0; i < dst->width; i++) {
+            int x0 = (int)((long long)i * src->width / dst->width);
+            int x1 = (int)((long long)(i + 1) * src->width / dst->width);
+            if (x1 <= x0)
+                x1 = x0 + 1;
+            uint32_t sum[4] = { 0, 0, 0, 0 };
+            for (int y = y0; y < y1; y++) {
+                const uint8_t *px = src->planes[0] + (size_t)y * src->strides[0] + (size_t)x0 * 4;
+                for (int x = x0; x < x1; x++, px += 4) {
+                    for (int c = 0; c < 4; c++)
+                        sum[c] += px[c];
+                }
+            }
+            uint32_t n = (uint32_t)((x1 - x0) * (y1 - y0));
+            uint32_t m = (65536u + n / 2) / n;
+            uint8_t *out = dst->planes[0] + (size_t)j * dst->strides[0] + (size_t)i * 4;
+            for (int c = 0; c < 4; c++)
+                out[c] = (uint8_t)((sum[c] * m + 32768) >> 16);
+        }
+    }
+}
+
+/* An output buffer of size bytes plus GUARD, all poisoned. */
+static uint8_t *alloc_poisoned(size_t size)
+{
+    uint8_t *p = malloc(size + GUARD);
+    if (p)
+        memset(p, POISON, size + GUARD);
+    return p;
+}
+
+/*
+ * Compare the pixels of a and b plane by plane into err; returns the
+ * number of differing bytes, or -1 if b's buffer (size bytes) was
+ * written past its end.
+ */
+static long verify_compare(const frame_t *a, const frame_t *b, const uint8_t *buf,
+                           size_t size, int err[3])
+{
+    for (size_t i = size; i < size + GUARD; i++) {
+        if (buf[i] != POISON)
+            return -1;
+    }
+
+    long bad = 0;
+    for (int p = 0; p < pix_fmt_planes(a->format); p++) {
+        size_t row_bytes;
+        int rows;
+        pix_fmt_plane(a->format, a->width, a->height, p, &row_bytes, &rows);
+        for (int j = 0; j < rows; j++) {
+            const uint8_t *x = a->planes[p] + (size_t)j * a->strides[p];
+            const uint8_t *y = b->planes[p] + (size_t)j * b->strides[p];
+            for (size_t k = 0; k < row_bytes; k++) {
+                int d = abs(x[k] - y[k]);
+                if (d > err[p])
+                    err[p] = d;
+                bad += d != 0;
+            }
+        }
+    }
+    return bad;
+}
+
+static void verify_note(verify_row_t *row, long bad, int w, int h, int pattern)
+{
+    row->cases++;
+    if (bad == 0)
+        return;
+    if (row->failed++ == 0)
+        snprintf(row->first, sizeof(row->first), "%dx%d %s: %s", w, h,
+                 verify_pattern_name(pattern),
+                 bad < 0 ? "wrote past the buffer" : "pixels differ");
+}
+
+/* Random even-aligned rects in a w x h frame, clipped at its edges. */
+static int verify_rects(int w, int h, uint32_t seed, dirty_rect_t *rects)
+{
+    int n = 1 + (int)(xorshift(&seed) % 4);
+    for (int i = 0; i < n; i++) {
+        dirty_rect_t *r = &rects[i];
+        r->x = (int)(xorshift(&seed) % (uint32_t)((w + 1) / 2)) * 2;
+        r->y = (int)(xorshift(&seed) % (uint32_t)((h + 1) / 2)) * 2;
+        r->w = 2 + (int)(xorshift(&seed) % (uint32_t)(w / 2 + 1)) * 2;
+        r->h = 2 + (int)(xorshift(&seed) % (uint32_t)(h / 2 + 1)) * 2;
+        if (r->w > w - r->x) r->w = w - r->x;
+        if (r->h > h - r->y) r->h = h - r->y;
+    }
+    return n;
+}
+
+/*
+ * One frame through one path with the active kernel, checked against
+ * golden_convert().  Paths: "full" and "threads" (frame_convert),
+ * "strided" (padded source and output rows) and "rects"
+ * (frame_convert_rects over a frame that changed only in the rects).
+ */
+static int verify_frame(verify_row_t *row, const char *path, pix_fmt_t fmt,
+                        int w, int h, int pattern, uint32_t seed)
+{
+    int strided = strcmp(path, "strided") == 0;
+    int rects   = strcmp(path, "rects") == 0;
+    size_t pad  = strided ? 4 * (1 + seed % 7) : 0;
+
+    frame_t src;
+    size_t src_stride = (size_t)w * 4 + pad;
+    uint8_t *src_buf = malloc(src_stride * h);
+    size_t row_bytes;
+    int nrows;
+    pix_fmt_plane(fmt, w, h, 0, &row_bytes, &nrows);
+    size_t dst_stride = strided ? row_bytes + 2 * (1 + seed % 16) : 0;
+    size_t size = pix_fmt_strided_size(fmt, w, h, dst_stride);
+    uint8_t *want_buf = alloc_poisoned(size), *got_buf = alloc_poisoned(size);
+    if (!src_buf || !want_buf || !got_buf) {
+        free(src_buf);
+        free(want_buf);
+        free(got_buf);
+        fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+        return -1;
+    }
+
+    frame_init(&src, PIX_FMT_BGRA, w, h, src_buf);
+    src.strides[0] = src_stride;
+    verify_fill(&src, pattern, seed);
+
+    frame_t want, got;
+    frame_init_strided(&want, fmt, w, h, want_buf, dst_stride);
+    frame_init_strided(&got, fmt, w, h, got_buf, dst_stride);
+
+    if (rects) {
+        /* Start from the whole frame, then change only the rects */
+        dirty_rect_t r[4];
+        int n = verify_rects(w, h, seed, r);
+        frame_convert(&src, &got);
+        for (int i = 0; i < n; i++) {
+            frame_t area;
+            frame_crop(&src, r[i].x, r[i].y, r[i].w, r[i].h, &area);
+            verify_fill(&area, 0, seed + (uint32_t)i);
+        }
+        frame_convert_rects(&src, &got, r, n);
+    } else {
+        frame_convert(&src, &got);
+    }
+    golden_convert(&src, &want);
+
+    long bad = verify_compare(&want, &got, got_buf, size, row->max_err);
+    verify_note(row, bad, w, h, pattern);
+    free(src_buf);
+    free(want_buf);
+    free(got_buf);
+    return 0;
+}
+
+/* Scaled output of the active kernel against golden_scale() + golden_convert(). */
+static int verify_scaled(verify_row_t *row, pix_fmt_t fmt, int w, int h, int pattern,
+                         uint32_t seed)
+{
+    int dw = 2 + (int)(seed % (uint32_t)(w + 1)) / 2 * 2;
+    int dh = 2 + (int)(seed / 7 % (uint32_t)(h + 1)) / 2 * 2;
+    scaler_t *sc = scaler_create(w, h, dw, dh);
+    if (!sc)
+        return 0;
+
+    size_t size = pix_fmt_frame_size(fmt, dw, dh);
+    uint8_t *src_buf = malloc((size_t)w * h * 4);
+    uint8_t *box_buf = malloc((size_t)dw * dh * 4);
+    uint8_t *want_buf = alloc_poisoned(size), *got_buf = alloc_poisoned(size);
+    if (!src_buf || !box_buf || !want_buf || !got_buf) {
+        free(src_buf);
+        free(box_buf);
+        free(want_buf);
+        free(got_buf);
+        scaler_free(sc);
+        fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+        return -1;
+    }
+
+    frame_t src, box, want, got;
+    frame_init(&src, PIX_FMT_BGRA, w, h, src_buf);
+    frame_init(&box, PIX_FMT_BGRA, dw, dh, box_buf);
+    frame_init(&want, fmt, dw, dh, want_buf);
+    frame_init(&got, fmt, dw, dh, got_buf);
+    verify_fill(&src, pattern, seed);
+
+    golden_scale(&src, &box);
+    golden_convert(&box, &want);
+    frame_scale_convert(sc, &src, &got);
+
+    long bad = verify_compare(&want, &got, got_buf, size, row->max_err);
+    verify_note(row, bad, w, h, pattern);
+    free(src_buf);
+    free(box_buf);
+    free(want_buf);
+    free(got_buf);
+    scaler_free(sc);
+    return 0;
+}
+
+/*
+ * Enlarge src 2x into dst pixel by pixel: every output sample is the
+ * source sample at half its coordinates, per plane.  YUYV pairs take the
+ * chroma of the one source pixel both map to (V 128 if it had none).
+ */
+static void golden_upscale(const frame_t *src, frame_t *dst)
+{
+    int w = dst->width, h = dst->height, cw = (w + 1) / 2, ch = (h + 1) / 2;
+    int dims[3][3];   /* per plane: width in samples, rows, bytes per sample */
+    int planes = 1;
+
+    switch (dst->format) {
+    case PIX_FMT_YUV420P:
+        planes = 3;
+        memcpy(dims, (int[3][3]){ { w, h, 1 }, { cw, ch, 1 }, { cw, ch, 1 } }, sizeof(dims));
+        break;
+    case PIX_FMT_NV12:
+        planes = 2;
+        memcpy(dims, (int[3][3]){ { w, h, 1 }, { cw, ch, 2 } }, sizeof(dims));
+        break;
+    case PIX_FMT_YUYV:
+        for (int y = 0; y < h; y++) {
+            const uint8_t *in = src->planes[0] + (size_t)(y / 2) * src->strides[0];
+            uint8_t *out = dst->planes[0] + (size_t)y * dst->strides[0];
+            for (int x = 0; x < w; x++) {
+                int m = x / 2;                                  /* source pixel */
+                out[2 * x] = in[2 * m];
+                if (x & 1)
+                    out[2 * x + 1] = (m | 1) < src->width ? in[(m / 2) * 4 + 3] : 128;
+                else
+                    out[2 * x + 1] = in[(m / 2) * 4 + 1];
+            }
+        }
+        return;
+    case PIX_FMT_RGB24:
+        memcpy(dims, (int[3][3]){ { w, h, 3 } }, sizeof(dims));
+        break;
+    default:
+        memcpy(dims, (int[3][3]){ { w, h, 4 } }, sizeof(dims));
+        break;
+    }
+
+    for (int p = 0; p < planes; p++) {
+        int n = dims[p][2];
+        for (int y = 0; y < dims[p][1]; y++) {
+            const uint8_t *in = src->planes[p] + (size_t)(y / 2) * src->strides[p];
+            uint8_t *out = dst->planes[p] + (size_t)y * dst->strides[p];
+            for (int x = 0; x < dims[p][0]; x++)
+                memcpy(out + (size_t)x * n, in + (size_t)(x / 2) * n, (size_t)n);
+        }
+    }
+}
+
+/*
+ * frame_upscale2x() of a half-size frame (as the --cpu-budget governor
+ * converts) into an odd- or even-sized, sometimes padded output.
+ */
+static int verify_half(verify_row_t *row, pix_fmt_t fmt, int w, int h, int pattern,
+                       uint32_t seed)
+{
+    int hw = (w + 1) / 2, hh = (h + 1) / 2;
+    size_t row_bytes;
+    int nrows;
+    pix_fmt_plane(fmt, w, h, 0, &row_bytes, &nrows);
+    size_t dst_stride = seed & 1 ? row_bytes + 2 * (1 + seed % 16) : 0;
+    size_t size = pix_fmt_strided_size(fmt, w, h, dst_stride);
+
+    uint8_t *bgra_buf = malloc((size_t)hw * hh * 4);
+    uint8_t *half_buf = malloc(pix_fmt_frame_size(fmt, hw, hh));
+    uint8_t *want_buf = alloc_poisoned(size), *got_buf = alloc_poisoned(size);
+    if (!bgra_buf || !half_buf || !want_buf || !got_buf) {
+        free(bgra_buf);
+        free(half_buf);
+        free(want_buf);
+        free(got_buf);
+        fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+        return -1;
+    }
+
+    frame_t bgra, half, want, got;
+    frame_init(&bgra, PIX_FMT_BGRA, hw, hh, bgra_buf);
+    frame_init(&half, fmt, hw, hh, half_buf);
+    frame_init_strided(&want, fmt, w, h, want_buf, dst_stride);
+    frame_init_strided(&got, fmt, w, h, got_buf, dst_stride);
+    verify_fill(&bgra, pattern, seed);
+    golden_convert(&bgra, &half);
+
+    golden_upscale(&half, &want);
+    frame_upscale2x(&half, &got);
+
+    long bad = verify_compare(&want, &got, got_buf, size, row->max_err);
+    verify_note(row, bad, w, h, pattern);
+    free(bgra_buf);
+    free(half_buf);
+    free(want_buf);
+    free(got_buf);
+    return 0;
+}
+
+static uint8_t golden_mix(int over, int under, int alpha)
+{
+    return (uint8_t)((over * alpha + under * (255 - alpha) + 127) / 255);
+}
+
+/*
+ * Blend a straight-alpha BGRA cursor (image_w x image_h, stretched over
+ * box by nearest sample) onto dst, deciding for every pixel of the frame
+ * whether the box covers it.  Chroma shared by a 2x2 block (4:2:0) or a
+ * pair (YUYV) comes from its top-left pixel; an unpaired last YUYV pixel
+ * has no chroma to blend.
+ */
+static void golden_blend(frame_t *dst, const dirty_rect_t *box, const uint8_t *image,
+                         int image_w, int image_h)
+{
+    for (int y = 0; y < dst->height; y++) {
+        for (int x = 0; x < dst->width; x++) {
+            if (x < box->x || x >= box->x + box->w || y < box->y || y >= box->y + box->h)
+                continue;
+            const uint8_t *s = image + ((size_t)((y - box->y) * image_h / box->h) * image_w +
+                                        (size_t)((x - box->x) * image_w / box->w)) * 4;
+            int b = s[0], g = s[1], r = s[2], a = s[3];
+            if (a == 0)
+                continue;
+            uint8_t *row = dst->planes[0] + (size_t)y * dst->strides[0];
+            int top_left = !(x & 1) && !(y & 1);
+            uint8_t *c;
+
+            switch (dst->format) {
+            case PIX_FMT_YUV420P:
+            case PIX_FMT_NV12:
+                row[x] = golden_mix(bt601_y(r, g, b), row[x], a);
+                if (!top_left)
+                    break;
+                if (dst->format == PIX_FMT_NV12) {
+                    c = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + (x / 2) * 2;
+                    c[0] = golden_mix(bt601_u(r, g, b), c[0], a);
+                    c[1] = golden_mix(bt601_v(r, g, b), c[1], a);
+                } else {
+                    c = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x / 2;
+                    *c = golden_mix(bt601_u(r, g, b), *c, a);
+                    c = dst->planes[2] + (size_t)(y / 2) * dst->strides[2] + x / 2;
+                    *c = golden_mix(bt601_v(r, g, b), *c, a);
+                }
+                break;
+            case PIX_FMT_YUYV:
+                c = row + (size_t)(x / 2) * 4;
+                c[(x & 1) * 2] = golden_mix(bt601_y(r, g, b), c[(x & 1) * 2], a);
+                if (!(x & 1) && x + 1 < dst->width) {
+                    c[1] = golden_mix(bt601_u(r, g, b), c[1], a);
+                    c[3] = golden_mix(bt601_v(r, g, b), c[3], a);
+                }
+                break;
+            case PIX_FMT_RGB24:
+            case PIX_FMT_RGBA: {
+                int n = dst->format == PIX_FMT_RGB24 ? 3 : 4;
+                c = row + (size_t)x * n;
+                c[0] = golden_mix(r, c[0], a);
+                c[1] = golden_mix(g, c[1], a);
+                c[2] = golden_mix(b, c[2], a);
+                break;
+            }
+            default:
+                c = row + (size_t)x * 4;
+                c[0] = golden_mix(b, c[0], a);
+                c[1] = golden_mix(g, c[1], a);
+                c[2] = golden_mix(r, c[2], a);
+                break;
+            }
+        }
+    }
+}
+
+/*
+ * frame_blend_cursor() of a random cursor, opaque, clear and translucent
+ * pixels mixed, stretched over a box at odd positions that often hangs
+ * off an edge of the frame.
+ */
+static int verify_cursor(verify_row_t *row, pix_fmt_t fmt, int w, int h, int pattern,
+                         uint32_t seed)
+{
+    int iw = 1 + (int)(seed % 32), ih = 1 + (int)(seed / 32 % 32);
+    dirty_rect_t box = {
+        .w = iw * (1 + (int)(seed / 1024 % 2)),
+        .h = ih * (1 + (int)(seed / 2048 % 2)),
+    };
+    box.x = (int)(seed / 4096 % (uint32_t)(w + box.w)) - box.w / 2;
+    box.y = (int)(seed / 65536 % (uint32_t)(h + box.h)) - box.h / 2;
+
+    size_t size = pix_fmt_frame_size(fmt, w, h);
+    uint8_t *src_buf = malloc((size_t)w * h * 4);
+    uint8_t *image = malloc((size_t)iw * ih * 4);
+    uint8_t *want_buf = alloc_poisoned(size), *got_buf = alloc_poisoned(size);
+    if (!src_buf || !image || !want_buf || !got_buf) {
+        free(src_buf);
+        free(image);
+        free(want_buf);
+        free(got_buf);
+        fprintf(stderr, "bench: out of memory at %dx%d\n", w, h);
+        return -1;
+    }
+
+    uint32_t s = seed | 1;
+    for (int i = 0; i < iw * ih; i++) {
+        uint32_t r = xorshift(&s);
+        memcpy(image + (size_t)i * 4, &r, 4);
+        if (i % 3 == 0)
+            image[i * 4 + 3] = i % 2 ? 255 : 0;
+    }
+
+    frame_t src, want, got;
+    frame_init(&src, PIX_FMT_BGRA, w, h, src_buf);
+    frame_init(&want, fmt, w, h, want_buf);
+    frame_init(&got, fmt, w, h, got_buf);
+    verify_fill(&src, pattern, seed);
+    golden_convert(&src, &want);
+    golden_convert(&src, &got);
+
+    golden_blend(&want, &box, image, iw, ih);
+    frame_blend_cursor(&got, &box, image, iw, ih);
+
+    long bad = verify_compare(&want, &got, got_buf, size, row->max_err);
+    verify_note(row, bad, w, h, pattern);
+    free(src_buf);
+    free(image);
+    free(want_buf);
+    free(got_buf);
+    return 0;
+}
+
+/* Every frame of one format through path, with kernel impl. */
+static int verify_frames(const bench_opts_t *o, verify_row_t *row, const char *path)
+{
+    int scaled = strcmp(path, "scaled") == 0 || strcmp(path, "scaled-threads") == 0;
+    int half   = strcmp(path, "half") == 0;
+    int cursor = strcmp(path, "cursor") == 0;
+    for (int i = 0; i < NVSIZES + o->frames; i++) {
+        int w, h;
+        verify_size(i, &w, &h);
+        int pattern = i % NPATTERNS;
+        uint32_t seed = 0x5eed0000u + (uint32_t)i * 2654435761u;
+        int rc = scaled ? verify_scaled(row, row->format, w, h, pattern, seed)
+               : half   ? verify_half(row, row->format, w, h, pattern, seed)
+               : cursor ? verify_cursor(row, row->format, w, h, pattern, seed)
+                        : verify_frame(row, path, row->format, w, h, pattern, seed);
+        if (rc < 0)
+            return -1;
+    }
+    return 0;
+}
+
+/* Every frame of every format through path, with kernel impl. */
+static int verify_path(const bench_opts_t *o, verify_t *v, const char *impl,
+                       const char *path)
+{
+    for (int f = 0; f < NFORMATS; f++) {
+        verify_row_t *row = verify_row(v, impl, path, verify_formats[f]);
+        if (!row || verify_frames(o, row, path) < 0)
+            return -1;
+    }
+    return 0;
+}
+
+typedef struct {
+    const bench_opts_t *o;
+    verify_row_t       *row;
+    int                 rc;
+} verify_job_t;
+
+static void *verify_thread(void *arg)
+{
+    verify_job_t *job = arg;
+    job->rc = verify_frames(job->o, job->row, "threads");
+    return NULL;
+}
+
+/* Every format at once, one thread each, all through the shared pool. */
+static int verify_concurrent(const bench_opts_t *o, verify_t *v, const char *impl)
+{
+    verify_job_t jobs[NFORMATS];
+    pthread_t threads[NFORMATS];
+    int started = 0, rc = 0;
+
+    for (int f = 0; f < NFORMATS; f++) {
+        jobs[f] = (verify_job_t){ o, verify_row(v, impl, "concurrent", verify_formats[f]), 0 };
+        if (!jobs[f].row)
+            return -1;
+    }
+    for (; started < NFORMATS; started++) {
+        if (pthread_create(&threads[started], NULL, verify_thread, &jobs[started]) != 0) {
+            fprintf(stderr, "bench: pthread_create failed\n");
+            rc = -1;
+            break;
+        }
+    }
+    for (int f = 0; f < started; f++) {
+        pthread_join(threads[f], NULL);
+        if (jobs[f].rc < 0)
+            rc = -1;
+    }
+    return rc;
+}
+
+static int bench_verify(const bench_opts_t *o)
+{
+    static verify_t v;
+    const char *detected = convert_kernel_name();
+    int threads = o->threads > 1 ? o->threads : 2;   /* the pool, even on one core */
+
+    for (int phase = 0; phase < 2; phase++) {
+        if (convert_set_threads(phase ? threads : 1) < 0)
+            return 1;
+        for (size_t k = 0; k < sizeof(kernel_names) / sizeof(kernel_names[0]); k++) {
+            const char *impl = kernel_names[k];
+            if (convert_use_kernel(impl) < 0)
+                continue;
+            int rc = phase ? (verify_path(o, &v, impl, "threads") < 0 ||
+                              verify_concurrent(o, &v, impl) < 0) ? -1 : 0 :
+                     (verify_path(o, &v, impl, "full") < 0 ||
+                      verify_path(o, &v, impl, "strided") < 0 ||
+                      verify_path(o, &v, impl, "rects") < 0) ? -1 : 0;
+            if (rc == 0)
+                rc = verify_path(o, &v, impl, phase ? "scaled-threads" : "scaled");
+            if (rc < 0)
+                return 1;
+        }
+    }
+    convert_use_kernel(detected);
+
+    /* Plain C, the same whatever the kernel */
+    if (verify_path(o, &v, "-", "half") < 0 || verify_path(o, &v, "-", "cursor") < 0)
+        return 1;
+
+    int failed = 0;
+    if (!o->json)
+        printf("%-8s %-8s %-15s %-8s %6s %6s  %-13s %s\n", "bench", "impl", "path",
+               "format", "frames", "failed", "max err", "");
+    for (int i = 0; i < v.nrows; i++) {
+        const verify_row_t *r = &v.rows[i];
+        int planes = pix_fmt_planes(r->format);
+        failed += r->failed;
+        if (o->json) {
+            printf("{\"bench\":\"verify\",\"impl\":\"%s\",\"path\":\"%s\",\"format\":\"%s\","
+                   "\"arch\":\"" ARCH "\",\"frames\":%d,\"failed\":%d,\"max_err\":[",
+                   r->impl, r->path, pix_fmt_name(r->format), r->cases, r->failed);
+            for (int p = 0; p < planes; p++)
+                printf("%s%d", p ? "," : "", r->max_err[p]);
+            if (r->failed)
+                printf("],\"first_failure\":\"%s\"}\n", r->first);
+            else
+                printf("],\"first_failure\":null}\n");
+            continue;
+        }
+
+        char err[32];
+        int n = 0;
+        for (int p = 0; p < planes; p++)
+            n += snprintf(err + n, sizeof(err) - (size_t)n, "%s%d", p ? "/" : "", r->max_err[p]);
+        printf("%-8s %-8s %-15s %-8s %6d %6d  %-13s %s\n", "verify", r->impl, r->path,
+               pix_fmt_name(r->format), r->cases, r->failed, err,
+               r->failed ? r->first : "ok");
+    }
+    fflush(stdout);
+
+    if (failed)
+        fprintf(stderr, "bench: verify: %d frames differ from the reference\n", failed);
+    else
+        fprintf(stderr, "bench: verify: every kernel and path matches the reference\n");
+    return failed ? 1 : 0;
+}
+
+/* ── Options ───────────────────────────────────────────────── */
+
+static void usage(const char *prog)
+{
+    fprintf(stderr,
+        "Usage: %s [OPTIONS]\n"
+        "\n"
+        "Benchmark BGRA conversion (every kernel, threaded, scaled) or capture.\n"
+        "\n"
+        "Options:\n"
+        "  -s, --sizes LIST    comma-separated 720p, 1080p, 1440p, 4k, 8k or WxH\n"
+        "                      [720p,1080p,1440p,4k,8k]\n"
+        "  -F, --format FMT    yuv420p, nv12, yuyv, bgra, rgb24 or rgba  [yuv420p]\n"
+        "  -p, --pattern P     synthetic frames: desktop, noise, gradient or all\n"
+        "                      [desktop]\n"
+        "  -i, --input FILE    raw BGRA frames instead (one size with --sizes WxH)\n"
+        "  -t, --threads N     threads for the threaded and scaled cases\n"
+        "                      [physical cores - 1]\n"
+        "  -T, --time SEC      minimum time per case  [0.5]\n"
+        "  -j, --json          one JSON object per result on stdout\n"
+        "  -V, --verify        check every kernel and path against the reference\n"
+        "                      BT.601 math instead; fails on any difference\n"
+        "  -C, --capture       time capture_grab() of each backend instead\n"
+#if !defined(_WIN32) && !defined(__APPLE__)
+        "  -b, --backend B     --capture: only 'x11' or 'pipewire'\n"
+#endif
+        "  -n, --frames N      --capture: frames to grab per backend;\n"
+        "                      --verify: random frames per check  [120]\n"
+        "  -r, --record FILE   --capture: save the frames as raw BGRA for --input\n"
+        "  -h, --help          show this help\n",
+        prog);
+}
+
+static int parse_sizes(char *list, bench_opts_t *o)
+{
+    o->nsizes = 0;
+    for (char *tok = strtok(list, ","); tok; tok = strtok(NULL, ",")) {
+        if (o->nsizes == MAX_SIZES)
+            return -1;
+        int *s = o->sizes[o->nsizes];
+        int found = 0;
+        for (int i = 0; i < NPRESETS && !found; i++) {
+            if (strcmp(tok, presets[i].name) == 0) {
+                s[0] = presets[i].width;
+                s[1] = presets[i].height;
+                found = 1;
+            }
+        }
+        if (!found && (sscanf(tok, "%dx%d", &s[0], &s[1]) != 2 ||
+                       s[0] < 16 || s[1] < 16 || s[0] > 16384 || s[1] > 16384 ||
+                       (s[0] | s[1]) & 1))
+            return -1;
+        o->nsizes++;
+    }
+    return o->nsizes > 0 ? 0 : -1;
+}
+
+int main(int argc, char *argv[])
+{
+    bench_opts_t o = {
+        .format  = PIX_FMT_YUV420P,
+        .pattern = "desktop",
+        .seconds = 0.5,
+        .frames  = 120,
+    };
+    for (int i = 0; i < NPRESETS; i++) {
+        o.sizes[i][0] = presets[i].width;
+        o.sizes[i][1] = presets[i].height;
+    }
+    o.nsizes = NPRESETS;
+
+    static struct option long_opts[] = {
+        { "sizes",   required_argument, NULL, 's' },
+        { "format",  required_argument, NULL, 'F' },
+        { "pattern", required_argument, NULL, 'p' },
+        { "input",   required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, 't' },
+        { "time",    required_argument, NULL, 'T' },
+        { "json",    no_argument,       NULL, 'j' },
+        { "verify",  no_argument,       NULL, 'V' },
+        { "capture", no_argument,       NULL, 'C' },
+        { "backend", required_argument, NULL, 'b' },
+        { "frames",  required_argument, NULL, 'n' },
+        { "record",  required_argument, NULL, 'r' },
+        { "help",    no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:F:p:i:t:T:jVCb:n:r:h", long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            if (parse_sizes(optarg, &o) < 0) {
+                fprintf(stderr, "error: sizes must be 720p, 1080p, 1440p, 4k, 8k or even WxH\n");
+                return 1;
+            }
+            break;
+        case 'F':
+            if (pix_fmt_parse(optarg, &o.format) < 0 || o.format == PIX_FMT_AUTO) {
+                fprintf(stderr, "error: format must be yuv420p, nv12, yuyv, bgra, rgb24 or rgba\n");
+                return 1;
+            }
+            break;
+        case 'p':
+            if (strcmp(optarg, "desktop") && strcmp(optarg, "noise") &&
+                strcmp(optarg, "gradient") && strcmp(optarg, "all")) {
+                fprintf(stderr, "error: pattern must be desktop, noise, gradient or all\n");
+                return 1;
+            }
+            o.pattern = optarg;
+            break;
+        case 'i': o.input = optarg; break;
+        case 't': o.threads = atoi(optarg); break;
+        case 'T': o.seconds = atof(optarg); break;
+        case 'j': o.json = 1; break;
+        case 'V': o.verify = 1; break;
+        case 'C': o.capture = 1; break;
+        case 'b':
+#if !defined(_WIN32) && !defined(__APPLE__)
+            if (strcmp(optarg, "x11") == 0 || strcmp(optarg, "pipewire") == 0) {
+                o.backend = optarg;
+                break;
+            }
+            fprintf(stderr, "error: backend must be 'x11' or 'pipewire'\n");
+#else
+            fprintf(stderr, "error: --backend is only available on Linux\n");
+#endif
+            return 1;
+        case 'n': o.frames = atoi(optarg); break;
+        case 'r': o.record = optarg; break;
+        case 'h': usage(argv[0]); return 0;
+        default:  usage(argv[0]); return 1;
+        }
+    }
+
+    if (o.threads == 0)
+        o.threads = workers_default_threads();
+    if (o.threads < 1 || o.threads > 64) {
+        fprintf(stderr, "error: threads must be 1-64\n");
+        return 1;
+    }
+    if (o.seconds < 0 || o.seconds > 60) {
+        fprintf(stderr, "error: time must be 0-60 seconds\n");
+        return 1;
+    }
+    if (o.frames < 1 || o.frames > 100000) {
+        fprintf(stderr, "error: frames must be 1-100000\n");
+        return 1;
+    }
+    if (o.input && o.nsizes != 1) {
+        fprintf(stderr, "error: --input needs the frame size as --sizes WxH\n");
+        return 1;
+    }
+
+    convert_init();
+    int rc = o.verify  ? bench_verify(&o)
+           : o.capture ? bench_capture(&o) : bench_convert(&o);
+    convert_shutdown();
+    return rc;
+}
@@ -1,4 +1,12 @@
-#include "capture.h"
+/*
+ * Linux X11 capture backend (MIT-SHM, XGetSubImage fallback), one of the
+ * backends behind capture_linux.c.  Neither grab includes the pointer;
+ * with XFixes it is reported apart (capture_cursor) for the pipeline to
+ * draw over the output.
+ */
+
+#include "capture_linux.h"
+#include "pool.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -10,41 +18,261 @@
 #include <sys/shm.h>
 #include <X11/extensions/XShm.h>
 
-struct capture_ctx {
+#ifdef HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#include <X11/extensions/Xfixes.h>
+#endif
+
+#ifdef HAVE_XFIXES
+#include <X11/extensions/Xfixes.h>
+#endif
+
+typedef struct {
     Display        *dpy;
     Window          root;
+    capture_target_t target;      /* what x11_reset() selects again */
+    Drawable        src;          /* root, or the target window */
+    int             src_w, src_h; /* its size, to spot ConfigureNotify resizes */
+    int             x, y;         /* captured area's origin in src */
     int             width;
     int             height;
+    int             lost;         /* src was resized: x11_reset() */
     int             use_shm;
     XShmSegmentInfo shm_info;
     XImage         *img;
-};
+    pool_buf_t     *img_buf;      /* img->data without MIT-SHM */
+    frame_t         frame;        /* describes img for x11_grab() */
 
-capture_ctx_t *capture_init(void)
+#ifdef HAVE_XDAMAGE
+    Damage          damage;       /* 0 if XDamage/XFixes are unavailable */
+    int             damage_event;
+    XserverRegion   region;
+#endif
+    dirty_rect_t   *dirty;
+    int             dirty_count;  /* -1 = whole frame */
+    int             dirty_cap;
+    int             grabbed;      /* at least one frame captured */
+
+#ifdef HAVE_XFIXES
+    /* The pointer, which XShmGetImage/XGetImage leave out */
+    int             fixes_event;  /* -1 if XFixes is unavailable */
+    int             cursor_stale; /* shape changed since it was read */
+    uint8_t        *cursor_image; /* BGRA, straight alpha */
+    int             cursor_w, cursor_h;
+    int             hot_x, hot_y;
+    uint32_t        cursor_serial;
+#endif
+} x11_ctx_t;
+
+/*
+ * Collect what changed since the last grab.  Called *before* reading the
+ * image, so anything drawn in between is reported again next time rather
+ * than lost.
+ */
+static void collect_damage(x11_ctx_t *ctx)
 {
-    capture_ctx_t *ctx = calloc(1, sizeof(*ctx));
-    if (!ctx)
-        return NULL;
+    ctx->dirty_count = -1;
 
-    ctx->dpy = XOpenDisplay(NULL);
-    if (!ctx->dpy) {
-        fprintf(stderr, "capture: cannot open X display\n");
-        free(ctx);
-        return NULL;
+#ifdef HAVE_XDAMAGE
+    if (!ctx->damage)
+        return;
+
+    /* Drain DamageNotify events — we only need the accumulated region */
+    XEvent ev;
+    while (XCheckTypedEvent(ctx->dpy, ctx->damage_event + XDamageNotify, &ev))
+        ;
+
+    XDamageSubtract(ctx->dpy, ctx->damage, None, ctx->region);
+
+    int n = 0;
+    XRectangle *xr = XFixesFetchRegion(ctx->dpy, ctx->region, &n);
+    int kept = 0;
+
+    if (n > ctx->dirty_cap) {
+        dirty_rect_t *grown = realloc(ctx->dirty, (size_t)n * sizeof(*grown));
+        if (grown) {
+            ctx->dirty     = grown;
+            ctx->dirty_cap = n;
+        }
     }
 
-    Screen *scr = DefaultScreenOfDisplay(ctx->dpy);
-    ctx->root   = DefaultRootWindow(ctx->dpy);
-    ctx->width  = WidthOfScreen(scr);
-    ctx->height = HeightOfScreen(scr);
+    /* The first frame is new in its entirety */
+    if (ctx->grabbed && (n == 0 || xr) && n <= ctx->dirty_cap) {
+        /* Damage is in src coordinates; keep what falls in our area */
+        for (int i = 0; i < n; i++) {
+            int x0 = xr[i].x - ctx->x, x1 = x0 + xr[i].width;
+            int y0 = xr[i].y - ctx->y, y1 = y0 + xr[i].height;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > ctx->width)  x1 = ctx->width;
+            if (y1 > ctx->height) y1 = ctx->height;
+            if (x1 <= x0 || y1 <= y0)
+                continue;
+            ctx->dirty[kept++] = (dirty_rect_t){ x0, y0, x1 - x0, y1 - y0 };
+        }
+        ctx->dirty_count = kept;
+    }
+    if (xr)
+        XFree(xr);
+#endif
+}
+
+static int on_x_error(Display *dpy, XErrorEvent *ev)
+{
+    (void)dpy;
+    (void)ev;
+    return 0;
+}
+
+/* Geometry of an active XRandR output, by index or name */
+static int find_monitor(x11_ctx_t *ctx, const capture_target_t *target,
+                        dirty_rect_t *area)
+{
+#ifdef HAVE_XRANDR
+    int event_base, error_base;
+    if (!XRRQueryExtension(ctx->dpy, &event_base, &error_base))
+        return -1;
+    XRRScreenResources *res = XRRGetScreenResourcesCurrent(ctx->dpy, ctx->root);
+    if (!res)
+        return -1;
+
+    int found = -1, index = 0;
+    for (int i = 0; i < res->noutput && found < 0; i++) {
+        XRROutputInfo *out = XRRGetOutputInfo(ctx->dpy, res, res->outputs[i]);
+        if (!out)
+            continue;
+        if (out->connection == RR_Connected && out->crtc) {
+            int match = target->output ? strcmp(out->name, target->output) == 0
+                                       : index == target->monitor;
+            XRRCrtcInfo *crtc = match ? XRRGetCrtcInfo(ctx->dpy, res, out->crtc) : NULL;
+            if (crtc) {
+                *area = (dirty_rect_t){ crtc->x, crtc->y,
+                                        (int)crtc->width, (int)crtc->height };
+                XRRFreeCrtcInfo(crtc);
+                found = 0;
+            }
+            index++;
+        }
+        XRRFreeOutputInfo(out);
+    }
+    XRRFreeScreenResources(res);
+    return found;
+#else
+    /* Without XRandR the root window is the only monitor we know of */
+    if (target->output || target->monitor != 0) {
+        fprintf(stderr, "capture: built without XRandR, only monitor 0 is known\n");
+        return -1;
+    }
+    *area = (dirty_rect_t){ 0, 0, ctx->width, ctx->height };
+    return 0;
+#endif
+}
+
+/*
+ * Point ctx->src / x / y / width / height at the target: a window's
+ * drawable, or a part of the root window (ctx->width x height so far).
+ */
+static int select_target(x11_ctx_t *ctx, const capture_target_t *target,
+                         Visual **visual, int *depth)
+{
+    dirty_rect_t base = { 0, 0, ctx->width, ctx->height };
+
+    if (target && target->window) {
+        XWindowAttributes wa;
+        if (!XGetWindowAttributes(ctx->dpy, (Window)target->window, &wa) ||
+            wa.map_state != IsViewable) {
+            fprintf(stderr, "capture: window 0x%lx not found or not mapped\n",
+                    (unsigned long)target->window);
+            return -1;
+        }
+        ctx->src = (Window)target->window;
+        base     = (dirty_rect_t){ 0, 0, wa.width, wa.height };
+        *visual  = wa.visual;   /* e.g. 32-bit ARGB windows */
+        *depth   = wa.depth;
+    } else if (target && (target->output || target->monitor >= 0)) {
+        if (find_monitor(ctx, target, &base) < 0) {
+            if (target->output)
+                fprintf(stderr, "capture: no active output named '%s'\n", target->output);
+            else
+                fprintf(stderr, "capture: no monitor %d\n", target->monitor);
+            return -1;
+        }
+    }
+
+    dirty_rect_t area;
+    if (capture_target_area(target, base.w, base.h, &area) < 0) {
+        fprintf(stderr, "capture: region is outside the %dx%d capture area\n",
+                base.w, base.h);
+        return -1;
+    }
+    ctx->x      = base.x + area.x;
+    ctx->y      = base.y + area.y;
+    ctx->width  = area.w;
+    ctx->height = area.h;
+    return ctx->width > 0 && ctx->height > 0 ? 0 : -1;
+}
+
+/* A resize of src (mode change, XRandR, window resize) since the last look */
+static int source_changed(x11_ctx_t *ctx)
+{
+    XEvent ev;
+    while (XCheckTypedWindowEvent(ctx->dpy, ctx->src, ConfigureNotify, &ev)) {
+        if (ev.xconfigure.width != ctx->src_w || ev.xconfigure.height != ctx->src_h)
+            ctx->lost = 1;
+    }
+    return ctx->lost;
+}
+
+/*
+ * Select the target as the screen is now and set up the image and
+ * damage tracking for it.  Used by x11_init() and x11_reset().
+ */
+static int open_source(x11_ctx_t *ctx)
+{
+    Screen *scr    = DefaultScreenOfDisplay(ctx->dpy);
+    Visual *visual = DefaultVisualOfScreen(scr);
+    int     depth  = DefaultDepthOfScreen(scr);
+
+    /* Resizes from here on are reported; anything queued is stale */
+    XSelectInput(ctx->dpy, ctx->root, StructureNotifyMask);
+    if (ctx->target.window)
+        XSelectInput(ctx->dpy, (Window)ctx->target.window, StructureNotifyMask);
+    XSync(ctx->dpy, False);
+    ctx->src = ctx->root;
+    source_changed(ctx);
+    if (ctx->target.window) {
+        ctx->src = (Window)ctx->target.window;
+        source_changed(ctx);
+    }
+
+    /* Screen sizes in Xlib's Display go stale after a mode change */
+    XWindowAttributes ra;
+    if (!XGetWindowAttributes(ctx->dpy, ctx->root, &ra))
+        return -1;
+    ctx->src    = ctx->root;
+    ctx->width  = ra.width;
+    ctx->height = ra.height;
+    ctx->src_w  = ra.width;
+    ctx->src_h  = ra.height;
+    if (select_target(ctx, &ctx->target, &visual, &depth) < 0)
+        return -1;
+    if (ctx->src != ctx->root) {
+        XWindowAttributes wa;
+        if (!XGetWindowAttributes(ctx->dpy, ctx->src, &wa))
+            return -1;
+        ctx->src_w = wa.width;
+        ctx->src_h = wa.height;
+    }
 
     /* Try MIT-SHM for fast capture */
     ctx->use_shm = XShmQueryExtension(ctx->dpy) ? 1 : 0;
 
     if (ctx->use_shm) {
-        ctx->img = XShmCreateImage(ctx->dpy,
-                                   DefaultVisualOfScreen(scr),
-                                   DefaultDepthOfScreen(scr),
+        ctx->img = XShmCreateImage(ctx->dpy, visual, depth,
                                    ZPixmap, NULL, &ctx->shm_info,
                                    ctx->width, ctx->height);
         if (!ctx->img) {
@@ -66,51 +294,319 @@ capture_ctx_t *capture_init(void)
         }
     }
 
-    fprintf(stderr, "capture: %dx%d shm=%s\n",
-            ctx->width, ctx->height, ctx->use_shm ? "yes" : "no");
-    return ctx;
-}
+    /* Without MIT-SHM, one image from the frame pool that every grab refills */
+    if (!ctx->use_shm) {
+        ctx->img = XCreateImage(ctx->dpy, visual, (unsigned)depth, ZPixmap, 0, NULL,
+                                (unsigned)ctx->width, (unsigned)ctx->height, 32, 0);
+        if (!ctx->img)
+            return -1;
+        ctx->img_buf = pool_get((size_t)ctx->img->bytes_per_line * ctx->img->height);
+        if (!ctx->img_buf)
+            return -1;
+        ctx->img->data = (char *)ctx->img_buf->data;
+    }
 
-int capture_width(const capture_ctx_t *ctx)  { return ctx->width;  }
-int capture_height(const capture_ctx_t *ctx) { return ctx->height; }
+#ifdef HAVE_XDAMAGE
+    /* Track changed areas so unchanged tiles can skip conversion */
+    int damage_error, fixes_event, fixes_error;
+    if (XDamageQueryExtension(ctx->dpy, &ctx->damage_event, &damage_error) &&
+        XFixesQueryExtension(ctx->dpy, &fixes_event, &fixes_error)) {
+        ctx->damage = XDamageCreate(ctx->dpy, ctx->src, XDamageReportNonEmpty);
+        ctx->region = XFixesCreateRegion(ctx->dpy, NULL, 0);
+    }
+    int have_damage = ctx->damage != 0;
+#else
+    int have_damage = 0;
+#endif
+    ctx->dirty_count = -1;
+    ctx->grabbed     = 0;
+    ctx->lost        = 0;
 
-const uint8_t *capture_grab(capture_ctx_t *ctx)
+    fprintf(stderr, "capture: %dx%d+%d+%d%s shm=%s damage=%s\n",
+            ctx->width, ctx->height, ctx->x, ctx->y,
+            ctx->src != ctx->root ? " (window)" : "", ctx->use_shm ? "yes" : "no",
+            have_damage ? "yes" : "no");
+    return 0;
+}
+
+/* Undo open_source(); the display connection stays. */
+static void close_source(x11_ctx_t *ctx)
 {
     if (ctx->use_shm) {
-        XShmGetImage(ctx->dpy, ctx->root, ctx->img, 0, 0, AllPlanes);
-        return (const uint8_t *)ctx->img->data;
+        XShmDetach(ctx->dpy, &ctx->shm_info);
+        shmdt(ctx->shm_info.shmaddr);
+        shmctl(ctx->shm_info.shmid, IPC_RMID, NULL);
+        ctx->use_shm = 0;
     }
 
-    /* Fallback: slow but works everywhere */
     if (ctx->img) {
+        if (ctx->img_buf)
+            ctx->img->data = NULL;   /* the pool's, not Xlib's to free */
         XDestroyImage(ctx->img);
         ctx->img = NULL;
     }
-    ctx->img = XGetImage(ctx->dpy, ctx->root,
-                         0, 0, ctx->width, ctx->height,
-                         AllPlanes, ZPixmap);
-    if (!ctx->img)
-        return NULL;
+    pool_put(ctx->img_buf);
+    ctx->img_buf = NULL;
 
-    return (const uint8_t *)ctx->img->data;
+#ifdef HAVE_XDAMAGE
+    if (ctx->damage) {
+        XDamageDestroy(ctx->dpy, ctx->damage);
+        XFixesDestroyRegion(ctx->dpy, ctx->region);
+        ctx->damage = 0;
+    }
+#endif
 }
 
-void capture_free(capture_ctx_t *ctx)
+static void x11_free(void *opaque);
+
+#ifdef HAVE_XFIXES
+/* Fetch the current cursor shape; XFixes has it premultiplied, as ARGB longs */
+static int read_cursor(x11_ctx_t *ctx)
 {
+    XFixesCursorImage *ci = XFixesGetCursorImage(ctx->dpy);
+    if (!ci)
+        return -1;
+
+    size_t n = (size_t)ci->width * ci->height;
+    uint8_t *img = realloc(ctx->cursor_image, n * 4 + 1);
+    if (!img) {
+        XFree(ci);
+        return -1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        unsigned long px = ci->pixels[i];
+        unsigned a = (px >> 24) & 0xff;
+        unsigned r = (px >> 16) & 0xff, g = (px >> 8) & 0xff, b = px & 0xff;
+        if (a && a < 255) {
+            r = r * 255 / a;
+            g = g * 255 / a;
+            b = b * 255 / a;
+        }
+        img[4 * i]     = (uint8_t)(b > 255 ? 255 : b);
+        img[4 * i + 1] = (uint8_t)(g > 255 ? 255 : g);
+        img[4 * i + 2] = (uint8_t)(r > 255 ? 255 : r);
+        img[4 * i + 3] = (uint8_t)a;
+    }
+    ctx->cursor_image  = img;
+    ctx->cursor_w      = ci->width;
+    ctx->cursor_h      = ci->height;
+    ctx->hot_x         = ci->xhot;
+    ctx->hot_y         = ci->yhot;
+    ctx->cursor_serial++;
+    XFree(ci);
+    return 0;
+}
+#endif
+
+static void *x11_init(const capture_target_t *target)
+{
+    x11_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
-        return;
+        return NULL;
+
+    ctx->dpy = XOpenDisplay(NULL);
+    if (!ctx->dpy) {
+        fprintf(stderr, "capture: cannot open X display\n");
+        free(ctx);
+        return NULL;
+    }
+
+    /* X errors for a source that went away or shrank end a grab, not the program */
+    XSetErrorHandler(on_x_error);
+
+    ctx->root   = DefaultRootWindow(ctx->dpy);
+    ctx->target = target ? *target : (capture_target_t){ .monitor = -1 };
+
+#ifdef HAVE_XFIXES
+    /* Shape changes arrive as events, so the image is only read when new */
+    int fixes_error, major = 4, minor = 0;
+    ctx->fixes_event  = -1;
+    ctx->cursor_stale = 1;
+    if (XFixesQueryExtension(ctx->dpy, &ctx->fixes_event, &fixes_error) &&
+        XFixesQueryVersion(ctx->dpy, &major, &minor) && major >= 1)
+        XFixesSelectCursorInput(ctx->dpy, ctx->root, XFixesDisplayCursorNotifyMask);
+    else
+        ctx->fixes_event = -1;
+#endif
+    if (open_source(ctx) < 0) {
+        x11_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+static int x11_width(const void *opaque)  { return ((const x11_ctx_t *)opaque)->width;  }
+static int x11_height(const void *opaque) { return ((const x11_ctx_t *)opaque)->height; }
+
+/* Point the frame descriptor at img, padded rows and all */
+static const frame_t *describe_image(x11_ctx_t *ctx)
+{
+    frame_init(&ctx->frame, PIX_FMT_BGRA, ctx->width, ctx->height,
+               (uint8_t *)ctx->img->data);
+    ctx->frame.strides[0] = (size_t)ctx->img->bytes_per_line;
+    return &ctx->frame;
+}
+
+static const frame_t *x11_grab(void *opaque)
+{
+    x11_ctx_t *ctx = opaque;
+    if (source_changed(ctx))
+        return NULL;
+    collect_damage(ctx);
+
+    /* Nothing was drawn: the previous image is still current */
+    if (ctx->dirty_count == 0 && ctx->img)
+        return describe_image(ctx);
+    ctx->grabbed = 1;
 
     if (ctx->use_shm) {
-        XShmDetach(ctx->dpy, &ctx->shm_info);
-        shmdt(ctx->shm_info.shmaddr);
-        shmctl(ctx->shm_info.shmid, IPC_RMID, NULL);
+        if (!XShmGetImage(ctx->dpy, ctx->src, ctx->img, ctx->x, ctx->y, AllPlanes)) {
+            ctx->grabbed = 0;   /* e.g. the window was unmapped */
+            return NULL;
+        }
+        return describe_image(ctx);
     }
 
-    if (ctx->img)
-        XDestroyImage(ctx->img);
+    /* Fallback: a round trip through the X socket, but into the same image */
+    if (!XGetSubImage(ctx->dpy, ctx->src, ctx->x, ctx->y,
+                      (unsigned)ctx->width, (unsigned)ctx->height,
+                      AllPlanes, ZPixmap, ctx->img, 0, 0)) {
+        ctx->grabbed = 0;
+        return NULL;
+    }
+    return describe_image(ctx);
+}
 
+/* Frames are always BGRA here; the caller converts on the CPU */
+static int x11_set_format(void *opaque, pix_fmt_t fmt)
+{
+    (void)opaque;
+    return fmt == PIX_FMT_BGRA ? 0 : -1;
+}
+
+/* No scaling in XShm/XGetImage; the caller scales on the CPU */
+static int x11_set_size(void *opaque, int width, int height)
+{
+    const x11_ctx_t *ctx = opaque;
+    return width == ctx->width && height == ctx->height ? 0 : -1;
+}
+
+/* Frames are copied out by x11_grab(); nothing to lend */
+static int x11_can_borrow(const void *opaque)
+{
+    (void)opaque;
+    return 0;
+}
+
+static int x11_acquire(void *opaque, capture_frame_t *frame)
+{
+    (void)opaque;
+    (void)frame;
+    return -1;
+}
+
+/* X11 has no presentation events for the root window */
+static int x11_wait_frame(void *opaque, uint64_t timeout_ns)
+{
+    (void)opaque;
+    (void)timeout_ns;
+    return -1;
+}
+
+static int x11_dirty_rects(const void *opaque, const dirty_rect_t **rects)
+{
+    const x11_ctx_t *ctx = opaque;
+    *rects = ctx->dirty;
+    return ctx->dirty_count;
+}
+
+static int x11_cursor(void *opaque, capture_cursor_t *cursor)
+{
+#ifdef HAVE_XFIXES
+    x11_ctx_t *ctx = opaque;
+    if (ctx->fixes_event < 0)
+        return -1;
+
+    XEvent ev;
+    while (XCheckTypedEvent(ctx->dpy, ctx->fixes_event + XFixesCursorNotify, &ev))
+        ctx->cursor_stale = 1;
+    if (ctx->cursor_stale && read_cursor(ctx) == 0)
+        ctx->cursor_stale = 0;
+
+    /* Pointer position relative to the source drawable: one round trip */
+    Window root, child;
+    int rx, ry, wx, wy;
+    unsigned mask;
+    int on = XQueryPointer(ctx->dpy, ctx->src, &root, &child, &rx, &ry, &wx, &wy, &mask);
+
+    dirty_rect_t box = { wx - ctx->hot_x - ctx->x, wy - ctx->hot_y - ctx->y,
+                         ctx->cursor_w, ctx->cursor_h };
+    *cursor = (capture_cursor_t){
+        .visible = on && ctx->cursor_image &&
+                   box.x < ctx->width && box.y < ctx->height &&
+                   box.x + box.w > 0 && box.y + box.h > 0,
+        .box     = box,
+        .image   = ctx->cursor_image,
+        .image_w = ctx->cursor_w,
+        .image_h = ctx->cursor_h,
+        .serial  = ctx->cursor_serial,
+    };
+    return 0;
+#else
+    (void)opaque;
+    (void)cursor;
+    return -1;
+#endif
+}
+
+static int x11_lost(const void *opaque)
+{
+    return ((const x11_ctx_t *)opaque)->lost;
+}
+
+/* Same display connection, new image and damage for the source's new size */
+static int x11_reset(void *opaque)
+{
+    x11_ctx_t *ctx = opaque;
+    close_source(ctx);
+    if (open_source(ctx) < 0) {
+        ctx->lost = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void x11_free(void *opaque)
+{
+    x11_ctx_t *ctx = opaque;
+    if (!ctx)
+        return;
+
+    close_source(ctx);
     if (ctx->dpy)
         XCloseDisplay(ctx->dpy);
 
+    free(ctx->dirty);
+#ifdef HAVE_XFIXES
+    free(ctx->cursor_image);
+#endif
     free(ctx);
 }
+
+const capture_backend_t capture_x11 = {
+    .name        = "x11",
+    .init        = x11_init,
+    .width       = x11_width,
+    .height      = x11_height,
+    .grab        = x11_grab,
+    .can_borrow  = x11_can_borrow,
+    .acquire     = x11_acquire,
+    .set_format  = x11_set_format,
+    .set_size    = x11_set_size,
+    .wait_frame  = x11_wait_frame,
+    .dirty_rects = x11_dirty_rects,
+    .cursor      = x11_cursor,
+    .lost        = x11_lost,
+    .reset       = x11_reset,
+    .free        = x11_free,
+};
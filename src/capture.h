@@ -3,20 +3,174 @@
 
 #include <stdint.h>
 
+#include "dirty.h"
+#include "pixfmt.h"
+
 typedef struct capture_ctx capture_ctx_t;
 
-/* Initialize screen capture. Returns NULL on failure. */
-capture_ctx_t *capture_init(void);
+/*
+ * A frame borrowed from the backend (capture_acquire) instead of copied
+ * out of it, described with the backend's own row strides.  The pixels
+ * stay valid until capture_frame_release(), however many frames are
+ * captured meanwhile; each handle holds its own reference on the
+ * backend's buffer.
+ */
+typedef struct {
+    frame_t        frame;
+    void          *ref;                  /* backend's reference */
+    void         (*release)(void *ref);
+} capture_frame_t;
+
+/*
+ * What to capture.  Only the selected area is read from the screen, so
+ * a smaller target costs proportionally less to grab.
+ */
+typedef struct {
+    int           monitor;  /* display index, -1 = default (X11: the whole root window) */
+    const char   *output;   /* display by name instead (XRandR output, DXGI device) */
+    dirty_rect_t  region;   /* part of the display or window, w = 0 for all */
+    uint64_t      window;   /* one window (X11 Window, CGWindowID, HWND), 0 = none */
+    const char   *backend;  /* Linux: "x11" or "pipewire", NULL = pick one */
+} capture_target_t;
+
+/*
+ * Initialize screen capture of target, or of the default display if
+ * target is NULL.  Returns NULL on failure, including a target that does
+ * not exist or that the backend cannot select.  Odd sizes are captured
+ * as they are.  target is copied for capture_reset(); its output string
+ * must outlive the context.
+ */
+capture_ctx_t *capture_init(const capture_target_t *target);
+
+/*
+ * For backends: the part of a width x height display or window that
+ * target captures.  Returns -1 if its region does not fit inside.
+ */
+static inline int capture_target_area(const capture_target_t *target,
+                                      int width, int height, dirty_rect_t *area)
+{
+    *area = (dirty_rect_t){ 0, 0, width, height };
+    if (!target || target->region.w <= 0)
+        return 0;
+
+    const dirty_rect_t *r = &target->region;
+    if (r->x < 0 || r->y < 0 || r->h <= 0 ||
+        r->x + r->w > width || r->y + r->h > height)
+        return -1;
+    *area = *r;
+    return 0;
+}
 
 /* Get capture dimensions. */
 int capture_width(const capture_ctx_t *ctx);
 int capture_height(const capture_ctx_t *ctx);
 
 /*
- * Grab a frame. Returns pointer to BGRA pixel data (4 bytes/pixel).
- * The pointer is valid until the next call to capture_grab() or capture_free().
+ * Grab a frame. Returns a description of it as the backend holds it: BGRA
+ * (4 bytes/pixel) or the format picked with capture_set_format(), rows as
+ * far apart as the backend's buffer has them.  NULL on failure.
+ * Frame and pixels are valid until the next capture_grab() or capture_free().
+ */
+const frame_t *capture_grab(capture_ctx_t *ctx);
+
+/*
+ * Non-zero if the backend can lend out its frames (capture_acquire);
+ * otherwise use capture_grab().  Use one or the other on a context.
+ */
+int capture_can_borrow(const capture_ctx_t *ctx);
+
+/*
+ * Grab a frame without copying: fills *frame with a borrowed reference
+ * to the latest one.  Returns 0, or -1 on failure (frame untouched).
+ * capture_dirty_rects() then describes it just as after capture_grab().
+ */
+int capture_acquire(capture_ctx_t *ctx, capture_frame_t *frame);
+
+/* Drop a borrowed frame.  Safe to call twice or on a zeroed handle. */
+static inline void capture_frame_release(capture_frame_t *frame)
+{
+    if (frame->release)
+        frame->release(frame->ref);
+    frame->release = NULL;
+    frame->ref     = NULL;
+}
+
+/*
+ * Ask for frames already converted to fmt (e.g. on the GPU) instead of
+ * BGRA.  Returns 0 if capture_grab() now returns fmt frames, or -1 if
+ * the backend cannot, in which case it keeps returning BGRA and the
+ * caller converts.  PIX_FMT_BGRA always
+ * succeeds.  Dirty rects stay in pixel coordinates either way.
+ */
+int capture_set_format(capture_ctx_t *ctx, pix_fmt_t fmt);
+
+/*
+ * Ask for frames scaled to width x height by the backend (compositor or
+ * GPU) instead of the screen's own size.  Returns 0 if capture_width()/
+ * capture_height() and every frame now have that size (dirty rects too
+ * are in its coordinates), or -1 if the backend cannot scale, in which
+ * case nothing changes and the caller scales.  Call after
+ * capture_set_format(); changing the format afterwards may reset it.
+ */
+int capture_set_size(capture_ctx_t *ctx, int width, int height);
+
+/*
+ * Block until the source has a frame newer than the last one grabbed
+ * (the compositor presented one), for at most timeout_ns.  Returns 1 if
+ * there is one, 0 on timeout, or -1 if the backend has no such event,
+ * in which case pace by wall time instead (--pace vsync).
+ */
+int capture_wait_frame(capture_ctx_t *ctx, uint64_t timeout_ns);
+
+/*
+ * Regions that changed between the previous capture_grab() and the last
+ * one.  Sets *rects to an array valid until the next grab and returns its
+ * length: 0 means the frame is unchanged, -1 means the backend cannot
+ * tell and the whole frame must be treated as dirty.
+ */
+int capture_dirty_rects(const capture_ctx_t *ctx, const dirty_rect_t **rects);
+
+/*
+ * The mouse pointer as of the last grab, for backends that keep it out
+ * of the frames.  The image goes over box, in frame coordinates (it may
+ * reach past the frame's edges; a scaled capture scales it too).
+ */
+typedef struct {
+    int             visible;   /* shown and over the captured area */
+    dirty_rect_t    box;
+    const uint8_t  *image;     /* image_w x image_h BGRA, straight alpha,
+                                  packed rows; valid until the next grab */
+    int             image_w;
+    int             image_h;
+    uint32_t        serial;    /* changes whenever the image does */
+} capture_cursor_t;
+
+/*
+ * Where the pointer is and what it looks like, to draw over the frames
+ * (frame_blend_cursor).  A pointer drawn separately means that moving it
+ * changes no pixels: dirty rects and unchanged-frame detection stay
+ * exact, and only the area under it has to be redone.  Returns 0, or -1
+ * if the backend has no cursor of its own: it is drawn into the frames
+ * already (PipeWire, ScreenCaptureKit) or not captured at all.
+ */
+int capture_cursor(capture_ctx_t *ctx, capture_cursor_t *cursor);
+
+/*
+ * Non-zero once the source changed under the context: a display mode or
+ * window size change, or (DXGI) access lost to another app or a secure
+ * desktop.  capture_grab() and capture_acquire() then keep failing until
+ * capture_reset().
+ */
+int capture_lost(const capture_ctx_t *ctx);
+
+/*
+ * Re-open the same target as it is now, typically at a new size, without
+ * a new capture_init() (which on some backends asks the user again).
+ * Format and size go back to BGRA at the source's own size, as after
+ * capture_init().  Every borrowed frame must have been released.
+ * Returns 0, or -1 if the target is not back yet: try again later.
  */
-const uint8_t *capture_grab(capture_ctx_t *ctx);
+int capture_reset(capture_ctx_t *ctx);
 
 /* Release resources. */
 void capture_free(capture_ctx_t *ctx);
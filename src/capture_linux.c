@@ -0,0 +1,129 @@
+/*
+ * Linux capture front end
+ *
+ * Picks a backend (X11, or PipeWire via xdg-desktop-portal when built
+ * with it) and forwards the capture.h calls to it.  Without a --capture
+ * choice, Wayland sessions try PipeWire first and everything else uses
+ * X11; if the first pick fails the other one is tried.
+ */
+
+#include "capture_linux.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct capture_ctx {
+    const capture_backend_t *backend;
+    void                    *impl;
+};
+
+static const capture_backend_t *const backends[] = {
+#ifdef HAVE_PIPEWIRE
+    &capture_pipewire,
+#endif
+    &capture_x11,
+};
+#define NBACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+static int wayland_session(void)
+{
+    const char *type = getenv("XDG_SESSION_TYPE");
+    return getenv("WAYLAND_DISPLAY") || (type && strcmp(type, "wayland") == 0);
+}
+
+capture_ctx_t *capture_init(const capture_target_t *target)
+{
+    const char *want = target ? target->backend : NULL;
+    const capture_backend_t *order[NBACKENDS];
+    int n = 0;
+
+    if (want) {
+        for (int i = 0; i < NBACKENDS; i++) {
+            if (strcmp(backends[i]->name, want) == 0)
+                order[n++] = backends[i];
+        }
+        if (n == 0) {
+            fprintf(stderr, "capture: no '%s' backend in this build\n", want);
+            return NULL;
+        }
+    } else {
+        /* PipeWire is listed first; X11 goes first outside Wayland */
+        for (int i = 0; i < NBACKENDS; i++)
+            order[n++] = backends[wayland_session() ? i : NBACKENDS - 1 - i];
+    }
+
+    capture_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+    for (int i = 0; i < n && !ctx->impl; i++) {
+        ctx->backend = order[i];
+        ctx->impl    = order[i]->init(target);
+    }
+    if (!ctx->impl) {
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+int capture_width(const capture_ctx_t *ctx)  { return ctx->backend->width(ctx->impl);  }
+int capture_height(const capture_ctx_t *ctx) { return ctx->backend->height(ctx->impl); }
+
+const frame_t *capture_grab(capture_ctx_t *ctx)
+{
+    return ctx->backend->grab(ctx->impl);
+}
+
+int capture_can_borrow(const capture_ctx_t *ctx)
+{
+    return ctx->backend->can_borrow(ctx->impl);
+}
+
+int capture_acquire(capture_ctx_t *ctx, capture_frame_t *frame)
+{
+    return ctx->backend->acquire(ctx->impl, frame);
+}
+
+int capture_set_format(capture_ctx_t *ctx, pix_fmt_t fmt)
+{
+    return ctx->backend->set_format(ctx->impl, fmt);
+}
+
+int capture_set_size(capture_ctx_t *ctx, int width, int height)
+{
+    return ctx->backend->set_size(ctx->impl, width, height);
+}
+
+int capture_wait_frame(capture_ctx_t *ctx, uint64_t timeout_ns)
+{
+    return ctx->backend->wait_frame(ctx->impl, timeout_ns);
+}
+
+int capture_dirty_rects(const capture_ctx_t *ctx, const dirty_rect_t **rects)
+{
+    return ctx->backend->dirty_rects(ctx->impl, rects);
+}
+
+int capture_cursor(capture_ctx_t *ctx, capture_cursor_t *cursor)
+{
+    return ctx->backend->cursor(ctx->impl, cursor);
+}
+
+int capture_lost(const capture_ctx_t *ctx)
+{
+    return ctx->backend->lost(ctx->impl);
+}
+
+int capture_reset(capture_ctx_t *ctx)
+{
+    return ctx->backend->reset(ctx->impl);
+}
+
+void capture_free(capture_ctx_t *ctx)
+{
+    if (!ctx)
+        return;
+    ctx->backend->free(ctx->impl);
+    free(ctx);
+}
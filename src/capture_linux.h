@@ -0,0 +1,35 @@
+#ifndef CAPTURE_LINUX_H
+#define CAPTURE_LINUX_H
+
+#include "capture.h"
+
+/*
+ * Linux has more than one capture backend; capture_linux.c implements
+ * capture.h by forwarding to the one picked at runtime (--capture).
+ * Each backend fills in this table with the capture.h calls for its own
+ * context type.
+ */
+typedef struct {
+    const char    *name;
+    void          *(*init)(const capture_target_t *target);
+    int            (*width)(const void *ctx);
+    int            (*height)(const void *ctx);
+    const frame_t *(*grab)(void *ctx);
+    int            (*can_borrow)(const void *ctx);
+    int            (*acquire)(void *ctx, capture_frame_t *frame);
+    int            (*set_format)(void *ctx, pix_fmt_t fmt);
+    int            (*set_size)(void *ctx, int width, int height);
+    int            (*wait_frame)(void *ctx, uint64_t timeout_ns);
+    int            (*dirty_rects)(const void *ctx, const dirty_rect_t **rects);
+    int            (*cursor)(void *ctx, capture_cursor_t *cursor);
+    int            (*lost)(const void *ctx);
+    int            (*reset)(void *ctx);
+    void           (*free)(void *ctx);
+} capture_backend_t;
+
+extern const capture_backend_t capture_x11;        /* capture.c */
+#ifdef HAVE_PIPEWIRE
+extern const capture_backend_t capture_pipewire;   /* capture_pipewire.c */
+#endif
+
+#endif /* CAPTURE_LINUX_H */
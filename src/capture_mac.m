@@ -6,10 +6,23 @@
  * Architecture:
  *   - SCStream delivers frames asynchronously via a delegate callback
  *   - Delegate stores the latest CVPixelBuffer (thread-safe via mutex)
- *   - capture_grab() copies pixel data from the latest buffer into a
- *     persistent BGRA buffer that matches convert.c expectations
+ *   - capture_grab() locks the latest buffer and describes it in place
+ *     (bytesPerRow strides), holding it until the next grab
+ *   - SCStreamFrameInfoDirtyRects from every delivered frame are merged
+ *     until the next grab, so capture_dirty_rects() can report them
+ *   - capture_acquire() hands out the locked CVPixelBuffer the same way,
+ *     retained per handle, so conversion reads the IOSurface in place
+ *     for as long as it needs
+ *
+ * Target: a display by index, one window (SCContentFilter
+ * initWithDesktopIndependentWindow), and/or a region of either
+ * (config.sourceRect), so only that area is composited and delivered.
  *
  * Pixel format: BGRA (byte order: B G R A) — set via kCVPixelFormatType_32BGRA.
+ * capture_set_format(NV12) switches the stream to 420v instead, so the
+ * BT.601 video-range conversion happens in hardware before delivery.
+ * capture_set_size() changes the stream's output size, so downscaling
+ * happens there too.
  *
  * Notes:
  *   - Requires Screen Recording permission (System Settings > Privacy &
@@ -26,6 +39,7 @@
 #import <CoreMedia/CoreMedia.h>
 #import <CoreVideo/CoreVideo.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -33,12 +47,21 @@
 
 /* ── Frame receiver (SCStreamOutput delegate) ──────────────── */
 
+#define MAX_DIRTY_RECTS 64
+
 @interface SCKFrameReceiver : NSObject <SCStreamOutput>
 {
     pthread_mutex_t _lock;
+    pthread_cond_t _arrived;                /* signalled per delivered frame */
+    int _fresh;                             /* delivered since the last copy */
     CVPixelBufferRef _latestPixelBuffer;
+    dirty_rect_t _dirty[MAX_DIRTY_RECTS];   /* changes since last copy */
+    int _dirtyCount;                        /* -1 = whole frame */
 }
-- (CVPixelBufferRef)copyLatestFrame;
+- (CVPixelBufferRef)copyLatestFrameDirty:(dirty_rect_t *)rects
+                                   count:(int *)count;
+- (int)waitForFrame:(uint64_t)timeoutNs;
+- (void)reset;
 @end
 
 @implementation SCKFrameReceiver
@@ -48,7 +71,9 @@
     self = [super init];
     if (self) {
         pthread_mutex_init(&_lock, NULL);
+        pthread_cond_init(&_arrived, NULL);
         _latestPixelBuffer = NULL;
+        _dirtyCount = -1;
     }
     return self;
 }
@@ -57,6 +82,7 @@
 {
     if (_latestPixelBuffer)
         CVPixelBufferRelease(_latestPixelBuffer);
+    pthread_cond_destroy(&_arrived);
     pthread_mutex_destroy(&_lock);
 }
 
@@ -70,41 +96,131 @@
 
     CVPixelBufferRef pixbuf = CMSampleBufferGetImageBuffer(sampleBuffer);
     if (!pixbuf)
-        return;
+        return;   /* idle / blank frames carry no image */
+
+    /* Changed areas of this frame, in output pixel coordinates */
+    dirty_rect_t rects[MAX_DIRTY_RECTS];
+    int nrects = -1;
+    CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sampleBuffer, false);
+    if (attachments && CFArrayGetCount(attachments) > 0) {
+        NSDictionary *info = (__bridge NSDictionary *)CFArrayGetValueAtIndex(attachments, 0);
+        NSArray *dirty = info[SCStreamFrameInfoDirtyRects];
+        if (dirty && dirty.count <= MAX_DIRTY_RECTS) {
+            nrects = 0;
+            for (NSDictionary *d in dirty) {
+                CGRect r;
+                if (!CGRectMakeWithDictionaryRepresentation((__bridge CFDictionaryRef)d, &r)) {
+                    nrects = -1;
+                    break;
+                }
+                r = CGRectIntegral(r);
+                rects[nrects++] = (dirty_rect_t){
+                    (int)r.origin.x, (int)r.origin.y,
+                    (int)r.size.width, (int)r.size.height
+                };
+            }
+        }
+    }
 
     CVPixelBufferRetain(pixbuf);
 
     pthread_mutex_lock(&_lock);
     CVPixelBufferRef old = _latestPixelBuffer;
     _latestPixelBuffer = pixbuf;
+    if (nrects < 0 || _dirtyCount < 0 || _dirtyCount + nrects > MAX_DIRTY_RECTS) {
+        _dirtyCount = -1;
+    } else {
+        memcpy(&_dirty[_dirtyCount], rects, (size_t)nrects * sizeof(rects[0]));
+        _dirtyCount += nrects;
+    }
+    _fresh = 1;
+    pthread_cond_signal(&_arrived);
     pthread_mutex_unlock(&_lock);
 
     if (old)
         CVPixelBufferRelease(old);
 }
 
-- (CVPixelBufferRef)copyLatestFrame
+- (CVPixelBufferRef)copyLatestFrameDirty:(dirty_rect_t *)rects
+                                   count:(int *)count
 {
     pthread_mutex_lock(&_lock);
     CVPixelBufferRef buf = _latestPixelBuffer;
-    if (buf)
+    if (buf) {
         CVPixelBufferRetain(buf);
+        *count = _dirtyCount;
+        if (_dirtyCount > 0)
+            memcpy(rects, _dirty, (size_t)_dirtyCount * sizeof(_dirty[0]));
+        _dirtyCount = 0;
+        _fresh = 0;
+    }
     pthread_mutex_unlock(&_lock);
     return buf;
 }
 
+/* 1 once a frame newer than the last copy is in, 0 after timeoutNs */
+- (int)waitForFrame:(uint64_t)timeoutNs
+{
+    struct timespec rel = {
+        .tv_sec  = (time_t)(timeoutNs / 1000000000u),
+        .tv_nsec = (long)(timeoutNs % 1000000000u),
+    };
+    pthread_mutex_lock(&_lock);
+    if (!_fresh)
+        pthread_cond_timedwait_relative_np(&_arrived, &_lock, &rel);
+    int fresh = _fresh;
+    pthread_mutex_unlock(&_lock);
+    return fresh;
+}
+
+/* Forget the latest frame, e.g. after the pixel format changed */
+- (void)reset
+{
+    pthread_mutex_lock(&_lock);
+    CVPixelBufferRef old = _latestPixelBuffer;
+    _latestPixelBuffer = NULL;
+    _dirtyCount = -1;
+    pthread_mutex_unlock(&_lock);
+
+    if (old)
+        CVPixelBufferRelease(old);
+}
+
 @end
 
 /* ── Capture context ───────────────────────────────────────── */
 
+/* Display reconfigurations so far (CGDisplayRegisterReconfigurationCallback) */
+static atomic_int display_changes;
+
+static void on_display_change(CGDirectDisplayID display,
+                              CGDisplayChangeSummaryFlags flags, void *info)
+{
+    (void)display;
+    (void)info;
+    if (!(flags & kCGDisplayBeginConfigurationFlag))
+        atomic_fetch_add(&display_changes, 1);
+}
+
 struct capture_ctx {
+    capture_target_t    target;      /* what capture_reset() opens again */
+    CGDirectDisplayID   display_id;
+    int                 display_w;   /* its mode's pixel size at capture_init() */
+    int                 display_h;
+    int                 seen_changes;  /* display_changes checked so far */
+    int                 lost;        /* mode changed: capture_reset() */
     void               *stream;      /* SCStream — retained via CFBridgingRetain */
     void               *receiver;    /* SCKFrameReceiver — retained */
+    void               *config;      /* SCStreamConfiguration — retained */
+    pix_fmt_t           format;      /* BGRA or NV12 (capture_set_format) */
+    OSType              cv_format;   /* matching CoreVideo pixel format */
     dispatch_queue_t    queue;
     int                 width;
     int                 height;
-    uint8_t            *buffer;
-    size_t              buffer_size;
+    capture_frame_t     held;        /* what capture_grab() returned */
+    int                 have_frame;   /* a frame was handed out */
+    dirty_rect_t        dirty[MAX_DIRTY_RECTS];
+    int                 dirty_count;  /* -1 = whole frame */
 };
 
 /* ── Helper: synchronous shareable content query ───────────── */
@@ -136,12 +252,19 @@ static SCShareableContent *get_shareable_content(void)
 
 /* ── Public interface ──────────────────────────────────────── */
 
-capture_ctx_t *capture_init(void)
+capture_ctx_t *capture_init(const capture_target_t *target)
 {
     @autoreleasepool {
         capture_ctx_t *ctx = calloc(1, sizeof(*ctx));
         if (!ctx)
             return NULL;
+        ctx->target = target ? *target : (capture_target_t){ .monitor = -1 };
+
+        static int watching;
+        if (!watching)
+            watching = CGDisplayRegisterReconfigurationCallback(on_display_change,
+                                                                NULL) == kCGErrorSuccess;
+        ctx->seen_changes = atomic_load(&display_changes);
 
         /* Query available displays */
         SCShareableContent *content = get_shareable_content();
@@ -153,7 +276,19 @@ capture_ctx_t *capture_init(void)
             return NULL;
         }
 
-        SCDisplay *display = content.displays[0];
+        if (target && target->output) {
+            fprintf(stderr, "capture_mac: displays are selected by index, not name\n");
+            free(ctx);
+            return NULL;
+        }
+        int index = target && target->monitor >= 0 ? target->monitor : 0;
+        if (index >= (int)content.displays.count) {
+            fprintf(stderr, "capture_mac: no display %d (%d found)\n",
+                    index, (int)content.displays.count);
+            free(ctx);
+            return NULL;
+        }
+        SCDisplay *display = content.displays[index];
 
         /* Use native pixel dimensions — display.width/height return logical
            points which are smaller than actual pixels on Retina displays,
@@ -168,19 +303,58 @@ capture_ctx_t *capture_init(void)
             ctx->width  = (int)(display.width);
             ctx->height = (int)(display.height);
         }
+        ctx->display_id = displayID;
+        ctx->display_w  = ctx->width;
+        ctx->display_h  = ctx->height;
+        /* Pixels per point, for window sizes and sourceRect */
+        CGFloat scale = display.width > 0 ? (CGFloat)ctx->width / display.width : 1;
+
+        SCContentFilter *filter = nil;
+        if (target && target->window) {
+            SCWindow *window = nil;
+            for (SCWindow *w in content.windows) {
+                if (w.windowID == (CGWindowID)target->window) {
+                    window = w;
+                    break;
+                }
+            }
+            if (!window) {
+                fprintf(stderr, "capture_mac: no window %llu\n",
+                        (unsigned long long)target->window);
+                free(ctx);
+                return NULL;
+            }
+            filter = [[SCContentFilter alloc] initWithDesktopIndependentWindow:window];
+            ctx->width  = (int)(window.frame.size.width  * scale);
+            ctx->height = (int)(window.frame.size.height * scale);
+        } else {
+            /* Filter: capture entire display, exclude nothing */
+            filter = [[SCContentFilter alloc] initWithDisplay:display
+                                            excludingWindows:@[]];
+        }
+
+        dirty_rect_t area;
+        if (capture_target_area(target, ctx->width, ctx->height, &area) < 0) {
+            fprintf(stderr, "capture_mac: region is outside the %dx%d capture area\n",
+                    ctx->width, ctx->height);
+            free(ctx);
+            return NULL;
+        }
+        ctx->width  = area.w;
+        ctx->height = area.h;
 
         /* Configure stream: BGRA pixel format, up to 60 fps */
         SCStreamConfiguration *config = [[SCStreamConfiguration alloc] init];
         config.width  = ctx->width;
         config.height = ctx->height;
+        if (target && target->region.w > 0)
+            config.sourceRect = CGRectMake(area.x / scale, area.y / scale,
+                                           ctx->width / scale, ctx->height / scale);
         config.pixelFormat = kCVPixelFormatType_32BGRA;
         config.minimumFrameInterval = CMTimeMake(1, 60);
         config.showsCursor = YES;
-
-        /* Filter: capture entire display, exclude nothing */
-        SCContentFilter *filter =
-            [[SCContentFilter alloc] initWithDisplay:display
-                                    excludingWindows:@[]];
+        /* Borrowed frames stay out of the pool while queued downstream */
+        config.queueDepth = 8;
 
         /* Create stream and frame receiver */
         SCStream *stream =
@@ -225,15 +399,11 @@ capture_ctx_t *capture_init(void)
         /* Retain ObjC objects into the C struct */
         ctx->stream   = (void *)CFBridgingRetain(stream);
         ctx->receiver = (void *)CFBridgingRetain(receiver);
+        ctx->config   = (void *)CFBridgingRetain(config);
 
-        /* Allocate persistent BGRA buffer */
-        ctx->buffer_size = (size_t)ctx->width * ctx->height * 4;
-        ctx->buffer = malloc(ctx->buffer_size);
-        if (!ctx->buffer) {
-            perror("capture_mac: malloc");
-            capture_free(ctx);
-            return NULL;
-        }
+        ctx->dirty_count = -1;
+        ctx->format      = PIX_FMT_BGRA;
+        ctx->cv_format   = kCVPixelFormatType_32BGRA;
 
         /* Wait for first frame delivery */
         usleep(200000);
@@ -247,46 +417,263 @@ capture_ctx_t *capture_init(void)
 int capture_width(const capture_ctx_t *ctx)  { return ctx->width;  }
 int capture_height(const capture_ctx_t *ctx) { return ctx->height; }
 
-const uint8_t *capture_grab(capture_ctx_t *ctx)
+/* Apply a changed config to the running stream.  Returns 0 or -1. */
+static int update_config(capture_ctx_t *ctx)
+{
+    SCStream *stream = (__bridge SCStream *)ctx->stream;
+    SCStreamConfiguration *config = (__bridge SCStreamConfiguration *)ctx->config;
+
+    dispatch_semaphore_t sem = dispatch_semaphore_create(0);
+    __block NSError *updateErr = nil;
+    [stream updateConfiguration:config completionHandler:^(NSError *err) {
+        updateErr = err;
+        dispatch_semaphore_signal(sem);
+    }];
+    dispatch_semaphore_wait(sem, dispatch_time(DISPATCH_TIME_NOW,
+                                               5 * NSEC_PER_SEC));
+    if (updateErr) {
+        fprintf(stderr, "capture_mac: updateConfiguration: %s\n",
+                [[updateErr localizedDescription] UTF8String]);
+        return -1;
+    }
+    return 0;
+}
+
+/* Drop frames delivered under the old config and wait for a new one */
+static void restart_frames(capture_ctx_t *ctx)
 {
+    ctx->have_frame = 0;
+    capture_frame_release(&ctx->held);
+    [(__bridge SCKFrameReceiver *)ctx->receiver reset];
+    usleep(200000);
+}
+
+/*
+ * BGRA, or NV12 converted by ScreenCaptureKit itself (420v, BT.601 video
+ * range like convert.c — not bit-identical, chroma is filtered).
+ */
+int capture_set_format(capture_ctx_t *ctx, pix_fmt_t fmt)
+{
+    OSType cv_format;
+    switch (fmt) {
+    case PIX_FMT_BGRA: cv_format = kCVPixelFormatType_32BGRA; break;
+    case PIX_FMT_NV12: cv_format = kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange; break;
+    default:           return -1;
+    }
+    if (fmt == ctx->format)
+        return 0;
+
     @autoreleasepool {
-        SCKFrameReceiver *receiver =
-            (__bridge SCKFrameReceiver *)ctx->receiver;
+        SCStreamConfiguration *config = (__bridge SCStreamConfiguration *)ctx->config;
+        config.pixelFormat = cv_format;
+        if (fmt == PIX_FMT_NV12)
+            config.colorMatrix = kCGDisplayStreamYCbCrMatrix_ITU_R_601_4;
+        if (update_config(ctx) < 0) {
+            config.pixelFormat = ctx->cv_format;
+            return -1;
+        }
+    }
 
-        CVPixelBufferRef pixbuf = [receiver copyLatestFrame];
-        if (!pixbuf)
-            return NULL;
+    ctx->format    = fmt;
+    ctx->cv_format = cv_format;
+    restart_frames(ctx);   /* held frame is still in the old format */
 
-        CVPixelBufferLockBaseAddress(pixbuf, kCVPixelBufferLock_ReadOnly);
+    fprintf(stderr, "capture_mac: delivering %s (converted by ScreenCaptureKit)\n",
+            pix_fmt_name(fmt));
+    return 0;
+}
 
-        void  *base       = CVPixelBufferGetBaseAddress(pixbuf);
-        size_t srcStride  = CVPixelBufferGetBytesPerRow(pixbuf);
-        size_t destStride = (size_t)ctx->width * 4;
-        int h = ctx->height;
+/*
+ * Let ScreenCaptureKit scale: the stream's output size is just config
+ * width/height, resampled by the compositor before delivery.
+ */
+int capture_set_size(capture_ctx_t *ctx, int width, int height)
+{
+    if (width == ctx->width && height == ctx->height)
+        return 0;
 
-        /* Copy pixel data — handle row padding if present */
-        if (srcStride == destStride) {
-            memcpy(ctx->buffer, base, destStride * h);
-        } else {
-            for (int j = 0; j < h; j++) {
-                memcpy(ctx->buffer + j * destStride,
-                       (uint8_t *)base + j * srcStride,
-                       destStride);
-            }
+    @autoreleasepool {
+        SCStreamConfiguration *config = (__bridge SCStreamConfiguration *)ctx->config;
+        config.width  = (size_t)width;
+        config.height = (size_t)height;
+        if (update_config(ctx) < 0) {
+            config.width  = (size_t)ctx->width;
+            config.height = (size_t)ctx->height;
+            return -1;
         }
+    }
+
+    ctx->width  = width;
+    ctx->height = height;
+    restart_frames(ctx);
+
+    fprintf(stderr, "capture_mac: scaling to %dx%d in ScreenCaptureKit\n",
+            width, height);
+    return 0;
+}
+
+int capture_dirty_rects(const capture_ctx_t *ctx, const dirty_rect_t **rects)
+{
+    *rects = ctx->dirty;
+    return ctx->dirty_count;
+}
+
+/* ScreenCaptureKit composites the cursor into the frames (showsCursor) */
+int capture_cursor(capture_ctx_t *ctx, capture_cursor_t *cursor)
+{
+    (void)ctx;
+    (void)cursor;
+    return -1;
+}
+
+/* ScreenCaptureKit delivers a frame per presented change, at most at our fps */
+int capture_wait_frame(capture_ctx_t *ctx, uint64_t timeout_ns)
+{
+    return [(__bridge SCKFrameReceiver *)ctx->receiver waitForFrame:timeout_ns];
+}
+
+int capture_can_borrow(const capture_ctx_t *ctx)
+{
+    (void)ctx;
+    return 1;
+}
 
-        CVPixelBufferUnlockBaseAddress(pixbuf, kCVPixelBufferLock_ReadOnly);
-        CVPixelBufferRelease(pixbuf);
+/*
+ * Take the latest delivered buffer (retained) and update dirty_count for
+ * it.  Returns NULL if there is none yet in the current format and size.
+ */
+static CVPixelBufferRef take_latest(capture_ctx_t *ctx)
+{
+    SCKFrameReceiver *receiver = (__bridge SCKFrameReceiver *)ctx->receiver;
 
-        return ctx->buffer;
+    int count = -1;
+    CVPixelBufferRef pixbuf = [receiver copyLatestFrameDirty:ctx->dirty
+                                                       count:&count];
+    if (!pixbuf)
+        return NULL;
+    if (CVPixelBufferGetPixelFormatType(pixbuf) != ctx->cv_format ||
+        (int)CVPixelBufferGetWidth(pixbuf)  != ctx->width ||
+        (int)CVPixelBufferGetHeight(pixbuf) != ctx->height) {
+        CVPixelBufferRelease(pixbuf);   /* delivered before a config change */
+        return NULL;
+    }
+
+    ctx->dirty_count = ctx->have_frame ? count : -1;
+    for (int i = 0; i < ctx->dirty_count; i++) {
+        dirty_rect_t *d = &ctx->dirty[i];
+        if (d->x < 0) { d->w += d->x; d->x = 0; }
+        if (d->y < 0) { d->h += d->y; d->y = 0; }
+        if (d->x + d->w > ctx->width)  d->w = ctx->width  - d->x;
+        if (d->y + d->h > ctx->height) d->h = ctx->height - d->y;
+        if (d->w <= 0 || d->h <= 0)
+            d->w = d->h = 0;
     }
+    return pixbuf;
 }
 
-void capture_free(capture_ctx_t *ctx)
+/*
+ * ScreenCaptureKit keeps streaming at the configured size when the
+ * display mode changes, stretching the new desktop into it; look at the
+ * mode again after every reconfiguration and give up the context if its
+ * size moved.
+ */
+static int display_changed(capture_ctx_t *ctx)
 {
-    if (!ctx)
-        return;
+    int changes = atomic_load(&display_changes);
+    if (ctx->lost || changes == ctx->seen_changes)
+        return ctx->lost;
+    ctx->seen_changes = changes;
+
+    CGDisplayModeRef mode = CGDisplayCopyDisplayMode(ctx->display_id);
+    if (!mode) {
+        ctx->lost = 1;   /* display unplugged */
+    } else {
+        ctx->lost = (int)CGDisplayModeGetPixelWidth(mode)  != ctx->display_w ||
+                    (int)CGDisplayModeGetPixelHeight(mode) != ctx->display_h;
+        CGDisplayModeRelease(mode);
+    }
+    if (ctx->lost)
+        fprintf(stderr, "capture_mac: display mode changed\n");
+    return ctx->lost;
+}
+
+int capture_lost(const capture_ctx_t *ctx)
+{
+    return ctx->lost;
+}
+
+static void release_pixbuf(void *ref)
+{
+    CVPixelBufferRef pixbuf = ref;
+    CVPixelBufferUnlockBaseAddress(pixbuf, kCVPixelBufferLock_ReadOnly);
+    CVPixelBufferRelease(pixbuf);
+}
+
+/* Lock pixbuf (read-only locks nest) and describe it in *frame, which takes
+ * over the caller's reference */
+static void lend_pixbuf(capture_ctx_t *ctx, CVPixelBufferRef pixbuf,
+                        capture_frame_t *frame)
+{
+    CVPixelBufferLockBaseAddress(pixbuf, kCVPixelBufferLock_ReadOnly);
+
+    memset(frame, 0, sizeof(*frame));
+    frame->frame.format = ctx->format;
+    frame->frame.width  = ctx->width;
+    frame->frame.height = ctx->height;
+    if (CVPixelBufferIsPlanar(pixbuf)) {
+        size_t n = CVPixelBufferGetPlaneCount(pixbuf);
+        for (size_t i = 0; i < n && i < 3; i++) {
+            frame->frame.planes[i]  = CVPixelBufferGetBaseAddressOfPlane(pixbuf, i);
+            frame->frame.strides[i] = CVPixelBufferGetBytesPerRowOfPlane(pixbuf, i);
+        }
+    } else {
+        frame->frame.planes[0]  = CVPixelBufferGetBaseAddress(pixbuf);
+        frame->frame.strides[0] = CVPixelBufferGetBytesPerRow(pixbuf);
+    }
+    frame->ref     = pixbuf;
+    frame->release = release_pixbuf;
+}
+
+int capture_acquire(capture_ctx_t *ctx, capture_frame_t *frame)
+{
+    if (display_changed(ctx))
+        return -1;
+    CVPixelBufferRef pixbuf = take_latest(ctx);
+    if (!pixbuf)
+        return -1;
+    ctx->have_frame = 1;
+
+    /* Locked for as long as the handle lives */
+    lend_pixbuf(ctx, pixbuf, frame);
+    return 0;
+}
+
+const frame_t *capture_grab(capture_ctx_t *ctx)
+{
+    @autoreleasepool {
+        if (display_changed(ctx))
+            return NULL;
+        CVPixelBufferRef pixbuf = take_latest(ctx);
+        if (!pixbuf)
+            return ctx->held.ref ? &ctx->held.frame : NULL;
 
+        if (ctx->dirty_count == 0 && ctx->held.ref) {
+            /* No new frame delivered since the last grab */
+            CVPixelBufferRelease(pixbuf);
+            return &ctx->held.frame;
+        }
+
+        /* Every delivered buffer is a full image: no copy, just swap */
+        capture_frame_release(&ctx->held);
+        lend_pixbuf(ctx, pixbuf, &ctx->held);
+        ctx->have_frame = 1;
+        return &ctx->held.frame;
+    }
+}
+
+/* Stop the stream and drop every object, keeping the struct. */
+static void release_ctx(capture_ctx_t *ctx)
+{
     @autoreleasepool {
         if (ctx->stream) {
             SCStream *stream = (__bridge SCStream *)ctx->stream;
@@ -302,8 +689,32 @@ void capture_free(capture_ctx_t *ctx)
 
         if (ctx->receiver)
             CFBridgingRelease(ctx->receiver);
+        if (ctx->config)
+            CFBridgingRelease(ctx->config);
     }
 
-    free(ctx->buffer);
+    capture_frame_release(&ctx->held);
+    ctx->stream   = NULL;
+    ctx->receiver = NULL;
+    ctx->config   = NULL;
+}
+
+/* A new stream and filter for the display as it is now */
+int capture_reset(capture_ctx_t *ctx)
+{
+    release_ctx(ctx);
+    capture_ctx_t *fresh = capture_init(&ctx->target);
+    if (!fresh)
+        return -1;
+    *ctx = *fresh;
+    free(fresh);   /* only the struct: ctx owns the stream now */
+    return 0;
+}
+
+void capture_free(capture_ctx_t *ctx)
+{
+    if (!ctx)
+        return;
+    release_ctx(ctx);
     free(ctx);
 }
@@ -0,0 +1,887 @@
+/*
+ * Linux PipeWire screencast backend (Wayland, via xdg-desktop-portal)
+ *
+ * Implements the capture.h calls for capture_linux.c.
+ *
+ * Architecture:
+ *   - Portal handshake on the session bus (org.freedesktop.portal
+ *     ScreenCast): CreateSession -> SelectSources -> Start, which shows
+ *     the compositor's picker, then OpenPipeWireRemote for the fd of a
+ *     PipeWire connection that can see the chosen stream node
+ *   - A pw_stream on its own pw_thread_loop; every processed buffer is
+ *     kept as "latest" and the previous one goes back to the compositor
+ *     once nobody holds it
+ *   - Formats offered: BGRx/BGRA as DMA-BUF with the LINEAR modifier
+ *     first, shared memory (MemFd) second.  A linear DMA-BUF is mmapped
+ *     once and read in place, bracketed by DMA_BUF_IOCTL_SYNC, so the
+ *     frame reaches the converter without a copy
+ *   - capture_acquire() lends the latest buffer out, refcounted, until
+ *     capture_frame_release(); capture_grab() holds one the same way
+ *   - SPA_META_VideoDamage regions of every buffer are merged until the
+ *     next grab and reported through capture_dirty_rects()
+ *
+ * The compositor's picker chooses the monitor or window; --region crops
+ * the result in place.
+ *
+ * Requires: libpipewire-0.3, libdbus-1 (HAVE_PIPEWIRE, see Makefile)
+ */
+
+#include "capture_linux.h"
+
+#include <pipewire/pipewire.h>
+#include <spa/buffer/meta.h>
+#include <spa/param/video/format-utils.h>
+#include <spa/pod/builder.h>
+#include <dbus/dbus.h>
+
+#include <linux/dma-buf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define MAX_DIRTY_RECTS 64
+#define MAX_DAMAGE      16    /* regions asked for per buffer */
+#define PORTAL_TIMEOUT  120   /* seconds, the picker waits for the user */
+
+#define PORTAL_NAME     "org.freedesktop.portal.Desktop"
+#define PORTAL_PATH     "/org/freedesktop/portal/desktop"
+#define PORTAL_CAST     "org.freedesktop.portal.ScreenCast"
+#define PORTAL_REQUEST  "org.freedesktop.portal.Request"
+
+typedef struct pw_ctx pw_ctx_t;
+
+/* Per pw_buffer, in its user_data */
+typedef struct {
+    pw_ctx_t         *ctx;
+    struct pw_buffer *buf;
+    int               refs;      /* latest + lent handles */
+    int               removed;   /* stream dropped it while lent */
+    uint8_t          *data;      /* pixels (our mmap for DMA-BUF) */
+    uint8_t          *map;       /* our mmap, NULL if PipeWire mapped it */
+    size_t            map_size;
+    int               dmabuf;    /* fd to sync, -1 if none */
+    size_t            offset;    /* of the latest frame, from its chunk */
+    size_t            stride;
+} pw_slot_t;
+
+struct pw_ctx {
+    DBusConnection     *bus;
+    char               *session;    /* portal session handle */
+    int                 cursor;     /* cursor drawn into the frames */
+
+    struct pw_thread_loop *loop;
+    struct pw_context  *context;
+    struct pw_core     *core;
+    struct pw_stream   *stream;
+    struct spa_hook     listener;
+
+    /* Guarded by the loop lock */
+    int                 width;      /* negotiated stream size */
+    int                 height;
+    int                 negotiated;
+    int                 failed;
+    int                 resized;    /* renegotiated to a new size: pwc_reset() */
+    pw_slot_t          *latest;
+    uint64_t            delivered;  /* buffers made latest so far */
+    uint64_t            taken;      /* `delivered` as of the last acquire */
+    dirty_rect_t        pending[MAX_DIRTY_RECTS];   /* since last acquire */
+    int                 pending_count;              /* -1 = whole frame */
+
+    /* Capture thread only */
+    capture_target_t    target;     /* for the --region on a new size */
+    dirty_rect_t        area;       /* --region, in stream pixels */
+    capture_frame_t     held;       /* what capture_grab() returned */
+    int                 have_frame;
+    dirty_rect_t        dirty[MAX_DIRTY_RECTS];
+    int                 dirty_count;
+};
+
+/* ── Portal (D-Bus) ────────────────────────────────────────── */
+
+static void dict_add(DBusMessageIter *dict, const char *key, int type,
+                     const char *sig, const void *value)
+{
+    DBusMessageIter entry, var;
+    dbus_message_iter_open_container(dict, DBUS_TYPE_DICT_ENTRY, NULL, &entry);
+    dbus_message_iter_append_basic(&entry, DBUS_TYPE_STRING, &key);
+    dbus_message_iter_open_container(&entry, DBUS_TYPE_VARIANT, sig, &var);
+    dbus_message_iter_append_basic(&var, type, value);
+    dbus_message_iter_close_container(&entry, &var);
+    dbus_message_iter_close_container(dict, &entry);
+}
+
+/* Find key in an a{sv} at *array and point *value into its variant */
+static int dict_find(DBusMessageIter *array, const char *key, DBusMessageIter *value)
+{
+    DBusMessageIter entries;
+    if (dbus_message_iter_get_arg_type(array) != DBUS_TYPE_ARRAY)
+        return -1;
+    dbus_message_iter_recurse(array, &entries);
+    while (dbus_message_iter_get_arg_type(&entries) == DBUS_TYPE_DICT_ENTRY) {
+        DBusMessageIter entry;
+        const char *k;
+        dbus_message_iter_recurse(&entries, &entry);
+        dbus_message_iter_get_basic(&entry, &k);
+        if (strcmp(k, key) == 0) {
+            dbus_message_iter_next(&entry);
+            dbus_message_iter_recurse(&entry, value);
+            return 0;
+        }
+        dbus_message_iter_next(&entries);
+    }
+    return -1;
+}
+
+/*
+ * Send a portal call whose answer comes as a Request.Response signal and
+ * wait for it.  Returns the signal (results a{sv} in *results), or NULL
+ * if the call failed or the user cancelled.
+ */
+static DBusMessage *portal_request(pw_ctx_t *ctx, DBusMessage *call, const char *token,
+                                   DBusMessageIter *results)
+{
+    /* The request object path is known in advance: subscribe first */
+    char sender[128], path[256], rule[384];
+    snprintf(sender, sizeof(sender), "%s", dbus_bus_get_unique_name(ctx->bus) + 1);
+    for (char *c = sender; *c; c++) {
+        if (*c == '.')
+            *c = '_';
+    }
+    snprintf(path, sizeof(path), PORTAL_PATH "/request/%s/%s", sender, token);
+    snprintf(rule, sizeof(rule),
+             "type='signal',interface='" PORTAL_REQUEST "',member='Response',path='%s'", path);
+    dbus_bus_add_match(ctx->bus, rule, NULL);
+
+    DBusError err;
+    dbus_error_init(&err);
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(ctx->bus, call, 5000, &err);
+    dbus_message_unref(call);
+    if (!reply) {
+        fprintf(stderr, "capture_pw: portal: %s\n", err.message);
+        dbus_error_free(&err);
+        dbus_bus_remove_match(ctx->bus, rule, NULL);
+        return NULL;
+    }
+    dbus_message_unref(reply);
+
+    DBusMessage *response = NULL;
+    for (int waited = 0; !response && waited < PORTAL_TIMEOUT * 10; waited++) {
+        dbus_connection_read_write(ctx->bus, 100);
+        DBusMessage *msg;
+        while (!response && (msg = dbus_connection_pop_message(ctx->bus)) != NULL) {
+            if (dbus_message_is_signal(msg, PORTAL_REQUEST, "Response") &&
+                strcmp(dbus_message_get_path(msg), path) == 0)
+                response = msg;
+            else
+                dbus_message_unref(msg);
+        }
+    }
+    dbus_bus_remove_match(ctx->bus, rule, NULL);
+    if (!response) {
+        fprintf(stderr, "capture_pw: portal did not answer\n");
+        return NULL;
+    }
+
+    DBusMessageIter args;
+    uint32_t code = 2;
+    dbus_message_iter_init(response, &args);
+    if (dbus_message_iter_get_arg_type(&args) == DBUS_TYPE_UINT32)
+        dbus_message_iter_get_basic(&args, &code);
+    if (code != 0) {
+        fprintf(stderr, "capture_pw: screencast %s\n", code == 1 ? "cancelled" : "refused");
+        dbus_message_unref(response);
+        return NULL;
+    }
+    dbus_message_iter_next(&args);
+    *results = args;
+    return response;
+}
+
+/* New ScreenCast call on the session (or none), options dict left open */
+static DBusMessage *portal_call(pw_ctx_t *ctx, const char *method, const char *token,
+                                DBusMessageIter *args, DBusMessageIter *options)
+{
+    DBusMessage *call = dbus_message_new_method_call(PORTAL_NAME, PORTAL_PATH,
+                                                     PORTAL_CAST, method);
+    dbus_message_iter_init_append(call, args);
+    if (ctx->session)
+        dbus_message_iter_append_basic(args, DBUS_TYPE_OBJECT_PATH, &ctx->session);
+    if (strcmp(method, "Start") == 0) {
+        const char *parent = "";
+        dbus_message_iter_append_basic(args, DBUS_TYPE_STRING, &parent);
+    }
+    dbus_message_iter_open_container(args, DBUS_TYPE_ARRAY, "{sv}", options);
+    if (token)
+        dict_add(options, "handle_token", DBUS_TYPE_STRING, "s", &token);
+    return call;
+}
+
+static uint32_t portal_property(pw_ctx_t *ctx, const char *name)
+{
+    const char *iface = PORTAL_CAST;
+    uint32_t value = 0;
+    DBusMessage *call = dbus_message_new_method_call(PORTAL_NAME, PORTAL_PATH,
+                                                     "org.freedesktop.DBus.Properties", "Get");
+    dbus_message_append_args(call, DBUS_TYPE_STRING, &iface, DBUS_TYPE_STRING, &name,
+                             DBUS_TYPE_INVALID);
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(ctx->bus, call, 5000, NULL);
+    dbus_message_unref(call);
+    if (reply) {
+        DBusMessageIter args, var;
+        dbus_message_iter_init(reply, &args);
+        dbus_message_iter_recurse(&args, &var);
+        if (dbus_message_iter_get_arg_type(&var) == DBUS_TYPE_UINT32)
+            dbus_message_iter_get_basic(&var, &value);
+        dbus_message_unref(reply);
+    }
+    return value;
+}
+
+/*
+ * Run the portal handshake.  Returns a PipeWire fd and the stream's node
+ * id in *node, or -1.
+ */
+static int portal_open(pw_ctx_t *ctx, uint32_t *node)
+{
+    DBusError err;
+    dbus_error_init(&err);
+    ctx->bus = dbus_bus_get_private(DBUS_BUS_SESSION, &err);
+    if (!ctx->bus) {
+        fprintf(stderr, "capture_pw: no session bus: %s\n", err.message);
+        dbus_error_free(&err);
+        return -1;
+    }
+    dbus_connection_set_exit_on_disconnect(ctx->bus, FALSE);
+
+    DBusMessageIter args, options, results, value;
+    DBusMessage *call, *response;
+
+    /* CreateSession */
+    char session_token[32];
+    snprintf(session_token, sizeof(session_token), "screen2cam%d", (int)getpid());
+    const char *session_token_p = session_token;
+    call = portal_call(ctx, "CreateSession", "screen2cam_create", &args, &options);
+    dict_add(&options, "session_handle_token", DBUS_TYPE_STRING, "s", &session_token_p);
+    dbus_message_iter_close_container(&args, &options);
+    response = portal_request(ctx, call, "screen2cam_create", &results);
+    if (!response)
+        return -1;
+    if (dict_find(&results, "session_handle", &value) == 0) {
+        const char *handle;
+        dbus_message_iter_get_basic(&value, &handle);
+        ctx->session = strdup(handle);
+    }
+    dbus_message_unref(response);
+    if (!ctx->session)
+        return -1;
+
+    /* SelectSources: one monitor or window; cursor drawn in if offered */
+    uint32_t types = 1 | 2;
+    dbus_bool_t multiple = FALSE;
+    uint32_t cursor_mode = 2;   /* embedded */
+    call = portal_call(ctx, "SelectSources", "screen2cam_select", &args, &options);
+    dict_add(&options, "types", DBUS_TYPE_UINT32, "u", &types);
+    dict_add(&options, "multiple", DBUS_TYPE_BOOLEAN, "b", &multiple);
+    if (portal_property(ctx, "AvailableCursorModes") & cursor_mode) {
+        dict_add(&options, "cursor_mode", DBUS_TYPE_UINT32, "u", &cursor_mode);
+        ctx->cursor = 1;
+    }
+    dbus_message_iter_close_container(&args, &options);
+    response = portal_request(ctx, call, "screen2cam_select", &results);
+    if (!response)
+        return -1;
+    dbus_message_unref(response);
+
+    /* Start: the picker; results carry streams a(ua{sv}) */
+    call = portal_call(ctx, "Start", "screen2cam_start", &args, &options);
+    dbus_message_iter_close_container(&args, &options);
+    response = portal_request(ctx, call, "screen2cam_start", &results);
+    if (!response)
+        return -1;
+    int have_node = 0;
+    if (dict_find(&results, "streams", &value) == 0 &&
+        dbus_message_iter_get_arg_type(&value) == DBUS_TYPE_ARRAY) {
+        DBusMessageIter streams, stream;
+        dbus_message_iter_recurse(&value, &streams);
+        if (dbus_message_iter_get_arg_type(&streams) == DBUS_TYPE_STRUCT) {
+            dbus_message_iter_recurse(&streams, &stream);
+            dbus_message_iter_get_basic(&stream, node);
+            have_node = 1;
+        }
+    }
+    dbus_message_unref(response);
+    if (!have_node) {
+        fprintf(stderr, "capture_pw: portal returned no stream\n");
+        return -1;
+    }
+
+    /* OpenPipeWireRemote answers directly with a unix fd */
+    call = portal_call(ctx, "OpenPipeWireRemote", NULL, &args, &options);
+    dbus_message_iter_close_container(&args, &options);
+    DBusMessage *reply = dbus_connection_send_with_reply_and_block(ctx->bus, call, 5000, &err);
+    dbus_message_unref(call);
+    int fd = -1;
+    if (!reply || !dbus_message_get_args(reply, &err, DBUS_TYPE_UNIX_FD, &fd,
+                                         DBUS_TYPE_INVALID)) {
+        fprintf(stderr, "capture_pw: OpenPipeWireRemote: %s\n", err.message);
+        dbus_error_free(&err);
+        fd = -1;
+    }
+    if (reply)
+        dbus_message_unref(reply);
+    return fd;
+}
+
+static void portal_close(pw_ctx_t *ctx)
+{
+    if (ctx->session) {
+        DBusMessage *call = dbus_message_new_method_call(PORTAL_NAME, ctx->session,
+                                                         "org.freedesktop.portal.Session",
+                                                         "Close");
+        dbus_connection_send(ctx->bus, call, NULL);
+        dbus_connection_flush(ctx->bus);
+        dbus_message_unref(call);
+        free(ctx->session);
+    }
+    if (ctx->bus) {
+        dbus_connection_close(ctx->bus);
+        dbus_connection_unref(ctx->bus);
+    }
+}
+
+/* ── Stream callbacks (loop thread, loop lock held) ────────── */
+
+/* Drop one reference; the last gives the buffer back to the compositor */
+static void slot_unref(pw_slot_t *slot)
+{
+    if (--slot->refs > 0)
+        return;
+    if (slot->removed) {
+        if (slot->map)
+            munmap(slot->map, slot->map_size);
+        free(slot);
+    } else {
+        pw_stream_queue_buffer(slot->ctx->stream, slot->buf);
+    }
+}
+
+static void add_pending(pw_ctx_t *ctx, const struct spa_buffer *buf)
+{
+    struct spa_meta *meta = spa_buffer_find_meta(buf, SPA_META_VideoDamage);
+    if (!meta) {
+        ctx->pending_count = -1;
+        return;
+    }
+
+    struct spa_meta_region *r;
+    spa_meta_for_each(r, meta) {
+        if (!spa_meta_region_is_valid(r))
+            break;
+        if (ctx->pending_count < 0)
+            continue;
+        if (ctx->pending_count == MAX_DIRTY_RECTS) {
+            ctx->pending_count = -1;
+            continue;
+        }
+        ctx->pending[ctx->pending_count++] = (dirty_rect_t){
+            r->region.position.x, r->region.position.y,
+            (int)r->region.size.width, (int)r->region.size.height
+        };
+    }
+}
+
+static void on_process(void *data)
+{
+    pw_ctx_t *ctx = data;
+    struct pw_buffer *b, *newest = NULL;
+
+    /* Keep only the newest buffer, but every one's damage */
+    while ((b = pw_stream_dequeue_buffer(ctx->stream)) != NULL) {
+        struct spa_data *d = &b->buffer->datas[0];
+        pw_slot_t *slot = b->user_data;
+        if (!slot->data || (d->chunk->flags & SPA_CHUNK_FLAG_CORRUPTED) ||
+            (d->chunk->size == 0 && d->type != SPA_DATA_DmaBuf)) {
+            pw_stream_queue_buffer(ctx->stream, b);   /* e.g. cursor-only update */
+            continue;
+        }
+        add_pending(ctx, b->buffer);
+        if (newest)
+            pw_stream_queue_buffer(ctx->stream, newest);
+        newest = b;
+    }
+    if (!newest)
+        return;
+
+    pw_slot_t *slot = newest->user_data;
+    const struct spa_chunk *chunk = newest->buffer->datas[0].chunk;
+    slot->offset = chunk->offset;
+    slot->stride = chunk->stride > 0 ? (size_t)chunk->stride : (size_t)ctx->width * 4;
+    slot->refs   = 1;
+    if (ctx->latest)
+        slot_unref(ctx->latest);
+    ctx->latest = slot;
+    ctx->delivered++;
+    pw_thread_loop_signal(ctx->loop, false);
+}
+
+static void on_param_changed(void *data, uint32_t id, const struct spa_pod *param)
+{
+    pw_ctx_t *ctx = data;
+    if (id != SPA_PARAM_Format || !param)
+        return;
+
+    struct spa_video_info_raw info;
+    uint32_t media_type, media_subtype;
+    if (spa_format_parse(param, &media_type, &media_subtype) < 0 ||
+        media_type != SPA_MEDIA_TYPE_video || media_subtype != SPA_MEDIA_SUBTYPE_raw ||
+        spa_format_video_raw_parse(param, &info) < 0)
+        return;
+
+    /* The monitor's mode changed: the frames are the new size from now on */
+    if (ctx->negotiated &&
+        ((int)info.size.width != ctx->width || (int)info.size.height != ctx->height)) {
+        fprintf(stderr, "capture_pw: stream size changed to %ux%u\n",
+                info.size.width, info.size.height);
+        ctx->resized = 1;
+        if (ctx->latest) {
+            slot_unref(ctx->latest);
+            ctx->latest = NULL;
+        }
+    }
+    ctx->width      = (int)info.size.width;
+    ctx->height     = (int)info.size.height;
+    ctx->negotiated = 1;
+
+    int dmabuf = (info.flags & SPA_VIDEO_FLAG_MODIFIER) != 0;
+    int types  = dmabuf ? 1 << SPA_DATA_DmaBuf
+                        : (1 << SPA_DATA_MemFd) | (1 << SPA_DATA_MemPtr);
+    fprintf(stderr, "capture_pw: %dx%d %s via %s\n", ctx->width, ctx->height,
+            info.format == SPA_VIDEO_FORMAT_BGRA ? "BGRA" : "BGRx",
+            dmabuf ? "DMA-BUF" : "shared memory");
+
+    uint8_t storage[1024];
+    struct spa_pod_builder b = SPA_POD_BUILDER_INIT(storage, sizeof(storage));
+    const struct spa_pod *params[3];
+    params[0] = spa_pod_builder_add_object(&b,
+        SPA_TYPE_OBJECT_ParamBuffers, SPA_PARAM_Buffers,
+        SPA_PARAM_BUFFERS_buffers,  SPA_POD_CHOICE_RANGE_Int(8, 3, 16),
+        SPA_PARAM_BUFFERS_dataType, SPA_POD_CHOICE_FLAGS_Int(types));
+    params[1] = spa_pod_builder_add_object(&b,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_Header),
+        SPA_PARAM_META_size, SPA_POD_Int(sizeof(struct spa_meta_header)));
+    params[2] = spa_pod_builder_add_object(&b,
+        SPA_TYPE_OBJECT_ParamMeta, SPA_PARAM_Meta,
+        SPA_PARAM_META_type, SPA_POD_Id(SPA_META_VideoDamage),
+        SPA_PARAM_META_size, SPA_POD_CHOICE_RANGE_Int(
+            sizeof(struct spa_meta_region) * MAX_DAMAGE,
+            sizeof(struct spa_meta_region) * 1,
+            sizeof(struct spa_meta_region) * MAX_DAMAGE));
+    pw_stream_update_params(ctx->stream, params, 3);
+}
+
+/* Map DMA-BUFs ourselves; PIPEWIRE maps memfds (PW_STREAM_FLAG_MAP_BUFFERS) */
+static void on_add_buffer(void *data, struct pw_buffer *buf)
+{
+    pw_ctx_t *ctx = data;
+    struct spa_data *d = &buf->buffer->datas[0];
+    pw_slot_t *slot = calloc(1, sizeof(*slot));
+    if (!slot)
+        return;
+    slot->ctx    = ctx;
+    slot->buf    = buf;
+    slot->dmabuf = -1;
+
+    if (d->type == SPA_DATA_DmaBuf) {
+        slot->map_size = d->mapoffset + d->maxsize;
+        slot->map = mmap(NULL, slot->map_size, PROT_READ, MAP_SHARED, (int)d->fd, 0);
+        if (slot->map == MAP_FAILED) {
+            fprintf(stderr, "capture_pw: cannot map DMA-BUF\n");
+            slot->map = NULL;
+        } else {
+            slot->data   = slot->map + d->mapoffset;
+            slot->dmabuf = (int)d->fd;
+        }
+    } else {
+        slot->data = d->data;
+    }
+    buf->user_data = slot;
+}
+
+static void on_remove_buffer(void *data, struct pw_buffer *buf)
+{
+    pw_ctx_t *ctx = data;
+    pw_slot_t *slot = buf->user_data;
+    if (!slot)
+        return;
+    if (ctx->latest == slot) {
+        ctx->latest = NULL;
+        slot->refs--;
+    }
+    slot->removed = 1;
+    slot->refs++;          /* slot_unref() below frees it unless lent */
+    slot_unref(slot);
+    buf->user_data = NULL;
+}
+
+static void on_state_changed(void *data, enum pw_stream_state old,
+                             enum pw_stream_state state, const char *error)
+{
+    pw_ctx_t *ctx = data;
+    (void)old;
+    if (state == PW_STREAM_STATE_ERROR || state == PW_STREAM_STATE_UNCONNECTED) {
+        fprintf(stderr, "capture_pw: stream %s%s%s\n", pw_stream_state_as_string(state),
+                error ? ": " : "", error ? error : "");
+        ctx->failed = 1;
+        pw_thread_loop_signal(ctx->loop, false);
+    }
+}
+
+static const struct pw_stream_events stream_events = {
+    PW_VERSION_STREAM_EVENTS,
+    .state_changed = on_state_changed,
+    .param_changed = on_param_changed,
+    .add_buffer    = on_add_buffer,
+    .remove_buffer = on_remove_buffer,
+    .process       = on_process,
+};
+
+/* BGRx/BGRA of any size, as DMA-BUF (linear only) or not */
+static const struct spa_pod *enum_format(struct spa_pod_builder *b, int dmabuf)
+{
+    struct spa_pod_frame f;
+    spa_pod_builder_push_object(b, &f, SPA_TYPE_OBJECT_Format, SPA_PARAM_EnumFormat);
+    spa_pod_builder_add(b,
+        SPA_FORMAT_mediaType,       SPA_POD_Id(SPA_MEDIA_TYPE_video),
+        SPA_FORMAT_mediaSubtype,    SPA_POD_Id(SPA_MEDIA_SUBTYPE_raw),
+        SPA_FORMAT_VIDEO_format,    SPA_POD_CHOICE_ENUM_Id(3, SPA_VIDEO_FORMAT_BGRx,
+                                                           SPA_VIDEO_FORMAT_BGRx,
+                                                           SPA_VIDEO_FORMAT_BGRA),
+        SPA_FORMAT_VIDEO_size,      SPA_POD_CHOICE_RANGE_Rectangle(
+                                        &SPA_RECTANGLE(1920, 1080),
+                                        &SPA_RECTANGLE(1, 1),
+                                        &SPA_RECTANGLE(16384, 16384)),
+        SPA_FORMAT_VIDEO_framerate, SPA_POD_CHOICE_RANGE_Fraction(
+                                        &SPA_FRACTION(60, 1),
+                                        &SPA_FRACTION(0, 1),
+                                        &SPA_FRACTION(360, 1)),
+        0);
+    if (dmabuf) {
+        spa_pod_builder_prop(b, SPA_FORMAT_VIDEO_modifier, SPA_POD_PROP_FLAG_MANDATORY);
+        spa_pod_builder_long(b, 0);   /* DRM_FORMAT_MOD_LINEAR: mappable as is */
+    }
+    return spa_pod_builder_pop(b, &f);
+}
+
+/* ── Backend interface ─────────────────────────────────────── */
+
+static void pwc_free(void *opaque);
+
+static void *pwc_init(const capture_target_t *target)
+{
+    if (target && (target->monitor >= 0 || target->output || target->window)) {
+        fprintf(stderr, "capture_pw: monitors and windows are picked in the "
+                        "portal dialog; only --region applies\n");
+        return NULL;
+    }
+
+    pw_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+    ctx->pending_count = -1;
+    ctx->dirty_count   = -1;
+
+    uint32_t node = 0;
+    int fd = portal_open(ctx, &node);
+    if (fd < 0) {
+        pwc_free(ctx);
+        return NULL;
+    }
+
+    pw_init(NULL, NULL);
+    ctx->loop = pw_thread_loop_new("screen2cam-pw", NULL);
+    ctx->context = ctx->loop ? pw_context_new(pw_thread_loop_get_loop(ctx->loop), NULL, 0)
+                             : NULL;
+    if (!ctx->context || pw_thread_loop_start(ctx->loop) < 0) {
+        fprintf(stderr, "capture_pw: cannot start PipeWire loop\n");
+        close(fd);
+        pwc_free(ctx);
+        return NULL;
+    }
+
+    pw_thread_loop_lock(ctx->loop);
+    ctx->core = pw_context_connect_fd(ctx->context, fd, NULL, 0);
+    if (ctx->core) {
+        ctx->stream = pw_stream_new(ctx->core, "screen2cam",
+            pw_properties_new(PW_KEY_MEDIA_TYPE, "Video",
+                              PW_KEY_MEDIA_CATEGORY, "Capture",
+                              PW_KEY_MEDIA_ROLE, "Screen", NULL));
+    }
+    if (ctx->stream) {
+        uint8_t storage[1024];
+        struct spa_pod_builder b = SPA_POD_BUILDER_INIT(storage, sizeof(storage));
+        const struct spa_pod *params[2] = { enum_format(&b, 1), enum_format(&b, 0) };
+
+        pw_stream_add_listener(ctx->stream, &ctx->listener, &stream_events, ctx);
+        if (pw_stream_connect(ctx->stream, PW_DIRECTION_INPUT, node,
+                              PW_STREAM_FLAG_AUTOCONNECT | PW_STREAM_FLAG_MAP_BUFFERS,
+                              params, 2) < 0)
+            ctx->failed = 1;
+
+        /* Wait for the first frame: its size is the capture size */
+        while (!ctx->latest && !ctx->failed) {
+            if (pw_thread_loop_timed_wait(ctx->loop, 5) != 0)
+                break;
+        }
+    }
+    int ok = ctx->latest && !ctx->failed;
+    pw_thread_loop_unlock(ctx->loop);
+
+    if (!ok) {
+        fprintf(stderr, "capture_pw: no frames from the screencast stream\n");
+        pwc_free(ctx);
+        return NULL;
+    }
+
+    if (capture_target_area(target, ctx->width, ctx->height, &ctx->area) < 0) {
+        fprintf(stderr, "capture_pw: region is outside the %dx%d stream\n",
+                ctx->width, ctx->height);
+        pwc_free(ctx);
+        return NULL;
+    }
+    ctx->target = target ? *target : (capture_target_t){ .monitor = -1 };
+
+    fprintf(stderr, "capture_pw: %dx%d (PipeWire screencast%s)\n",
+            ctx->area.w, ctx->area.h, ctx->cursor ? ", with cursor" : "");
+    return ctx;
+}
+
+static int pwc_width(const void *opaque)  { return ((const pw_ctx_t *)opaque)->area.w; }
+static int pwc_height(const void *opaque) { return ((const pw_ctx_t *)opaque)->area.h; }
+
+static void dmabuf_sync(const pw_slot_t *slot, uint64_t flags)
+{
+    if (slot->dmabuf >= 0) {
+        struct dma_buf_sync sync = { .flags = flags | DMA_BUF_SYNC_READ };
+        ioctl(slot->dmabuf, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+}
+
+static void release_slot(void *ref)
+{
+    pw_slot_t *slot = ref;
+    pw_ctx_t *ctx = slot->ctx;
+
+    dmabuf_sync(slot, DMA_BUF_SYNC_END);
+    pw_thread_loop_lock(ctx->loop);
+    slot_unref(slot);
+    pw_thread_loop_unlock(ctx->loop);
+}
+
+/* Damage since the last acquire, clipped to --region */
+static void take_dirty(pw_ctx_t *ctx)
+{
+    int n = ctx->have_frame ? ctx->pending_count : -1;
+    ctx->dirty_count = n;
+    if (n > 0) {
+        int kept = 0;
+        for (int i = 0; i < n; i++) {
+            const dirty_rect_t *r = &ctx->pending[i];
+            int x0 = r->x - ctx->area.x, x1 = x0 + r->w;
+            int y0 = r->y - ctx->area.y, y1 = y0 + r->h;
+            if (x0 < 0) x0 = 0;
+            if (y0 < 0) y0 = 0;
+            if (x1 > ctx->area.w) x1 = ctx->area.w;
+            if (y1 > ctx->area.h) y1 = ctx->area.h;
+            if (x1 > x0 && y1 > y0)
+                ctx->dirty[kept++] = (dirty_rect_t){ x0, y0, x1 - x0, y1 - y0 };
+        }
+        ctx->dirty_count = kept;
+    }
+    ctx->pending_count = 0;
+}
+
+static int pwc_acquire(void *opaque, capture_frame_t *frame)
+{
+    pw_ctx_t *ctx = opaque;
+
+    pw_thread_loop_lock(ctx->loop);
+    pw_slot_t *slot = ctx->latest;
+    if (!slot || ctx->failed || ctx->resized) {
+        pw_thread_loop_unlock(ctx->loop);
+        return -1;
+    }
+    slot->refs++;
+    ctx->taken = ctx->delivered;
+    take_dirty(ctx);
+    size_t offset = slot->offset, stride = slot->stride;
+    pw_thread_loop_unlock(ctx->loop);
+
+    dmabuf_sync(slot, DMA_BUF_SYNC_START);
+    memset(frame, 0, sizeof(*frame));
+    frame->frame.format     = PIX_FMT_BGRA;
+    frame->frame.width      = ctx->area.w;
+    frame->frame.height     = ctx->area.h;
+    frame->frame.planes[0]  = slot->data + offset + (size_t)ctx->area.y * stride +
+                              (size_t)ctx->area.x * 4;
+    frame->frame.strides[0] = stride;
+    frame->ref     = slot;
+    frame->release = release_slot;
+    ctx->have_frame = 1;
+    return 0;
+}
+
+/* The latest buffer, held until the next grab: no copy either way */
+static const frame_t *pwc_grab(void *opaque)
+{
+    pw_ctx_t *ctx = opaque;
+    capture_frame_t next;
+
+    if (pwc_acquire(ctx, &next) < 0)
+        return NULL;
+    capture_frame_release(&ctx->held);
+    ctx->held = next;
+    return &ctx->held.frame;
+}
+
+static int pwc_can_borrow(const void *opaque)
+{
+    (void)opaque;
+    return 1;
+}
+
+/* The compositor delivers BGRx/BGRA only; the caller converts */
+static int pwc_set_format(void *opaque, pix_fmt_t fmt)
+{
+    (void)opaque;
+    return fmt == PIX_FMT_BGRA ? 0 : -1;
+}
+
+static int pwc_set_size(void *opaque, int width, int height)
+{
+    const pw_ctx_t *ctx = opaque;
+    return width == ctx->area.w && height == ctx->area.h ? 0 : -1;
+}
+
+/* The compositor queues a buffer per presented frame it has changes for */
+static int pwc_wait_frame(void *opaque, uint64_t timeout_ns)
+{
+    pw_ctx_t *ctx = opaque;
+    struct timespec abstime;
+
+    pw_thread_loop_lock(ctx->loop);
+    pw_thread_loop_get_time(ctx->loop, &abstime, (int64_t)timeout_ns);
+    while (ctx->delivered == ctx->taken && !ctx->failed) {
+        if (pw_thread_loop_timed_wait_full(ctx->loop, &abstime) != 0)
+            break;
+    }
+    int fresh = ctx->delivered != ctx->taken;
+    pw_thread_loop_unlock(ctx->loop);
+    return fresh;
+}
+
+/* The portal draws the cursor into the frames (cursor_mode embedded) */
+static int pwc_cursor(void *opaque, capture_cursor_t *cursor)
+{
+    (void)opaque;
+    (void)cursor;
+    return -1;
+}
+
+static int pwc_dirty_rects(const void *opaque, const dirty_rect_t **rects)
+{
+    const pw_ctx_t *ctx = opaque;
+    *rects = ctx->dirty;
+    return ctx->dirty_count;
+}
+
+static int pwc_lost(const void *opaque)
+{
+    pw_ctx_t *ctx = (pw_ctx_t *)opaque;
+    pw_thread_loop_lock(ctx->loop);
+    int lost = ctx->resized;
+    pw_thread_loop_unlock(ctx->loop);
+    return lost;
+}
+
+/*
+ * The portal session and stream stay: PipeWire has already renegotiated
+ * the buffers, only --region needs placing on the new size.
+ */
+static int pwc_reset(void *opaque)
+{
+    pw_ctx_t *ctx = opaque;
+    capture_frame_release(&ctx->held);
+
+    pw_thread_loop_lock(ctx->loop);
+    int width = ctx->width, height = ctx->height;
+    int ready = ctx->latest && !ctx->failed;
+    pw_thread_loop_unlock(ctx->loop);
+    if (!ready)
+        return -1;   /* no frame of the new size yet */
+
+    dirty_rect_t area;
+    if (capture_target_area(&ctx->target, width, height, &area) < 0) {
+        fprintf(stderr, "capture_pw: region is outside the %dx%d stream\n", width, height);
+        return -1;
+    }
+
+    pw_thread_loop_lock(ctx->loop);
+    ctx->resized       = 0;
+    ctx->pending_count = -1;
+    pw_thread_loop_unlock(ctx->loop);
+    ctx->area        = area;
+    ctx->have_frame  = 0;
+    ctx->dirty_count = -1;
+    fprintf(stderr, "capture_pw: %dx%d (PipeWire screencast%s)\n",
+            ctx->area.w, ctx->area.h, ctx->cursor ? ", with cursor" : "");
+    return 0;
+}
+
+static void pwc_free(void *opaque)
+{
+    pw_ctx_t *ctx = opaque;
+    if (!ctx)
+        return;
+
+    if (ctx->loop) {
+        capture_frame_release(&ctx->held);
+        pw_thread_loop_lock(ctx->loop);
+        if (ctx->latest) {
+            slot_unref(ctx->latest);
+            ctx->latest = NULL;
+        }
+        pw_thread_loop_unlock(ctx->loop);
+        pw_thread_loop_stop(ctx->loop);
+        if (ctx->stream)
+            pw_stream_destroy(ctx->stream);   /* frees the slots */
+        if (ctx->core)
+            pw_core_disconnect(ctx->core);
+        if (ctx->context)
+            pw_context_destroy(ctx->context);
+        pw_thread_loop_destroy(ctx->loop);
+    }
+    portal_close(ctx);
+    free(ctx);
+}
+
+const capture_backend_t capture_pipewire = {
+    .name        = "pipewire",
+    .init        = pwc_init,
+    .width       = pwc_width,
+    .height      = pwc_height,
+    .grab        = pwc_grab,
+    .can_borrow  = pwc_can_borrow,
+    .acquire     = pwc_acquire,
+    .set_format  = pwc_set_format,
+    .set_size    = pwc_set_size,
+    .wait_frame  = pwc_wait_frame,
+    .dirty_rects = pwc_dirty_rects,
+    .cursor      = pwc_cursor,
+    .lost        = pwc_lost,
+    .reset       = pwc_reset,
+    .free        = pwc_free,
+};
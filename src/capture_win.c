@@ -7,8 +7,27 @@
  * Architecture:
  *   - Create D3D11 device -> get DXGI adapter -> get output (monitor)
  *   - DuplicateOutput() for desktop duplication
- *   - Each capture_grab() call: AcquireNextFrame -> copy to staging texture
- *     -> Map -> copy BGRA pixels -> Unmap -> ReleaseFrame
+ *   - Each capture_grab() call: Unmap previous -> AcquireNextFrame -> copy
+ *     to staging texture -> Map -> ReleaseFrame.  The mapped texture is
+ *     handed out as is (RowPitch stride) until the next grab; the staging
+ *     texture itself keeps the last full image
+ *   - Move/dirty rect metadata limits both copies to the changed areas and
+ *     is reported through capture_dirty_rects()
+ *   - The target picks the output (index, device name, or the one a window
+ *     is on); a region or window keeps the copies to that part of it —
+ *     Desktop Duplication cannot isolate a window, so covering windows
+ *     show through
+ *   - With capture_set_format(I420 or NV12) a compute shader converts on
+ *     the GPU instead, so only the 1.5 bytes/pixel result is read back:
+ *     frame -> shader-readable copy -> Dispatch -> staging buffer -> Map,
+ *     again handed out mapped.
+ *     capture_set_size() makes the same shader box-filter the desktop down
+ *     to the requested size while it converts.
+ *     The shader is compiled at runtime (d3dcompiler_47.dll, loaded on
+ *     demand); without it, or below feature level 11_0, frames stay BGRA.
+ *   - DXGI_ERROR_ACCESS_LOST (mode change, UAC prompt, fullscreen app)
+ *     marks the context lost; capture_reset() builds device, duplication
+ *     and staging again at the output's new size
  *
  * Pixel format: BGRA (DXGI_FORMAT_B8G8R8A8_UNORM) — matches capture.h contract.
  *
@@ -27,6 +46,7 @@
 #include <windows.h>
 #include <d3d11.h>
 #include <dxgi1_2.h>
+#include <d3dcompiler.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -42,17 +62,334 @@ static const GUID local_IID_IDXGIAdapter  = {0x2411e7e1,0x12ac,0x4ccf,{0xbd,0x14
 static const GUID local_IID_IDXGIOutput1  = {0x00cddea8,0x939b,0x4b83,{0xa3,0x40,0xa6,0x85,0x22,0x66,0x66,0xcc}};
 
 struct capture_ctx {
+    capture_target_t         target;       /* what capture_reset() opens again */
+    int                      lost;         /* DXGI_ERROR_ACCESS_LOST seen */
     ID3D11Device            *device;
     ID3D11DeviceContext     *context;
     IDXGIOutputDuplication  *duplication;
     ID3D11Texture2D         *staging;
-    int                      width;
+    D3D_FEATURE_LEVEL        feature_level;
+    int                      width;        /* of the frames handed out */
     int                      height;
-    uint8_t                 *buffer;
-    size_t                   buffer_size;
+    int                      src_width;    /* captured part of the desktop */
+    int                      src_height;
+    int                      origin_x;     /* its position on the output */
+    int                      origin_y;
+    frame_t                  frame;        /* returned by capture_grab() */
+    ID3D11Resource          *mapped;       /* staging resource behind frame */
+    int                      have_frame;   /* staging holds a full image */
+    IDXGIResource           *pending;      /* acquired by capture_wait_frame() */
+    DXGI_OUTDUPL_FRAME_INFO  pending_info;
+
+    /* Frame metadata (move + dirty rects) */
+    uint8_t                 *meta;
+    UINT                     meta_size;
+    dirty_rect_t            *dirty;
+    int                      dirty_count;  /* -1 = whole frame */
+    int                      dirty_cap;
+
+    /* The pointer, which desktop duplication keeps out of the frames */
+    int                      cursor_visible;
+    int                      cursor_x;     /* shape's top-left, on the captured part */
+    int                      cursor_y;
+    uint8_t                 *shape;        /* GetFramePointerShape() buffer */
+    UINT                     shape_size;
+    uint8_t                 *cursor_image; /* the shape as BGRA, straight alpha */
+    int                      cursor_w;
+    int                      cursor_h;
+    uint32_t                 cursor_serial;
+
+    /* GPU conversion (capture_set_format), NULL members when off */
+    pix_fmt_t                format;       /* of the frames handed out */
+    size_t                   frame_size;
+    ID3D11Texture2D         *gpu_src;      /* shader-readable desktop copy */
+    ID3D11ShaderResourceView *gpu_srv;
+    ID3D11Buffer            *gpu_out;      /* converted frame, raw UAV */
+    ID3D11UnorderedAccessView *gpu_uav;
+    ID3D11Buffer            *gpu_staging;  /* CPU-readable copy of gpu_out */
+    ID3D11Buffer            *gpu_params;
+    ID3D11ComputeShader     *gpu_shader;
+    UINT                     gpu_groups;
 };
 
-capture_ctx_t *capture_init(void)
+/*
+ * BGRA -> I420 / NV12, bit-identical to the CPU kernels (convert.c).
+ * One thread per 32-bit word of the output frame: each of its four bytes
+ * is located by plane and position and computed with the same integer
+ * BT.601 math, chroma from the top-left pixel of each 2x2 block (odd
+ * sizes round chroma up, as pixfmt.h does).  When
+ * scaling, every output pixel is the average of its box of source pixels
+ * (the same boxes as convert.c's scaler, float rounding).
+ */
+static const char gpu_shader_src[] =
+    "Texture2D<float4> src : register(t0);\n"
+    "RWByteAddressBuffer dst : register(u0);\n"
+    "cbuffer params : register(b0) { uint width, height, nv12, total, src_w, src_h; };\n"
+    "int3 rgb(uint x, uint y) {\n"
+    "    uint x0 = x * src_w / width, x1 = max((x + 1) * src_w / width, x0 + 1);\n"
+    "    uint y0 = y * src_h / height, y1 = max((y + 1) * src_h / height, y0 + 1);\n"
+    "    float3 s = 0;\n"
+    "    for (uint j = y0; j < y1; j++)\n"
+    "        for (uint i = x0; i < x1; i++) s += src.Load(int3(i, j, 0)).rgb;\n"
+    "    return int3(round(s * 255.0 / float((x1 - x0) * (y1 - y0))));\n"
+    "}\n"
+    "uint u8(int v) { return (uint)clamp(v, 0, 255); }\n"
+    "uint luma(int3 p) { return u8(((66 * p.r + 129 * p.g + 25 * p.b + 128) >> 8) + 16); }\n"
+    "uint cb(int3 p) { return u8(((-38 * p.r - 74 * p.g + 112 * p.b + 128) >> 8) + 128); }\n"
+    "uint cr(int3 p) { return u8(((112 * p.r - 94 * p.g - 18 * p.b + 128) >> 8) + 128); }\n"
+    "uint out_byte(uint i) {\n"
+    "    uint cw = (width + 1) / 2, csize = cw * ((height + 1) / 2);\n"
+    "    if (i < width * height) return luma(rgb(i % width, i / width));\n"
+    "    i -= width * height;\n"
+    "    if (nv12) { int3 p = rgb(i / 2 % cw * 2, i / 2 / cw * 2); return (i & 1) ? cr(p) : cb(p); }\n"
+    "    if (i < csize) return cb(rgb(i % cw * 2, i / cw * 2));\n"
+    "    i -= csize;\n"
+    "    return cr(rgb(i % cw * 2, i / cw * 2));\n"
+    "}\n"
+    "[numthreads(256, 1, 1)]\n"
+    "void main(uint3 id : SV_DispatchThreadID) {\n"
+    "    uint w = id.x * 4, v = 0;\n"
+    "    if (w >= total) return;\n"
+    "    for (uint k = 0; k < 4 && w + k < total; k++) v |= out_byte(w + k) << (8 * k);\n"
+    "    dst.Store(w, v);\n"
+    "}\n";
+
+typedef HRESULT (WINAPI *d3d_compile_fn)(LPCVOID, SIZE_T, LPCSTR,
+                                         const D3D_SHADER_MACRO *, ID3DInclude *,
+                                         LPCSTR, LPCSTR, UINT, UINT,
+                                         ID3DBlob **, ID3DBlob **);
+
+static int grow_dirty(capture_ctx_t *ctx, int n)
+{
+    if (n <= ctx->dirty_cap)
+        return 0;
+    dirty_rect_t *grown = realloc(ctx->dirty, (size_t)n * sizeof(*grown));
+    if (!grown)
+        return -1;
+    ctx->dirty     = grown;
+    ctx->dirty_cap = n;
+    return 0;
+}
+
+/* Add an output-relative rect, as part of the captured area */
+static void add_dirty(capture_ctx_t *ctx, const RECT *r)
+{
+    LONG l = r->left   - ctx->origin_x;
+    LONG t = r->top    - ctx->origin_y;
+    LONG rr = r->right  - ctx->origin_x;
+    LONG b = r->bottom - ctx->origin_y;
+    if (l < 0) l = 0;
+    if (t < 0) t = 0;
+    if (rr > ctx->src_width)  rr = ctx->src_width;
+    if (b > ctx->src_height) b = ctx->src_height;
+    if (rr <= l || b <= t)
+        return;
+    dirty_rect_t *d = &ctx->dirty[ctx->dirty_count++];
+    d->x = (int)l;
+    d->y = (int)t;
+    d->w = (int)(rr - l);
+    d->h = (int)(b - t);
+}
+
+/*
+ * Map ctx->dirty from desktop to output coordinates once the copies are
+ * done: every output pixel whose box overlaps a changed source pixel.
+ */
+static void scale_dirty(capture_ctx_t *ctx)
+{
+    if (ctx->width == ctx->src_width && ctx->height == ctx->src_height)
+        return;
+    for (int i = 0; i < ctx->dirty_count; i++) {
+        dirty_rect_t *d = &ctx->dirty[i];
+        int64_t x0 = (int64_t)d->x * ctx->width / ctx->src_width;
+        int64_t y0 = (int64_t)d->y * ctx->height / ctx->src_height;
+        int64_t x1 = ((int64_t)(d->x + d->w) * ctx->width + ctx->src_width - 1) / ctx->src_width;
+        int64_t y1 = ((int64_t)(d->y + d->h) * ctx->height + ctx->src_height - 1) / ctx->src_height;
+        d->x = (int)x0;
+        d->y = (int)y0;
+        d->w = (int)((x1 < ctx->width  ? x1 : ctx->width)  - x0);
+        d->h = (int)((y1 < ctx->height ? y1 : ctx->height) - y0);
+    }
+}
+
+/*
+ * Turn the frame's move and dirty rects into ctx->dirty.  Moved areas are
+ * reported by destination — the desktop image already has them applied.
+ * Leaves dirty_count at -1 whenever the full frame has to be copied.
+ */
+static void collect_dirty(capture_ctx_t *ctx, const DXGI_OUTDUPL_FRAME_INFO *info)
+{
+    ctx->dirty_count = -1;
+    if (!ctx->have_frame)
+        return;
+
+    if (info->TotalMetadataBufferSize == 0) {
+        /* Pointer-only update: the desktop image did not change */
+        if (info->LastPresentTime.QuadPart == 0)
+            ctx->dirty_count = 0;
+        return;
+    }
+
+    if (info->TotalMetadataBufferSize > ctx->meta_size) {
+        uint8_t *grown = realloc(ctx->meta, info->TotalMetadataBufferSize);
+        if (!grown)
+            return;
+        ctx->meta      = grown;
+        ctx->meta_size = info->TotalMetadataBufferSize;
+    }
+
+    UINT move_bytes = 0, dirty_bytes = 0;
+    HRESULT hr = IDXGIOutputDuplication_GetFrameMoveRects(ctx->duplication,
+                     ctx->meta_size, (DXGI_OUTDUPL_MOVE_RECT *)ctx->meta, &move_bytes);
+    if (FAILED(hr))
+        return;
+    hr = IDXGIOutputDuplication_GetFrameDirtyRects(ctx->duplication,
+                     ctx->meta_size - move_bytes, (RECT *)(ctx->meta + move_bytes),
+                     &dirty_bytes);
+    if (FAILED(hr))
+        return;
+
+    int nmove  = (int)(move_bytes  / sizeof(DXGI_OUTDUPL_MOVE_RECT));
+    int ndirty = (int)(dirty_bytes / sizeof(RECT));
+    if (grow_dirty(ctx, nmove + ndirty) < 0)
+        return;
+
+    const DXGI_OUTDUPL_MOVE_RECT *moves = (const DXGI_OUTDUPL_MOVE_RECT *)ctx->meta;
+    const RECT *rects = (const RECT *)(ctx->meta + move_bytes);
+
+    ctx->dirty_count = 0;
+    for (int i = 0; i < nmove; i++)
+        add_dirty(ctx, &moves[i].DestinationRect);
+    for (int i = 0; i < ndirty; i++)
+        add_dirty(ctx, &rects[i]);
+}
+
+/* Turn a pointer shape into BGRA with straight alpha (ctx->cursor_image). */
+static int decode_shape(capture_ctx_t *ctx, const DXGI_OUTDUPL_POINTER_SHAPE_INFO *si)
+{
+    int mono = si->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_MONOCHROME;
+    int w = (int)si->Width, h = (int)si->Height / (mono ? 2 : 1);
+    uint8_t *img = realloc(ctx->cursor_image, (size_t)w * h * 4 + 1);
+    if (!img)
+        return -1;
+    ctx->cursor_image = img;
+    ctx->cursor_w     = w;
+    ctx->cursor_h     = h;
+
+    for (int y = 0; y < h; y++) {
+        const uint8_t *row = ctx->shape + (size_t)y * si->Pitch;
+        for (int x = 0; x < w; x++, img += 4) {
+            if (mono) {
+                /* AND mask above the XOR mask, one bit per pixel */
+                int bit = 0x80 >> (x & 7);
+                int and_bit = row[x / 8] & bit;
+                int xor_bit = row[(size_t)h * si->Pitch + x / 8] & bit;
+                uint8_t v = !and_bit && xor_bit ? 255 : 0;   /* "invert" drawn black */
+                img[0] = img[1] = img[2] = v;
+                img[3] = and_bit && !xor_bit ? 0 : 255;
+                continue;
+            }
+            const uint8_t *px = row + (size_t)x * 4;
+            img[0] = px[0];
+            img[1] = px[1];
+            img[2] = px[2];
+            if (si->Type == DXGI_OUTDUPL_POINTER_SHAPE_TYPE_COLOR)
+                img[3] = px[3];
+            else   /* masked colour: 0 = opaque, 0xFF = XOR, kept where not black */
+                img[3] = !px[3] || px[0] || px[1] || px[2] ? 255 : 0;
+        }
+    }
+    ctx->cursor_serial++;
+    return 0;
+}
+
+/* Follow the pointer: only updates that moved it or changed its shape say so. */
+static void update_pointer(capture_ctx_t *ctx, const DXGI_OUTDUPL_FRAME_INFO *info)
+{
+    if (info->LastMouseUpdateTime.QuadPart == 0)
+        return;
+    ctx->cursor_visible = info->PointerPosition.Visible;
+    ctx->cursor_x = (int)info->PointerPosition.Position.x - ctx->origin_x;
+    ctx->cursor_y = (int)info->PointerPosition.Position.y - ctx->origin_y;
+    if (info->PointerShapeBufferSize == 0)
+        return;
+
+    if (info->PointerShapeBufferSize > ctx->shape_size) {
+        uint8_t *grown = realloc(ctx->shape, info->PointerShapeBufferSize);
+        if (!grown)
+            return;
+        ctx->shape      = grown;
+        ctx->shape_size = info->PointerShapeBufferSize;
+    }
+    UINT size = 0;
+    DXGI_OUTDUPL_POINTER_SHAPE_INFO si;
+    if (SUCCEEDED(IDXGIOutputDuplication_GetFramePointerShape(ctx->duplication,
+                      ctx->shape_size, ctx->shape, &size, &si)))
+        decode_shape(ctx, &si);
+}
+
+/*
+ * The output the target names, and the part of it to capture
+ * (output-relative).  Returns NULL if there is no such output.
+ */
+static IDXGIOutput *select_output(IDXGIAdapter *adapter, const capture_target_t *target,
+                                  dirty_rect_t *base)
+{
+    RECT win = {0};
+    int by_window = target && target->window &&
+                    GetWindowRect((HWND)(uintptr_t)target->window, &win);
+    if (target && target->window && !by_window) {
+        fprintf(stderr, "capture_win: no window %llu\n",
+                (unsigned long long)target->window);
+        return NULL;
+    }
+    int want = target && target->monitor >= 0 ? target->monitor : 0;
+
+    IDXGIOutput *output = NULL;
+    for (UINT i = 0; IDXGIAdapter_EnumOutputs(adapter, i, &output) == S_OK; i++) {
+        DXGI_OUTPUT_DESC desc;
+        IDXGIOutput_GetDesc(output, &desc);
+        RECT d = desc.DesktopCoordinates;
+        *base = (dirty_rect_t){ 0, 0, (int)(d.right - d.left), (int)(d.bottom - d.top) };
+
+        int match;
+        if (by_window) {
+            LONG cx = (win.left + win.right) / 2, cy = (win.top + win.bottom) / 2;
+            match = cx >= d.left && cx < d.right && cy >= d.top && cy < d.bottom;
+        } else if (target && target->output) {
+            char name[64];
+            WideCharToMultiByte(CP_UTF8, 0, desc.DeviceName, -1, name, sizeof(name), NULL, NULL);
+            match = strcmp(name, target->output) == 0;
+        } else {
+            match = (int)i == want;
+        }
+
+        if (match) {
+            if (by_window) {
+                /* The window's rect, clipped to this output */
+                LONG l  = win.left   > d.left   ? win.left   : d.left;
+                LONG t  = win.top    > d.top    ? win.top    : d.top;
+                LONG rr = win.right  < d.right  ? win.right  : d.right;
+                LONG b  = win.bottom < d.bottom ? win.bottom : d.bottom;
+                *base = (dirty_rect_t){ (int)(l - d.left), (int)(t - d.top),
+                                        (int)(rr - l), (int)(b - t) };
+            }
+            return output;
+        }
+        IDXGIOutput_Release(output);
+        output = NULL;
+    }
+
+    if (by_window)
+        fprintf(stderr, "capture_win: window is not on this adapter's outputs\n");
+    else if (target && target->output)
+        fprintf(stderr, "capture_win: no output named '%s'\n", target->output);
+    else
+        fprintf(stderr, "capture_win: no output %d\n", want);
+    return NULL;
+}
+
+capture_ctx_t *capture_init(const capture_target_t *target)
 {
     HRESULT hr;
 
@@ -66,6 +403,7 @@ capture_ctx_t *capture_init(void)
     capture_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
         return NULL;
+    ctx->target = target ? *target : (capture_target_t){ .monitor = -1 };
 
     /* Create D3D11 device */
     D3D_FEATURE_LEVEL feature_level;
@@ -80,6 +418,7 @@ capture_ctx_t *capture_init(void)
         &feature_level,
         &ctx->context
     );
+    ctx->feature_level = feature_level;
     if (FAILED(hr)) {
         fprintf(stderr, "capture_win: D3D11CreateDevice failed: 0x%08lx\n", (unsigned long)hr);
         free(ctx);
@@ -102,20 +441,26 @@ capture_ctx_t *capture_init(void)
         goto fail;
     }
 
-    IDXGIOutput *output = NULL;
-    hr = IDXGIAdapter_EnumOutputs(adapter, 0, &output);
+    dirty_rect_t base;
+    IDXGIOutput *output = select_output(adapter, target, &base);
     IDXGIAdapter_Release(adapter);
-    if (FAILED(hr)) {
-        fprintf(stderr, "capture_win: EnumOutputs(0) failed: 0x%08lx\n", (unsigned long)hr);
-        fprintf(stderr, "capture_win: no display output found\n");
+    if (!output)
         goto fail;
-    }
 
-    /* Get output dimensions from DXGI_OUTPUT_DESC */
-    DXGI_OUTPUT_DESC out_desc;
-    IDXGIOutput_GetDesc(output, &out_desc);
-    ctx->width  = out_desc.DesktopCoordinates.right  - out_desc.DesktopCoordinates.left;
-    ctx->height = out_desc.DesktopCoordinates.bottom - out_desc.DesktopCoordinates.top;
+    /* The captured part of the output: all of it, a window or a region */
+    dirty_rect_t area;
+    if (capture_target_area(target, base.w, base.h, &area) < 0) {
+        fprintf(stderr, "capture_win: region is outside the %dx%d capture area\n",
+                base.w, base.h);
+        IDXGIOutput_Release(output);
+        goto fail;
+    }
+    ctx->origin_x   = base.x + area.x;
+    ctx->origin_y   = base.y + area.y;
+    ctx->src_width  = area.w;
+    ctx->src_height = area.h;
+    ctx->width      = ctx->src_width;
+    ctx->height     = ctx->src_height;
 
     /* QueryInterface for IDXGIOutput1 (Desktop Duplication requires DXGI 1.2) */
     IDXGIOutput1 *output1 = NULL;
@@ -139,8 +484,8 @@ capture_ctx_t *capture_init(void)
 
     /* Create CPU-readable staging texture for pixel readback */
     D3D11_TEXTURE2D_DESC staging_desc = {0};
-    staging_desc.Width              = (UINT)ctx->width;
-    staging_desc.Height             = (UINT)ctx->height;
+    staging_desc.Width              = (UINT)ctx->src_width;
+    staging_desc.Height             = (UINT)ctx->src_height;
     staging_desc.MipLevels          = 1;
     staging_desc.ArraySize          = 1;
     staging_desc.Format             = DXGI_FORMAT_B8G8R8A8_UNORM;
@@ -157,13 +502,8 @@ capture_ctx_t *capture_init(void)
         goto fail;
     }
 
-    /* Allocate persistent BGRA buffer */
-    ctx->buffer_size = (size_t)ctx->width * ctx->height * 4;
-    ctx->buffer = malloc(ctx->buffer_size);
-    if (!ctx->buffer) {
-        perror("capture_win: malloc");
-        goto fail;
-    }
+    ctx->dirty_count = -1;
+    ctx->format      = PIX_FMT_BGRA;
 
     fprintf(stderr, "capture_win: %dx%d (DXGI Desktop Duplication)\n",
             ctx->width, ctx->height);
@@ -177,22 +517,357 @@ fail:
 int capture_width(const capture_ctx_t *ctx)  { return ctx->width;  }
 int capture_height(const capture_ctx_t *ctx) { return ctx->height; }
 
-const uint8_t *capture_grab(capture_ctx_t *ctx)
+static void gpu_release(capture_ctx_t *ctx)
+{
+    if (ctx->gpu_shader)  ID3D11ComputeShader_Release(ctx->gpu_shader);
+    if (ctx->gpu_params)  ID3D11Buffer_Release(ctx->gpu_params);
+    if (ctx->gpu_staging) ID3D11Buffer_Release(ctx->gpu_staging);
+    if (ctx->gpu_uav)     ID3D11UnorderedAccessView_Release(ctx->gpu_uav);
+    if (ctx->gpu_out)     ID3D11Buffer_Release(ctx->gpu_out);
+    if (ctx->gpu_srv)     ID3D11ShaderResourceView_Release(ctx->gpu_srv);
+    if (ctx->gpu_src)     ID3D11Texture2D_Release(ctx->gpu_src);
+    ctx->gpu_shader  = NULL;
+    ctx->gpu_params  = NULL;
+    ctx->gpu_staging = NULL;
+    ctx->gpu_uav     = NULL;
+    ctx->gpu_out     = NULL;
+    ctx->gpu_srv     = NULL;
+    ctx->gpu_src     = NULL;
+}
+
+static ID3D11ComputeShader *gpu_compile(capture_ctx_t *ctx)
+{
+    static d3d_compile_fn compile;
+    if (!compile) {
+        HMODULE dll = LoadLibraryA("d3dcompiler_47.dll");
+        if (dll)
+            compile = (d3d_compile_fn)(void (*)(void))GetProcAddress(dll, "D3DCompile");
+        if (!compile) {
+            fprintf(stderr, "capture_win: d3dcompiler_47.dll not available\n");
+            return NULL;
+        }
+    }
+
+    ID3DBlob *code = NULL, *errors = NULL;
+    HRESULT hr = compile(gpu_shader_src, sizeof(gpu_shader_src) - 1, "convert",
+                         NULL, NULL, "main", "cs_5_0",
+                         D3DCOMPILE_OPTIMIZATION_LEVEL3, 0, &code, &errors);
+    if (FAILED(hr)) {
+        fprintf(stderr, "capture_win: shader compile failed: %s\n",
+                errors ? (const char *)ID3D10Blob_GetBufferPointer(errors) : "?");
+        if (errors) ID3D10Blob_Release(errors);
+        return NULL;
+    }
+    if (errors) ID3D10Blob_Release(errors);
+
+    ID3D11ComputeShader *shader = NULL;
+    hr = ID3D11Device_CreateComputeShader(ctx->device,
+                                          ID3D10Blob_GetBufferPointer(code),
+                                          ID3D10Blob_GetBufferSize(code),
+                                          NULL, &shader);
+    ID3D10Blob_Release(code);
+    if (FAILED(hr)) {
+        fprintf(stderr, "capture_win: CreateComputeShader failed: 0x%08lx\n", (unsigned long)hr);
+        return NULL;
+    }
+    return shader;
+}
+
+/* Create everything the compute path needs; returns -1 (and cleans up) on failure. */
+static int gpu_setup(capture_ctx_t *ctx, pix_fmt_t fmt)
+{
+    HRESULT hr;
+    size_t frame_size = pix_fmt_frame_size(fmt, ctx->width, ctx->height);
+    UINT words = (UINT)((frame_size + 3) / 4);
+
+    if (ctx->feature_level < D3D_FEATURE_LEVEL_11_0) {
+        fprintf(stderr, "capture_win: GPU conversion needs feature level 11_0\n");
+        return -1;
+    }
+
+    ctx->gpu_shader = gpu_compile(ctx);
+    if (!ctx->gpu_shader)
+        goto fail;
+
+    D3D11_TEXTURE2D_DESC src_desc = {0};
+    src_desc.Width            = (UINT)ctx->src_width;
+    src_desc.Height           = (UINT)ctx->src_height;
+    src_desc.MipLevels        = 1;
+    src_desc.ArraySize        = 1;
+    src_desc.Format           = DXGI_FORMAT_B8G8R8A8_UNORM;
+    src_desc.SampleDesc.Count = 1;
+    src_desc.Usage            = D3D11_USAGE_DEFAULT;
+    src_desc.BindFlags        = D3D11_BIND_SHADER_RESOURCE;
+    hr = ID3D11Device_CreateTexture2D(ctx->device, &src_desc, NULL, &ctx->gpu_src);
+    if (FAILED(hr))
+        goto fail_hr;
+    hr = ID3D11Device_CreateShaderResourceView(ctx->device, (ID3D11Resource *)ctx->gpu_src,
+                                               NULL, &ctx->gpu_srv);
+    if (FAILED(hr))
+        goto fail_hr;
+
+    D3D11_BUFFER_DESC out_desc = {0};
+    out_desc.ByteWidth = words * 4;
+    out_desc.Usage     = D3D11_USAGE_DEFAULT;
+    out_desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+    out_desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_ALLOW_RAW_VIEWS;
+    hr = ID3D11Device_CreateBuffer(ctx->device, &out_desc, NULL, &ctx->gpu_out);
+    if (FAILED(hr))
+        goto fail_hr;
+
+    D3D11_UNORDERED_ACCESS_VIEW_DESC uav_desc = {0};
+    uav_desc.Format              = DXGI_FORMAT_R32_TYPELESS;
+    uav_desc.ViewDimension       = D3D11_UAV_DIMENSION_BUFFER;
+    uav_desc.Buffer.FirstElement = 0;
+    uav_desc.Buffer.NumElements  = words;
+    uav_desc.Buffer.Flags        = D3D11_BUFFER_UAV_FLAG_RAW;
+    hr = ID3D11Device_CreateUnorderedAccessView(ctx->device, (ID3D11Resource *)ctx->gpu_out,
+                                                &uav_desc, &ctx->gpu_uav);
+    if (FAILED(hr))
+        goto fail_hr;
+
+    D3D11_BUFFER_DESC staging_desc = {0};
+    staging_desc.ByteWidth      = words * 4;
+    staging_desc.Usage          = D3D11_USAGE_STAGING;
+    staging_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    hr = ID3D11Device_CreateBuffer(ctx->device, &staging_desc, NULL, &ctx->gpu_staging);
+    if (FAILED(hr))
+        goto fail_hr;
+
+    UINT params[8] = {
+        (UINT)ctx->width, (UINT)ctx->height,
+        fmt == PIX_FMT_NV12, (UINT)frame_size,
+        (UINT)ctx->src_width, (UINT)ctx->src_height, 0, 0
+    };
+    D3D11_BUFFER_DESC params_desc = {0};
+    params_desc.ByteWidth = sizeof(params);
+    params_desc.Usage     = D3D11_USAGE_IMMUTABLE;
+    params_desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    D3D11_SUBRESOURCE_DATA params_data = { params, 0, 0 };
+    hr = ID3D11Device_CreateBuffer(ctx->device, &params_desc, &params_data, &ctx->gpu_params);
+    if (FAILED(hr))
+        goto fail_hr;
+
+    ctx->gpu_groups = (words + 255) / 256;
+    ctx->frame_size = frame_size;
+    return 0;
+
+fail_hr:
+    fprintf(stderr, "capture_win: GPU conversion setup failed: 0x%08lx\n", (unsigned long)hr);
+fail:
+    gpu_release(ctx);
+    return -1;
+}
+
+/* Give the staging resource back to the GPU before it is written again */
+static void unmap_frame(capture_ctx_t *ctx)
+{
+    if (ctx->mapped) {
+        ID3D11DeviceContext_Unmap(ctx->context, ctx->mapped, 0);
+        ctx->mapped = NULL;
+    }
+}
+
+/*
+ * Map the resource holding the current frame (staging texture, or the
+ * converted frame when converting on the GPU) and describe it in
+ * ctx->frame.  Stays mapped until unmap_frame().
+ */
+static const frame_t *map_frame(capture_ctx_t *ctx)
+{
+    if (ctx->mapped)
+        return &ctx->frame;
+
+    ID3D11Resource *res = ctx->gpu_src ? (ID3D11Resource *)ctx->gpu_staging
+                                       : (ID3D11Resource *)ctx->staging;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    HRESULT hr = ID3D11DeviceContext_Map(ctx->context, res, 0, D3D11_MAP_READ, 0, &mapped);
+    if (FAILED(hr)) {
+        fprintf(stderr, "capture_win: Map(staging) failed: 0x%08lx\n", (unsigned long)hr);
+        return NULL;
+    }
+    ctx->mapped = res;
+
+    frame_init(&ctx->frame, ctx->format, ctx->width, ctx->height, mapped.pData);
+    if (!ctx->gpu_src)
+        ctx->frame.strides[0] = mapped.RowPitch;   /* rows may be padded */
+    return &ctx->frame;
+}
+
+int capture_set_format(capture_ctx_t *ctx, pix_fmt_t fmt)
+{
+    if (fmt == ctx->format)
+        return 0;
+
+    unmap_frame(ctx);
+    gpu_release(ctx);
+    ctx->format     = PIX_FMT_BGRA;
+    ctx->width      = ctx->src_width;   /* scaling is part of the GPU path */
+    ctx->height     = ctx->src_height;
+    ctx->have_frame = 0;   /* the next grab fills the new path completely */
+    if (fmt == PIX_FMT_BGRA)
+        return 0;
+    if (fmt != PIX_FMT_YUV420P && fmt != PIX_FMT_NV12)
+        return -1;
+    if (gpu_setup(ctx, fmt) < 0) {
+        fprintf(stderr, "capture_win: converting on the CPU instead\n");
+        return -1;
+    }
+
+    ctx->format = fmt;
+    fprintf(stderr, "capture_win: converting to %s on the GPU\n", pix_fmt_name(fmt));
+    return 0;
+}
+
+/*
+ * Scaling rides on the conversion shader, so it needs capture_set_format()
+ * to have succeeded first.
+ */
+int capture_set_size(capture_ctx_t *ctx, int width, int height)
+{
+    if (width == ctx->width && height == ctx->height)
+        return 0;
+    if (!ctx->gpu_src)
+        return -1;
+
+    unmap_frame(ctx);
+    gpu_release(ctx);
+    ctx->have_frame = 0;
+
+    int old_width = ctx->width, old_height = ctx->height;
+    ctx->width  = width;
+    ctx->height = height;
+    if (gpu_setup(ctx, ctx->format) == 0) {
+        fprintf(stderr, "capture_win: scaling to %dx%d on the GPU\n", width, height);
+        return 0;
+    }
+
+    ctx->width  = old_width;
+    ctx->height = old_height;
+    if (gpu_setup(ctx, ctx->format) < 0) {
+        /* Lost the GPU path altogether: back to plain BGRA */
+        ctx->format = PIX_FMT_BGRA;
+        ctx->width  = ctx->src_width;
+        ctx->height = ctx->src_height;
+    }
+    return -1;
+}
+
+/* Run the shader over gpu_src and queue the result's copy to gpu_staging. */
+static void gpu_convert(capture_ctx_t *ctx)
+{
+    ID3D11DeviceContext *dc = ctx->context;
+    ID3D11ShaderResourceView *no_srv = NULL;
+    ID3D11UnorderedAccessView *no_uav = NULL;
+
+    ID3D11DeviceContext_CSSetShader(dc, ctx->gpu_shader, NULL, 0);
+    ID3D11DeviceContext_CSSetShaderResources(dc, 0, 1, &ctx->gpu_srv);
+    ID3D11DeviceContext_CSSetUnorderedAccessViews(dc, 0, 1, &ctx->gpu_uav, NULL);
+    ID3D11DeviceContext_CSSetConstantBuffers(dc, 0, 1, &ctx->gpu_params);
+    ID3D11DeviceContext_Dispatch(dc, ctx->gpu_groups, 1, 1);
+
+    /* Unbind so the next frame can be copied into gpu_src */
+    ID3D11DeviceContext_CSSetShaderResources(dc, 0, 1, &no_srv);
+    ID3D11DeviceContext_CSSetUnorderedAccessViews(dc, 0, 1, &no_uav, NULL);
+
+    ID3D11DeviceContext_CopyResource(dc, (ID3D11Resource *)ctx->gpu_staging,
+                                     (ID3D11Resource *)ctx->gpu_out);
+}
+
+/* capture_grab() frames live in the one staging resource; nothing to lend */
+int capture_can_borrow(const capture_ctx_t *ctx)
+{
+    (void)ctx;
+    return 0;
+}
+
+int capture_acquire(capture_ctx_t *ctx, capture_frame_t *frame)
+{
+    (void)ctx;
+    (void)frame;
+    return -1;
+}
+
+int capture_dirty_rects(const capture_ctx_t *ctx, const dirty_rect_t **rects)
+{
+    *rects = ctx->dirty;
+    return ctx->dirty_count;
+}
+
+int capture_cursor(capture_ctx_t *ctx, capture_cursor_t *cursor)
+{
+    /* In frame coordinates, scaled along with a GPU-scaled capture */
+    dirty_rect_t box = { ctx->cursor_x, ctx->cursor_y, ctx->cursor_w, ctx->cursor_h };
+    if (ctx->width != ctx->src_width || ctx->height != ctx->src_height) {
+        box.x = (int)((int64_t)box.x * ctx->width / ctx->src_width);
+        box.y = (int)((int64_t)box.y * ctx->height / ctx->src_height);
+        box.w = (int)(((int64_t)box.w * ctx->width + ctx->src_width - 1) / ctx->src_width);
+        box.h = (int)(((int64_t)box.h * ctx->height + ctx->src_height - 1) / ctx->src_height);
+    }
+    *cursor = (capture_cursor_t){
+        .visible = ctx->cursor_visible && ctx->cursor_image &&
+                   box.x < ctx->width && box.y < ctx->height &&
+                   box.x + box.w > 0 && box.y + box.h > 0,
+        .box     = box,
+        .image   = ctx->cursor_image,
+        .image_w = ctx->cursor_w,
+        .image_h = ctx->cursor_h,
+        .serial  = ctx->cursor_serial,
+    };
+    return 0;
+}
+
+/*
+ * Hold the next desktop frame in ctx->pending, waiting up to timeout_ms
+ * for DWM to present one.  Returns S_OK, DXGI_ERROR_WAIT_TIMEOUT or an
+ * error; a frame already pending is returned at once.
+ */
+static HRESULT acquire_next(capture_ctx_t *ctx, UINT timeout_ms)
+{
+    if (ctx->pending)
+        return S_OK;
+    return IDXGIOutputDuplication_AcquireNextFrame(ctx->duplication, timeout_ms,
+                                                   &ctx->pending_info, &ctx->pending);
+}
+
+int capture_wait_frame(capture_ctx_t *ctx, uint64_t timeout_ns)
+{
+    if (ctx->lost)
+        return 1;   /* capture_grab() reports it */
+    HRESULT hr = acquire_next(ctx, (UINT)((timeout_ns + 999999) / 1000000));
+    if (hr == DXGI_ERROR_WAIT_TIMEOUT)
+        return 0;
+    return 1;   /* a frame, or an error capture_grab() reports */
+}
+
+const frame_t *capture_grab(capture_ctx_t *ctx)
 {
     HRESULT hr;
     IDXGIResource *frame_resource = NULL;
     DXGI_OUTDUPL_FRAME_INFO frame_info;
 
-    hr = IDXGIOutputDuplication_AcquireNextFrame(ctx->duplication, 100, &frame_info, &frame_resource);
+    if (ctx->lost)
+        return NULL;
+
+    /* The caller paces: only wait for the very first image */
+    hr = acquire_next(ctx, ctx->have_frame ? 0 : 100);
+    if (SUCCEEDED(hr)) {
+        frame_resource = ctx->pending;
+        frame_info     = ctx->pending_info;
+        ctx->pending   = NULL;
+    }
 
     if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-        /* No new frame — return previous buffer contents */
-        return ctx->buffer;
+        /* No new frame — hand out the previous one again */
+        ctx->dirty_count = ctx->have_frame ? 0 : -1;
+        return map_frame(ctx);
     }
 
     if (hr == DXGI_ERROR_ACCESS_LOST) {
-        /* Desktop mode changed or another app took over — caller should retry init */
+        /* Desktop mode changed, a secure desktop or a fullscreen app took
+         * over: the duplication is dead until capture_reset() */
         fprintf(stderr, "capture_win: access lost (desktop mode change?)\n");
+        ctx->lost = 1;
         return NULL;
     }
 
@@ -201,6 +876,15 @@ const uint8_t *capture_grab(capture_ctx_t *ctx)
         return NULL;
     }
 
+    update_pointer(ctx, &frame_info);
+    collect_dirty(ctx, &frame_info);
+    if (ctx->dirty_count == 0) {
+        /* Nothing to copy — keep the previous image */
+        IDXGIResource_Release(frame_resource);
+        IDXGIOutputDuplication_ReleaseFrame(ctx->duplication);
+        return map_frame(ctx);
+    }
+
     /* Get the GPU texture from the acquired frame */
     static const GUID local_IID_ID3D11Texture2D =
         {0x6f15aaf2,0xd208,0x4e89,{0x9a,0xb4,0x48,0x95,0x35,0xd3,0x4f,0x9c}};
@@ -212,51 +896,50 @@ const uint8_t *capture_grab(capture_ctx_t *ctx)
     if (FAILED(hr)) {
         fprintf(stderr, "capture_win: QueryInterface(ID3D11Texture2D) failed: 0x%08lx\n", (unsigned long)hr);
         IDXGIOutputDuplication_ReleaseFrame(ctx->duplication);
+        ctx->have_frame = 0;   /* changes were lost: next grab copies everything */
         return NULL;
     }
 
-    /* Copy GPU texture -> staging texture (CPU-readable) */
-    ID3D11DeviceContext_CopyResource(ctx->context,
-                                     (ID3D11Resource *)ctx->staging,
-                                     (ID3D11Resource *)frame_texture);
-    ID3D11Texture2D_Release(frame_texture);
-
-    /* Map staging texture to read pixel data */
-    D3D11_MAPPED_SUBRESOURCE mapped;
-    hr = ID3D11DeviceContext_Map(ctx->context,
-                                (ID3D11Resource *)ctx->staging,
-                                0, D3D11_MAP_READ, 0, &mapped);
-    if (FAILED(hr)) {
-        fprintf(stderr, "capture_win: Map(staging) failed: 0x%08lx\n", (unsigned long)hr);
-        IDXGIOutputDuplication_ReleaseFrame(ctx->duplication);
-        return NULL;
+    /* Copy GPU texture -> staging texture (CPU-readable), or into the
+     * shader's input when converting on the GPU.  Neither may stay mapped
+     * while the GPU writes it. */
+    unmap_frame(ctx);
+    ID3D11Resource *dest = ctx->gpu_src ? (ID3D11Resource *)ctx->gpu_src
+                                        : (ID3D11Resource *)ctx->staging;
+    dirty_rect_t all = { 0, 0, ctx->src_width, ctx->src_height };
+    int ncopy = ctx->dirty_count < 0 ? 1 : ctx->dirty_count;
+    for (int i = 0; i < ncopy; i++) {
+        const dirty_rect_t *d = ctx->dirty_count < 0 ? &all : &ctx->dirty[i];
+        UINT x = (UINT)(ctx->origin_x + d->x), y = (UINT)(ctx->origin_y + d->y);
+        D3D11_BOX box = { x, y, 0, x + (UINT)d->w, y + (UINT)d->h, 1 };
+        ID3D11DeviceContext_CopySubresourceRegion(ctx->context,
+            dest, 0, (UINT)d->x, (UINT)d->y, 0,
+            (ID3D11Resource *)frame_texture, 0, &box);
     }
+    ID3D11Texture2D_Release(frame_texture);
 
-    /* Copy pixel data — handle row padding (stride != width*4) */
-    size_t dest_stride = (size_t)ctx->width * 4;
-    if ((size_t)mapped.RowPitch == dest_stride) {
-        memcpy(ctx->buffer, mapped.pData, dest_stride * ctx->height);
-    } else {
-        for (int y = 0; y < ctx->height; y++) {
-            memcpy(ctx->buffer + y * dest_stride,
-                   (uint8_t *)mapped.pData + y * mapped.RowPitch,
-                   dest_stride);
-        }
-    }
+    if (ctx->gpu_src)
+        gpu_convert(ctx);
+    scale_dirty(ctx);
 
-    ID3D11DeviceContext_Unmap(ctx->context,
-                             (ID3D11Resource *)ctx->staging, 0);
+    /* Map before releasing the desktop frame, whose copy may still be queued */
+    const frame_t *f = map_frame(ctx);
     IDXGIOutputDuplication_ReleaseFrame(ctx->duplication);
-
-    return ctx->buffer;
+    ctx->have_frame = f != NULL;
+    return f;
 }
 
-void capture_free(capture_ctx_t *ctx)
+/* Release everything ctx holds, leaving an empty shell. */
+static void release_ctx(capture_ctx_t *ctx)
 {
-    if (!ctx)
-        return;
-
     /* Release COM objects in reverse creation order */
+    if (ctx->context)
+        unmap_frame(ctx);
+    if (ctx->pending) {
+        IDXGIResource_Release(ctx->pending);
+        IDXGIOutputDuplication_ReleaseFrame(ctx->duplication);
+    }
+    gpu_release(ctx);
     if (ctx->staging)
         ID3D11Texture2D_Release(ctx->staging);
     if (ctx->duplication)
@@ -266,6 +949,42 @@ void capture_free(capture_ctx_t *ctx)
     if (ctx->device)
         ID3D11Device_Release(ctx->device);
 
-    free(ctx->buffer);
+    free(ctx->meta);
+    free(ctx->dirty);
+    free(ctx->shape);
+    free(ctx->cursor_image);
+
+    capture_target_t target = ctx->target;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->target = target;
+}
+
+int capture_lost(const capture_ctx_t *ctx)
+{
+    return ctx->lost;
+}
+
+/*
+ * A lost duplication cannot be revived: release it (and the device, whose
+ * output may be gone too) before duplicating the output again.
+ */
+int capture_reset(capture_ctx_t *ctx)
+{
+    release_ctx(ctx);
+    ctx->lost = 1;
+
+    capture_ctx_t *fresh = capture_init(&ctx->target);
+    if (!fresh)
+        return -1;
+    *ctx = *fresh;
+    free(fresh);   /* only the struct: ctx owns its objects now */
+    return 0;
+}
+
+void capture_free(capture_ctx_t *ctx)
+{
+    if (!ctx)
+        return;
+    release_ctx(ctx);
     free(ctx);
 }
@@ -1,42 +1,873 @@
 #include "convert.h"
+#include "convert_kernels.h"
+#include "workers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 /*
- * BGRA -> YUV420P (I420) conversion.
+ * BGRA -> YUV420P (I420), NV12 and YUYV conversion.
  *
  * Y  plane: width * height bytes
- * Cb plane: (width/2) * (height/2) bytes
- * Cr plane: (width/2) * (height/2) bytes
+ * Cb plane: ceil(width/2) * ceil(height/2) bytes
+ * Cr plane: ceil(width/2) * ceil(height/2) bytes
+ * (NV12 interleaves Cb/Cr into one plane; YUYV packs 4:2:2, see pixfmt.h)
+ *
+ * Uses standard BT.601 coefficients.  The scalar kernel below is the
+ * reference; SIMD kernels (convert_x86.c, convert_neon.c) must produce
+ * bit-identical output.  The fastest kernel the CPU supports is picked
+ * once by convert_init().
  *
- * Uses standard BT.601 coefficients.
+ * With convert_set_threads(n > 1) the frame is split into n horizontal
+ * bands of an even number of rows, so every chroma row belongs to
+ * exactly one band and the bands can be converted in parallel.
  */
-void bgra_to_yuv420p(const uint8_t *src, uint8_t *dst, int width, int height)
+
+void yuv420p_kernel_scalar(const uint8_t *src, size_t src_stride,
+                           uint8_t *y, size_t y_stride,
+                           uint8_t *u, uint8_t *v, size_t c_stride,
+                           int c_vsub, int width, int height)
+{
+    for (int j = 0; j < height; j++) {
+        int chroma = c_vsub == 1 || (j & 1) == 0;
+        size_t ci  = (size_t)(j / c_vsub) * c_stride;
+
+        yuv420p_row_tail(src + (size_t)j * src_stride,
+                         y + (size_t)j * y_stride,
+                         chroma ? u + ci : NULL,
+                         chroma ? v + ci : NULL,
+                         0, width);
+    }
+}
+
+void colsum_kernel_scalar(const uint8_t *src, size_t stride, int rows,
+                          uint16_t *sum, size_t n)
+{
+    colsum_tail(src, stride, rows, sum, 0, n);
+}
+
+void boxrow_kernel_scalar(const uint16_t *sum, const int *x0, const int *x1,
+                          int c0, int c1, int rows, const uint32_t *recip,
+                          uint8_t *out)
+{
+    int base = x0[c0];
+
+    for (int i = c0; i < c1; i++, out += 4) {
+        const uint16_t *p = sum + (size_t)(x0[i] - base) * 4;
+        int w = x1[i] - x0[i];
+        uint32_t b = 0, g = 0, r = 0, a = 0;
+        for (int k = 0; k < w; k++, p += 4) {
+            b += p[0];
+            g += p[1];
+            r += p[2];
+            a += p[3];
+        }
+        uint32_t m = recip[w * rows];
+        out[0] = (uint8_t)((b * m + 32768) >> 16);
+        out[1] = (uint8_t)((g * m + 32768) >> 16);
+        out[2] = (uint8_t)((r * m + 32768) >> 16);
+        out[3] = (uint8_t)((a * m + 32768) >> 16);
+    }
+}
+
+/* ── Runtime dispatch ──────────────────────────────────────── */
+
+#if defined(__x86_64__) || defined(__i386__)
+static int cpu_has_avx2(void)  { return __builtin_cpu_supports("avx2");   }
+static int cpu_has_sse41(void) { return __builtin_cpu_supports("sse4.1"); }
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+static int cpu_has_neon(void)  { return 1; }   /* baseline on arm64 */
+#endif
+
+static int cpu_has_nothing(void) { return 1; }
+
+/* Ordered fastest first; the scalar entry always matches. */
+static const struct {
+    const char        *name;
+    int              (*supported)(void);
+    yuv420p_kernel_fn  yuv420p;
+    colsum_kernel_fn   colsum;
+    boxrow_kernel_fn   boxrow;
+} kernels[] = {
+#if defined(__x86_64__) || defined(__i386__)
+    { "avx2",   cpu_has_avx2,    yuv420p_kernel_avx2,   colsum_kernel_avx2,   boxrow_kernel_sse41  },
+    { "sse4.1", cpu_has_sse41,   yuv420p_kernel_sse41,  colsum_kernel_sse41,  boxrow_kernel_sse41  },
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+    { "neon",   cpu_has_neon,    yuv420p_kernel_neon,   colsum_kernel_neon,   boxrow_kernel_neon   },
+#endif
+    { "scalar", cpu_has_nothing, yuv420p_kernel_scalar, colsum_kernel_scalar, boxrow_kernel_scalar },
+};
+
+static int active = -1;
+
+void convert_init(void)
 {
-    int half_w = width  / 2;
+    if (active >= 0)
+        return;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+#endif
+
+    int n = (int)(sizeof(kernels) / sizeof(kernels[0]));
+    for (int i = 0; i < n; i++) {
+        if (kernels[i].supported()) {
+            active = i;
+            break;
+        }
+    }
+    fprintf(stderr, "convert: using %s kernel\n", kernels[active].name);
+}
+
+const char *convert_kernel_name(void)
+{
+    convert_init();
+    return kernels[active].name;
+}
+
+int convert_use_kernel(const char *name)
+{
+    convert_init();
+    int n = (int)(sizeof(kernels) / sizeof(kernels[0]));
+    for (int i = 0; i < n; i++) {
+        if (strcmp(kernels[i].name, name) == 0 && kernels[i].supported()) {
+            active = i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* ── Output formats ────────────────────────────────────────── */
+
+#define CHUNK 512   /* pixels per scratch row for interleaved formats (even) */
+
+typedef struct {
+    const frame_t      *src;         /* BGRA */
+    frame_t            *dst;
+    int                 width;
+    int                 height;
+    int                 band_rows;   /* even; band-parallel frames */
+    const dirty_rect_t *rects;       /* incremental updates */
+} convert_job_t;
+
+static const uint8_t *src_at(const convert_job_t *job, int x, int y)
+{
+    return job->src->planes[0] + (size_t)y * job->src->strides[0] + (size_t)x * 4;
+}
+
+/*
+ * NV12 / YUYV: the kernel writes luma straight into the frame and chroma
+ * (or packed-row luma) into a small L1-resident scratch row, which is
+ * interleaved on the way out.  Source and destination are still touched
+ * exactly once per frame.
+ */
+static void nv12_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    uint8_t u[CHUNK / 2], v[CHUNK / 2];
+    const frame_t *dst = job->dst;
+
+    for (int j = y; j < y + h; j += 2) {
+        int rows = y + h - j < 2 ? 1 : 2;
+        for (int i = x; i < x + w; i += CHUNK) {
+            int n = x + w - i < CHUNK ? x + w - i : CHUNK;
+            kernels[active].yuv420p(src_at(job, i, j), job->src->strides[0],
+                                    dst->planes[0] + (size_t)j * dst->strides[0] + i,
+                                    dst->strides[0],
+                                    u, v, 0, 2, n, rows);
+
+            uint8_t *uv = dst->planes[1] + (size_t)(j / 2) * dst->strides[1] + (size_t)(i / 2) * 2;
+            for (int k = 0; k < (n + 1) / 2; k++) {
+                uv[2 * k]     = u[k];
+                uv[2 * k + 1] = v[k];
+            }
+        }
+    }
+}
+
+static void yuyv_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    uint8_t yy[CHUNK], u[CHUNK / 2], v[CHUNK / 2];
+    const frame_t *dst = job->dst;
+
+    for (int j = y; j < y + h; j++) {
+        for (int i = x; i < x + w; i += CHUNK) {
+            int n = x + w - i < CHUNK ? x + w - i : CHUNK;
+            kernels[active].yuv420p(src_at(job, i, j), job->src->strides[0],
+                                    yy, 0, u, v, 0, 1, n, 1);
+
+            uint8_t *out = dst->planes[0] + (size_t)j * dst->strides[0] + (size_t)i * 2;
+            for (int k = 0; k < n / 2; k++) {
+                out[4 * k]     = yy[2 * k];
+                out[4 * k + 1] = u[k];
+                out[4 * k + 2] = yy[2 * k + 1];
+                out[4 * k + 3] = v[k];
+            }
+            if (n & 1) {
+                /* Unpaired last pixel of an odd-width frame */
+                out[2 * (n - 1)]     = yy[n - 1];
+                out[2 * (n - 1) + 1] = 128;
+            }
+        }
+    }
+}
+
+/* BGRA output: nothing to convert, just copy the rows. */
+static void bgra_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    const frame_t *dst = job->dst;
+    uint8_t *out = dst->planes[0] + (size_t)y * dst->strides[0] + (size_t)x * 4;
+
+    for (int j = 0; j < h; j++, out += dst->strides[0])
+        memcpy(out, src_at(job, x, y + j), (size_t)w * 4);
+}
+
+/*
+ * RGBA / RGB24 output: a byte shuffle per pixel, no color math.  Plain
+ * loops over fixed-size pixels, which the compiler vectorizes.
+ */
+static void rgba_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    const frame_t *dst = job->dst;
+    uint8_t *out = dst->planes[0] + (size_t)y * dst->strides[0] + (size_t)x * 4;
+
+    for (int j = 0; j < h; j++, out += dst->strides[0]) {
+        const uint8_t *in = src_at(job, x, y + j);
+        for (int i = 0; i < w; i++) {
+            out[4 * i]     = in[4 * i + 2];
+            out[4 * i + 1] = in[4 * i + 1];
+            out[4 * i + 2] = in[4 * i];
+            out[4 * i + 3] = in[4 * i + 3];
+        }
+    }
+}
+
+static void rgb24_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    const frame_t *dst = job->dst;
+    uint8_t *out = dst->planes[0] + (size_t)y * dst->strides[0] + (size_t)x * 3;
+
+    for (int j = 0; j < h; j++, out += dst->strides[0]) {
+        const uint8_t *in = src_at(job, x, y + j);
+        for (int i = 0; i < w; i++) {
+            out[3 * i]     = in[4 * i + 2];
+            out[3 * i + 1] = in[4 * i + 1];
+            out[3 * i + 2] = in[4 * i];
+        }
+    }
+}
+
+/* Convert one region of the frame; x and y are even. */
+static void convert_region(const convert_job_t *job, int x, int y, int w, int h)
+{
+    const frame_t *dst = job->dst;
+
+    switch (dst->format) {
+    case PIX_FMT_BGRA:
+        bgra_region(job, x, y, w, h);
+        return;
+    case PIX_FMT_RGBA:
+        rgba_region(job, x, y, w, h);
+        return;
+    case PIX_FMT_RGB24:
+        rgb24_region(job, x, y, w, h);
+        return;
+    case PIX_FMT_NV12:
+        nv12_region(job, x, y, w, h);
+        return;
+    case PIX_FMT_YUYV:
+        yuyv_region(job, x, y, w, h);
+        return;
+    default:
+        break;
+    }
+
+    kernels[active].yuv420p(src_at(job, x, y), job->src->strides[0],
+                            dst->planes[0] + (size_t)y * dst->strides[0] + x,
+                            dst->strides[0],
+                            dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x / 2,
+                            dst->planes[2] + (size_t)(y / 2) * dst->strides[2] + x / 2,
+                            dst->strides[1], 2, w, h);
+}
+
+/* ── Band-parallel conversion ──────────────────────────────── */
+
+static workers_t *pool;
+
+static void convert_band(void *arg, int index, int count)
+{
+    (void)count;
+    const convert_job_t *job = arg;
+
+    int row0 = index * job->band_rows;
+    int rows = job->height - row0;
+    if (rows > job->band_rows)
+        rows = job->band_rows;
+    if (rows <= 0)
+        return;
+
+    convert_region(job, 0, row0, job->width, rows);
+}
+
+int convert_set_threads(int threads)
+{
+    workers_destroy(pool);
+    pool = NULL;
+
+    if (threads <= 1)
+        return 0;
+
+    pool = workers_create(threads);
+    if (!pool) {
+        fprintf(stderr, "convert: cannot create worker pool\n");
+        return -1;
+    }
+    fprintf(stderr, "convert: %d threads\n", workers_count(pool));
+    return 0;
+}
+
+void convert_shutdown(void)
+{
+    workers_destroy(pool);
+    pool = NULL;
+}
+
+void frame_convert(const frame_t *src, frame_t *dst)
+{
+    int height = src->height;
     int half_h = height / 2;
 
-    uint8_t *y_plane = dst;
-    uint8_t *u_plane = dst + width * height;
-    uint8_t *v_plane = u_plane + half_w * half_h;
+    dst->timestamp_ns = src->timestamp_ns;
+    if (src->format != PIX_FMT_BGRA) {
+        frame_copy(dst, src);
+        return;
+    }
 
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            int idx = (j * width + i) * 4;
-            uint8_t b = src[idx + 0];
-            uint8_t g = src[idx + 1];
-            uint8_t r = src[idx + 2];
-            /* src[idx+3] is alpha, ignored */
-
-            /* Y */
-            int y = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
-            y_plane[j * width + i] = (uint8_t)(y < 0 ? 0 : (y > 255 ? 255 : y));
-
-            /* Subsample U and V: one value per 2x2 block */
-            if ((j & 1) == 0 && (i & 1) == 0) {
-                int u = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
-                int v = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
-                int ci = (j / 2) * half_w + (i / 2);
-                u_plane[ci] = (uint8_t)(u < 0 ? 0 : (u > 255 ? 255 : u));
-                v_plane[ci] = (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+    convert_job_t job = {
+        .src    = src,
+        .dst    = dst,
+        .width  = src->width,
+        .height = height,
+    };
+
+    convert_init();
+
+    int bands = pool ? workers_count(pool) : 1;
+    if (bands > half_h)
+        bands = half_h > 0 ? half_h : 1;
+
+    /* Round band height up to an even row count */
+    job.band_rows = (height + bands - 1) / bands;
+    job.band_rows = (job.band_rows + 1) & ~1;
+    bands = (height + job.band_rows - 1) / job.band_rows;
+
+    if (bands <= 1 || !pool)
+        convert_band(&job, 0, 1);
+    else
+        workers_run(pool, convert_band, &job, bands);
+}
+
+void bgra_convert(pix_fmt_t fmt, const uint8_t *src, uint8_t *dst,
+                  int width, int height)
+{
+    frame_t in, out;
+    frame_init(&in, PIX_FMT_BGRA, width, height, (uint8_t *)src);
+    frame_init(&out, fmt, width, height, dst);
+    frame_convert(&in, &out);
+}
+
+void bgra_to_yuv420p(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    bgra_convert(PIX_FMT_YUV420P, src, dst, width, height);
+}
+
+void bgra_to_nv12(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    bgra_convert(PIX_FMT_NV12, src, dst, width, height);
+}
+
+void bgra_to_yuyv(const uint8_t *src, uint8_t *dst, int width, int height)
+{
+    bgra_convert(PIX_FMT_YUYV, src, dst, width, height);
+}
+
+/* ── Dirty-rect incremental conversion ─────────────────────── */
+
+static void convert_rect(void *arg, int index, int count)
+{
+    (void)count;
+    const convert_job_t *job = arg;
+    const dirty_rect_t  *r   = &job->rects[index];
+
+    convert_region(job, r->x, r->y, r->w, r->h);
+}
+
+void frame_convert_rects(const frame_t *src, frame_t *dst,
+                         const dirty_rect_t *rects, int count)
+{
+    dst->timestamp_ns = src->timestamp_ns;
+    if (src->format != PIX_FMT_BGRA) {
+        frame_copy(dst, src);
+        return;
+    }
+
+    convert_job_t job = {
+        .src    = src,
+        .dst    = dst,
+        .width  = src->width,
+        .height = src->height,
+        .rects  = rects,
+    };
+
+    convert_init();
+
+    if (pool) {
+        workers_run(pool, convert_rect, &job, count);
+    } else {
+        for (int i = 0; i < count; i++)
+            convert_rect(&job, i, count);
+    }
+}
+
+/* ── Fused scale + convert ─────────────────────────────────── */
+
+/*
+ * Every output pixel averages a box of source pixels: output column i
+ * covers source columns [x0[i], x1[i]), rows likewise.  Shrinking, the
+ * boxes tile the source exactly, so each source pixel is read once;
+ * enlarging, each box is a single (nearest) pixel.  Output rows are
+ * scaled in pairs into a small BGRA scratch that goes straight through
+ * the conversion kernel, so the scaled image never reaches memory.
+ */
+struct scaler {
+    int       src_w, src_h;
+    int       dst_w, dst_h;
+    int      *x0, *x1;          /* per output column */
+    int      *y0, *y1;          /* per output row */
+    int      *col_lo, *col_hi;  /* per source column: output columns using it */
+    int      *row_lo, *row_hi;  /* per source row: output rows using it */
+    uint32_t *recip;            /* 65536 / box area, rounded */
+    int      *span_x0, *span_x1;/* per output row pair: columns to redo */
+    int       bands;
+    uint8_t  *scratch;          /* per band: two scaled rows + column sums */
+    size_t    scratch_size;
+};
+
+typedef struct {
+    scaler_t      *s;
+    const frame_t *src;
+    frame_t       *dst;
+    int            band_rows;   /* even */
+    int            partial;     /* only rows with a span, else everything */
+} scale_job_t;
+
+/* Box bounds along one axis; lo/hi map each source index back. */
+static void scale_axis(int src, int dst, int *b0, int *b1, int *lo, int *hi)
+{
+    for (int i = 0; i < src; i++) {
+        lo[i] = dst;
+        hi[i] = 0;
+    }
+    for (int i = 0; i < dst; i++) {
+        b0[i] = (int)((long long)i * src / dst);
+        b1[i] = (int)((long long)(i + 1) * src / dst);
+        if (b1[i] <= b0[i])
+            b1[i] = b0[i] + 1;
+        for (int k = b0[i]; k < b1[i]; k++) {
+            if (lo[k] > i)     lo[k] = i;
+            if (hi[k] < i + 1) hi[k] = i + 1;
+        }
+    }
+}
+
+scaler_t *scaler_create(int src_w, int src_h, int dst_w, int dst_h)
+{
+    /* Column sums are 16-bit: at most 257 source rows per output row */
+    if (src_h / dst_h > 256)
+        return NULL;
+
+    scaler_t *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+
+    s->src_w = src_w;
+    s->src_h = src_h;
+    s->dst_w = dst_w;
+    s->dst_h = dst_h;
+    s->bands = pool ? workers_count(pool) : 1;
+
+    int box_w = (src_w + dst_w - 1) / dst_w + 1;
+    int box_h = (src_h + dst_h - 1) / dst_h + 1;
+    int pairs = (dst_h + 1) / 2;
+
+    s->x0      = malloc((size_t)dst_w * sizeof(int));
+    s->x1      = malloc((size_t)dst_w * sizeof(int));
+    s->y0      = malloc((size_t)dst_h * sizeof(int));
+    s->y1      = malloc((size_t)dst_h * sizeof(int));
+    s->col_lo  = malloc((size_t)src_w * sizeof(int));
+    s->col_hi  = malloc((size_t)src_w * sizeof(int));
+    s->row_lo  = malloc((size_t)src_h * sizeof(int));
+    s->row_hi  = malloc((size_t)src_h * sizeof(int));
+    s->recip   = malloc((size_t)(box_w * box_h + 1) * sizeof(uint32_t));
+    s->span_x0 = malloc((size_t)pairs * sizeof(int));
+    s->span_x1 = malloc((size_t)pairs * sizeof(int));
+    s->scratch_size = (size_t)dst_w * 2 * 4 + (size_t)src_w * 4 * sizeof(uint16_t);
+    s->scratch = malloc(s->scratch_size * (size_t)s->bands);
+    if (!s->x0 || !s->x1 || !s->y0 || !s->y1 || !s->col_lo || !s->col_hi ||
+        !s->row_lo || !s->row_hi || !s->recip || !s->span_x0 || !s->span_x1 ||
+        !s->scratch) {
+        scaler_free(s);
+        return NULL;
+    }
+
+    scale_axis(src_w, dst_w, s->x0, s->x1, s->col_lo, s->col_hi);
+    scale_axis(src_h, dst_h, s->y0, s->y1, s->row_lo, s->row_hi);
+    s->recip[0] = 0;
+    for (int n = 1; n <= box_w * box_h; n++)
+        s->recip[n] = (65536u + (uint32_t)n / 2) / (uint32_t)n;
+    return s;
+}
+
+void scaler_free(scaler_t *s)
+{
+    if (!s)
+        return;
+    free(s->x0);
+    free(s->x1);
+    free(s->y0);
+    free(s->y1);
+    free(s->col_lo);
+    free(s->col_hi);
+    free(s->row_lo);
+    free(s->row_hi);
+    free(s->recip);
+    free(s->span_x0);
+    free(s->span_x1);
+    free(s->scratch);
+    free(s);
+}
+
+/*
+ * Scale output row j, columns [c0, c1), into out (BGRA): the box's source
+ * rows are summed column-wise first, then each output pixel adds up its
+ * few columns of sums.
+ */
+static void scale_row(const scaler_t *s, const frame_t *src, int j, int c0, int c1,
+                      uint8_t *out, uint16_t *sum)
+{
+    int base = s->x0[c0];
+    int rows = s->y1[j] - s->y0[j];
+
+    kernels[active].colsum(src->planes[0] + (size_t)s->y0[j] * src->strides[0] + (size_t)base * 4,
+                           src->strides[0], rows, sum, (size_t)(s->x1[c1 - 1] - base) * 4);
+    kernels[active].boxrow(sum, s->x0, s->x1, c0, c1, rows, s->recip, out);
+}
+
+static void scale_band(void *arg, int index, int count)
+{
+    (void)count;
+    const scale_job_t *job = arg;
+    scaler_t *s = job->s;
+    uint8_t  *rows = s->scratch + s->scratch_size * (size_t)index;
+    uint16_t *sum  = (uint16_t *)(rows + (size_t)s->dst_w * 2 * 4);
+
+    int end = (index + 1) * job->band_rows;
+    if (end > s->dst_h)
+        end = s->dst_h;
+
+    for (int j = index * job->band_rows; j < end; j += 2) {
+        int c0 = job->partial ? s->span_x0[j / 2] : 0;
+        int c1 = job->partial ? s->span_x1[j / 2] : s->dst_w;
+        if (c1 <= c0)
+            continue;
+
+        int n = j + 1 < s->dst_h ? 2 : 1;
+        size_t stride = (size_t)s->dst_w * 4;
+        for (int k = 0; k < n; k++)
+            scale_row(s, job->src, j + k, c0, c1, rows + k * stride, sum);
+
+        /* Feed the scaled pair to the usual region converter */
+        frame_t scaled, out;
+        frame_init(&scaled, PIX_FMT_BGRA, c1 - c0, n, rows);
+        scaled.strides[0] = stride;
+        frame_crop(job->dst, c0, j, c1 - c0, n, &out);
+
+        convert_job_t conv = {
+            .src    = &scaled,
+            .dst    = &out,
+            .width  = c1 - c0,
+            .height = n,
+        };
+        convert_region(&conv, 0, 0, c1 - c0, n);
+    }
+}
+
+static void scale_run(scaler_t *s, const frame_t *src, frame_t *dst, int partial)
+{
+    scale_job_t job = { .s = s, .src = src, .dst = dst, .partial = partial };
+
+    convert_init();
+
+    int bands = s->bands;
+    if (pool && workers_count(pool) < bands)
+        bands = workers_count(pool);
+    if (!pool)
+        bands = 1;
+
+    job.band_rows = (s->dst_h + bands - 1) / bands;
+    job.band_rows = (job.band_rows + 1) & ~1;
+    bands = (s->dst_h + job.band_rows - 1) / job.band_rows;
+
+    if (bands <= 1)
+        scale_band(&job, 0, 1);
+    else
+        workers_run(pool, scale_band, &job, bands);
+}
+
+void frame_scale_convert(scaler_t *s, const frame_t *src, frame_t *dst)
+{
+    dst->timestamp_ns = src->timestamp_ns;
+    scale_run(s, src, dst, 0);
+}
+
+void frame_scale_convert_rects(scaler_t *s, const frame_t *src, frame_t *dst,
+                               const dirty_rect_t *rects, int count)
+{
+    int pairs = (s->dst_h + 1) / 2;
+    for (int k = 0; k < pairs; k++) {
+        s->span_x0[k] = s->dst_w;
+        s->span_x1[k] = 0;
+    }
+
+    /* Output area each source rect feeds, widened to even coordinates and
+     * merged per row pair so no output pixel is converted twice */
+    for (int i = 0; i < count; i++) {
+        const dirty_rect_t *r = &rects[i];
+        if (r->w <= 0 || r->h <= 0)
+            continue;
+        int c0 = s->col_lo[r->x] & ~1;
+        int c1 = (s->col_hi[r->x + r->w - 1] + 1) & ~1;
+        int p0 = s->row_lo[r->y] / 2;
+        int p1 = (s->row_hi[r->y + r->h - 1] + 1) / 2;
+        if (c1 > s->dst_w)
+            c1 = s->dst_w;
+        for (int k = p0; k < p1; k++) {
+            if (s->span_x0[k] > c0) s->span_x0[k] = c0;
+            if (s->span_x1[k] < c1) s->span_x1[k] = c1;
+        }
+    }
+
+    dst->timestamp_ns = src->timestamp_ns;
+    scale_run(s, src, dst, 1);
+}
+
+void scale_fit(int src_w, int src_h, int dst_w, int dst_h, dirty_rect_t *area)
+{
+    long long wide = (long long)src_w * dst_h;
+    long long tall = (long long)src_h * dst_w;
+
+    /* An odd-sized screen in the next even size: a 1-pixel bar, no blur */
+    if (dst_w - src_w >= 0 && dst_w - src_w <= 1 &&
+        dst_h - src_h >= 0 && dst_h - src_h <= 1) {
+        *area = (dirty_rect_t){ 0, 0, src_w, src_h };
+        return;
+    }
+
+    area->w = dst_w;
+    area->h = dst_h;
+    if (wide > tall)
+        area->h = (int)((long long)dst_w * src_h / src_w) & ~1;   /* bars above and below */
+    else if (wide < tall)
+        area->w = (int)((long long)dst_h * src_w / src_h) & ~1;   /* bars left and right */
+    if (area->w < 2) area->w = dst_w < 2 ? dst_w : 2;
+    if (area->h < 2) area->h = dst_h < 2 ? dst_h : 2;
+    area->x = ((dst_w - area->w) / 2) & ~1;
+    area->y = ((dst_h - area->h) / 2) & ~1;
+}
+
+void frame_clear(frame_t *dst)
+{
+    for (int j = 0; j < dst->height; j++) {
+        uint8_t *row = dst->planes[0] + (size_t)j * dst->strides[0];
+        switch (dst->format) {
+        case PIX_FMT_YUYV:
+            for (int i = 0; i < dst->width; i++) {
+                row[2 * i]     = 16;
+                row[2 * i + 1] = 128;
+            }
+            break;
+        case PIX_FMT_BGRA:
+        case PIX_FMT_RGBA:
+            for (int i = 0; i < dst->width; i++) {
+                row[4 * i] = row[4 * i + 1] = row[4 * i + 2] = 0;
+                row[4 * i + 3] = 255;
+            }
+            break;
+        case PIX_FMT_RGB24:
+            memset(row, 0, (size_t)dst->width * 3);
+            break;
+        default:
+            memset(row, 16, (size_t)dst->width);
+            break;
+        }
+    }
+
+    /* Neutral chroma for the planar formats */
+    for (int p = 1; p < pix_fmt_planes(dst->format); p++) {
+        size_t row_bytes;
+        int rows;
+        pix_fmt_plane(dst->format, dst->width, dst->height, p, &row_bytes, &rows);
+        for (int j = 0; j < rows; j++)
+            memset(dst->planes[p] + (size_t)j * dst->strides[p], 128, row_bytes);
+    }
+}
+
+/* Widen one row: every element of src twice (the last once for odd n). */
+static void widen_row(const uint8_t *src, uint8_t *dst, int n, int elem)
+{
+    switch (elem) {
+    case 1:
+        for (int x = 0; x < n; x++)
+            dst[x] = src[x / 2];
+        break;
+    case 2:
+        for (int x = 0; x < n; x++)
+            memcpy(dst + 2 * x, src + 2 * (x / 2), 2);
+        break;
+    case 3:
+        for (int x = 0; x < n; x++)
+            memcpy(dst + 3 * x, src + 3 * (x / 2), 3);
+        break;
+    default:
+        for (int x = 0; x < n; x++)
+            memcpy(dst + 4 * x, src + 4 * (x / 2), 4);
+        break;
+    }
+}
+
+/* YUYV: each source pixel becomes a pair, with its macro-pixel's chroma. */
+static void widen_row_yuyv(const uint8_t *src, int src_w, uint8_t *dst, int dst_w)
+{
+    for (int x = 0; x < dst_w; x += 2) {
+        int m = x / 2;
+        const uint8_t *mp = src + (size_t)(m / 2) * 4;
+        uint8_t y = mp[(m & 1) * 2];
+        dst[2 * x]     = y;
+        dst[2 * x + 1] = mp[1];
+        if (x + 1 < dst_w) {
+            dst[2 * x + 2] = y;
+            dst[2 * x + 3] = (m | 1) < src_w ? mp[3] : 128;
+        }
+    }
+}
+
+void frame_upscale2x(const frame_t *src, frame_t *dst)
+{
+    for (int p = 0; p < pix_fmt_planes(dst->format); p++) {
+        size_t row_bytes;
+        int rows, elem;
+        pix_fmt_plane(dst->format, dst->width, dst->height, p, &row_bytes, &rows);
+        switch (dst->format) {
+        case PIX_FMT_NV12:  elem = p ? 2 : 1; break;
+        case PIX_FMT_YUYV:  elem = 2; break;
+        case PIX_FMT_RGB24: elem = 3; break;
+        case PIX_FMT_BGRA:
+        case PIX_FMT_RGBA:  elem = 4; break;
+        default:            elem = 1; break;
+        }
+
+        for (int j = 0; j < rows; j++) {
+            uint8_t *out = dst->planes[p] + (size_t)j * dst->strides[p];
+            if (j & 1) {
+                memcpy(out, out - dst->strides[p], row_bytes);
+                continue;
+            }
+            const uint8_t *in = src->planes[p] + (size_t)(j / 2) * src->strides[p];
+            if (dst->format == PIX_FMT_YUYV)
+                widen_row_yuyv(in, src->width, out, dst->width);
+            else
+                widen_row(in, out, (int)(row_bytes / (size_t)elem), elem);
+        }
+    }
+    dst->timestamp_ns = src->timestamp_ns;
+}
+
+static inline uint8_t blend_u8(int over, int under, int alpha)
+{
+    return (uint8_t)((over * alpha + under * (255 - alpha) + 127) / 255);
+}
+
+void frame_blend_cursor(frame_t *dst, const dirty_rect_t *box,
+                        const uint8_t *image, int image_w, int image_h)
+{
+    if (box->w <= 0 || box->h <= 0)
+        return;
+    int x0 = box->x < 0 ? 0 : box->x;
+    int y0 = box->y < 0 ? 0 : box->y;
+    int x1 = box->x + box->w < dst->width  ? box->x + box->w : dst->width;
+    int y1 = box->y + box->h < dst->height ? box->y + box->h : dst->height;
+    int half_rows = dst->format == PIX_FMT_YUV420P || dst->format == PIX_FMT_NV12;
+
+    for (int y = y0; y < y1; y++) {
+        const uint8_t *irow = image + (size_t)((y - box->y) * image_h / box->h) * image_w * 4;
+        uint8_t *row = dst->planes[0] + (size_t)y * dst->strides[0];
+        for (int x = x0; x < x1; x++) {
+            const uint8_t *s = irow + (size_t)((x - box->x) * image_w / box->w) * 4;
+            int b = s[0], g = s[1], r = s[2], a = s[3];
+            if (a == 0)
+                continue;
+
+            /* Chroma from the top-left pixel of each block, as the kernels */
+            int cx = !(x & 1) && !(half_rows && (y & 1));
+            uint8_t *c;
+            switch (dst->format) {
+            case PIX_FMT_YUV420P:
+                row[x] = blend_u8(bt601_y(r, g, b), row[x], a);
+                if (cx) {
+                    c = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x / 2;
+                    *c = blend_u8(bt601_u(r, g, b), *c, a);
+                    c = dst->planes[2] + (size_t)(y / 2) * dst->strides[2] + x / 2;
+                    *c = blend_u8(bt601_v(r, g, b), *c, a);
+                }
+                break;
+            case PIX_FMT_NV12:
+                row[x] = blend_u8(bt601_y(r, g, b), row[x], a);
+                if (cx) {
+                    c = dst->planes[1] + (size_t)(y / 2) * dst->strides[1] + x;
+                    c[0] = blend_u8(bt601_u(r, g, b), c[0], a);
+                    c[1] = blend_u8(bt601_v(r, g, b), c[1], a);
+                }
+                break;
+            case PIX_FMT_YUYV:
+                c = row + (size_t)x * 2;
+                c[0] = blend_u8(bt601_y(r, g, b), c[0], a);
+                if (cx && x + 1 < dst->width) {   /* the unpaired last pixel stays 128 */
+                    c[1] = blend_u8(bt601_u(r, g, b), c[1], a);
+                    c[3] = blend_u8(bt601_v(r, g, b), c[3], a);
+                }
+                break;
+            case PIX_FMT_RGB24:
+                c = row + (size_t)x * 3;
+                c[0] = blend_u8(r, c[0], a);
+                c[1] = blend_u8(g, c[1], a);
+                c[2] = blend_u8(b, c[2], a);
+                break;
+            case PIX_FMT_RGBA:
+                c = row + (size_t)x * 4;
+                c[0] = blend_u8(r, c[0], a);
+                c[1] = blend_u8(g, c[1], a);
+                c[2] = blend_u8(b, c[2], a);
+                break;
+            default:
+                c = row + (size_t)x * 4;
+                c[0] = blend_u8(b, c[0], a);
+                c[1] = blend_u8(g, c[1], a);
+                c[2] = blend_u8(r, c[2], a);
+                break;
             }
         }
     }
@@ -3,12 +3,111 @@
 
 #include <stdint.h>
 
+#include "dirty.h"
+#include "pixfmt.h"
+
+/*
+ * Pick the fastest conversion kernel for this CPU (AVX2, SSE4.1, NEON or
+ * scalar).  Called automatically on first use; call it once at startup to
+ * keep the detection out of the frame loop.
+ */
+void convert_init(void);
+
+/* Name of the kernel selected by convert_init(), e.g. "avx2". */
+const char *convert_kernel_name(void);
+
 /*
- * Convert BGRA frame to YUV420P (I420).
- * src:  input  BGRA buffer (width * height * 4 bytes)
- * dst:  output YUV420P buffer (width * height * 3/2 bytes)
- * Caller must allocate dst.
+ * Use the kernel called `name` ("avx2", "sse4.1", "neon" or "scalar")
+ * instead of the detected one, e.g. to compare them.  Returns -1 if this
+ * build or CPU has no such kernel.
  */
+int convert_use_kernel(const char *name);
+
+/*
+ * Convert frames on `threads` threads (the caller plus a persistent pool).
+ * threads <= 1 converts on the calling thread only.  Workers are created
+ * here, once, and reused for every frame.  Returns 0 on success.
+ */
+int convert_set_threads(int threads);
+
+/* Stop the worker pool started by convert_set_threads(). */
+void convert_shutdown(void);
+
+/*
+ * Convert a BGRA frame into dst, which has the same size and is laid out
+ * as dst->format (see pixfmt.h); both may have padded rows.  A src that
+ * is already in dst's format (converted by the capture backend) is just
+ * copied.  The timestamp is carried over.
+ */
+void frame_convert(const frame_t *src, frame_t *dst);
+
+/*
+ * Incremental variant: re-convert only the given regions of src into an
+ * existing frame dst; everything else in dst is left untouched.  Each
+ * rect must start on even x/y (dirty_map_since() guarantees this).  A
+ * src already in dst's format is copied whole.
+ */
+void frame_convert_rects(const frame_t *src, frame_t *dst,
+                         const dirty_rect_t *rects, int count);
+
+/*
+ * Scaling conversion: a src_w x src_h BGRA frame into a dst_w x dst_h
+ * frame of any output format, in one pass.  Box filter (area average)
+ * when shrinking, nearest pixel when enlarging; each source pixel is
+ * read once and the scaled pixels go straight into the kernel.  Create
+ * the scaler after convert_set_threads(); one frame at a time per scaler.
+ */
+typedef struct scaler scaler_t;
+
+scaler_t *scaler_create(int src_w, int src_h, int dst_w, int dst_h);
+void      scaler_free(scaler_t *s);
+
+void frame_scale_convert(scaler_t *s, const frame_t *src, frame_t *dst);
+
+/*
+ * Incremental variant: rects are in source coordinates; only the output
+ * pixels they feed are redone, the rest of dst is left untouched.
+ */
+void frame_scale_convert_rects(scaler_t *s, const frame_t *src, frame_t *dst,
+                               const dirty_rect_t *rects, int count);
+
+/*
+ * Where a src_w x src_h picture goes inside dst_w x dst_h with its aspect
+ * ratio kept: centred, bars on two sides, even coordinates.  A picture at
+ * most one pixel smaller either way (an odd size in the next even one)
+ * stays unscaled in the top-left corner.
+ */
+void scale_fit(int src_w, int src_h, int dst_w, int dst_h, dirty_rect_t *area);
+
+/* Paint dst black (the bars around a letterboxed picture). */
+void frame_clear(frame_t *dst);
+
+/*
+ * Enlarge src 2x into dst (same format; src is dst's size halved, rounded
+ * up) by repeating pixels.  Cheap enough to run on every changed frame,
+ * for a picture converted at half resolution to save CPU.
+ */
+void frame_upscale2x(const frame_t *src, frame_t *dst);
+
+/*
+ * Draw a cursor image (image_w x image_h BGRA, straight alpha, packed
+ * rows) over dst, stretched to box (dst coordinates; what falls outside
+ * dst is clipped).  Nearest pixel; chroma of subsampled formats is
+ * blended from each block's top-left pixel, as the converters take it.
+ */
+void frame_blend_cursor(frame_t *dst, const dirty_rect_t *box,
+                        const uint8_t *image, int image_w, int image_h);
+
+/*
+ * frame_convert() for tightly packed buffers: a BGRA frame (width *
+ * height * 4 bytes) into dst laid out as fmt (pix_fmt_frame_size() bytes).
+ */
+void bgra_convert(pix_fmt_t fmt, const uint8_t *src, uint8_t *dst,
+                  int width, int height);
+
+/* Shorthands for bgra_convert() with a fixed format. */
 void bgra_to_yuv420p(const uint8_t *src, uint8_t *dst, int width, int height);
+void bgra_to_nv12(const uint8_t *src, uint8_t *dst, int width, int height);
+void bgra_to_yuyv(const uint8_t *src, uint8_t *dst, int width, int height);
 
 #endif /* CONVERT_H */
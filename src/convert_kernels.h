@@ -0,0 +1,138 @@
+/*
+ * Internal interface between convert.c and its per-ISA kernels.
+ *
+ * Every kernel converts a block of rows starting on an even source row.
+ * Planes are addressed through explicit strides so the same kernel can
+ * fill a whole frame or any horizontal slice of one.  c_vsub is the
+ * vertical chroma subsampling: 2 writes a chroma row per row pair
+ * (4:2:0), 1 writes one for every row (4:2:2).
+ *
+ * Not part of the public API — include convert.h instead.
+ */
+
+#ifndef CONVERT_KERNELS_H
+#define CONVERT_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*yuv420p_kernel_fn)(const uint8_t *src, size_t src_stride,
+                                  uint8_t *y, size_t y_stride,
+                                  uint8_t *u, uint8_t *v, size_t c_stride,
+                                  int c_vsub, int width, int height);
+
+void yuv420p_kernel_scalar(const uint8_t *src, size_t src_stride,
+                           uint8_t *y, size_t y_stride,
+                           uint8_t *u, uint8_t *v, size_t c_stride,
+                           int c_vsub, int width, int height);
+
+/*
+ * Column sums for the scaler: sum[k] = src[k] + src[stride + k] + ... over
+ * `rows` rows, for k in [0, n).  rows <= 257, so no sum overflows.
+ */
+typedef void (*colsum_kernel_fn)(const uint8_t *src, size_t stride, int rows,
+                                 uint16_t *sum, size_t n);
+
+void colsum_kernel_scalar(const uint8_t *src, size_t stride, int rows,
+                          uint16_t *sum, size_t n);
+
+/*
+ * Finish scaled BGRA pixels [c0, c1) of one row: pixel i adds up the
+ * column sums of source pixels [x0[i], x1[i]) (sum starts at x0[c0]) and
+ * divides by the box area, out = (total * recip[w * rows] + 32768) >> 16.
+ */
+typedef void (*boxrow_kernel_fn)(const uint16_t *sum, const int *x0, const int *x1,
+                                 int c0, int c1, int rows, const uint32_t *recip,
+                                 uint8_t *out);
+
+void boxrow_kernel_scalar(const uint16_t *sum, const int *x0, const int *x1,
+                          int c0, int c1, int rows, const uint32_t *recip,
+                          uint8_t *out);
+
+#if defined(__x86_64__) || defined(__i386__)
+void yuv420p_kernel_sse41(const uint8_t *src, size_t src_stride,
+                          uint8_t *y, size_t y_stride,
+                          uint8_t *u, uint8_t *v, size_t c_stride,
+                          int c_vsub, int width, int height);
+void yuv420p_kernel_avx2(const uint8_t *src, size_t src_stride,
+                         uint8_t *y, size_t y_stride,
+                         uint8_t *u, uint8_t *v, size_t c_stride,
+                         int c_vsub, int width, int height);
+void colsum_kernel_sse41(const uint8_t *src, size_t stride, int rows,
+                         uint16_t *sum, size_t n);
+void colsum_kernel_avx2(const uint8_t *src, size_t stride, int rows,
+                        uint16_t *sum, size_t n);
+void boxrow_kernel_sse41(const uint16_t *sum, const int *x0, const int *x1,
+                         int c0, int c1, int rows, const uint32_t *recip,
+                         uint8_t *out);
+#endif
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+void yuv420p_kernel_neon(const uint8_t *src, size_t src_stride,
+                         uint8_t *y, size_t y_stride,
+                         uint8_t *u, uint8_t *v, size_t c_stride,
+                         int c_vsub, int width, int height);
+void colsum_kernel_neon(const uint8_t *src, size_t stride, int rows,
+                        uint16_t *sum, size_t n);
+void boxrow_kernel_neon(const uint16_t *sum, const int *x0, const int *x1,
+                        int c0, int c1, int rows, const uint32_t *recip,
+                        uint8_t *out);
+#endif
+
+/* ── BT.601 reference math (shared by all kernels for row tails) ── */
+
+static inline uint8_t clamp_u8(int v)
+{
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static inline uint8_t bt601_y(int r, int g, int b)
+{
+    return clamp_u8(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+}
+
+static inline uint8_t bt601_u(int r, int g, int b)
+{
+    return clamp_u8(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+}
+
+static inline uint8_t bt601_v(int r, int g, int b)
+{
+    return clamp_u8(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+}
+
+/*
+ * Convert pixels [x0, width) of one BGRA row; x0 is even.  u/v are NULL
+ * on odd rows.  Chroma is taken from the top-left pixel of each 2x2
+ * block, including the blocks an odd width or height cuts short.
+ */
+static inline void yuv420p_row_tail(const uint8_t *src, uint8_t *y,
+                                    uint8_t *u, uint8_t *v,
+                                    int x0, int width)
+{
+    for (int i = x0; i < width; i++) {
+        const uint8_t *px = src + (size_t)i * 4;
+        y[i] = bt601_y(px[2], px[1], px[0]);
+    }
+    if (u) {
+        for (int i = x0; i < width; i += 2) {
+            const uint8_t *px = src + (size_t)i * 4;
+            u[i / 2] = bt601_u(px[2], px[1], px[0]);
+            v[i / 2] = bt601_v(px[2], px[1], px[0]);
+        }
+    }
+}
+
+/* Sums [k0, n) for the kernels' tails. */
+static inline void colsum_tail(const uint8_t *src, size_t stride, int rows,
+                               uint16_t *sum, size_t k0, size_t n)
+{
+    for (size_t k = k0; k < n; k++) {
+        unsigned acc = 0;
+        for (int r = 0; r < rows; r++)
+            acc += src[(size_t)r * stride + k];
+        sum[k] = (uint16_t)acc;
+    }
+}
+
+#endif /* CONVERT_KERNELS_H */
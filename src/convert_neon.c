@@ -0,0 +1,126 @@
+/*
+ * ARM NEON kernel for BGRA -> YUV420P (Apple Silicon, arm64 Linux)
+ *
+ * vld4q_u8 de-interleaves 16 BGRA pixels into B/G/R/A vectors, so the
+ * BT.601 sums are plain widening multiply-accumulates.  Luma fits in
+ * uint16 (max 56228), chroma in int16 (|x| <= 28688), and the rounding
+ * narrowing shifts compute exactly (x + 128) >> 8 — bit-exact with the
+ * scalar reference in convert.c.
+ */
+
+#if defined(__ARM_NEON) || defined(__aarch64__)
+
+#include "convert_kernels.h"
+
+#include <arm_neon.h>
+
+static inline uint8x8_t luma8(uint8x8_t r, uint8x8_t g, uint8x8_t b)
+{
+    uint16x8_t acc = vmull_u8(r, vdup_n_u8(66));
+    acc = vmlal_u8(acc, g, vdup_n_u8(129));
+    acc = vmlal_u8(acc, b, vdup_n_u8(25));
+    return vadd_u8(vrshrn_n_u16(acc, 8), vdup_n_u8(16));
+}
+
+static inline int16x8_t widen_even(uint8x16_t c)
+{
+    /* Low byte of each 16-bit lane = even-indexed pixel */
+    return vreinterpretq_s16_u16(vmovl_u8(vmovn_u16(vreinterpretq_u16_u8(c))));
+}
+
+static void row_neon(const uint8_t *src, uint8_t *y,
+                     uint8_t *u, uint8_t *v, int width)
+{
+    const int16x8_t c_off = vdupq_n_s16(128);
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        uint8x16x4_t px = vld4q_u8(src + (size_t)i * 4);   /* B, G, R, A */
+
+        uint8x8_t y_lo = luma8(vget_low_u8(px.val[2]),
+                               vget_low_u8(px.val[1]),
+                               vget_low_u8(px.val[0]));
+        uint8x8_t y_hi = luma8(vget_high_u8(px.val[2]),
+                               vget_high_u8(px.val[1]),
+                               vget_high_u8(px.val[0]));
+        vst1q_u8(y + i, vcombine_u8(y_lo, y_hi));
+
+        if (u) {
+            int16x8_t b = widen_even(px.val[0]);
+            int16x8_t g = widen_even(px.val[1]);
+            int16x8_t r = widen_even(px.val[2]);
+
+            int16x8_t cu = vmulq_n_s16(b, 112);
+            cu = vmlsq_n_s16(cu, g, 74);
+            cu = vmlsq_n_s16(cu, r, 38);
+
+            int16x8_t cv = vmulq_n_s16(r, 112);
+            cv = vmlsq_n_s16(cv, g, 94);
+            cv = vmlsq_n_s16(cv, b, 18);
+
+            vst1_u8(u + i / 2, vqmovun_s16(vaddq_s16(vrshrq_n_s16(cu, 8), c_off)));
+            vst1_u8(v + i / 2, vqmovun_s16(vaddq_s16(vrshrq_n_s16(cv, 8), c_off)));
+        }
+    }
+
+    yuv420p_row_tail(src, y, u, v, i, width);
+}
+
+void yuv420p_kernel_neon(const uint8_t *src, size_t src_stride,
+                         uint8_t *y, size_t y_stride,
+                         uint8_t *u, uint8_t *v, size_t c_stride,
+                         int c_vsub, int width, int height)
+{
+    for (int j = 0; j < height; j++) {
+        int chroma = c_vsub == 1 || (j & 1) == 0;
+        size_t ci  = (size_t)(j / c_vsub) * c_stride;
+
+        row_neon(src + (size_t)j * src_stride,
+                 y + (size_t)j * y_stride,
+                 chroma ? u + ci : NULL,
+                 chroma ? v + ci : NULL,
+                 width);
+    }
+}
+
+/* Scaler column sums: 16 bytes widened and accumulated per step */
+void colsum_kernel_neon(const uint8_t *src, size_t stride, int rows,
+                        uint16_t *sum, size_t n)
+{
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        uint16x8_t lo = vdupq_n_u16(0), hi = vdupq_n_u16(0);
+        for (int r = 0; r < rows; r++) {
+            uint8x16_t px = vld1q_u8(src + (size_t)r * stride + k);
+            lo = vaddw_u8(lo, vget_low_u8(px));
+            hi = vaddw_u8(hi, vget_high_u8(px));
+        }
+        vst1q_u16(sum + k, lo);
+        vst1q_u16(sum + k + 8, hi);
+    }
+    colsum_tail(src, stride, rows, sum, k, n);
+}
+
+/* One pixel per step, its four channels in 32-bit lanes */
+void boxrow_kernel_neon(const uint16_t *sum, const int *x0, const int *x1,
+                        int c0, int c1, int rows, const uint32_t *recip,
+                        uint8_t *out)
+{
+    const uint32x4_t rnd = vdupq_n_u32(32768);
+    int base = x0[c0];
+
+    for (int i = c0; i < c1; i++, out += 4) {
+        const uint16_t *p = sum + (size_t)(x0[i] - base) * 4;
+        int w = x1[i] - x0[i];
+        uint32x4_t acc = vdupq_n_u32(0);
+        for (int k = 0; k < w; k++, p += 4)
+            acc = vaddw_u16(acc, vld1_u16(p));
+
+        uint32x4_t v = vaddq_u32(vmulq_n_u32(acc, recip[w * rows]), rnd);
+        uint16x4_t h = vshrn_n_u32(v, 16);
+        uint8x8_t  b = vqmovn_u16(vcombine_u16(h, h));
+        vst1_lane_u32((uint32_t *)(void *)out, vreinterpret_u32_u8(b), 0);
+    }
+}
+
+#endif /* __ARM_NEON || __aarch64__ */
@@ -0,0 +1,255 @@
+/*
+ * x86 SIMD kernels for BGRA -> YUV420P (SSE4.1 and AVX2)
+ *
+ * Each function is compiled for its own ISA via target attributes, so the
+ * file builds with the default -O2 flags and convert.c only calls a kernel
+ * after checking the CPU supports it.
+ *
+ * Bit-exact with the scalar reference: pixels are widened to 16 bits and
+ * the BT.601 dot products are done with pmaddwd into 32-bit lanes, so no
+ * intermediate ever saturates.  Chroma uses the even (top-left) pixel of
+ * each pair, exactly like the scalar path.
+ *
+ * The scaler's column sums widen bytes to 16-bit lanes and accumulate a
+ * whole box of rows in registers before storing.
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+#include "convert_kernels.h"
+
+#include <immintrin.h>
+#include <string.h>
+
+/* ── SSE4.1: 16 pixels per iteration ───────────────────────── */
+
+__attribute__((target("sse4.1")))
+static inline __m128i dot4_sse41(__m128i px, __m128i coef)
+{
+    /* px holds 4 BGRA pixels; returns the 4 per-pixel dot products */
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo   = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), coef);
+    __m128i hi   = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), coef);
+    return _mm_hadd_epi32(lo, hi);
+}
+
+__attribute__((target("sse4.1")))
+static void row_sse41(const uint8_t *src, uint8_t *y,
+                      uint8_t *u, uint8_t *v, int width)
+{
+    const __m128i ky   = _mm_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0);
+    const __m128i ku   = _mm_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0);
+    const __m128i kv   = _mm_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0);
+    const __m128i rnd  = _mm_set1_epi32(128);
+    const __m128i y_off = _mm_set1_epi16(16);
+    const __m128i c_off = _mm_set1_epi16(128);
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        const uint8_t *s = src + (size_t)i * 4;
+        __m128i p0 = _mm_loadu_si128((const __m128i *)(s +  0));
+        __m128i p1 = _mm_loadu_si128((const __m128i *)(s + 16));
+        __m128i p2 = _mm_loadu_si128((const __m128i *)(s + 32));
+        __m128i p3 = _mm_loadu_si128((const __m128i *)(s + 48));
+
+        __m128i y0 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(p0, ky), rnd), 8);
+        __m128i y1 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(p1, ky), rnd), 8);
+        __m128i y2 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(p2, ky), rnd), 8);
+        __m128i y3 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(p3, ky), rnd), 8);
+
+        __m128i ya = _mm_add_epi16(_mm_packs_epi32(y0, y1), y_off);
+        __m128i yb = _mm_add_epi16(_mm_packs_epi32(y2, y3), y_off);
+        _mm_storeu_si128((__m128i *)(y + i), _mm_packus_epi16(ya, yb));
+
+        if (u) {
+            /* Even pixels 0,2,4,...,14 */
+            __m128i e0 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(p0),
+                                                         _mm_castsi128_ps(p1),
+                                                         _MM_SHUFFLE(2, 0, 2, 0)));
+            __m128i e1 = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(p2),
+                                                         _mm_castsi128_ps(p3),
+                                                         _MM_SHUFFLE(2, 0, 2, 0)));
+
+            __m128i u0 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(e0, ku), rnd), 8);
+            __m128i u1 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(e1, ku), rnd), 8);
+            __m128i v0 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(e0, kv), rnd), 8);
+            __m128i v1 = _mm_srai_epi32(_mm_add_epi32(dot4_sse41(e1, kv), rnd), 8);
+
+            __m128i uu = _mm_add_epi16(_mm_packs_epi32(u0, u1), c_off);
+            __m128i vv = _mm_add_epi16(_mm_packs_epi32(v0, v1), c_off);
+            _mm_storel_epi64((__m128i *)(u + i / 2), _mm_packus_epi16(uu, uu));
+            _mm_storel_epi64((__m128i *)(v + i / 2), _mm_packus_epi16(vv, vv));
+        }
+    }
+
+    yuv420p_row_tail(src, y, u, v, i, width);
+}
+
+__attribute__((target("sse4.1")))
+void yuv420p_kernel_sse41(const uint8_t *src, size_t src_stride,
+                          uint8_t *y, size_t y_stride,
+                          uint8_t *u, uint8_t *v, size_t c_stride,
+                          int c_vsub, int width, int height)
+{
+    for (int j = 0; j < height; j++) {
+        int chroma = c_vsub == 1 || (j & 1) == 0;
+        size_t ci  = (size_t)(j / c_vsub) * c_stride;
+
+        row_sse41(src + (size_t)j * src_stride,
+                  y + (size_t)j * y_stride,
+                  chroma ? u + ci : NULL,
+                  chroma ? v + ci : NULL,
+                  width);
+    }
+}
+
+/* ── AVX2: 16 pixels per iteration, two 128-bit lanes ──────── */
+
+__attribute__((target("avx2")))
+static inline __m256i dot8_avx2(__m256i px, __m256i coef)
+{
+    /* px holds 8 BGRA pixels [0-3 | 4-7]; result is in pixel order */
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo   = _mm256_madd_epi16(_mm256_unpacklo_epi8(px, zero), coef);
+    __m256i hi   = _mm256_madd_epi16(_mm256_unpackhi_epi8(px, zero), coef);
+    return _mm256_hadd_epi32(lo, hi);
+}
+
+__attribute__((target("avx2")))
+static inline __m128i pack16_avx2(__m256i a, __m256i b, __m256i off)
+{
+    /* a = values 0-7, b = values 8-15 (int32) -> 16 x uint8 in order */
+    __m256i s = _mm256_packs_epi32(a, b);              /* 0-3 8-11 | 4-7 12-15 */
+    s = _mm256_permute4x64_epi64(s, _MM_SHUFFLE(3, 1, 2, 0));
+    s = _mm256_add_epi16(s, off);
+    return _mm_packus_epi16(_mm256_castsi256_si128(s),
+                            _mm256_extracti128_si256(s, 1));
+}
+
+__attribute__((target("avx2")))
+static void row_avx2(const uint8_t *src, uint8_t *y,
+                     uint8_t *u, uint8_t *v, int width)
+{
+    const __m256i ky    = _mm256_setr_epi16(25, 129, 66, 0, 25, 129, 66, 0,
+                                            25, 129, 66, 0, 25, 129, 66, 0);
+    const __m256i ku    = _mm256_setr_epi16(112, -74, -38, 0, 112, -74, -38, 0,
+                                            112, -74, -38, 0, 112, -74, -38, 0);
+    const __m256i kv    = _mm256_setr_epi16(-18, -94, 112, 0, -18, -94, 112, 0,
+                                            -18, -94, 112, 0, -18, -94, 112, 0);
+    const __m256i rnd   = _mm256_set1_epi32(128);
+    const __m256i y_off = _mm256_set1_epi16(16);
+    const __m256i c_off = _mm256_set1_epi16(128);
+    /* Undo the in-lane interleave of the even-pixel gather below */
+    const __m256i fix   = _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7);
+
+    int i = 0;
+    for (; i + 16 <= width; i += 16) {
+        const uint8_t *s = src + (size_t)i * 4;
+        __m256i p0 = _mm256_loadu_si256((const __m256i *)(s +  0));
+        __m256i p1 = _mm256_loadu_si256((const __m256i *)(s + 32));
+
+        __m256i y0 = _mm256_srai_epi32(_mm256_add_epi32(dot8_avx2(p0, ky), rnd), 8);
+        __m256i y1 = _mm256_srai_epi32(_mm256_add_epi32(dot8_avx2(p1, ky), rnd), 8);
+        _mm_storeu_si128((__m128i *)(y + i), pack16_avx2(y0, y1, y_off));
+
+        if (u) {
+            /* Even pixels: lane 0 = 0,2,8,10  lane 1 = 4,6,12,14 */
+            __m256i e = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(p0),
+                                                              _mm256_castsi256_ps(p1),
+                                                              _MM_SHUFFLE(2, 0, 2, 0)));
+            __m256i uu = _mm256_srai_epi32(_mm256_add_epi32(dot8_avx2(e, ku), rnd), 8);
+            __m256i vv = _mm256_srai_epi32(_mm256_add_epi32(dot8_avx2(e, kv), rnd), 8);
+            uu = _mm256_permutevar8x32_epi32(uu, fix);
+            vv = _mm256_permutevar8x32_epi32(vv, fix);
+
+            __m128i out = pack16_avx2(uu, vv, c_off);   /* 8 U then 8 V */
+            _mm_storel_epi64((__m128i *)(u + i / 2), out);
+            _mm_storel_epi64((__m128i *)(v + i / 2), _mm_unpackhi_epi64(out, out));
+        }
+    }
+
+    yuv420p_row_tail(src, y, u, v, i, width);
+}
+
+__attribute__((target("avx2")))
+void yuv420p_kernel_avx2(const uint8_t *src, size_t src_stride,
+                         uint8_t *y, size_t y_stride,
+                         uint8_t *u, uint8_t *v, size_t c_stride,
+                         int c_vsub, int width, int height)
+{
+    for (int j = 0; j < height; j++) {
+        int chroma = c_vsub == 1 || (j & 1) == 0;
+        size_t ci  = (size_t)(j / c_vsub) * c_stride;
+
+        row_avx2(src + (size_t)j * src_stride,
+                 y + (size_t)j * y_stride,
+                 chroma ? u + ci : NULL,
+                 chroma ? v + ci : NULL,
+                 width);
+    }
+}
+
+/* ── Column sums ────────────────────────────────────────────── */
+
+__attribute__((target("sse4.1")))
+void colsum_kernel_sse41(const uint8_t *src, size_t stride, int rows,
+                         uint16_t *sum, size_t n)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m128i lo = zero, hi = zero;
+        for (int r = 0; r < rows; r++) {
+            __m128i px = _mm_loadu_si128((const __m128i *)(src + (size_t)r * stride + k));
+            lo = _mm_add_epi16(lo, _mm_cvtepu8_epi16(px));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(px, zero));
+        }
+        _mm_storeu_si128((__m128i *)(sum + k), lo);
+        _mm_storeu_si128((__m128i *)(sum + k + 8), hi);
+    }
+    colsum_tail(src, stride, rows, sum, k, n);
+}
+
+__attribute__((target("avx2")))
+void colsum_kernel_avx2(const uint8_t *src, size_t stride, int rows,
+                        uint16_t *sum, size_t n)
+{
+    size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i lo = _mm256_setzero_si256(), hi = _mm256_setzero_si256();
+        for (int r = 0; r < rows; r++) {
+            const uint8_t *s = src + (size_t)r * stride + k;
+            lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)s)));
+            hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(s + 16))));
+        }
+        _mm256_storeu_si256((__m256i *)(sum + k), lo);
+        _mm256_storeu_si256((__m256i *)(sum + k + 16), hi);
+    }
+    colsum_tail(src, stride, rows, sum, k, n);
+}
+
+/* One pixel per step, its four channels in 32-bit lanes (AVX2 uses it too) */
+__attribute__((target("sse4.1")))
+void boxrow_kernel_sse41(const uint16_t *sum, const int *x0, const int *x1,
+                         int c0, int c1, int rows, const uint32_t *recip,
+                         uint8_t *out)
+{
+    const __m128i rnd = _mm_set1_epi32(32768);
+    int base = x0[c0];
+
+    for (int i = c0; i < c1; i++, out += 4) {
+        const uint16_t *p = sum + (size_t)(x0[i] - base) * 4;
+        int w = x1[i] - x0[i];
+        __m128i acc = _mm_setzero_si128();
+        for (int k = 0; k < w; k++, p += 4)
+            acc = _mm_add_epi32(acc, _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *)p)));
+
+        __m128i m = _mm_set1_epi32((int)recip[w * rows]);
+        __m128i v = _mm_srli_epi32(_mm_add_epi32(_mm_mullo_epi32(acc, m), rnd), 16);
+        v = _mm_packus_epi16(_mm_packus_epi32(v, v), v);
+        int px = _mm_cvtsi128_si32(v);
+        memcpy(out, &px, 4);
+    }
+}
+
+#endif /* __x86_64__ || __i386__ */
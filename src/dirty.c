@@ -0,0 +1,84 @@
+#include "dirty.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+int dirty_map_init(dirty_map_t *m, int width, int height)
+{
+    m->width  = width;
+    m->height = height;
+    m->cols   = (width  + DIRTY_TILE - 1) / DIRTY_TILE;
+    m->rows   = (height + DIRTY_TILE - 1) / DIRTY_TILE;
+    m->stamp  = calloc((size_t)m->cols * m->rows, sizeof(*m->stamp));
+    return m->stamp ? 0 : -1;
+}
+
+void dirty_map_free(dirty_map_t *m)
+{
+    free(m->stamp);
+    m->stamp = NULL;
+}
+
+void dirty_map_mark(dirty_map_t *m, const dirty_rect_t *r, uint32_t seq)
+{
+    int x0 = r->x < 0 ? 0 : r->x;
+    int y0 = r->y < 0 ? 0 : r->y;
+    int x1 = r->x + r->w > m->width  ? m->width  : r->x + r->w;
+    int y1 = r->y + r->h > m->height ? m->height : r->y + r->h;
+    if (x1 <= x0 || y1 <= y0)
+        return;
+
+    int c0 = x0 / DIRTY_TILE, c1 = (x1 - 1) / DIRTY_TILE;
+    int r0 = y0 / DIRTY_TILE, r1 = (y1 - 1) / DIRTY_TILE;
+    for (int row = r0; row <= r1; row++) {
+        uint32_t *t = m->stamp + (size_t)row * m->cols;
+        for (int col = c0; col <= c1; col++)
+            t[col] = seq;
+    }
+}
+
+void dirty_map_mark_all(dirty_map_t *m, uint32_t seq)
+{
+    size_t n = (size_t)m->cols * m->rows;
+    for (size_t i = 0; i < n; i++)
+        m->stamp[i] = seq;
+}
+
+void dirty_map_copy(dirty_map_t *dst, const dirty_map_t *src)
+{
+    memcpy(dst->stamp, src->stamp, (size_t)src->cols * src->rows * sizeof(*src->stamp));
+}
+
+int dirty_map_max_rects(const dirty_map_t *m)
+{
+    /* Worst case: every other tile in every row */
+    return m->rows * ((m->cols + 1) / 2);
+}
+
+int dirty_map_since(const dirty_map_t *m, uint32_t seq, dirty_rect_t *out)
+{
+    int n = 0;
+
+    for (int row = 0; row < m->rows; row++) {
+        const uint32_t *t = m->stamp + (size_t)row * m->cols;
+        int col = 0;
+        while (col < m->cols) {
+            if (t[col] <= seq) {
+                col++;
+                continue;
+            }
+            int start = col;
+            while (col < m->cols && t[col] > seq)
+                col++;
+
+            dirty_rect_t *r = &out[n++];
+            r->x = start * DIRTY_TILE;
+            r->y = row * DIRTY_TILE;
+            r->w = col * DIRTY_TILE - r->x;
+            r->h = DIRTY_TILE;
+            if (r->x + r->w > m->width)  r->w = m->width  - r->x;
+            if (r->y + r->h > m->height) r->h = m->height - r->y;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,50 @@
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <stdint.h>
+
+/*
+ * Dirty-region bookkeeping for incremental capture and conversion.
+ *
+ * Backends report changed areas as rectangles.  The pipeline folds them
+ * into a coarse tile map that records, per tile, the sequence number of
+ * the last frame that touched it.  Any buffer that remembers which frame
+ * it was last brought up to date with can then ask for exactly the tiles
+ * changed since — no matter how many frames were skipped or dropped in
+ * between.  Tiles are aligned to the 2x2 chroma grid.
+ */
+
+#define DIRTY_TILE 32   /* tile edge in pixels (even) */
+
+typedef struct {
+    int x, y, w, h;
+} dirty_rect_t;
+
+typedef struct {
+    int       width, height;  /* frame size in pixels */
+    int       cols, rows;     /* tile grid */
+    uint32_t *stamp;          /* cols * rows, frame seq of last change */
+} dirty_map_t;
+
+/* Returns 0 on success, -1 on allocation failure.  All stamps start at 0. */
+int  dirty_map_init(dirty_map_t *m, int width, int height);
+void dirty_map_free(dirty_map_t *m);
+
+/* Stamp every tile touched by r (clipped to the frame) with seq. */
+void dirty_map_mark(dirty_map_t *m, const dirty_rect_t *r, uint32_t seq);
+void dirty_map_mark_all(dirty_map_t *m, uint32_t seq);
+
+/* dst = src (same dimensions). */
+void dirty_map_copy(dirty_map_t *dst, const dirty_map_t *src);
+
+/* Upper bound on the rect count dirty_map_since() can return. */
+int  dirty_map_max_rects(const dirty_map_t *m);
+
+/*
+ * Collect the tiles changed after frame `seq` as runs of tiles per tile
+ * row, clipped to the frame.  out must hold dirty_map_max_rects() entries.
+ * Returns the count (0 = nothing changed).
+ */
+int  dirty_map_since(const dirty_map_t *m, uint32_t seq, dirty_rect_t *out);
+
+#endif /* DIRTY_H */
@@ -0,0 +1,93 @@
+/*
+ * Encoder front end
+ *
+ * Picks the platform's hardware encoder (encode_mac.m, encode_win.c,
+ * encode_v4l2.c) and, for MJPEG, falls back to the software one
+ * (encode_jpeg.c).  Unchanged MJPEG frames re-send the last image instead
+ * of encoding it again; H.264 encodes them, since an encoder turns a
+ * repeated picture into a few bytes of skipped macroblocks anyway.
+ */
+
+#include "encode_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct encoder {
+    const encode_backend_t *backend;
+    void                   *impl;
+    codec_t                 codec;
+    pix_fmt_t               format;
+    packet_t                last;    /* MJPEG: the image to repeat */
+};
+
+static const encode_backend_t *const backends[] = {
+#ifdef __APPLE__
+    &encode_videotoolbox,
+#elif defined(_WIN32)
+    &encode_mediafoundation,
+#else
+    &encode_v4l2m2m,
+#endif
+    &encode_jpeg,
+};
+#define NBACKENDS ((int)(sizeof(backends) / sizeof(backends[0])))
+
+encoder_t *encoder_open(codec_t codec, int width, int height, int fps)
+{
+    if (codec == CODEC_RAW)
+        return NULL;
+
+    encoder_t *enc = calloc(1, sizeof(*enc));
+    if (!enc)
+        return NULL;
+    enc->codec = codec;
+
+    for (int i = 0; i < NBACKENDS && !enc->impl; i++) {
+        enc->backend = backends[i];
+        enc->impl    = backends[i]->open(codec, width, height, fps, &enc->format);
+    }
+    if (!enc->impl) {
+        fprintf(stderr, "encode: no %s encoder available\n", codec_name(codec));
+        free(enc);
+        return NULL;
+    }
+
+    fprintf(stderr, "encode: %s %dx%d from %s via %s\n", codec_name(codec),
+            width, height, pix_fmt_name(enc->format), enc->backend->name);
+    return enc;
+}
+
+pix_fmt_t encoder_format(const encoder_t *enc)
+{
+    return enc->format;
+}
+
+const char *encoder_name(const encoder_t *enc)
+{
+    return enc->backend->name;
+}
+
+int encoder_encode(encoder_t *enc, const frame_t *frame, int repeat, packet_t *pkt)
+{
+    if (repeat && enc->codec == CODEC_MJPEG && enc->last.size) {
+        *pkt = enc->last;
+        pkt->timestamp_ns = frame->timestamp_ns;
+        return 0;
+    }
+
+    if (enc->backend->encode(enc->impl, frame, pkt) < 0)
+        return -1;
+    pkt->timestamp_ns = frame->timestamp_ns;
+    if (enc->codec == CODEC_MJPEG && pkt->size)
+        enc->last = *pkt;
+    return 0;
+}
+
+void encoder_close(encoder_t *enc)
+{
+    if (!enc)
+        return;
+    enc->backend->close(enc->impl);
+    free(enc);
+}
@@ -0,0 +1,85 @@
+#ifndef ENCODE_H
+#define ENCODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pixfmt.h"
+
+/*
+ * Compressed output (--codec).  The pipeline converts to the layout the
+ * encoder asks for (encoder_format()) and the output stage encodes each
+ * frame before vcam_write_packet(), so pipes and network consumers get
+ * H.264 or MJPEG instead of raw YUV.
+ *
+ * H.264 comes out as Annex-B access units (start codes, SPS/PPS in front
+ * of every keyframe), no B-frames, one packet per frame.  MJPEG is one
+ * baseline JFIF image per frame.
+ */
+
+typedef enum {
+    CODEC_RAW = 0,   /* no encoder: raw frames in vcam_format() */
+    CODEC_H264,
+    CODEC_MJPEG
+} codec_t;
+
+typedef struct {
+    const uint8_t *data;       /* owned by the encoder, valid until the next call */
+    size_t         size;
+    uint64_t       timestamp_ns;
+    int            keyframe;
+} packet_t;
+
+typedef struct encoder encoder_t;
+
+/*
+ * Open an encoder for width x height frames at fps, in hardware when the
+ * platform has one (VideoToolbox, Media Foundation, V4L2 M2M); MJPEG falls
+ * back to a built-in software encoder.  Returns NULL on failure.
+ */
+encoder_t *encoder_open(codec_t codec, int width, int height, int fps);
+
+/* Layout the frames given to encoder_encode() must be in (I420 or NV12). */
+pix_fmt_t encoder_format(const encoder_t *enc);
+
+/* What actually encodes, e.g. "videotoolbox" or "jpeg (software)". */
+const char *encoder_name(const encoder_t *enc);
+
+/*
+ * Encode one frame into *pkt.  repeat != 0 says frame is unchanged since
+ * the last call; an MJPEG encoder then hands out the previous image again
+ * without encoding.  Returns 0 on success, -1 on failure; pkt->size is 0
+ * if nothing came out for this frame (dropped, or an encoder that holds
+ * a few frames back before its first packet).
+ */
+int encoder_encode(encoder_t *enc, const frame_t *frame, int repeat, packet_t *pkt);
+
+void encoder_close(encoder_t *enc);
+
+static inline const char *codec_name(codec_t codec)
+{
+    switch (codec) {
+    case CODEC_H264:  return "h264";
+    case CODEC_MJPEG: return "mjpeg";
+    default:          return "raw";
+    }
+}
+
+/* Parse a --codec argument.  Returns 0 on success, -1 if unknown. */
+static inline int codec_parse(const char *name, codec_t *codec)
+{
+    static const codec_t all[] = { CODEC_RAW, CODEC_H264, CODEC_MJPEG };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(name, codec_name(all[i])) == 0) {
+            *codec = all[i];
+            return 0;
+        }
+    }
+    if (strcmp(name, "jpeg") == 0) {
+        *codec = CODEC_MJPEG;
+        return 0;
+    }
+    return -1;
+}
+
+#endif /* ENCODE_H */
@@ -0,0 +1,50 @@
+#ifndef ENCODE_BACKEND_H
+#define ENCODE_BACKEND_H
+
+#include "encode.h"
+
+/*
+ * Encoder implementations behind encode.h.  encode.c tries them in order
+ * for the requested codec; open() returns NULL when a backend cannot do
+ * it (no hardware, codec not offered), and the next one is tried.
+ */
+typedef struct {
+    const char *name;
+    void     *(*open)(codec_t codec, int width, int height, int fps, pix_fmt_t *format);
+    int       (*encode)(void *impl, const frame_t *frame, packet_t *pkt);
+    void      (*close)(void *impl);
+} encode_backend_t;
+
+/* Bits per second for a width x height H.264 stream at fps. */
+static inline int encode_bitrate(int width, int height, int fps)
+{
+    return (int)((int64_t)width * height * fps / 8);
+}
+
+/* Type of the first NAL unit in an Annex-B buffer (7 = SPS), or -1. */
+static inline int h264_first_nal_type(const uint8_t *p, size_t size)
+{
+    for (size_t i = 0; i + 3 < size; i++) {
+        if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1)
+            return p[i + 3] & 0x1f;
+    }
+    return -1;
+}
+
+/*
+ * One table of a DHT segment at p (Tc/Th byte, 16 counts, values), n
+ * bytes left in the segment.  Returns its length if it is the Annex K.3
+ * table for its class and id, which RFC 2435 receivers assume, else -1.
+ */
+int jpeg_standard_huff_table(const uint8_t *p, size_t n);
+
+#ifdef __APPLE__
+extern const encode_backend_t encode_videotoolbox;
+#elif defined(_WIN32)
+extern const encode_backend_t encode_mediafoundation;
+#else
+extern const encode_backend_t encode_v4l2m2m;
+#endif
+extern const encode_backend_t encode_jpeg;   /* software, MJPEG only */
+
+#endif /* ENCODE_BACKEND_H */
@@ -0,0 +1,538 @@
+/*
+ * Software MJPEG encoder (baseline JFIF)
+ *
+ * The fallback when the platform has no hardware JPEG encoder.  Takes
+ * I420 frames straight from the converter: 4:2:0 is JPEG's own 2x2
+ * subsampling, so each 16x16 MCU is four luma blocks plus one block of
+ * each chroma plane read in place, with no resampling.
+ *
+ *   - BT.601 video range (16-235) is stretched to full range on load,
+ *     since JFIF decoders assume full range
+ *   - Float AAN forward DCT (as in IJG jfdctflt), its output scale folded
+ *     into the quantization divisors, written so it vectorizes
+ *   - Annex K quantization tables at a fixed quality, Annex K Huffman
+ *     tables, so no second pass over the coefficients is needed
+ *
+ * Partial MCUs at the right and bottom edge repeat the last column/row.
+ */
+
+#include "encode_backend.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JPEG_QUALITY 85
+
+/* Zigzag position -> natural (row-major) index */
+static const uint8_t zigzag[64] = {
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+/* Annex K.1 quantization tables, natural order */
+static const uint8_t luma_quant[64] = {
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+};
+
+static const uint8_t chroma_quant[64] = {
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+/* Annex K.3 Huffman tables: code counts per length 1-16, then symbols */
+static const uint8_t dc_luma_bits[16]   = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const uint8_t dc_chroma_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const uint8_t dc_values[12] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const uint8_t ac_luma_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const uint8_t ac_luma_values[162] = {
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06,
+    0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08,
+    0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62, 0x72,
+    0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45,
+    0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59,
+    0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74, 0x75,
+    0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3,
+    0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6,
+    0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9,
+    0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+
+static const uint8_t ac_chroma_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const uint8_t ac_chroma_values[162] = {
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41,
+    0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91,
+    0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72, 0xd1,
+    0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
+    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
+    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
+    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a,
+    0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4,
+    0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7,
+    0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4,
+    0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa
+};
+
+typedef struct {
+    uint16_t code[256];
+    uint8_t  size[256];
+} huff_t;
+
+/* Per component class: 0 = luma, 1 = chroma */
+typedef struct {
+    uint8_t quant[64];      /* zigzag order, as written to DQT */
+    float   divisor[64];    /* natural order: 1 / (q * DCT scale) */
+    huff_t  dc, ac;
+} table_t;
+
+typedef struct {
+    int      width;
+    int      height;
+    table_t  tables[2];
+    float    level[2][256]; /* sample -> full range, minus 128 */
+
+    uint8_t *out;           /* header + entropy-coded data */
+    size_t   cap;
+    size_t   len;
+    size_t   header_len;
+    uint32_t bits;          /* pending bits, MSB first */
+    int      nbits;
+} jpeg_enc_t;
+
+/* ── Tables ────────────────────────────────────────────────── */
+
+static void build_huff(huff_t *h, const uint8_t bits[16], const uint8_t *values)
+{
+    unsigned code = 0;
+    int k = 0;
+    for (int len = 1; len <= 16; len++) {
+        for (int i = 0; i < bits[len - 1]; i++, k++) {
+            h->code[values[k]] = (uint16_t)code++;
+            h->size[values[k]] = (uint8_t)len;
+        }
+        code <<= 1;
+    }
+}
+
+static void build_table(table_t *t, const uint8_t base[64], int quality)
+{
+    /* IJG quality scaling; AAN row/column scale factors */
+    static const float aan[8] = {
+        1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+        1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+    };
+    int scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+
+    for (int i = 0; i < 64; i++) {
+        int q = (base[zigzag[i]] * scale + 50) / 100;
+        q = q < 1 ? 1 : q > 255 ? 255 : q;
+        t->quant[i] = (uint8_t)q;
+        int n = zigzag[i];
+        t->divisor[n] = 1.0f / ((float)q * aan[n / 8] * aan[n % 8] * 8.0f);
+    }
+}
+
+/* ── Output ────────────────────────────────────────────────── */
+
+static int reserve(jpeg_enc_t *j, size_t more)
+{
+    if (j->len + more <= j->cap)
+        return 0;
+    size_t cap = (j->len + more) * 2;
+    uint8_t *p = realloc(j->out, cap);
+    if (!p)
+        return -1;
+    j->out = p;
+    j->cap = cap;
+    return 0;
+}
+
+static void put_byte(jpeg_enc_t *j, uint8_t b)
+{
+    j->out[j->len++] = b;
+}
+
+static void put_u16(jpeg_enc_t *j, unsigned v)
+{
+    put_byte(j, (uint8_t)(v >> 8));
+    put_byte(j, (uint8_t)v);
+}
+
+/* Entropy-coded bits; a 0xFF byte is stuffed with 0x00 */
+static inline void put_bits(jpeg_enc_t *j, unsigned code, int size)
+{
+    j->bits  |= (uint32_t)code << (32 - size - j->nbits);
+    j->nbits += size;
+    while (j->nbits >= 8) {
+        uint8_t b = (uint8_t)(j->bits >> 24);
+        j->out[j->len++] = b;
+        if (b == 0xFF)
+            j->out[j->len++] = 0;
+        j->bits <<= 8;
+        j->nbits -= 8;
+    }
+}
+
+static void put_huff_table(jpeg_enc_t *j, int class_id, const uint8_t bits[16],
+                           const uint8_t *values)
+{
+    int n = 0;
+    for (int i = 0; i < 16; i++)
+        n += bits[i];
+    put_byte(j, (uint8_t)class_id);
+    for (int i = 0; i < 16; i++)
+        put_byte(j, bits[i]);
+    for (int i = 0; i < n; i++)
+        put_byte(j, values[i]);
+}
+
+int jpeg_standard_huff_table(const uint8_t *p, size_t n)
+{
+    static const uint8_t *const bits[2][2] = {
+        { dc_luma_bits, dc_chroma_bits }, { ac_luma_bits, ac_chroma_bits }
+    };
+    static const uint8_t *const values[2][2] = {
+        { dc_values, dc_values }, { ac_luma_values, ac_chroma_values }
+    };
+    if (n < 17 || (p[0] >> 4) > 1 || (p[0] & 15) > 1)
+        return -1;
+    int tc = p[0] >> 4, th = p[0] & 15;
+    size_t count = 0;
+    for (int i = 0; i < 16; i++)
+        count += p[1 + i];
+    if (17 + count > n || memcmp(p + 1, bits[tc][th], 16) != 0 ||
+        memcmp(p + 17, values[tc][th], count) != 0)
+        return -1;
+    return (int)(17 + count);
+}
+
+/* Everything up to the entropy-coded data; the same for every frame */
+static void write_header(jpeg_enc_t *j)
+{
+    static const uint8_t jfif[] = {
+        0xFF, 0xD8,                                      /* SOI */
+        0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0,   /* APP0 */
+        1, 1, 0, 0, 1, 0, 1, 0, 0
+    };
+    memcpy(j->out, jfif, sizeof(jfif));
+    j->len = sizeof(jfif);
+
+    put_u16(j, 0xFFDB);                     /* DQT */
+    put_u16(j, 2 + 2 * 65);
+    for (int t = 0; t < 2; t++) {
+        put_byte(j, (uint8_t)t);
+        for (int i = 0; i < 64; i++)
+            put_byte(j, j->tables[t].quant[i]);
+    }
+
+    put_u16(j, 0xFFC0);                     /* SOF0: Y 2x2, Cb/Cr 1x1 */
+    put_u16(j, 8 + 3 * 3);
+    put_byte(j, 8);
+    put_u16(j, (unsigned)j->height);
+    put_u16(j, (unsigned)j->width);
+    put_byte(j, 3);
+    static const uint8_t comps[3][3] = { { 1, 0x22, 0 }, { 2, 0x11, 1 }, { 3, 0x11, 1 } };
+    for (int c = 0; c < 3; c++) {
+        for (int i = 0; i < 3; i++)
+            put_byte(j, comps[c][i]);
+    }
+
+    put_u16(j, 0xFFC4);                     /* DHT */
+    put_u16(j, 2 + 4 * 17 + 12 + 12 + 162 + 162);
+    put_huff_table(j, 0x00, dc_luma_bits, dc_values);
+    put_huff_table(j, 0x10, ac_luma_bits, ac_luma_values);
+    put_huff_table(j, 0x01, dc_chroma_bits, dc_values);
+    put_huff_table(j, 0x11, ac_chroma_bits, ac_chroma_values);
+
+    put_u16(j, 0xFFDA);                     /* SOS */
+    put_u16(j, 6 + 2 * 3);
+    put_byte(j, 3);
+    static const uint8_t scan[3][2] = { { 1, 0x00 }, { 2, 0x11 }, { 3, 0x11 } };
+    for (int c = 0; c < 3; c++) {
+        put_byte(j, scan[c][0]);
+        put_byte(j, scan[c][1]);
+    }
+    put_byte(j, 0);
+    put_byte(j, 63);
+    put_byte(j, 0);
+    j->header_len = j->len;
+}
+
+/* ── Blocks ────────────────────────────────────────────────── */
+
+/*
+ * 8x8 samples at (x, y) of a plane, edges repeated, level-shifted.
+ * Stored transposed (blk[col * 8 + row]); see encode_block().
+ */
+static void load_block(const uint8_t *plane, size_t stride, int pw, int ph,
+                       int x, int y, const float *level, float *blk)
+{
+    if (x + 8 <= pw && y + 8 <= ph) {
+        for (int r = 0; r < 8; r++) {
+            const uint8_t *row = plane + (size_t)(y + r) * stride + x;
+            for (int c = 0; c < 8; c++)
+                blk[c * 8 + r] = level[row[c]];
+        }
+        return;
+    }
+    for (int r = 0; r < 8; r++) {
+        int sy = y + r < ph ? y + r : ph - 1;
+        const uint8_t *row = plane + (size_t)sy * stride;
+        for (int c = 0; c < 8; c++)
+            blk[c * 8 + r] = level[row[x + c < pw ? x + c : pw - 1]];
+    }
+}
+
+/*
+ * One pass of the AAN forward DCT down all 8 columns of d at once: the
+ * columns are independent lanes, so the compiler vectorizes the loop.
+ */
+static inline void fdct_columns(float *d)
+{
+    for (int c = 0; c < 8; c++) {
+        float t0 = d[0 * 8 + c] + d[7 * 8 + c], t7 = d[0 * 8 + c] - d[7 * 8 + c];
+        float t1 = d[1 * 8 + c] + d[6 * 8 + c], t6 = d[1 * 8 + c] - d[6 * 8 + c];
+        float t2 = d[2 * 8 + c] + d[5 * 8 + c], t5 = d[2 * 8 + c] - d[5 * 8 + c];
+        float t3 = d[3 * 8 + c] + d[4 * 8 + c], t4 = d[3 * 8 + c] - d[4 * 8 + c];
+
+        float t10 = t0 + t3, t13 = t0 - t3;
+        float t11 = t1 + t2, t12 = t1 - t2;
+        d[0 * 8 + c] = t10 + t11;
+        d[4 * 8 + c] = t10 - t11;
+        float z1 = (t12 + t13) * 0.707106781f;
+        d[2 * 8 + c] = t13 + z1;
+        d[6 * 8 + c] = t13 - z1;
+
+        t10 = t4 + t5;
+        t11 = t5 + t6;
+        t12 = t6 + t7;
+        float z5 = (t10 - t12) * 0.382683433f;
+        float z2 = 0.541196100f * t10 + z5;
+        float z4 = 1.306562965f * t12 + z5;
+        float z3 = t11 * 0.707106781f;
+        float z11 = t7 + z3, z13 = t7 - z3;
+        d[5 * 8 + c] = z13 + z2;
+        d[3 * 8 + c] = z13 - z2;
+        d[1 * 8 + c] = z11 + z4;
+        d[7 * 8 + c] = z11 - z4;
+    }
+}
+
+static inline void transpose8(const float *in, float *out)
+{
+    for (int r = 0; r < 8; r++) {
+        for (int c = 0; c < 8; c++)
+            out[c * 8 + r] = in[r * 8 + c];
+    }
+}
+
+static inline int bit_length(unsigned v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return v ? 32 - __builtin_clz(v) : 0;
+#else
+    int n = 0;
+    while (v) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+#endif
+}
+
+static inline int ctz64(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(v);
+#else
+    int n = 0;
+    while (!(v & 1)) {
+        n++;
+        v >>= 1;
+    }
+    return n;
+#endif
+}
+
+/*
+ * DCT, quantize and Huffman-code one block; returns its DC.  blk comes
+ * transposed from load_block(), so the first column pass transforms the
+ * rows and, after a transpose, the second one the columns, leaving the
+ * coefficients in natural order.
+ */
+static int encode_block(jpeg_enc_t *j, float *blk, const table_t *t, int prev_dc)
+{
+    float tmp[64];
+    fdct_columns(blk);
+    transpose8(blk, tmp);
+    fdct_columns(tmp);
+
+    int q[64];
+    for (int i = 0; i < 64; i++) {
+        float v = tmp[i] * t->divisor[i];
+        q[i] = (int)(v + copysignf(0.5f, v));   /* branch-free rounding */
+    }
+
+    int dc = q[0];
+    int diff = dc - prev_dc;
+    int mag = diff < 0 ? -diff : diff;
+    int cat = bit_length((unsigned)mag);
+    put_bits(j, t->dc.code[cat], t->dc.size[cat]);
+    if (cat)
+        put_bits(j, (unsigned)(diff < 0 ? diff - 1 : diff) & ((1u << cat) - 1), cat);
+
+    /* Non-zero AC coefficients in zigzag order, walked by bit */
+    uint64_t nonzero = 0;
+    for (int k = 1; k < 64; k++)
+        nonzero |= (uint64_t)(q[zigzag[k]] != 0) << k;
+
+    int last = 0;
+    while (nonzero) {
+        int k = ctz64(nonzero);
+        nonzero &= nonzero - 1;
+        int run = k - last - 1;
+        last = k;
+        while (run > 15) {
+            put_bits(j, t->ac.code[0xF0], t->ac.size[0xF0]);
+            run -= 16;
+        }
+        int v = q[zigzag[k]];
+        mag = v < 0 ? -v : v;
+        cat = bit_length((unsigned)mag);
+        int sym = (run << 4) | cat;
+        put_bits(j, t->ac.code[sym], t->ac.size[sym]);
+        put_bits(j, (unsigned)(v < 0 ? v - 1 : v) & ((1u << cat) - 1), cat);
+    }
+    if (last != 63)
+        put_bits(j, t->ac.code[0x00], t->ac.size[0x00]);
+    return dc;
+}
+
+/* ── Backend interface ─────────────────────────────────────── */
+
+static void jpeg_close(void *impl);
+
+static void *jpeg_open(codec_t codec, int width, int height, int fps, pix_fmt_t *format)
+{
+    (void)fps;
+    if (codec != CODEC_MJPEG || width > 65535 || height > 65535)
+        return NULL;
+
+    jpeg_enc_t *j = calloc(1, sizeof(*j));
+    if (!j)
+        return NULL;
+    j->width  = width;
+    j->height = height;
+
+    build_table(&j->tables[0], luma_quant, JPEG_QUALITY);
+    build_table(&j->tables[1], chroma_quant, JPEG_QUALITY);
+    build_huff(&j->tables[0].dc, dc_luma_bits, dc_values);
+    build_huff(&j->tables[0].ac, ac_luma_bits, ac_luma_values);
+    build_huff(&j->tables[1].dc, dc_chroma_bits, dc_values);
+    build_huff(&j->tables[1].ac, ac_chroma_bits, ac_chroma_values);
+
+    /* Video range -> full range: Y 16-235, Cb/Cr 16-240 around 128 */
+    for (int v = 0; v < 256; v++) {
+        float y = ((float)v - 16.0f) * 255.0f / 219.0f;
+        float c = ((float)v - 128.0f) * 255.0f / 224.0f;
+        j->level[0][v] = (y < 0.0f ? 0.0f : y > 255.0f ? 255.0f : y) - 128.0f;
+        j->level[1][v] = c < -128.0f ? -128.0f : c > 127.0f ? 127.0f : c;
+    }
+
+    /* A frame rarely compresses worse than raw 4:2:0 */
+    j->cap = pix_fmt_frame_size(PIX_FMT_YUV420P, width, height) + 1024;
+    j->out = malloc(j->cap);
+    if (!j->out) {
+        jpeg_close(j);
+        return NULL;
+    }
+    write_header(j);
+
+    *format = PIX_FMT_YUV420P;
+    return j;
+}
+
+static int jpeg_encode(void *impl, const frame_t *frame, packet_t *pkt)
+{
+    jpeg_enc_t *j = impl;
+    int cw = (j->width + 1) / 2, ch = (j->height + 1) / 2;
+    int mcus = (j->width + 15) / 16;
+    size_t row_max = (size_t)mcus * 6 * 448;   /* worst case, stuffing included */
+    int dc[3] = { 0, 0, 0 };
+    float blk[64];
+
+    j->len   = j->header_len;
+    j->bits  = 0;
+    j->nbits = 0;
+
+    for (int my = 0; my < j->height; my += 16) {
+        if (reserve(j, row_max) < 0) {
+            fprintf(stderr, "encode: out of memory\n");
+            return -1;
+        }
+        for (int mx = 0; mx < j->width; mx += 16) {
+            for (int b = 0; b < 4; b++) {
+                load_block(frame->planes[0], frame->strides[0], j->width, j->height,
+                           mx + (b & 1) * 8, my + (b >> 1) * 8, j->level[0], blk);
+                dc[0] = encode_block(j, blk, &j->tables[0], dc[0]);
+            }
+            for (int p = 1; p <= 2; p++) {
+                load_block(frame->planes[p], frame->strides[p], cw, ch,
+                           mx / 2, my / 2, j->level[1], blk);
+                dc[p] = encode_block(j, blk, &j->tables[1], dc[p]);
+            }
+        }
+    }
+
+    /* Pad the last byte with 1 bits, then EOI */
+    if (reserve(j, 4) < 0)
+        return -1;
+    if (j->nbits)
+        put_bits(j, (1u << (8 - j->nbits)) - 1, 8 - j->nbits);
+    put_u16(j, 0xFFD9);
+
+    pkt->data     = j->out;
+    pkt->size     = j->len;
+    pkt->keyframe = 1;
+    return 0;
+}
+
+static void jpeg_close(void *impl)
+{
+    jpeg_enc_t *j = impl;
+    if (!j)
+        return;
+    free(j->out);
+    free(j);
+}
+
+const encode_backend_t encode_jpeg = {
+    .name   = "jpeg (software)",
+    .open   = jpeg_open,
+    .encode = jpeg_encode,
+    .close  = jpeg_close,
+};
@@ -0,0 +1,262 @@
+/*
+ * macOS hardware encoder (VideoToolbox)
+ *
+ * A VTCompressionSession in real-time mode with frame reordering off, so
+ * each frame's packet is ready as soon as VTCompressionSessionCompleteFrames()
+ * returns and encoding stays synchronous on the output thread.
+ *
+ *   - Frames are copied into NV12 CVPixelBuffers from the session's
+ *     own pool (IOSurface-backed, what the encoder reads without another
+ *     conversion)
+ *   - H.264 comes out as AVCC (length-prefixed NAL units); the 4-byte
+ *     lengths are rewritten to start codes in place and the SPS/PPS
+ *     from the format description go in front of every keyframe
+ *   - MJPEG uses the same session with kCMVideoCodecType_JPEG
+ *
+ * Frameworks: VideoToolbox, CoreMedia, CoreVideo
+ */
+
+#include "encode_backend.h"
+
+#import <VideoToolbox/VideoToolbox.h>
+#import <CoreMedia/CoreMedia.h>
+#import <CoreVideo/CoreVideo.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    VTCompressionSessionRef session;
+    codec_t   codec;
+    int       width;
+    int       height;
+    int       fps;
+    int64_t   index;       /* frames submitted, the presentation clock */
+
+    /* Filled by the output callback */
+    uint8_t  *packet;
+    size_t    cap;
+    size_t    len;
+    int       keyframe;
+    int       failed;
+} vt_ctx_t;
+
+static int reserve(vt_ctx_t *ctx, size_t size)
+{
+    if (size <= ctx->cap)
+        return 0;
+    uint8_t *p = realloc(ctx->packet, size * 2);
+    if (!p)
+        return -1;
+    ctx->packet = p;
+    ctx->cap    = size * 2;
+    return 0;
+}
+
+static const uint8_t start_code[4] = { 0, 0, 0, 1 };
+
+/* SPS and PPS of fmt as Annex-B at the start of the packet */
+static size_t put_parameter_sets(vt_ctx_t *ctx, CMFormatDescriptionRef fmt)
+{
+    size_t count = 0, len = 0;
+    if (CMVideoFormatDescriptionGetH264ParameterSetAtIndex(fmt, 0, NULL, NULL,
+                                                            &count, NULL) != noErr)
+        return 0;
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t *set;
+        size_t size;
+        if (CMVideoFormatDescriptionGetH264ParameterSetAtIndex(fmt, i, &set, &size,
+                                                                NULL, NULL) != noErr ||
+            reserve(ctx, len + 4 + size) < 0)
+            return 0;
+        memcpy(ctx->packet + len, start_code, 4);
+        memcpy(ctx->packet + len + 4, set, size);
+        len += 4 + size;
+    }
+    return len;
+}
+
+static void on_encoded(void *refcon, void *frame_refcon, OSStatus status,
+                       VTEncodeInfoFlags flags, CMSampleBufferRef sample)
+{
+    vt_ctx_t *ctx = refcon;
+    (void)frame_refcon;
+
+    if (status != noErr || !sample || (flags & kVTEncodeInfo_FrameDropped)) {
+        if (status != noErr)
+            ctx->failed = 1;
+        return;
+    }
+
+    ctx->keyframe = 1;
+    CFArrayRef attachments = CMSampleBufferGetSampleAttachmentsArray(sample, false);
+    if (attachments && CFArrayGetCount(attachments) > 0) {
+        CFDictionaryRef a = CFArrayGetValueAtIndex(attachments, 0);
+        ctx->keyframe = !CFDictionaryContainsKey(a, kCMSampleAttachmentKey_NotSync);
+    }
+
+    size_t len = 0;
+    int nal_len = 4;
+    if (ctx->codec == CODEC_H264) {
+        CMFormatDescriptionRef fmt = CMSampleBufferGetFormatDescription(sample);
+        CMVideoFormatDescriptionGetH264ParameterSetAtIndex(fmt, 0, NULL, NULL, NULL,
+                                                           &nal_len);
+        if (ctx->keyframe)
+            len = put_parameter_sets(ctx, fmt);
+    }
+
+    CMBlockBufferRef block = CMSampleBufferGetDataBuffer(sample);
+    size_t size = CMBlockBufferGetDataLength(block);
+    if (reserve(ctx, len + size) < 0 ||
+        CMBlockBufferCopyDataBytes(block, 0, size, ctx->packet + len) != noErr) {
+        ctx->failed = 1;
+        return;
+    }
+
+    /* AVCC -> Annex-B: each 4-byte big-endian length becomes a start code */
+    if (ctx->codec == CODEC_H264) {
+        if (nal_len != 4) {
+            fprintf(stderr, "encode_vt: unexpected %d-byte NAL lengths\n", nal_len);
+            ctx->failed = 1;
+            return;
+        }
+        uint8_t *p = ctx->packet + len, *end = p + size;
+        while (p + 4 <= end) {
+            uint32_t n = (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 |
+                         (uint32_t)p[2] << 8 | p[3];
+            memcpy(p, start_code, 4);
+            p += 4 + n;
+        }
+    }
+    ctx->len = len + size;
+}
+
+static void set_property(VTCompressionSessionRef s, CFStringRef key, CFTypeRef value)
+{
+    VTSessionSetProperty(s, key, value);   /* optional: encoders differ */
+}
+
+static void set_int_property(VTCompressionSessionRef s, CFStringRef key, int value)
+{
+    CFNumberRef n = CFNumberCreate(NULL, kCFNumberIntType, &value);
+    set_property(s, key, n);
+    CFRelease(n);
+}
+
+static void vt_close(void *impl);
+
+static void *vt_open(codec_t codec, int width, int height, int fps, pix_fmt_t *format)
+{
+    vt_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+    ctx->codec  = codec;
+    ctx->width  = width;
+    ctx->height = height;
+    ctx->fps    = fps;
+
+    NSDictionary *spec = @{
+        (__bridge NSString *)kVTVideoEncoderSpecification_EnableHardwareAcceleratedVideoEncoder: @YES
+    };
+    NSDictionary *source = @{
+        (__bridge NSString *)kCVPixelBufferPixelFormatTypeKey:
+            @(kCVPixelFormatType_420YpCbCr8BiPlanarVideoRange),
+        (__bridge NSString *)kCVPixelBufferWidthKey:  @(width),
+        (__bridge NSString *)kCVPixelBufferHeightKey: @(height),
+        (__bridge NSString *)kCVPixelBufferIOSurfacePropertiesKey: @{},
+    };
+    OSStatus err = VTCompressionSessionCreate(
+        NULL, width, height,
+        codec == CODEC_H264 ? kCMVideoCodecType_H264 : kCMVideoCodecType_JPEG,
+        (__bridge CFDictionaryRef)spec, (__bridge CFDictionaryRef)source, NULL,
+        on_encoded, ctx, &ctx->session);
+    if (err != noErr) {
+        fprintf(stderr, "encode_vt: no %s encoder (%d)\n", codec_name(codec), (int)err);
+        vt_close(ctx);
+        return NULL;
+    }
+
+    VTCompressionSessionRef s = ctx->session;
+    set_property(s, kVTCompressionPropertyKey_RealTime, kCFBooleanTrue);
+    set_property(s, kVTCompressionPropertyKey_AllowFrameReordering, kCFBooleanFalse);
+    set_int_property(s, kVTCompressionPropertyKey_ExpectedFrameRate, fps);
+    if (codec == CODEC_H264) {
+        set_property(s, kVTCompressionPropertyKey_ProfileLevel,
+                     kVTProfileLevel_H264_Main_AutoLevel);
+        set_int_property(s, kVTCompressionPropertyKey_AverageBitRate,
+                         encode_bitrate(width, height, fps));
+        set_int_property(s, kVTCompressionPropertyKey_MaxKeyFrameInterval, fps * 2);
+    } else {
+        float quality = 0.85f;
+        CFNumberRef q = CFNumberCreate(NULL, kCFNumberFloatType, &quality);
+        set_property(s, kVTCompressionPropertyKey_Quality, q);
+        CFRelease(q);
+    }
+    VTCompressionSessionPrepareToEncodeFrames(s);
+
+    *format = PIX_FMT_NV12;
+    return ctx;
+}
+
+static int vt_encode(void *impl, const frame_t *frame, packet_t *pkt)
+{
+    vt_ctx_t *ctx = impl;
+
+    CVPixelBufferRef pb = NULL;
+    CVPixelBufferPoolRef pool = VTCompressionSessionGetPixelBufferPool(ctx->session);
+    if (!pool || CVPixelBufferPoolCreatePixelBuffer(NULL, pool, &pb) != kCVReturnSuccess) {
+        fprintf(stderr, "encode_vt: no pixel buffer\n");
+        return -1;
+    }
+
+    CVPixelBufferLockBaseAddress(pb, 0);
+    frame_t dst;
+    memset(&dst, 0, sizeof(dst));
+    dst.format = PIX_FMT_NV12;
+    dst.width  = ctx->width;
+    dst.height = ctx->height;
+    for (int p = 0; p < 2; p++) {
+        dst.planes[p]  = CVPixelBufferGetBaseAddressOfPlane(pb, p);
+        dst.strides[p] = CVPixelBufferGetBytesPerRowOfPlane(pb, p);
+    }
+    frame_copy(&dst, frame);
+    CVPixelBufferUnlockBaseAddress(pb, 0);
+
+    ctx->len = 0;
+    CMTime pts = CMTimeMake(ctx->index++, ctx->fps);
+    OSStatus err = VTCompressionSessionEncodeFrame(ctx->session, pb, pts, kCMTimeInvalid,
+                                                   NULL, NULL, NULL);
+    CVPixelBufferRelease(pb);
+    if (err == noErr)
+        err = VTCompressionSessionCompleteFrames(ctx->session, pts);
+    if (err != noErr || ctx->failed) {
+        fprintf(stderr, "encode_vt: encoding failed (%d)\n", (int)err);
+        return -1;
+    }
+
+    pkt->data     = ctx->packet;
+    pkt->size     = ctx->len;   /* 0 if the encoder dropped the frame */
+    pkt->keyframe = ctx->keyframe;
+    return 0;
+}
+
+static void vt_close(void *impl)
+{
+    vt_ctx_t *ctx = impl;
+    if (!ctx)
+        return;
+    if (ctx->session) {
+        VTCompressionSessionCompleteFrames(ctx->session, kCMTimeInvalid);
+        VTCompressionSessionInvalidate(ctx->session);
+        CFRelease(ctx->session);
+    }
+    free(ctx->packet);
+    free(ctx);
+}
+
+const encode_backend_t encode_videotoolbox = {
+    .name   = "videotoolbox",
+    .open   = vt_open,
+    .encode = vt_encode,
+    .close  = vt_close,
+};
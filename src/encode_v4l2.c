@@ -0,0 +1,471 @@
+/*
+ * Linux hardware encoder (V4L2 memory-to-memory)
+ *
+ * Uses the stateful encoder interface that SoC codecs expose as a video
+ * device (Raspberry Pi bcm2835-codec, Rockchip/Hantro, Qualcomm Venus,
+ * Amlogic...): raw frames are queued on the OUTPUT queue, compressed
+ * ones come back on the CAPTURE queue.  The first /dev/video* node that
+ * is a multi-planar M2M device producing the codec from NV12 or I420 is
+ * used.
+ *
+ *   - Both queues are MMAP; a frame is copied into an OUTPUT buffer
+ *     (1.5 bytes/pixel) and encoded synchronously: queue it, then wait
+ *     for its CAPTURE buffer, so packets come out in frame order with
+ *     no reordering delay (B-frames off)
+ *   - H.264: SPS/PPS repeated before every IDR where the driver can; if
+ *     it only sends them once, they are kept and put in front of every
+ *     keyframe, so consumers can join mid-stream
+ *   - The packet is copied out of the CAPTURE buffer, which is queued
+ *     again at once
+ */
+
+#include "encode_backend.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/videodev2.h>
+
+#define M2M_MAX_DEVICES 64
+#define M2M_BUFFERS     4
+#define M2M_TIMEOUT_MS  1000
+
+typedef struct {
+    uint8_t *data[VIDEO_MAX_PLANES];
+    size_t   len[VIDEO_MAX_PLANES];
+} m2m_buf_t;
+
+typedef struct {
+    int        fd;
+    codec_t    codec;
+    int        width;
+    int        height;
+    pix_fmt_t  format;
+    int        nplanes;            /* OUTPUT planes: 1, or 2-3 for NV12M/YUV420M */
+    size_t     strides[VIDEO_MAX_PLANES];
+    int        luma_rows;          /* 1 plane: rows before chroma (may be padded) */
+
+    m2m_buf_t  in[M2M_BUFFERS];    /* OUTPUT queue */
+    int        nin;
+    int        in_queued;          /* OUTPUT buffers handed out at least once */
+    m2m_buf_t  out[M2M_BUFFERS];   /* CAPTURE queue */
+    int        nout;
+    int        streaming;
+
+    uint8_t   *header;             /* H.264 SPS/PPS, if sent separately */
+    size_t     header_size;
+    uint8_t   *packet;             /* what encode() returns */
+    size_t     packet_cap;
+} m2m_ctx_t;
+
+static int xioctl(int fd, unsigned long req, void *arg)
+{
+    int r;
+    do {
+        r = ioctl(fd, req, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+/* Non-zero if the device lists fourcc on queue type */
+static int has_format(int fd, uint32_t type, uint32_t fourcc)
+{
+    struct v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = type;
+    for (; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+        if (desc.pixelformat == fourcc)
+            return 1;
+    }
+    return 0;
+}
+
+static void set_control(int fd, uint32_t id, int32_t value)
+{
+    struct v4l2_control ctrl = { .id = id, .value = value };
+    xioctl(fd, VIDIOC_S_CTRL, &ctrl);   /* optional: drivers differ */
+}
+
+/* Raw layouts we can fill, contiguous ones first */
+static const struct {
+    uint32_t  fourcc;
+    pix_fmt_t format;
+    int       planes;
+} inputs[] = {
+    { V4L2_PIX_FMT_NV12,    PIX_FMT_NV12,    1 },
+    { V4L2_PIX_FMT_YUV420,  PIX_FMT_YUV420P, 1 },
+    { V4L2_PIX_FMT_NV12M,   PIX_FMT_NV12,    2 },
+    { V4L2_PIX_FMT_YUV420M, PIX_FMT_YUV420P, 3 },
+};
+#define NINPUTS ((int)(sizeof(inputs) / sizeof(inputs[0])))
+
+/* An M2M encoder node for codec; returns the fd and the input layout index */
+static int find_device(uint32_t coded, int *input, char *path, size_t path_len)
+{
+    for (int n = 0; n < M2M_MAX_DEVICES; n++) {
+        snprintf(path, path_len, "/dev/video%d", n);
+        int fd = open(path, O_RDWR);
+        if (fd < 0)
+            continue;
+
+        struct v4l2_capability cap;
+        memset(&cap, 0, sizeof(cap));
+        if (xioctl(fd, VIDIOC_QUERYCAP, &cap) == 0) {
+            uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+                            ? cap.device_caps : cap.capabilities;
+            if ((caps & V4L2_CAP_VIDEO_M2M_MPLANE) && (caps & V4L2_CAP_STREAMING) &&
+                has_format(fd, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, coded)) {
+                for (int i = 0; i < NINPUTS; i++) {
+                    if (has_format(fd, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, inputs[i].fourcc)) {
+                        *input = i;
+                        return fd;
+                    }
+                }
+            }
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+static int map_buffers(m2m_ctx_t *ctx, uint32_t type, m2m_buf_t *bufs, int *count)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count  = M2M_BUFFERS;
+    req.type   = type;
+    req.memory = V4L2_MEMORY_MMAP;
+    if (xioctl(ctx->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 1)
+        return -1;
+    *count = req.count < M2M_BUFFERS ? (int)req.count : M2M_BUFFERS;
+
+    for (int i = 0; i < *count; i++) {
+        struct v4l2_plane planes[VIDEO_MAX_PLANES];
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        memset(planes, 0, sizeof(planes));
+        buf.type     = type;
+        buf.memory   = V4L2_MEMORY_MMAP;
+        buf.index    = i;
+        buf.length   = VIDEO_MAX_PLANES;
+        buf.m.planes = planes;
+        if (xioctl(ctx->fd, VIDIOC_QUERYBUF, &buf) < 0)
+            return -1;
+        for (unsigned p = 0; p < buf.length; p++) {
+            void *m = mmap(NULL, planes[p].length, PROT_READ | PROT_WRITE, MAP_SHARED,
+                           ctx->fd, planes[p].m.mem_offset);
+            if (m == MAP_FAILED)
+                return -1;
+            bufs[i].data[p] = m;
+            bufs[i].len[p]  = planes[p].length;
+        }
+    }
+    return 0;
+}
+
+static int queue_capture(m2m_ctx_t *ctx, int index)
+{
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    memset(planes, 0, sizeof(planes));
+    buf.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    buf.memory   = V4L2_MEMORY_MMAP;
+    buf.index    = index;
+    buf.length   = 1;
+    buf.m.planes = planes;
+    return xioctl(ctx->fd, VIDIOC_QBUF, &buf);
+}
+
+/* Wait for and dequeue a buffer of queue type */
+static int dequeue(m2m_ctx_t *ctx, uint32_t type, struct v4l2_buffer *buf,
+                   struct v4l2_plane *planes)
+{
+    struct pollfd pfd = {
+        .fd     = ctx->fd,
+        .events = type == V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE ? POLLIN : POLLOUT
+    };
+    if (poll(&pfd, 1, M2M_TIMEOUT_MS) <= 0) {
+        fprintf(stderr, "encode_v4l2: encoder timed out\n");
+        return -1;
+    }
+
+    memset(buf, 0, sizeof(*buf));
+    memset(planes, 0, sizeof(*planes) * VIDEO_MAX_PLANES);
+    buf->type     = type;
+    buf->memory   = V4L2_MEMORY_MMAP;
+    buf->length   = VIDEO_MAX_PLANES;
+    buf->m.planes = planes;
+    if (xioctl(ctx->fd, VIDIOC_DQBUF, buf) < 0) {
+        perror("encode_v4l2: VIDIOC_DQBUF");
+        return -1;
+    }
+    return 0;
+}
+
+static int append(m2m_ctx_t *ctx, size_t *len, const uint8_t *data, size_t size)
+{
+    if (*len + size > ctx->packet_cap) {
+        size_t cap = (*len + size) * 2;
+        uint8_t *p = realloc(ctx->packet, cap);
+        if (!p)
+            return -1;
+        ctx->packet     = p;
+        ctx->packet_cap = cap;
+    }
+    memcpy(ctx->packet + *len, data, size);
+    *len += size;
+    return 0;
+}
+
+static void m2m_close(void *impl);
+
+static void *m2m_open(codec_t codec, int width, int height, int fps, pix_fmt_t *format)
+{
+    uint32_t coded = codec == CODEC_H264 ? V4L2_PIX_FMT_H264 : V4L2_PIX_FMT_JPEG;
+    char path[32];
+    int input;
+    int fd = find_device(coded, &input, path, sizeof(path));
+    if (fd < 0 && codec == CODEC_MJPEG) {
+        coded = V4L2_PIX_FMT_MJPEG;
+        fd = find_device(coded, &input, path, sizeof(path));
+    }
+    if (fd < 0)
+        return NULL;
+
+    m2m_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        close(fd);
+        return NULL;
+    }
+    ctx->fd     = fd;
+    ctx->codec  = codec;
+    ctx->width  = width;
+    ctx->height = height;
+    ctx->format = inputs[input].format;
+
+    /* Coded side first: it decides what the raw side may be */
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE;
+    fmt.fmt.pix_mp.width       = width;
+    fmt.fmt.pix_mp.height      = height;
+    fmt.fmt.pix_mp.pixelformat = coded;
+    fmt.fmt.pix_mp.num_planes  = 1;
+    fmt.fmt.pix_mp.plane_fmt[0].sizeimage =
+        (uint32_t)pix_fmt_frame_size(PIX_FMT_YUV420P, width, height);
+    if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0)
+        goto fail;
+
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    fmt.fmt.pix_mp.width       = width;
+    fmt.fmt.pix_mp.height      = height;
+    fmt.fmt.pix_mp.pixelformat = inputs[input].fourcc;
+    fmt.fmt.pix_mp.num_planes  = (uint8_t)inputs[input].planes;
+    if (xioctl(fd, VIDIOC_S_FMT, &fmt) < 0 ||
+        fmt.fmt.pix_mp.pixelformat != inputs[input].fourcc ||
+        (int)fmt.fmt.pix_mp.width != width || (int)fmt.fmt.pix_mp.height != height) {
+        fprintf(stderr, "encode_v4l2: %s cannot take %dx%d %s\n",
+                path, width, height, pix_fmt_name(ctx->format));
+        goto fail;
+    }
+    ctx->nplanes = fmt.fmt.pix_mp.num_planes;
+    for (int p = 0; p < ctx->nplanes; p++)
+        ctx->strides[p] = fmt.fmt.pix_mp.plane_fmt[p].bytesperline;
+    if (ctx->strides[0] < (size_t)width)
+        ctx->strides[0] = (size_t)width;
+
+    /* Chroma may start below a height aligned up to the codec's blocks */
+    ctx->luma_rows = height;
+    if (ctx->nplanes == 1) {
+        size_t rows = fmt.fmt.pix_mp.plane_fmt[0].sizeimage * 2 / (ctx->strides[0] * 3);
+        if (rows > (size_t)height)
+            ctx->luma_rows = (int)rows & ~1;
+    }
+
+    struct v4l2_streamparm parm;
+    memset(&parm, 0, sizeof(parm));
+    parm.type = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    parm.parm.output.timeperframe.numerator   = 1;
+    parm.parm.output.timeperframe.denominator = (uint32_t)fps;
+    xioctl(fd, VIDIOC_S_PARM, &parm);
+
+    if (codec == CODEC_H264) {
+        set_control(fd, V4L2_CID_MPEG_VIDEO_BITRATE, encode_bitrate(width, height, fps));
+        set_control(fd, V4L2_CID_MPEG_VIDEO_B_FRAMES, 0);
+        set_control(fd, V4L2_CID_MPEG_VIDEO_GOP_SIZE, fps * 2);
+        set_control(fd, V4L2_CID_MPEG_VIDEO_H264_I_PERIOD, fps * 2);
+        set_control(fd, V4L2_CID_MPEG_VIDEO_REPEAT_SEQ_HEADER, 1);
+        set_control(fd, V4L2_CID_MPEG_VIDEO_HEADER_MODE,
+                    V4L2_MPEG_VIDEO_HEADER_MODE_JOINED_WITH_1ST_FRAME);
+        set_control(fd, V4L2_CID_MPEG_VIDEO_H264_PROFILE,
+                    V4L2_MPEG_VIDEO_H264_PROFILE_CONSTRAINED_BASELINE);
+    } else {
+        set_control(fd, V4L2_CID_JPEG_COMPRESSION_QUALITY, 85);
+    }
+
+    if (map_buffers(ctx, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, ctx->in, &ctx->nin) < 0 ||
+        map_buffers(ctx, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, ctx->out, &ctx->nout) < 0) {
+        fprintf(stderr, "encode_v4l2: cannot map %s buffers: %s\n", path, strerror(errno));
+        goto fail;
+    }
+    for (int i = 0; i < ctx->nout; i++) {
+        if (queue_capture(ctx, i) < 0)
+            goto fail;
+    }
+
+    int types[2] = { V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE };
+    for (int i = 0; i < 2; i++) {
+        if (xioctl(fd, VIDIOC_STREAMON, &types[i]) < 0) {
+            perror("encode_v4l2: VIDIOC_STREAMON");
+            goto fail;
+        }
+    }
+    ctx->streaming = 1;
+
+    fprintf(stderr, "encode_v4l2: %s\n", path);
+    *format = ctx->format;
+    return ctx;
+
+fail:
+    m2m_close(ctx);
+    return NULL;
+}
+
+/* Describe OUTPUT buffer index as a frame in our format */
+static void input_frame(const m2m_ctx_t *ctx, int index, frame_t *f)
+{
+    const m2m_buf_t *b = &ctx->in[index];
+    frame_init(f, ctx->format, ctx->width, ctx->height, b->data[0]);
+    f->strides[0] = ctx->strides[0];
+
+    size_t off = ctx->strides[0] * (size_t)ctx->luma_rows;
+    for (int p = 1; p < pix_fmt_planes(ctx->format); p++) {
+        if (ctx->nplanes > 1) {
+            f->planes[p]  = b->data[p];
+            f->strides[p] = ctx->strides[p];
+        } else {
+            f->planes[p]  = b->data[0] + off;
+            f->strides[p] = ctx->format == PIX_FMT_NV12 ? ctx->strides[0]
+                                                        : ctx->strides[0] / 2;
+            off += f->strides[p] * (size_t)((ctx->luma_rows + 1) / 2);
+        }
+    }
+}
+
+static int m2m_encode(void *impl, const frame_t *frame, packet_t *pkt)
+{
+    m2m_ctx_t *ctx = impl;
+    struct v4l2_plane planes[VIDEO_MAX_PLANES];
+    struct v4l2_buffer buf;
+
+    /* A free OUTPUT buffer: unused ones first, then the encoder's returns */
+    int index;
+    if (ctx->in_queued < ctx->nin) {
+        index = ctx->in_queued++;
+    } else {
+        if (dequeue(ctx, V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, &buf, planes) < 0)
+            return -1;
+        index = (int)buf.index;
+    }
+
+    frame_t dst;
+    input_frame(ctx, index, &dst);
+    frame_copy(&dst, frame);
+
+    memset(&buf, 0, sizeof(buf));
+    memset(planes, 0, sizeof(planes));
+    buf.type     = V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE;
+    buf.memory   = V4L2_MEMORY_MMAP;
+    buf.index    = index;
+    buf.length   = ctx->nplanes;
+    buf.m.planes = planes;
+    buf.field    = V4L2_FIELD_NONE;
+    buf.timestamp.tv_sec  = (time_t)(frame->timestamp_ns / 1000000000u);
+    buf.timestamp.tv_usec = (suseconds_t)(frame->timestamp_ns % 1000000000u / 1000);
+    for (int p = 0; p < ctx->nplanes; p++)
+        planes[p].bytesused = (uint32_t)ctx->in[index].len[p];
+    if (xioctl(ctx->fd, VIDIOC_QBUF, &buf) < 0) {
+        perror("encode_v4l2: VIDIOC_QBUF");
+        return -1;
+    }
+
+    /* Its packet; a buffer with only SPS/PPS is kept and the next one read */
+    size_t len = 0;
+    for (;;) {
+        if (dequeue(ctx, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE, &buf, planes) < 0)
+            return -1;
+        const uint8_t *data = ctx->out[buf.index].data[0] + planes[0].data_offset;
+        size_t size = planes[0].bytesused > planes[0].data_offset
+                    ? planes[0].bytesused - planes[0].data_offset : 0;
+        int picture = buf.flags & (V4L2_BUF_FLAG_KEYFRAME | V4L2_BUF_FLAG_PFRAME |
+                                   V4L2_BUF_FLAG_BFRAME);
+        int keyframe = ctx->codec == CODEC_MJPEG || (buf.flags & V4L2_BUF_FLAG_KEYFRAME);
+        int rc = 0;
+
+        if (ctx->codec == CODEC_H264 && !picture && h264_first_nal_type(data, size) == 7) {
+            uint8_t *h = realloc(ctx->header, size);
+            if (h) {
+                memcpy(h, data, size);
+                ctx->header      = h;
+                ctx->header_size = size;
+            }
+        } else {
+            if (ctx->codec == CODEC_H264 && keyframe && ctx->header &&
+                h264_first_nal_type(data, size) != 7)
+                rc = append(ctx, &len, ctx->header, ctx->header_size);
+            if (rc == 0)
+                rc = append(ctx, &len, data, size);
+            pkt->keyframe = keyframe;
+        }
+
+        if (queue_capture(ctx, (int)buf.index) < 0 || rc < 0)
+            return -1;
+        if (len > 0)
+            break;
+    }
+
+    pkt->data = ctx->packet;
+    pkt->size = len;
+    return 0;
+}
+
+static void m2m_close(void *impl)
+{
+    m2m_ctx_t *ctx = impl;
+    if (!ctx)
+        return;
+    if (ctx->streaming) {
+        int types[2] = { V4L2_BUF_TYPE_VIDEO_OUTPUT_MPLANE, V4L2_BUF_TYPE_VIDEO_CAPTURE_MPLANE };
+        for (int i = 0; i < 2; i++)
+            xioctl(ctx->fd, VIDIOC_STREAMOFF, &types[i]);
+    }
+    m2m_buf_t *lists[2] = { ctx->in, ctx->out };
+    for (int l = 0; l < 2; l++) {
+        for (int i = 0; i < M2M_BUFFERS; i++) {
+            for (int p = 0; p < VIDEO_MAX_PLANES; p++) {
+                if (lists[l][i].data[p])
+                    munmap(lists[l][i].data[p], lists[l][i].len[p]);
+            }
+        }
+    }
+    close(ctx->fd);
+    free(ctx->header);
+    free(ctx->packet);
+    free(ctx);
+}
+
+const encode_backend_t encode_v4l2m2m = {
+    .name   = "v4l2 m2m",
+    .open   = m2m_open,
+    .encode = m2m_encode,
+    .close  = m2m_close,
+};
@@ -0,0 +1,439 @@
+/*
+ * Windows hardware encoder (Media Foundation H.264 MFT)
+ *
+ * Enumerates H.264 encoder transforms that take NV12, hardware ones
+ * first (NVENC, Quick Sync and AMF all register as MFTs), falling back
+ * to Microsoft's software encoder.
+ *
+ *   - Hardware MFTs are asynchronous: they ask for input and announce
+ *     output through METransformNeedInput / METransformHaveOutput events.
+ *     encode() feeds one frame when the MFT asks and waits for its packet
+ *     unless the MFT asks for more input first (it holds frames back),
+ *     in which case the frame's packet comes out with a later call
+ *   - Software MFTs are synchronous: ProcessInput, then ProcessOutput
+ *     until it needs more input
+ *   - MF_LOW_LATENCY, no B-frames: one packet per frame in practice
+ *   - Output is Annex-B; if keyframes come without SPS/PPS, the sequence
+ *     header from the output type is put in front of them
+ *
+ * MJPEG has no system encoder MFT; encode.c falls back to software.
+ *
+ * COM usage: Plain C with COBJMACROS (no C++), as in capture_win.c.
+ * Libraries: mfplat, mfuuid
+ */
+
+#define COBJMACROS
+#define CINTERFACE
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
+#include "encode_backend.h"
+
+#include <windows.h>
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mferror.h>
+#include <mftransform.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    IMFTransform           *mft;
+    IMFMediaEventGenerator *events;   /* async MFTs only */
+    int                     mf_started;
+    int                     width;
+    int                     height;
+    int                     fps;
+    int64_t                 index;    /* frames submitted */
+    int                     need_input;      /* async: requests not yet answered */
+    int                     provides_samples;
+    DWORD                   out_size;
+
+    uint8_t                *header;   /* MF_MT_MPEG_SEQUENCE_HEADER */
+    UINT32                  header_size;
+    uint8_t                *packet;
+    size_t                  cap;
+    size_t                  len;
+    int                     keyframe;
+} mf_ctx_t;
+
+static int reserve(mf_ctx_t *ctx, size_t size)
+{
+    if (size <= ctx->cap)
+        return 0;
+    uint8_t *p = realloc(ctx->packet, size * 2);
+    if (!p)
+        return -1;
+    ctx->packet = p;
+    ctx->cap    = size * 2;
+    return 0;
+}
+
+static IMFMediaType *video_type(const mf_ctx_t *ctx, const GUID *subtype)
+{
+    IMFMediaType *t = NULL;
+    if (FAILED(MFCreateMediaType(&t)))
+        return NULL;
+    IMFMediaType_SetGUID(t, &MF_MT_MAJOR_TYPE, &MFMediaType_Video);
+    IMFMediaType_SetGUID(t, &MF_MT_SUBTYPE, subtype);
+    IMFMediaType_SetUINT64(t, &MF_MT_FRAME_SIZE,
+                           (UINT64)ctx->width << 32 | (UINT32)ctx->height);
+    IMFMediaType_SetUINT64(t, &MF_MT_FRAME_RATE, (UINT64)ctx->fps << 32 | 1);
+    IMFMediaType_SetUINT64(t, &MF_MT_PIXEL_ASPECT_RATIO, (UINT64)1 << 32 | 1);
+    IMFMediaType_SetUINT32(t, &MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive);
+    return t;
+}
+
+/* The encoder's SPS/PPS, once the output type carries them */
+static void read_header(mf_ctx_t *ctx)
+{
+    IMFMediaType *t = NULL;
+    if (FAILED(IMFTransform_GetOutputCurrentType(ctx->mft, 0, &t)))
+        return;
+    UINT8 *blob = NULL;
+    UINT32 size = 0;
+    if (SUCCEEDED(IMFMediaType_GetAllocatedBlob(t, &MF_MT_MPEG_SEQUENCE_HEADER,
+                                                &blob, &size))) {
+        uint8_t *h = realloc(ctx->header, size);
+        if (h) {
+            memcpy(h, blob, size);
+            ctx->header      = h;
+            ctx->header_size = size;
+        }
+        CoTaskMemFree(blob);
+    }
+    IMFMediaType_Release(t);
+}
+
+static int set_types(mf_ctx_t *ctx)
+{
+    /* Output first: encoders derive the input types they offer from it */
+    IMFMediaType *out = video_type(ctx, &MFVideoFormat_H264);
+    IMFMediaType *in  = video_type(ctx, &MFVideoFormat_NV12);
+    HRESULT hr = E_OUTOFMEMORY;
+    if (out && in) {
+        IMFMediaType_SetUINT32(out, &MF_MT_AVG_BITRATE,
+                               (UINT32)encode_bitrate(ctx->width, ctx->height, ctx->fps));
+        IMFMediaType_SetUINT32(out, &MF_MT_MPEG2_PROFILE, 77);   /* eAVEncH264VProfile_Main */
+        hr = IMFTransform_SetOutputType(ctx->mft, 0, out, 0);
+        if (SUCCEEDED(hr))
+            hr = IMFTransform_SetInputType(ctx->mft, 0, in, 0);
+    }
+    if (out)
+        IMFMediaType_Release(out);
+    if (in)
+        IMFMediaType_Release(in);
+    return SUCCEEDED(hr) ? 0 : -1;
+}
+
+/* Activate the first MFT of the list that accepts our types */
+static int activate(mf_ctx_t *ctx, UINT32 flags)
+{
+    MFT_REGISTER_TYPE_INFO in  = { MFMediaType_Video, MFVideoFormat_NV12 };
+    MFT_REGISTER_TYPE_INFO out = { MFMediaType_Video, MFVideoFormat_H264 };
+    IMFActivate **list = NULL;
+    UINT32 count = 0;
+
+    if (FAILED(MFTEnumEx(MFT_CATEGORY_VIDEO_ENCODER, flags | MFT_ENUM_FLAG_SORTANDFILTER,
+                         &in, &out, &list, &count)))
+        return -1;
+
+    for (UINT32 i = 0; i < count && !ctx->mft; i++) {
+        if (FAILED(IMFActivate_ActivateObject(list[i], &IID_IMFTransform,
+                                              (void **)&ctx->mft)))
+            continue;
+
+        IMFAttributes *attrs = NULL;
+        UINT32 async = 0;
+        if (SUCCEEDED(IMFTransform_GetAttributes(ctx->mft, &attrs)) && attrs) {
+            IMFAttributes_GetUINT32(attrs, &MF_TRANSFORM_ASYNC, &async);
+            if (async)
+                IMFAttributes_SetUINT32(attrs, &MF_TRANSFORM_ASYNC_UNLOCK, TRUE);
+            IMFAttributes_SetUINT32(attrs, &MF_LOW_LATENCY, TRUE);
+            IMFAttributes_Release(attrs);
+        }
+        if (async)
+            IMFTransform_QueryInterface(ctx->mft, &IID_IMFMediaEventGenerator,
+                                        (void **)&ctx->events);
+
+        if ((async && !ctx->events) || set_types(ctx) < 0) {
+            if (ctx->events) {
+                IMFMediaEventGenerator_Release(ctx->events);
+                ctx->events = NULL;
+            }
+            IMFActivate_ShutdownObject(list[i]);
+            IMFTransform_Release(ctx->mft);
+            ctx->mft = NULL;
+            continue;
+        }
+
+        WCHAR name[128];
+        UINT32 len = 0;
+        if (SUCCEEDED(IMFActivate_GetString(list[i], &MFT_FRIENDLY_NAME_Attribute,
+                                            name, 128, &len)))
+            fprintf(stderr, "encode_mf: %ls\n", name);
+    }
+
+    for (UINT32 i = 0; i < count; i++)
+        IMFActivate_Release(list[i]);
+    CoTaskMemFree(list);
+    return ctx->mft ? 0 : -1;
+}
+
+static void mf_close(void *impl);
+
+static void *mf_open(codec_t codec, int width, int height, int fps, pix_fmt_t *format)
+{
+    if (codec != CODEC_H264)
+        return NULL;
+
+    mf_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+    ctx->width  = width;
+    ctx->height = height;
+    ctx->fps    = fps;
+
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (FAILED(hr) && hr != RPC_E_CHANGED_MODE) {
+        free(ctx);
+        return NULL;
+    }
+    if (FAILED(MFStartup(MF_VERSION, MFSTARTUP_LITE))) {
+        fprintf(stderr, "encode_mf: MFStartup failed\n");
+        mf_close(ctx);
+        return NULL;
+    }
+    ctx->mf_started = 1;
+
+    if (activate(ctx, MFT_ENUM_FLAG_HARDWARE) < 0 &&
+        activate(ctx, MFT_ENUM_FLAG_SYNCMFT) < 0) {
+        fprintf(stderr, "encode_mf: no H.264 encoder takes %dx%d NV12\n", width, height);
+        mf_close(ctx);
+        return NULL;
+    }
+
+    MFT_OUTPUT_STREAM_INFO info;
+    memset(&info, 0, sizeof(info));
+    IMFTransform_GetOutputStreamInfo(ctx->mft, 0, &info);
+    ctx->provides_samples = (info.dwFlags & (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES |
+                                             MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES)) != 0;
+    ctx->out_size = info.cbSize ? info.cbSize
+                                : (DWORD)pix_fmt_frame_size(PIX_FMT_NV12, width, height);
+    read_header(ctx);
+
+    IMFTransform_ProcessMessage(ctx->mft, MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0);
+    IMFTransform_ProcessMessage(ctx->mft, MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0);
+
+    *format = PIX_FMT_NV12;
+    return ctx;
+}
+
+static int process_input(mf_ctx_t *ctx, const frame_t *frame)
+{
+    DWORD size = (DWORD)pix_fmt_frame_size(PIX_FMT_NV12, ctx->width, ctx->height);
+    IMFMediaBuffer *buf = NULL;
+    IMFSample *sample = NULL;
+    BYTE *data;
+    HRESULT hr = MFCreateMemoryBuffer(size, &buf);
+    if (SUCCEEDED(hr))
+        hr = IMFMediaBuffer_Lock(buf, &data, NULL, NULL);
+    if (SUCCEEDED(hr)) {
+        frame_t dst;
+        frame_init(&dst, PIX_FMT_NV12, ctx->width, ctx->height, data);
+        frame_copy(&dst, frame);
+        IMFMediaBuffer_Unlock(buf);
+        IMFMediaBuffer_SetCurrentLength(buf, size);
+        hr = MFCreateSample(&sample);
+    }
+    if (SUCCEEDED(hr))
+        hr = IMFSample_AddBuffer(sample, buf);
+    if (SUCCEEDED(hr)) {
+        LONGLONG step = 10000000LL / ctx->fps;   /* 100 ns units */
+        IMFSample_SetSampleTime(sample, ctx->index * step);
+        IMFSample_SetSampleDuration(sample, step);
+        ctx->index++;
+        hr = IMFTransform_ProcessInput(ctx->mft, 0, sample, 0);
+    }
+    if (sample)
+        IMFSample_Release(sample);
+    if (buf)
+        IMFMediaBuffer_Release(buf);
+    return SUCCEEDED(hr) ? 0 : (hr == MF_E_NOTACCEPTING ? 1 : -1);
+}
+
+/* Take one packet from the MFT.  Returns 1 if one came, 0 if it needs input */
+static int process_output(mf_ctx_t *ctx)
+{
+    for (;;) {
+        MFT_OUTPUT_DATA_BUFFER out;
+        memset(&out, 0, sizeof(out));
+        if (!ctx->provides_samples) {
+            IMFMediaBuffer *buf = NULL;
+            if (FAILED(MFCreateSample(&out.pSample)) ||
+                FAILED(MFCreateMemoryBuffer(ctx->out_size, &buf))) {
+                if (out.pSample)
+                    IMFSample_Release(out.pSample);
+                return -1;
+            }
+            IMFSample_AddBuffer(out.pSample, buf);
+            IMFMediaBuffer_Release(buf);
+        }
+
+        DWORD status = 0;
+        HRESULT hr = IMFTransform_ProcessOutput(ctx->mft, 0, 1, &out, &status);
+        if (out.pEvents)
+            IMFCollection_Release(out.pEvents);
+
+        if (hr == MF_E_TRANSFORM_STREAM_CHANGE) {
+            /* The encoder revised its output type: take it as offered */
+            IMFMediaType *t = NULL;
+            if (out.pSample)
+                IMFSample_Release(out.pSample);
+            if (FAILED(IMFTransform_GetOutputAvailableType(ctx->mft, 0, 0, &t)))
+                return -1;
+            hr = IMFTransform_SetOutputType(ctx->mft, 0, t, 0);
+            IMFMediaType_Release(t);
+            if (FAILED(hr))
+                return -1;
+            read_header(ctx);
+            continue;
+        }
+        if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+            if (out.pSample)
+                IMFSample_Release(out.pSample);
+            return 0;
+        }
+        if (FAILED(hr) || !out.pSample) {
+            if (out.pSample)
+                IMFSample_Release(out.pSample);
+            fprintf(stderr, "encode_mf: ProcessOutput failed: 0x%08lx\n", (unsigned long)hr);
+            return -1;
+        }
+
+        UINT32 clean = 0;
+        IMFSample_GetUINT32(out.pSample, &MFSampleExtension_CleanPoint, &clean);
+        ctx->keyframe = clean != 0;
+
+        IMFMediaBuffer *buf = NULL;
+        BYTE *data;
+        DWORD size = 0;
+        int rc = -1;
+        if (SUCCEEDED(IMFSample_ConvertToContiguousBuffer(out.pSample, &buf)) &&
+            SUCCEEDED(IMFMediaBuffer_Lock(buf, &data, NULL, &size))) {
+            size_t len = 0;
+            int prefix = ctx->keyframe && ctx->header &&
+                         h264_first_nal_type(data, size) != 7;
+            if (reserve(ctx, size + (prefix ? ctx->header_size : 0)) == 0) {
+                if (prefix) {
+                    memcpy(ctx->packet, ctx->header, ctx->header_size);
+                    len = ctx->header_size;
+                }
+                memcpy(ctx->packet + len, data, size);
+                ctx->len = len + size;
+                rc = 1;
+            }
+            IMFMediaBuffer_Unlock(buf);
+        }
+        if (buf)
+            IMFMediaBuffer_Release(buf);
+        IMFSample_Release(out.pSample);
+        return rc;
+    }
+}
+
+/* Async MFTs: next event type, blocking */
+static int next_event(mf_ctx_t *ctx, MediaEventType *type)
+{
+    IMFMediaEvent *ev = NULL;
+    if (FAILED(IMFMediaEventGenerator_GetEvent(ctx->events, 0, &ev)))
+        return -1;
+    IMFMediaEvent_GetType(ev, type);
+    IMFMediaEvent_Release(ev);
+    return 0;
+}
+
+static int mf_encode(void *impl, const frame_t *frame, packet_t *pkt)
+{
+    mf_ctx_t *ctx = impl;
+    MediaEventType type;
+    ctx->len = 0;
+
+    if (!ctx->events) {
+        /* Synchronous MFT */
+        int rc = process_input(ctx, frame);
+        if (rc == 1) {   /* output pending first */
+            if (process_output(ctx) < 0)
+                return -1;
+            rc = process_input(ctx, frame);
+        }
+        if (rc != 0 || (!ctx->len && process_output(ctx) < 0))
+            return -1;
+    } else {
+        /* Wait until the MFT asks for a frame, keeping any packet it sends */
+        while (ctx->need_input == 0) {
+            if (next_event(ctx, &type) < 0)
+                return -1;
+            if (type == METransformNeedInput)
+                ctx->need_input++;
+            else if (type == METransformHaveOutput && process_output(ctx) < 0)
+                return -1;
+        }
+        if (process_input(ctx, frame) != 0)
+            return -1;
+        ctx->need_input--;
+
+        /* Its packet, unless the MFT wants more input before it has one */
+        while (!ctx->len) {
+            if (next_event(ctx, &type) < 0)
+                return -1;
+            if (type == METransformNeedInput) {
+                ctx->need_input++;
+                break;
+            }
+            if (type == METransformHaveOutput && process_output(ctx) < 0)
+                return -1;
+        }
+    }
+
+    pkt->data     = ctx->packet;
+    pkt->size     = ctx->len;
+    pkt->keyframe = ctx->keyframe;
+    return 0;
+}
+
+static void mf_close(void *impl)
+{
+    mf_ctx_t *ctx = impl;
+    if (!ctx)
+        return;
+    if (ctx->mft) {
+        IMFTransform_ProcessMessage(ctx->mft, MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0);
+        IMFTransform_ProcessMessage(ctx->mft, MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+        if (ctx->events) {
+            IMFShutdown *shutdown = NULL;
+            if (SUCCEEDED(IMFTransform_QueryInterface(ctx->mft, &IID_IMFShutdown,
+                                                      (void **)&shutdown))) {
+                IMFShutdown_Shutdown(shutdown);
+                IMFShutdown_Release(shutdown);
+            }
+            IMFMediaEventGenerator_Release(ctx->events);
+        }
+        IMFTransform_Release(ctx->mft);
+    }
+    if (ctx->mf_started)
+        MFShutdown();
+    free(ctx->header);
+    free(ctx->packet);
+    free(ctx);
+}
+
+const encode_backend_t encode_mediafoundation = {
+    .name   = "media foundation",
+    .open   = mf_open,
+    .encode = mf_encode,
+    .close  = mf_close,
+};
@@ -0,0 +1,293 @@
+/*
+ * Fan-out of refcounted buffers to several SPSC rings
+ *
+ * Every consumer's ring only moves indices; its slots point at shared
+ * buffers through a per-consumer table (slot -> buffer).  A slot that is
+ * queued or held by the consumer carries one reference to its buffer.
+ * The consumer drops it before handing the slot back, and the producer
+ * drops the one of a slot it stole under the drop-oldest policy, so a
+ * slot on a ring's free queue never holds a buffer.
+ *
+ * A buffer's refcount reaching zero runs the drained callback and then
+ * marks it idle; the producer only takes idle buffers, so the callback
+ * never races with a refill.
+ */
+
+#include "fanout.h"
+
+#include <stdatomic.h>
+#include <stdlib.h>
+
+#define MAX_CONSUMERS 32
+
+typedef struct {
+    ring_t     *ring;
+    int        *slot_buf;   /* per ring slot: buffer it references, or -1 */
+    int         held;       /* slot from fanout_pop(), or -1 */
+    int         fps;
+    int         acc;        /* decimation accumulator, producer only */
+    atomic_int  detached;
+} consumer_t;
+
+struct fanout {
+    int          nbufs;
+    pool_buf_t **bufs;      /* NULL entries for buf_size 0 */
+    atomic_int  *refs;
+    atomic_int  *idle;      /* 1 = free for the producer */
+    int          last;      /* last buffer published, or -1 */
+    uint64_t     last_seq;  /* and its frame number */
+
+    int          nconsumers;
+    int          rate;      /* producer fps: the highest consumer's */
+    consumer_t  *consumers;
+
+    void       (*drained)(void *arg, int buf);
+    void        *drained_arg;
+};
+
+static void unref(fanout_t *f, int buf)
+{
+    if (buf < 0 || atomic_fetch_sub(&f->refs[buf], 1) != 1)
+        return;
+    if (f->drained)
+        f->drained(f->drained_arg, buf);
+    atomic_store(&f->idle[buf], 1);
+}
+
+/* ── Lifecycle ─────────────────────────────────────────────── */
+
+fanout_t *fanout_create(int consumers, const int *fps, int depth, size_t buf_size,
+                        ring_policy_t policy)
+{
+    if (consumers < 1 || consumers > MAX_CONSUMERS || depth < 1)
+        return NULL;
+
+    fanout_t *f = calloc(1, sizeof(*f));
+    if (!f)
+        return NULL;
+    f->nconsumers = consumers;
+    f->nbufs      = consumers * (depth + 1) + 1;
+    f->last       = -1;
+    f->bufs       = calloc((size_t)f->nbufs, sizeof(*f->bufs));
+    f->refs       = calloc((size_t)f->nbufs, sizeof(*f->refs));
+    f->idle       = calloc((size_t)f->nbufs, sizeof(*f->idle));
+    f->consumers  = calloc((size_t)consumers, sizeof(*f->consumers));
+    if (!f->bufs || !f->refs || !f->idle || !f->consumers) {
+        free(f->bufs);
+        free((void *)f->refs);
+        free((void *)f->idle);
+        free(f->consumers);
+        free(f);
+        return NULL;
+    }
+
+    for (int i = 0; i < f->nbufs; i++) {
+        atomic_init(&f->refs[i], 0);
+        atomic_init(&f->idle[i], 1);
+    }
+    for (int c = 0; c < consumers; c++) {
+        if (fps[c] > f->rate)
+            f->rate = fps[c];
+    }
+
+    /* A slow consumer must not hold back the others */
+    if (consumers > 1)
+        policy = RING_DROP_OLDEST;
+
+    for (int c = 0; c < consumers; c++) {
+        consumer_t *k = &f->consumers[c];
+        k->held = -1;
+        k->fps  = fps[c];
+        k->acc  = f->rate - fps[c];   /* everyone takes the first frame */
+        atomic_init(&k->detached, 0);
+        k->ring = ring_create(depth, 0, policy);
+        if (!k->ring)
+            goto fail;
+        int nslots = ring_slot_count(k->ring);
+        k->slot_buf = malloc((size_t)nslots * sizeof(*k->slot_buf));
+        if (!k->slot_buf)
+            goto fail;
+        for (int s = 0; s < nslots; s++)
+            k->slot_buf[s] = -1;
+    }
+
+    if (buf_size) {
+        for (int i = 0; i < f->nbufs; i++) {
+            f->bufs[i] = pool_get(buf_size);
+            if (!f->bufs[i])
+                goto fail;
+        }
+    }
+    return f;
+
+fail:
+    fanout_free(f);
+    return NULL;
+}
+
+void fanout_close(fanout_t *f)
+{
+    for (int c = 0; c < f->nconsumers; c++)
+        ring_close(f->consumers[c].ring);
+}
+
+void fanout_free(fanout_t *f)
+{
+    if (!f)
+        return;
+    for (int c = 0; c < f->nconsumers; c++) {
+        ring_free(f->consumers[c].ring);
+        free(f->consumers[c].slot_buf);
+    }
+    for (int i = 0; i < f->nbufs; i++)
+        pool_put(f->bufs[i]);
+    free(f->consumers);
+    free(f->bufs);
+    free((void *)f->refs);
+    free((void *)f->idle);
+    free(f);
+}
+
+int fanout_buffer_count(const fanout_t *f)
+{
+    return f->nbufs;
+}
+
+uint8_t *fanout_data(const fanout_t *f, int buf)
+{
+    return f->bufs[buf] ? f->bufs[buf]->data : NULL;
+}
+
+void fanout_on_drained(fanout_t *f, void (*fn)(void *arg, int buf), void *arg)
+{
+    f->drained     = fn;
+    f->drained_arg = arg;
+}
+
+uint64_t fanout_dropped(const fanout_t *f)
+{
+    uint64_t n = 0;
+    for (int c = 0; c < f->nconsumers; c++)
+        n += ring_dropped(f->consumers[c].ring);
+    return n;
+}
+
+/* ── Producer ──────────────────────────────────────────────── */
+
+unsigned fanout_due(fanout_t *f)
+{
+    unsigned mask = 0;
+    for (int c = 0; c < f->nconsumers; c++) {
+        consumer_t *k = &f->consumers[c];
+        if (atomic_load_explicit(&k->detached, memory_order_relaxed))
+            continue;
+        k->acc += k->fps;
+        if (k->acc >= f->rate) {
+            k->acc -= f->rate;
+            mask |= 1u << c;
+        }
+    }
+    return mask;
+}
+
+int fanout_acquire(fanout_t *f)
+{
+    int buf = -1;
+    if (f->last >= 0 && atomic_load(&f->idle[f->last]))
+        buf = f->last;
+    for (int i = 0; buf < 0 && i < f->nbufs; i++) {
+        if (atomic_load(&f->idle[i]))
+            buf = i;
+    }
+    if (buf < 0)
+        return -1;   /* cannot happen: see nbufs in fanout_create() */
+    atomic_store(&f->idle[buf], 0);
+    atomic_store(&f->refs[buf], 1);   /* the producer's, until published */
+    return buf;
+}
+
+int fanout_publish(fanout_t *f, int buf, uint64_t seq, unsigned mask)
+{
+    int dropped = 0, closed = 0;
+
+    for (int c = 0; c < f->nconsumers; c++) {
+        consumer_t *k = &f->consumers[c];
+        if (!(mask & (1u << c)) || atomic_load(&k->detached))
+            continue;
+
+        ring_slot_t *slot = ring_write_slot(k->ring);
+        atomic_fetch_add(&f->refs[buf], 1);
+        k->slot_buf[slot->index] = buf;
+        slot->seq = seq;
+
+        int rc = ring_publish(k->ring);
+        if (rc < 0) {
+            closed = 1;
+            continue;
+        }
+        if (rc == 1) {
+            /* We took back the oldest queued slot: drop its frame */
+            slot = ring_write_slot(k->ring);
+            unref(f, k->slot_buf[slot->index]);
+            k->slot_buf[slot->index] = -1;
+            dropped++;
+        }
+    }
+    f->last     = buf;
+    f->last_seq = seq;
+    unref(f, buf);
+    return closed ? -1 : dropped;
+}
+
+int fanout_repeat(fanout_t *f, unsigned mask)
+{
+    int buf = f->last;
+    if (buf < 0)
+        return 0;
+
+    /* Join the holders, unless the last of them is letting go right now */
+    int refs = atomic_load(&f->refs[buf]);
+    while (refs > 0 && !atomic_compare_exchange_weak(&f->refs[buf], &refs, refs + 1))
+        ;
+    if (refs == 0) {
+        if (f->drained)
+            return 0;
+        while (!atomic_load(&f->idle[buf]))
+            ;   /* only the idle store is left to do */
+        atomic_store(&f->idle[buf], 0);
+        atomic_store(&f->refs[buf], 1);
+    }
+    return fanout_publish(f, buf, f->last_seq, mask) < 0 ? -1 : 1;
+}
+
+/* ── Consumer ──────────────────────────────────────────────── */
+
+void fanout_release(fanout_t *f, int c)
+{
+    consumer_t *k = &f->consumers[c];
+    if (k->held < 0)
+        return;
+    unref(f, k->slot_buf[k->held]);
+    k->slot_buf[k->held] = -1;
+    k->held = -1;
+    ring_release(k->ring);
+}
+
+int fanout_pop(fanout_t *f, int c, uint64_t *seq)
+{
+    consumer_t *k = &f->consumers[c];
+    fanout_release(f, c);
+
+    ring_slot_t *slot = ring_pop(k->ring);
+    if (!slot)
+        return -1;
+    k->held = slot->index;
+    *seq = slot->seq;
+    return k->slot_buf[slot->index];
+}
+
+void fanout_detach(fanout_t *f, int c)
+{
+    atomic_store(&f->consumers[c].detached, 1);
+    fanout_release(f, c);
+}
@@ -0,0 +1,103 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ring.h"
+
+/*
+ * One producer feeding several consumers from shared, refcounted buffers.
+ *
+ * The producer fills a buffer once and publishes it to every consumer
+ * that is due; each consumer has a ring of its own (ring.h) that carries
+ * only buffer indices, so a frame reaches N consumers without N copies.
+ * A buffer goes back to the producer when the last consumer holding it
+ * lets go.  One buffer more than all consumers can hold at once
+ * (depth queued plus one in use, each) is allocated, so the producer
+ * always finds a free one and never waits for a slow consumer.
+ *
+ * Consumers may run at a lower rate than the producer: fanout_due()
+ * decimates each one to its own fps, evenly spaced.  With more than one
+ * consumer the rings always drop the oldest frame when full; blocking
+ * would let the slowest consumer hold back all the others.
+ */
+
+typedef struct fanout fanout_t;
+
+/*
+ * consumers >= 1 (at most 32), each taking fps[i] frames per second of a
+ * producer running at the highest of them.  buf_size may be 0 for
+ * buffers that only stand for something the caller keeps per index
+ * (borrowed capture frames).  Returns NULL on failure.
+ */
+fanout_t *fanout_create(int consumers, const int *fps, int depth, size_t buf_size,
+                        ring_policy_t policy);
+
+/* Number of buffers, for per-buffer side tables. */
+int fanout_buffer_count(const fanout_t *f);
+
+/* Buffer memory (page-aligned, from pool.h), NULL for buf_size 0. */
+uint8_t *fanout_data(const fanout_t *f, int buf);
+
+/*
+ * Called with a buffer's index when its last holder lets go, before the
+ * producer may take it again (e.g. to release a borrowed capture frame).
+ * Runs on whichever thread dropped the last reference.
+ */
+void fanout_on_drained(fanout_t *f, void (*fn)(void *arg, int buf), void *arg);
+
+/* ── Producer ── */
+
+/*
+ * Advance one producer tick: which consumers (bit i = consumer i) take
+ * this frame.  Only the highest-rate consumer is due on every tick.
+ */
+unsigned fanout_due(fanout_t *f);
+
+/*
+ * A free buffer to fill: the last one published if nobody holds it any
+ * more (least to update incrementally), otherwise any free one.
+ */
+int fanout_acquire(fanout_t *f);
+
+/*
+ * Hand buffer buf (from fanout_acquire) to the consumers in mask, with
+ * frame number seq.  A buffer nobody took is drained right away.
+ * Returns the number of frames dropped from full rings, or -1 once the
+ * fanout is closed.
+ */
+int fanout_publish(fanout_t *f, int buf, uint64_t seq, unsigned mask);
+
+/*
+ * Publish the last published buffer again, unchanged and with its frame
+ * number, to the consumers in mask: a repeat without refilling anything.
+ * Returns 1, or -1 once the fanout is closed, or 0 with nothing sent:
+ * before the first publish, or when that buffer was drained already and
+ * the drained callback let go of its contents.
+ */
+int fanout_repeat(fanout_t *f, unsigned mask);
+
+/* ── Consumer ── */
+
+/*
+ * Wait for consumer c's next buffer and hold it, letting go of the one
+ * held before.  Sets *seq; returns the buffer index, or -1 once closed.
+ */
+int fanout_pop(fanout_t *f, int c, uint64_t *seq);
+
+/* Let go of the buffer from fanout_pop(). */
+void fanout_release(fanout_t *f, int c);
+
+/* Consumer c stops for good (its output failed): it is no longer due. */
+void fanout_detach(fanout_t *f, int c);
+
+/* Wake every waiter and make further waits fail.  Use before joining. */
+void fanout_close(fanout_t *f);
+
+/* Frames the consumers' rings dropped so far. */
+uint64_t fanout_dropped(const fanout_t *f);
+
+void fanout_free(fanout_t *f);
+
+#endif /* FANOUT_H */
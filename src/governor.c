@@ -0,0 +1,186 @@
+/*
+ * CPU budget governor
+ *
+ * The quality ladder, from full to lowest, is a rate divider of 1..4 and
+ * half resolution on or off.  Each decision is one step along it:
+ *
+ *   over budget, static screen:  rate first, then resolution
+ *   over budget, moving screen:  resolution first, then rate
+ *   well under budget:           the same in reverse, restoring what the
+ *                                screen shows most: sharpness when static,
+ *                                fluid motion when moving
+ *
+ * "Well under" is below UP_SHARE of the budget: undoing a step can
+ * double the cost, so stepping up any earlier would only bounce.  A step
+ * up that has to be taken back soon after doubles the wait before the
+ * next one (up to MAX_HOLD_NS), so a load that sits right at the edge
+ * settles at the lower step instead of flapping.
+ */
+
+#include "governor.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include "platform.h"
+#endif
+
+#define MAX_DIV      4
+#define PERIOD_NS    1000000000u   /* between measurements */
+#define SETTLE_NS    2000000000u   /* after a step, before the next one */
+#define MAX_HOLD_NS  64000000000u  /* longest wait before stepping back up */
+#define UP_SHARE     0.5           /* of the budget, to step back up */
+#define MOTION_SHARE 0.05          /* of the screen changed per frame: moving */
+#define CONVERT_SHARE 0.33         /* of the stage time, for half resolution to pay */
+
+struct governor {
+    pipeline_t  *p;
+    double       budget;      /* percent of one core */
+    int          div;
+    int          half;
+    int          stuck;       /* at the bottom and over budget, reported */
+
+    uint64_t     last_ns;
+    uint64_t     settle_ns;   /* no step before this */
+    uint64_t     up_ns;       /* no step up before this */
+    uint64_t     hold_ns;     /* wait after a step down before stepping up */
+    uint64_t     raised_ns;   /* last step up */
+    uint64_t     cpu_ns;      /* process CPU time at last_ns */
+    uint64_t     changed;     /* pipeline_activity() at last_ns */
+    uint64_t     grabbed;
+    stats_dist_t timing[STAGE_COUNT];
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* CPU time of every thread of the process so far. */
+static uint64_t cpu_time_ns(void)
+{
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return 0;
+    ULARGE_INTEGER k = { .LowPart = kernel.dwLowDateTime, .HighPart = kernel.dwHighDateTime };
+    ULARGE_INTEGER u = { .LowPart = user.dwLowDateTime, .HighPart = user.dwHighDateTime };
+    return (k.QuadPart + u.QuadPart) * 100;   /* 100 ns units */
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void describe(const governor_t *g, char *buf, size_t len)
+{
+    if (g->div == 1)
+        snprintf(buf, len, "every frame, %s resolution", g->half ? "half" : "full");
+    else
+        snprintf(buf, len, "every %d%s frame, %s resolution", g->div,
+                 g->div == 2 ? "nd" : g->div == 3 ? "rd" : "th",
+                 g->half ? "half" : "full");
+}
+
+governor_t *governor_create(pipeline_t *p, int budget_pct)
+{
+    governor_t *g = calloc(1, sizeof(*g));
+    if (!g)
+        return NULL;
+    g->p       = p;
+    g->budget  = budget_pct;
+    g->div     = 1;
+    g->hold_ns = SETTLE_NS;
+    g->last_ns = now_ns();
+    g->cpu_ns  = cpu_time_ns();
+    pipeline_activity(p, &g->changed, &g->grabbed);
+    pipeline_timing(p, g->timing);
+    return g;
+}
+
+void governor_update(governor_t *g)
+{
+    uint64_t now = now_ns();
+    if (now - g->last_ns < PERIOD_NS)
+        return;
+
+    /* What happened since the last measurement */
+    uint64_t cpu = cpu_time_ns(), changed, grabbed;
+    stats_dist_t timing[STAGE_COUNT];
+    pipeline_activity(g->p, &changed, &grabbed);
+    pipeline_timing(g->p, timing);
+
+    double usage  = 100.0 * (double)(cpu - g->cpu_ns) / (double)(now - g->last_ns);
+    double motion = grabbed > g->grabbed
+                  ? (double)(changed - g->changed) / (double)(grabbed - g->grabbed) : 0;
+    double grab    = (double)(timing[STAGE_GRAB].sum_ns - g->timing[STAGE_GRAB].sum_ns);
+    double convert = (double)(timing[STAGE_CONVERT].sum_ns - g->timing[STAGE_CONVERT].sum_ns) +
+                     (double)(timing[STAGE_ENCODE].sum_ns - g->timing[STAGE_ENCODE].sum_ns);
+
+    g->last_ns = now;
+    g->cpu_ns  = cpu;
+    g->changed = changed;
+    g->grabbed = grabbed;
+    for (int i = 0; i < STAGE_COUNT; i++)
+        g->timing[i] = timing[i];
+    if (now < g->settle_ns)
+        return;
+
+    int moving = motion > MOTION_SHARE;
+    int halve  = !g->half && pipeline_can_halve(g->p) &&
+                 convert >= CONVERT_SHARE * (grab + convert);
+    int div = g->div, half = g->half;
+
+    if (usage > g->budget) {
+        if (moving && halve)
+            half = 1;
+        else if (div < MAX_DIV)
+            div++;
+        else if (halve)
+            half = 1;
+    } else if (usage < UP_SHARE * g->budget && now >= g->up_ns) {
+        if (moving ? div == 1 && half : half)
+            half = 0;
+        else if (div > 1)
+            div--;
+    }
+
+    if (div == g->div && half == g->half) {
+        if (usage > g->budget && !g->stuck)
+            fprintf(stderr, "\ngovernor: %.0f%% CPU is over the %.0f%% budget "
+                            "at the lowest quality\n", usage, g->budget);
+        g->stuck = usage > g->budget;
+        return;
+    }
+
+    if (usage > g->budget) {
+        /* Taken back soon after a step up: wait longer next time */
+        if (g->raised_ns && now - g->raised_ns < 2 * g->hold_ns + PERIOD_NS)
+            g->hold_ns = g->hold_ns * 2 < MAX_HOLD_NS ? g->hold_ns * 2 : MAX_HOLD_NS;
+        else
+            g->hold_ns = SETTLE_NS;
+        g->up_ns = now + g->hold_ns;
+    } else {
+        g->raised_ns = now;
+    }
+    g->div       = div;
+    g->half      = half;
+    g->stuck     = 0;
+    g->settle_ns = now + SETTLE_NS;
+    pipeline_set_quality(g->p, div, half);
+
+    char state[64];
+    describe(g, state, sizeof(state));
+    fprintf(stderr, "\ngovernor: %.0f%% CPU (budget %.0f%%), screen %s: %s\n",
+            usage, g->budget, moving ? "moving" : "static", state);
+}
+
+void governor_free(governor_t *g)
+{
+    free(g);
+}
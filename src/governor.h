@@ -0,0 +1,33 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "pipeline.h"
+
+/*
+ * CPU budget governor (--cpu-budget).
+ *
+ * Once a second it compares the process's CPU time with a budget, in
+ * percent of one core, and steps the pipeline's quality down or back up
+ * (pipeline_set_quality) to stay within it.  Two knobs: the grab rate
+ * (every 2nd, 3rd, 4th frame, repeats in between) and half resolution.
+ * Which goes first depends on the screen: while it is static a lower
+ * rate loses nothing visible, so the rate drops first; while it moves,
+ * smooth motion matters more than sharpness, so the resolution does.
+ * Half resolution is only tried when conversion and encoding take a fair
+ * share of the stage time (pipeline_timing), since otherwise it saves
+ * little.  Stepping up runs the ladder in reverse, once usage is well
+ * below the budget, and every step is followed by a pause for the
+ * effect to show, so the governor does not oscillate.
+ */
+
+typedef struct governor governor_t;
+
+/* Watch pipeline p against budget_pct (1 .. 6400, percent of one core).  NULL on failure. */
+governor_t *governor_create(pipeline_t *p, int budget_pct);
+
+/* Call regularly from the main loop; acts at most once a second. */
+void governor_update(governor_t *g);
+
+void governor_free(governor_t *g);
+
+#endif /* GOVERNOR_H */
@@ -14,7 +14,12 @@
 
 #include "capture.h"
 #include "convert.h"
+#include "governor.h"
+#include "pipeline.h"
+#include "stats.h"
 #include "vcam.h"
+#include "vcam_net.h"
+#include "workers.h"
 
 static volatile sig_atomic_t running = 1;
 
@@ -33,6 +38,123 @@ static void on_signal(int sig)
 }
 #endif
 
+static double now_s(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Counters and timings of the pipeline since it started. */
+static void read_totals(const pipeline_t *p, stats_report_t *r)
+{
+    pacer_stats_t pacing;
+    pipeline_pacing(p, &pacing);
+    r->frames   = pipeline_frames(p);
+    r->repeated = pipeline_repeated(p);
+    r->dropped  = pipeline_dropped(p);
+    r->skipped  = pacing.skipped;
+    pipeline_timing(p, r->stage);
+}
+
+/* Turn the totals in r into what happened since prev. */
+static void make_interval(stats_report_t *r, const stats_report_t *prev, double seconds)
+{
+    r->seconds   = seconds;
+    r->frames   -= prev->frames;
+    r->repeated -= prev->repeated;
+    r->dropped  -= prev->dropped;
+    r->skipped  -= prev->skipped;
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stats_sub(&r->stage[i], &prev->stage[i]);
+}
+
+/* One --device: where it goes and what it overrides of the global options */
+typedef struct {
+    char      path[512];
+    int       fps;
+    int       width;    /* 0 = screen size */
+    int       height;
+    pix_fmt_t format;
+    codec_t   codec;
+} output_spec_t;
+
+static int parse_size(const char *s, int *w, int *h)
+{
+    int len = 0;
+    if (sscanf(s, "%dx%d%n", w, h, &len) != 2 || s[len] ||
+        *w < 16 || *h < 16 || *w > 8192 || *h > 8192 || (*w | *h) & 1) {
+        fprintf(stderr, "error: size must be WxH, even, 16-8192 (e.g. 1280x720)\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * PATH[,fps=N][,size=WxH][,format=F][,codec=C]; o holds the global
+ * options on entry.  Returns 0, or -1 after printing why not.
+ */
+static int parse_output(const char *spec, output_spec_t *o)
+{
+    size_t len = strcspn(spec, ",");
+    if (len == 0 || len >= sizeof(o->path)) {
+        fprintf(stderr, "error: bad device '%s'\n", spec);
+        return -1;
+    }
+    memcpy(o->path, spec, len);
+    o->path[len] = '\0';
+
+    for (const char *opt = spec + len; *opt == ','; ) {
+        opt++;
+        size_t n = strcspn(opt, ",");
+        char item[64];
+        if (n >= sizeof(item)) {
+            fprintf(stderr, "error: bad device option in '%s'\n", spec);
+            return -1;
+        }
+        memcpy(item, opt, n);
+        item[n] = '\0';
+        opt += n;
+
+        const char *val = strchr(item, '=');
+        if (!val) {
+            fprintf(stderr, "error: device option '%s' needs a value\n", item);
+            return -1;
+        }
+        val++;
+        if (strncmp(item, "fps=", 4) == 0) {
+            o->fps = atoi(val);
+        } else if (strncmp(item, "size=", 5) == 0) {
+            if (parse_size(val, &o->width, &o->height) < 0)
+                return -1;
+        } else if (strncmp(item, "format=", 7) == 0) {
+            if (pix_fmt_parse(val, &o->format) < 0) {
+                fprintf(stderr, "error: format must be yuv420p, nv12, yuyv, bgra, rgb24, rgba or auto\n");
+                return -1;
+            }
+        } else if (strncmp(item, "codec=", 6) == 0) {
+            if (codec_parse(val, &o->codec) < 0) {
+                fprintf(stderr, "error: codec must be raw, h264 or mjpeg\n");
+                return -1;
+            }
+        } else {
+            fprintf(stderr, "error: unknown device option '%s' "
+                            "(fps, size, format or codec)\n", item);
+            return -1;
+        }
+    }
+
+    if (o->fps < 1 || o->fps > 60) {
+        fprintf(stderr, "error: fps must be 1-60\n");
+        return -1;
+    }
+    if (vcam_net_is_url(o->path) && o->codec == CODEC_RAW) {
+        fprintf(stderr, "error: network output needs --codec h264 or mjpeg\n");
+        return -1;
+    }
+    return 0;
+}
+
 static void usage(const char *prog)
 {
     fprintf(stderr,
@@ -43,10 +165,53 @@ static void usage(const char *prog)
         "Options:\n"
 #if defined(_WIN32) || defined(__APPLE__)
         "  -d, --device PATH   output path or '-' for stdout  [-]\n"
+        "                      or rtp://HOST:PORT, srt://HOST:PORT (needs --codec)\n"
+#ifdef _WIN32
+        "                      or 'vcam' for the Windows 11 virtual camera\n"
+#endif
 #else
         "  -d, --device PATH   v4l2loopback device  [/dev/video10]\n"
+        "                      or rtp://HOST:PORT, srt://HOST:PORT (needs --codec)\n"
+        "                      or shm:NAME for local readers (shared memory)\n"
 #endif
+        "                      repeat for more outputs from one capture, each\n"
+        "                      optionally PATH,fps=N,size=WxH,format=F,codec=C\n"
         "  -f, --fps N         target frame rate     [15]\n"
+        "  -F, --format FMT    yuv420p, nv12, yuyv, bgra, rgb24, rgba or auto\n"
+        "                      [yuv420p]\n"
+        "  -e, --codec C       send 'raw' frames or encode them to 'h264' or\n"
+        "                      'mjpeg' (hardware where available)  [raw]\n"
+        "  -L, --latency MS    network output: time a frame may spend on the wire\n"
+        "                      (RTP pacing window, SRT receive buffer)  [40]\n"
+        "  -m, --monitor N     capture display N or the output with that name\n"
+#if !defined(_WIN32) && !defined(__APPLE__)
+        "                      (XRandR, e.g. HDMI-1)  [whole X screen]\n"
+#else
+        "                      [0]\n"
+#endif
+        "  -r, --region WxH+X+Y  capture only this part of the display/window\n"
+        "  -w, --window ID     capture one window (X11 id, CGWindowID or HWND)\n"
+#if !defined(_WIN32) && !defined(__APPLE__)
+        "  -c, --capture B     capture backend: 'x11' or 'pipewire' (Wayland,\n"
+        "                      picked in the portal dialog)  [by session]\n"
+#endif
+        "  -s, --size WxH      output size; the screen is scaled to fit,\n"
+        "                      letterboxed  [screen size]\n"
+        "  -t, --threads N     conversion threads    [physical cores - 1]\n"
+        "  -q, --queue N       frames queued between stages  [1]\n"
+        "  -p, --policy P      full queue: 'drop' oldest or 'block'  [drop]\n"
+        "  -P, --pace SRC      grab on the 'wall' clock or right after the source\n"
+        "                      presents a frame ('vsync')  [wall]\n"
+        "  -l, --late L        missed frame times: 'skip' them or 'catchup'  [skip]\n"
+        "  -G, --gpu MODE      convert/scale on the GPU if the capture backend can:\n"
+        "                      'auto' or 'off'  [auto]\n"
+        "  -C, --cursor MODE   draw the mouse pointer: 'on' or 'off'  [on]\n"
+        "  -S, --stats SEC     print fps, drops and per-stage timings every SEC\n"
+        "                      seconds  [off]\n"
+        "  -T, --stats-to DEST also send them to statsd://HOST:PORT or append\n"
+        "                      them as JSON lines to file DEST  [every 10 s]\n"
+        "  -B, --cpu-budget PCT  keep CPU use under PCT%% of one core by lowering\n"
+        "                      the grab rate or resolution as needed  [off]\n"
         "  -h, --help          show this help\n",
         prog);
 }
@@ -54,24 +219,190 @@ static void usage(const char *prog)
 int main(int argc, char *argv[])
 {
 #if defined(_WIN32) || defined(__APPLE__)
-    const char *device = "-";
+    const char *devices[PIPELINE_MAX_OUTPUTS] = { "-" };
 #else
-    const char *device = "/dev/video10";
+    const char *devices[PIPELINE_MAX_OUTPUTS] = { "/dev/video10" };
 #endif
+    int ndevices = 0;   /* 0 = the default above */
     int fps = 15;
+    int threads = 0;   /* 0 = auto */
+    int depth = 1;
+    ring_policy_t policy = RING_DROP_OLDEST;
+    pace_late_t late = PACE_SKIP;
+    int vsync = 0;
+    pix_fmt_t format = PIX_FMT_YUV420P;
+    codec_t codec = CODEC_RAW;
+    int latency_ms = 40;
+    int gpu = 1;
+    int cursor = 1;
+    int stats_sec = 0;             /* 0 = no periodic report */
+    const char *stats_to = NULL;
+    int cpu_budget = 0;            /* 0 = no governor */
+    int out_w = 0, out_h = 0;   /* 0 = screen size */
+    capture_target_t target = { .monitor = -1 };
 
     static struct option long_opts[] = {
-        { "device", required_argument, NULL, 'd' },
-        { "fps",    required_argument, NULL, 'f' },
-        { "help",   no_argument,       NULL, 'h' },
+        { "device",  required_argument, NULL, 'd' },
+        { "fps",     required_argument, NULL, 'f' },
+        { "format",  required_argument, NULL, 'F' },
+        { "codec",   required_argument, NULL, 'e' },
+        { "latency", required_argument, NULL, 'L' },
+        { "size",    required_argument, NULL, 's' },
+        { "monitor", required_argument, NULL, 'm' },
+        { "region",  required_argument, NULL, 'r' },
+        { "window",  required_argument, NULL, 'w' },
+        { "capture", required_argument, NULL, 'c' },
+        { "threads", required_argument, NULL, 't' },
+        { "queue",   required_argument, NULL, 'q' },
+        { "policy",  required_argument, NULL, 'p' },
+        { "pace",    required_argument, NULL, 'P' },
+        { "late",    required_argument, NULL, 'l' },
+        { "gpu",     required_argument, NULL, 'G' },
+        { "cursor",  required_argument, NULL, 'C' },
+        { "stats",   required_argument, NULL, 'S' },
+        { "stats-to", required_argument, NULL, 'T' },
+        { "cpu-budget", required_argument, NULL, 'B' },
+        { "help",    no_argument,       NULL, 'h' },
         { NULL, 0, NULL, 0 }
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "d:f:h", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:f:F:e:L:s:m:r:w:c:t:q:p:P:l:G:C:S:T:B:h", long_opts, NULL)) != -1) {
         switch (opt) {
-        case 'd': device = optarg; break;
+        case 'd':
+            if (ndevices == PIPELINE_MAX_OUTPUTS) {
+                fprintf(stderr, "error: at most %d devices\n", PIPELINE_MAX_OUTPUTS);
+                return 1;
+            }
+            devices[ndevices++] = optarg;
+            break;
         case 'f': fps = atoi(optarg); break;
+        case 'F':
+            if (pix_fmt_parse(optarg, &format) < 0) {
+                fprintf(stderr, "error: format must be yuv420p, nv12, yuyv, bgra, rgb24, rgba or auto\n");
+                return 1;
+            }
+            break;
+        case 'e':
+            if (codec_parse(optarg, &codec) < 0) {
+                fprintf(stderr, "error: codec must be raw, h264 or mjpeg\n");
+                return 1;
+            }
+            break;
+        case 'L': latency_ms = atoi(optarg); break;
+        case 's':
+            if (parse_size(optarg, &out_w, &out_h) < 0)
+                return 1;
+            break;
+        case 'm': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (*optarg && !*end) {
+                if (n < 0 || n > 63) {
+                    fprintf(stderr, "error: monitor must be 0-63 or an output name\n");
+                    return 1;
+                }
+                target.monitor = (int)n;
+            } else {
+                target.output = optarg;
+            }
+            break;
+        }
+        case 'r': {
+            dirty_rect_t *r = &target.region;
+            int len = 0;
+            if (sscanf(optarg, "%dx%d+%d+%d%n", &r->w, &r->h, &r->x, &r->y, &len) != 4 ||
+                optarg[len] || r->w < 16 || r->h < 16 || r->x < 0 || r->y < 0) {
+                fprintf(stderr, "error: region must be WxH+X+Y, size >= 16 "
+                                "(e.g. 1280x720+0+0)\n");
+                return 1;
+            }
+            break;
+        }
+        case 'w': {
+            char *end;
+            target.window = (uint64_t)strtoull(optarg, &end, 0);
+            if (!*optarg || *end || !target.window) {
+                fprintf(stderr, "error: window must be a non-zero id (decimal or 0x hex)\n");
+                return 1;
+            }
+            break;
+        }
+        case 'c':
+#if !defined(_WIN32) && !defined(__APPLE__)
+            if (strcmp(optarg, "x11") == 0 || strcmp(optarg, "pipewire") == 0) {
+                target.backend = optarg;
+                break;
+            }
+            fprintf(stderr, "error: capture must be 'x11' or 'pipewire'\n");
+#else
+            fprintf(stderr, "error: --capture is only available on Linux\n");
+#endif
+            return 1;
+        case 't': threads = atoi(optarg); break;
+        case 'q': depth = atoi(optarg); break;
+        case 'p':
+            if (strcmp(optarg, "drop") == 0) {
+                policy = RING_DROP_OLDEST;
+            } else if (strcmp(optarg, "block") == 0) {
+                policy = RING_BLOCK;
+            } else {
+                fprintf(stderr, "error: policy must be 'drop' or 'block'\n");
+                return 1;
+            }
+            break;
+        case 'P':
+            if (strcmp(optarg, "wall") == 0) {
+                vsync = 0;
+            } else if (strcmp(optarg, "vsync") == 0) {
+                vsync = 1;
+            } else {
+                fprintf(stderr, "error: pace must be 'wall' or 'vsync'\n");
+                return 1;
+            }
+            break;
+        case 'l':
+            if (strcmp(optarg, "skip") == 0) {
+                late = PACE_SKIP;
+            } else if (strcmp(optarg, "catchup") == 0) {
+                late = PACE_CATCHUP;
+            } else {
+                fprintf(stderr, "error: late must be 'skip' or 'catchup'\n");
+                return 1;
+            }
+            break;
+        case 'G':
+            if (strcmp(optarg, "auto") == 0) {
+                gpu = 1;
+            } else if (strcmp(optarg, "off") == 0) {
+                gpu = 0;
+            } else {
+                fprintf(stderr, "error: gpu must be 'auto' or 'off'\n");
+                return 1;
+            }
+            break;
+        case 'C':
+            if (strcmp(optarg, "on") == 0) {
+                cursor = 1;
+            } else if (strcmp(optarg, "off") == 0) {
+                cursor = 0;
+            } else {
+                fprintf(stderr, "error: cursor must be 'on' or 'off'\n");
+                return 1;
+            }
+            break;
+        case 'S': stats_sec = atoi(optarg); break;
+        case 'T': stats_to = optarg; break;
+        case 'B': {
+            char *end;
+            long n = strtol(optarg, &end, 10);
+            if (!*optarg || *end || n < 1 || n > 6400) {
+                fprintf(stderr, "error: cpu-budget must be 1-6400 (percent of one core)\n");
+                return 1;
+            }
+            cpu_budget = (int)n;
+            break;
+        }
         case 'h': usage(argv[0]); return 0;
         default:  usage(argv[0]); return 1;
         }
@@ -82,6 +413,46 @@ int main(int argc, char *argv[])
         return 1;
     }
 
+    if (threads == 0)
+        threads = workers_default_threads();
+    if (threads < 1 || threads > 64) {
+        fprintf(stderr, "error: threads must be 1-64\n");
+        return 1;
+    }
+
+    if (depth < 1 || depth > 8) {
+        fprintf(stderr, "error: queue must be 1-8\n");
+        return 1;
+    }
+
+    if (latency_ms < 0 || latency_ms > 10000) {
+        fprintf(stderr, "error: latency must be 0-10000 ms\n");
+        return 1;
+    }
+
+    if (stats_sec < 0 || stats_sec > 3600) {
+        fprintf(stderr, "error: stats must be 0-3600 seconds\n");
+        return 1;
+    }
+    if (stats_to && !stats_sec)
+        stats_sec = 10;
+
+    /* Global options are the defaults of every device */
+    output_spec_t specs[PIPELINE_MAX_OUTPUTS];
+    if (ndevices == 0)
+        ndevices = 1;
+    for (int i = 0; i < ndevices; i++) {
+        specs[i] = (output_spec_t){ .fps = fps, .width = out_w, .height = out_h,
+                                    .format = format, .codec = codec };
+        if (parse_output(devices[i], &specs[i]) < 0)
+            return 1;
+    }
+
+    if (target.window && (target.monitor >= 0 || target.output)) {
+        fprintf(stderr, "error: --window and --monitor cannot be combined\n");
+        return 1;
+    }
+
 #ifdef _WIN32
     SetConsoleCtrlHandler(on_console_ctrl, TRUE);
 #else
@@ -89,75 +460,143 @@ int main(int argc, char *argv[])
     signal(SIGTERM, on_signal);
 #endif
 
+    /* Select the fastest BGRA -> YUV kernel for this CPU */
+    convert_init();
+    if (convert_set_threads(threads) < 0)
+        return 1;
+
     /* Initialize screen capture */
-    capture_ctx_t *cap = capture_init();
-    if (!cap)
+    capture_ctx_t *cap = capture_init(&target);
+    if (!cap) {
+        convert_shutdown();
         return 1;
+    }
 
-    int w = capture_width(cap);
-    int h = capture_height(cap);
+    /* Open every output: encoder first, its input format replaces --format */
+    pipeline_output_t outputs[PIPELINE_MAX_OUTPUTS];
+    int nopen = 0;
+    for (; nopen < ndevices; nopen++) {
+        const output_spec_t *o = &specs[nopen];
+        pipeline_output_t *out = &outputs[nopen];
 
-    /* Open virtual camera */
-    vcam_ctx_t *cam = vcam_open(device, w, h);
-    if (!cam) {
-        capture_free(cap);
-        return 1;
+        /* Odd screen sizes get a 1-pixel bar: 4:2:0 consumers want even ones */
+        out->width   = o->width  ? o->width  : (capture_width(cap) + 1) & ~1;
+        out->height  = o->height ? o->height : (capture_height(cap) + 1) & ~1;
+        out->fps     = o->fps;
+        out->encoder = NULL;
+        if (o->codec != CODEC_RAW) {
+            out->encoder = encoder_open(o->codec, out->width, out->height, o->fps);
+            if (!out->encoder)
+                break;
+        }
+        out->cam = out->encoder
+                 ? vcam_open_coded(o->path, out->width, out->height, o->codec, o->fps, latency_ms)
+                 : vcam_open(o->path, out->width, out->height, o->format);
+        if (!out->cam) {
+            encoder_close(out->encoder);
+            break;
+        }
+        fprintf(stderr, "screen2cam: streaming %dx%d @ %d fps -> %s\n",
+                out->width, out->height, out->fps, o->path);
     }
 
-    /* Allocate YUV buffer */
-    size_t yuv_size = (size_t)w * h * 3 / 2;
-    uint8_t *yuv_buf = malloc(yuv_size);
-    if (!yuv_buf) {
-        perror("malloc");
-        vcam_close(cam);
+    pipeline_config_t cfg = {
+        .outputs  = outputs,
+        .noutputs = nopen,
+        .depth  = depth,
+        .policy = policy,
+        .late   = late,
+        .vsync  = vsync,
+        .capture_convert = gpu,
+        .cursor = cursor,
+    };
+
+    /* Start capture / convert / output threads */
+    stats_sink_t *sink = NULL;
+    pipeline_t *pipeline = NULL;
+    governor_t *governor = NULL;
+    if (nopen == ndevices) {
+        fprintf(stderr, "screen2cam: press Ctrl+C to stop\n");
+        sink = stats_to ? stats_sink_open(stats_to) : NULL;
+        if (!stats_to || sink)
+            pipeline = pipeline_start(cap, &cfg);
+    }
+    if (pipeline && cpu_budget) {
+        governor = governor_create(pipeline, cpu_budget);
+        if (!governor) {
+            pipeline_stop(pipeline);
+            pipeline = NULL;
+        }
+    }
+    if (!pipeline) {
+        stats_sink_close(sink);
+        for (int i = 0; i < nopen; i++) {
+            vcam_close(outputs[i].cam);
+            encoder_close(outputs[i].encoder);
+        }
         capture_free(cap);
+        convert_shutdown();
         return 1;
     }
 
-    long frame_ns = 1000000000L / fps;
-    unsigned long frames = 0;
-
-    fprintf(stderr, "screen2cam: streaming %dx%d @ %d fps -> %s\n", w, h, fps, device);
-    fprintf(stderr, "screen2cam: press Ctrl+C to stop\n");
-
-    while (running) {
-        struct timespec t0;
-        clock_gettime(CLOCK_MONOTONIC, &t0);
-
-        /* Grab screen */
-        const uint8_t *bgra = capture_grab(cap);
-        if (!bgra) {
-            fprintf(stderr, "screen2cam: capture failed, retrying...\n");
-            usleep(100000);
+    double start = now_s(), last = start;
+    stats_report_t prev = {0}, report;
+    while (running && pipeline_ok(pipeline)) {
+        usleep(20000);
+        if (pipeline_lost(pipeline))
+            pipeline_renegotiate(pipeline);   /* keeps polling until it is back */
+        else if (governor)
+            governor_update(governor);
+        if (!stats_sec || now_s() - last < stats_sec)
             continue;
-        }
-
-        /* Convert BGRA -> YUV420P */
-        bgra_to_yuv420p(bgra, yuv_buf, w, h);
 
-        /* Write to virtual camera */
-        if (vcam_write(cam, yuv_buf, yuv_size) < 0)
-            break;
+        double now = now_s();
+        read_totals(pipeline, &report);
+        stats_report_t totals = report;
+        make_interval(&report, &prev, now - last);
+        stats_print(&report);
+        if (sink)
+            stats_sink_send(sink, &report);
+        prev = totals;
+        last = now;
+    }
 
-        frames++;
-        if (frames % (unsigned long)fps == 0)
-            fprintf(stderr, "\rscreen2cam: %lu frames sent", frames);
-
-        /* Sleep to maintain target fps */
-        struct timespec t1;
-        clock_gettime(CLOCK_MONOTONIC, &t1);
-        long elapsed = (t1.tv_sec - t0.tv_sec) * 1000000000L + (t1.tv_nsec - t0.tv_nsec);
-        long remaining = frame_ns - elapsed;
-        if (remaining > 0) {
-            struct timespec ts = { .tv_sec = 0, .tv_nsec = remaining };
-            nanosleep(&ts, NULL);
-        }
+    unsigned long frames   = (unsigned long)pipeline_frames(pipeline);
+    unsigned long repeated = (unsigned long)pipeline_repeated(pipeline);
+    unsigned long dropped  = (unsigned long)pipeline_dropped(pipeline);
+    pacer_stats_t pacing;
+    pipeline_pacing(pipeline, &pacing);
+    if (stats_sec) {
+        read_totals(pipeline, &report);
+        report.seconds = now_s() - start;
     }
 
-    fprintf(stderr, "\nscreen2cam: stopping (%lu frames total)\n", frames);
+    unsigned long per_output[PIPELINE_MAX_OUTPUTS];
+    for (int i = 0; i < nopen; i++)
+        per_output[i] = (unsigned long)pipeline_output_frames(pipeline, i);
+    governor_free(governor);
+    pipeline_stop(pipeline);
 
-    free(yuv_buf);
-    vcam_close(cam);
+    fprintf(stderr, "\nscreen2cam: stopping (%lu frames total, %lu unchanged, %lu dropped)\n",
+            frames, repeated, dropped);
+    for (int i = 0; i < nopen && nopen > 1; i++)
+        fprintf(stderr, "screen2cam: %s: %lu frames\n", specs[i].path, per_output[i]);
+    if (pacing.ticks)
+        fprintf(stderr, "screen2cam: pacing: woke %.2f ms late on average, %.2f ms at worst, "
+                        "%lu frame times skipped\n",
+                pacing.late_sum_ns / 1e6 / (double)pacing.ticks, pacing.late_max_ns / 1e6,
+                (unsigned long)pacing.skipped);
+    if (stats_sec) {
+        fprintf(stderr, "screen2cam: whole run:\n");
+        stats_print(&report);
+    }
+    stats_sink_close(sink);
+
+    for (int i = 0; i < nopen; i++) {
+        vcam_close(outputs[i].cam);
+        encoder_close(outputs[i].encoder);
+    }
     capture_free(cap);
+    convert_shutdown();
     return 0;
 }
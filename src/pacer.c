@@ -0,0 +1,178 @@
+/*
+ * Frame pacing on absolute deadlines (see pacer.h).
+ */
+
+#include "pacer.h"
+
+#include <errno.h>
+#include <time.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#include <mmsystem.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#elif defined(__APPLE__)
+#include <mach/mach_time.h>
+#endif
+
+/* ── Clock and sleep, per platform ─────────────────────────── */
+
+#ifdef _WIN32
+
+uint64_t pacer_now_ns(void)
+{
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000000u +
+           (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000000u / (uint64_t)freq.QuadPart;
+}
+
+/*
+ * High-resolution timers exist since Windows 10 1803.  Before that, a
+ * plain timer plus timeBeginPeriod(1) still gets about 1 ms.
+ */
+static void timer_open(pacer_t *p)
+{
+    p->timer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION,
+                                      TIMER_ALL_ACCESS);
+    if (!p->timer) {
+        timeBeginPeriod(1);
+        p->timer = CreateWaitableTimerExW(NULL, NULL, 0, TIMER_ALL_ACCESS);
+        if (!p->timer)
+            timeEndPeriod(1);
+        else
+            p->period = 1;
+    }
+}
+
+static void timer_close(pacer_t *p)
+{
+    if (!p->timer)
+        return;
+    CloseHandle(p->timer);
+    if (p->period)
+        timeEndPeriod(1);
+    p->timer = NULL;
+}
+
+static void sleep_for(pacer_t *p, uint64_t ns)
+{
+    if (!p->timer) {
+        Sleep((DWORD)((ns + 999999) / 1000000));
+        return;
+    }
+    /* Relative due time in 100 ns units: the deadline itself stays absolute */
+    LARGE_INTEGER due;
+    due.QuadPart = -(LONGLONG)((ns + 99) / 100);
+    if (SetWaitableTimer(p->timer, &due, 0, NULL, NULL, FALSE))
+        WaitForSingleObject(p->timer, INFINITE);
+}
+
+#elif defined(__APPLE__)
+
+static mach_timebase_info_data_t timebase;
+
+uint64_t pacer_now_ns(void)
+{
+    if (!timebase.denom)
+        mach_timebase_info(&timebase);
+    uint64_t t = mach_absolute_time();
+    return t / timebase.denom * timebase.numer +
+           t % timebase.denom * timebase.numer / timebase.denom;
+}
+
+static void timer_open(pacer_t *p)  { (void)p; }
+static void timer_close(pacer_t *p) { (void)p; }
+
+#else
+
+uint64_t pacer_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void timer_open(pacer_t *p)  { (void)p; }
+static void timer_close(pacer_t *p) { (void)p; }
+
+#endif
+
+void pacer_sleep_until(pacer_t *p, uint64_t deadline_ns)
+{
+#ifdef _WIN32
+    uint64_t now = pacer_now_ns();
+    if (deadline_ns > now)
+        sleep_for(p, deadline_ns - now);
+#elif defined(__APPLE__)
+    (void)p;
+    if (!timebase.denom)
+        mach_timebase_info(&timebase);
+    uint64_t t = deadline_ns / timebase.numer * timebase.denom +
+                 deadline_ns % timebase.numer * timebase.denom / timebase.numer;
+    mach_wait_until(t);
+#else
+    (void)p;
+    struct timespec ts = {
+        .tv_sec  = (time_t)(deadline_ns / 1000000000u),
+        .tv_nsec = (long)(deadline_ns % 1000000000u),
+    };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+#endif
+}
+
+/* ── Ticks ─────────────────────────────────────────────────── */
+
+int pacer_init(pacer_t *p, int fps, pace_late_t late)
+{
+    if (fps <= 0)
+        return -1;
+    *p = (pacer_t){
+        .interval_ns = 1000000000u / (uint64_t)fps,
+        .next_ns     = pacer_now_ns(),
+        .late        = late,
+    };
+    timer_open(p);
+    return 0;
+}
+
+void pacer_free(pacer_t *p)
+{
+    timer_close(p);
+}
+
+uint64_t pacer_wait(pacer_t *p)
+{
+    uint64_t deadline = p->next_ns;
+    uint64_t now = pacer_now_ns();
+    if (now < deadline) {
+        pacer_sleep_until(p, deadline);
+        now = pacer_now_ns();
+    }
+
+    uint64_t late = now > deadline ? now - deadline : 0;
+    p->stats.ticks++;
+    p->stats.late_sum_ns += late;
+    if (late > p->stats.late_max_ns)
+        p->stats.late_max_ns = late;
+
+    /* Missed whole ticks: skip them, or leave them due (a second at most) */
+    p->next_ns += p->interval_ns;
+    if (now >= p->next_ns) {
+        uint64_t missed = (now - p->next_ns) / p->interval_ns + 1;
+        if (p->late == PACE_SKIP || missed * p->interval_ns > 1000000000u) {
+            p->next_ns += missed * p->interval_ns;
+            p->stats.skipped += missed;
+        }
+    }
+    return deadline;
+}
@@ -0,0 +1,59 @@
+#ifndef PACER_H
+#define PACER_H
+
+#include <stdint.h>
+
+/*
+ * Frame pacing on absolute deadlines.
+ *
+ * Tick n is due at start + n * interval, so an oversleep or a slow grab
+ * delays that one frame but never shifts the ones after it.  The sleep
+ * itself is the most precise absolute wait each platform has:
+ * clock_nanosleep(TIMER_ABSTIME) on Linux, mach_wait_until() on macOS and
+ * a high-resolution waitable timer on Windows (Sleep() there rounds to
+ * the 15.6 ms scheduler tick).
+ *
+ * A tick that is missed by more than a whole interval (the capture took
+ * too long, the machine was suspended) is either skipped, keeping the
+ * phase, or caught up by returning the late ticks back to back.
+ */
+
+typedef enum {
+    PACE_SKIP,      /* drop missed ticks: fps can dip, frames stay evenly spaced */
+    PACE_CATCHUP    /* run missed ticks at once (up to a second's worth):
+                       the frame count per second stays exact */
+} pace_late_t;
+
+typedef struct {
+    uint64_t ticks;       /* deadlines served */
+    uint64_t skipped;     /* deadlines given up */
+    uint64_t late_sum_ns; /* wake-up time past the deadline, summed over ticks */
+    uint64_t late_max_ns;
+} pacer_stats_t;
+
+typedef struct {
+    uint64_t      interval_ns;
+    uint64_t      next_ns;     /* deadline of the next tick (pacer_now_ns clock) */
+    pace_late_t   late;
+    pacer_stats_t stats;
+    void         *timer;       /* Windows: waitable timer HANDLE */
+    int           period;      /* Windows: timeBeginPeriod(1) taken */
+} pacer_t;
+
+/* Monotonic clock the deadlines are on, in nanoseconds. */
+uint64_t pacer_now_ns(void);
+
+/* First tick is due now.  Returns 0, or -1 if fps <= 0. */
+int  pacer_init(pacer_t *p, int fps, pace_late_t late);
+void pacer_free(pacer_t *p);
+
+/* Sleep until deadline_ns (pacer_now_ns clock); returns at once if it passed. */
+void pacer_sleep_until(pacer_t *p, uint64_t deadline_ns);
+
+/*
+ * Sleep until the next tick is due and move on to the one after.
+ * Returns the deadline that was waited for.
+ */
+uint64_t pacer_wait(pacer_t *p);
+
+#endif /* PACER_H */
@@ -0,0 +1,1264 @@
+/*
+ * Streaming pipeline
+ *
+ *   capture thread ──raw ring──> convert thread ──yuv ring──> output thread
+ *   (paced at fps)   BGRA          frame_convert     YUV        vcam_write
+ *
+ * With several outputs (-d given more than once) the rings fan out
+ * (fanout.h): one capture feeds one convert thread per distinct output
+ * format and size, and each of those feeds one output thread per device
+ * using it.  Frames are shared by reference, not copied, and every
+ * consumer has a ring of its own, so a slow device only drops its own
+ * frames.  The capture runs at the highest output rate; slower outputs
+ * take every n-th frame, decimated where their branch splits off.
+ *
+ * The capture thread grabs on absolute deadlines (pacer.h), so a slow
+ * grab delays one frame without dragging the schedule after it.  With
+ * vsync pacing it waits past each deadline for the source's next
+ * presented frame (at most half an interval), so grabs stay in phase
+ * with the compositor instead of beating against its refresh.
+ *
+ * The YUV layout (I420, NV12, YUYV) is whatever vcam_format() settled on
+ * for each output.
+ *
+ * When an output lends out its own buffers (vcam_acquire, e.g. V4L2
+ * mmap streaming) the last two stages merge: one thread converts straight
+ * into the buffer the consumer reads and submits it, with no yuv ring.
+ * Such an output gets a conversion of its own.
+ *
+ * When the capture backend can deliver frames already in the output
+ * format (capture_set_format, e.g. D3D11 on Windows) there is nothing
+ * left to convert: the convert stage is skipped and the outputs read the
+ * raw ring directly.  That needs a single output format and size.
+ *
+ * capture_grab()'s buffer is only valid until the next grab, so the
+ * capture thread copies it into a preallocated ring buffer.  That is what
+ * lets grab N+1 overlap with conversion and output of frame N.  Backends
+ * that can lend out their frames (capture_acquire, e.g. ScreenCaptureKit)
+ * skip that copy: the raw ring then carries only buffer indices, each
+ * with a borrowed frame that the converters read in place and the last
+ * of them releases.
+ *
+ * Both the copy and the conversion are incremental.  The capture thread
+ * stamps the tiles each frame changed (capture_dirty_rects) into a tile
+ * map, and every ring buffer remembers which frame its contents are
+ * current with.  Bringing a buffer up to date therefore touches only the
+ * tiles changed since then, however many frames were dropped in between,
+ * and CPU cost follows screen activity instead of resolution.
+ *
+ * A frame the backend reports as unchanged keeps the previous sequence
+ * number.  It still travels down the rings so the output keeps its frame
+ * rate, but once every buffer has caught up there is nothing to copy or
+ * convert, and the output stage hands it to vcam_repeat() instead of
+ * vcam_write().
+ *
+ * An output size other than the screen's (pipeline_output_t width/height)
+ * is scaled by the capture backend when it can (capture_set_size, e.g.
+ * ScreenCaptureKit or the D3D11 shader) if it is the only size, otherwise
+ * by the converter in the same pass as the conversion (frame_scale_convert).  The picture keeps
+ * its aspect ratio; the bars around it are painted once per buffer and
+ * never touched again.
+ *
+ * With an encoder (pipeline_output_t encoder, --codec) the output stage
+ * compresses each frame (encoder_encode) and hands the packet to
+ * vcam_write_packet().  The YUV layout is then the encoder's input
+ * format, and the direct path is not used since packets, not frames, go
+ * to the device.
+ *
+ * Frames travel as frame_t descriptors (pixfmt.h), so a borrowed capture
+ * buffer or an output buffer with padded rows is read and written as it
+ * is; only ring buffers of our own are tightly packed.
+ *
+ * When the source changes under the capture (a display mode change, a
+ * resized window, lost DXGI access) the capture thread stops and flags
+ * it.  pipeline_renegotiate() then joins the other stages, has the
+ * backend re-open the target at its new size (capture_reset) and builds
+ * rings, tile maps and scalers again around it.  Outputs keep their
+ * size and format, since consumers of a V4L2 device or a shared-memory
+ * camera cannot follow a format change mid-stream; the new screen is
+ * scaled and letterboxed into it instead.  Counters and timings carry
+ * on across the switch.  Ring buffers come from the frame pool (pool.h):
+ * the old rings' buffers are reused by the new ones where they fit, and
+ * only the rest is unmapped.
+ *
+ * Backends that keep the pointer out of their frames (capture_cursor:
+ * X11 with XFixes, DXGI) get it drawn over the outputs instead, with
+ * cfg.cursor.  The capture thread only notes where it is and which
+ * shape it has, per raw buffer; a move bumps the frame number but marks
+ * no tiles.  Each converter then redoes just the tiles under where it
+ * drew the pointer into that buffer before and blends it in at its new
+ * place (frame_blend_cursor), so the pointer moving costs a cursor-sized
+ * conversion instead of a full frame, and dirty rects and unchanged-frame
+ * repeats stay exact while it sits still.  Passthrough frames get it in
+ * the raw buffer instead, the old spot restored from the capture.
+ *
+ * Two knobs trade quality for CPU at run time (pipeline_set_quality, used
+ * by the --cpu-budget governor).  A rate divider has the capture thread
+ * grab only every n-th tick and publish the previous frame again on the
+ * others, so outputs still see their full frame rate, only as repeats.
+ * Half resolution has each converter scale into a frame of half the
+ * output size and enlarge that 2x into the output buffer: the output
+ * format and size stay what the consumers negotiated.
+ *
+ * Every stage times its work into a histogram (stats.h): the grab, the
+ * conversion of frames that changed, the encode and the write, and how
+ * long each frame took from capture to being handed to the output.
+ */
+
+#include "pipeline.h"
+#include "convert.h"
+#include "fanout.h"
+#include "pool.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include "platform.h"
+#else
+#include <unistd.h>
+#endif
+
+typedef struct branch branch_t;
+
+/* What of the pointer is drawn into a buffer, or was over a frame */
+typedef struct {
+    int              visible;
+    dirty_rect_t     box;        /* captured-frame coordinates */
+    uint32_t         serial;     /* capture_cursor_t serial of its image */
+} cursor_mark_t;
+
+/* The pointer as of one captured frame (capture_cursor) */
+typedef struct {
+    cursor_mark_t    mark;
+    pool_buf_t      *image;      /* BGRA; one reference per holder */
+    int              image_w;
+    int              image_h;
+} cursor_t;
+
+/* One output and its output thread */
+typedef struct {
+    pipeline_t       *p;
+    pipeline_output_t out;
+    int               index;     /* in cfg.outputs */
+    pix_fmt_t         format;    /* vcam_format(cam), or encoder_format(encoder) */
+    branch_t         *branch;    /* where it gets its frames */
+    int               consumer;  /* its place in the ring it reads */
+    atomic_int        failed;
+    atomic_ullong     frames;
+    atomic_ullong     repeated;
+} sink_t;
+
+/* Outputs sharing one conversion: same format and size */
+struct branch {
+    pipeline_t      *p;
+    pix_fmt_t        format;
+    int              width;
+    int              height;
+    int              fps;        /* the highest of its sinks' */
+    size_t           frame_size;
+    int              direct;     /* its one sink lends buffers (vcam_acquire) */
+    int              consumer;   /* its place in the raw fanout */
+    sink_t          *sinks[PIPELINE_MAX_OUTPUTS];
+    int              nsinks;
+
+    dirty_rect_t     area;       /* where captured frames go in the output frame */
+    int              letterbox;  /* area is smaller than the output frame */
+    scaler_t        *scaler;     /* CPU scaling; NULL if sizes already match */
+    fanout_t        *yuv;        /* convert -> sinks; NULL when not needed */
+    frame_t         *yuv_frames; /* per yuv buffer */
+    uint32_t        *yuv_seq;    /* per yuv buffer or vcam buffer: frame its planes match */
+    dirty_rect_t    *convert_rects;  /* dirty_map_max_rects() + 1 for the pointer */
+    cursor_mark_t   *yuv_drawn;  /* per yuv buffer or vcam buffer: pointer drawn in it */
+    int              nyuv;       /* entries in yuv_frames, yuv_seq, yuv_drawn */
+
+    /* Half resolution (pipeline_set_quality): area at half size here,
+     * upscaled into the output frame */
+    int              half;       /* converting that way now */
+    frame_t          half_frame;
+    pool_buf_t      *half_buf;
+    scaler_t        *half_scaler;
+    uint32_t         half_seq;   /* frame half_frame matches */
+};
+
+struct pipeline {
+    capture_ctx_t   *cap;
+    pipeline_config_t cfg;
+    int              fps;      /* capture rate: the highest output's */
+    sink_t           sinks[PIPELINE_MAX_OUTPUTS];
+    int              nsinks;
+    branch_t         branches[PIPELINE_MAX_OUTPUTS];
+    int              nbranches;
+    int              native;   /* capture delivers branches[0]'s format itself */
+    int              borrow;   /* raw buffers hold capture_frame_t, not pixels */
+    int              passthrough;  /* native frames need no convert stage */
+    int              src_w;    /* size of the captured frames */
+    int              src_h;
+
+    fanout_t        *raw;      /* capture -> branches (or sinks, passthrough) */
+
+    /* Incremental update state (see dirty.h) */
+    dirty_map_t      changed;    /* capture thread: last change per tile */
+    dirty_map_t     *raw_maps;   /* per raw buffer: `changed` as of its frame */
+    capture_frame_t *raw_frames; /* per raw buffer: its frame (borrowed or own data) */
+    uint32_t        *raw_seq;    /* per raw buffer: frame its pixels match */
+    dirty_rect_t    *capture_rects;
+
+    /* Pointer overlay (cfg.cursor): drawn over the outputs, not captured */
+    int              overlay;    /* the backend reports it apart */
+    cursor_t         cursor;     /* capture thread: the latest */
+    cursor_t        *raw_cursor; /* per raw buffer: as of its frame */
+    cursor_mark_t   *raw_drawn;  /* per raw buffer: drawn in it (passthrough) */
+
+    pthread_t        threads[1 + 2 * PIPELINE_MAX_OUTPUTS];
+    int              started;  /* threads successfully created */
+
+    atomic_int       stop;
+    atomic_int       failed;
+    atomic_int       dead;     /* sinks that failed */
+    atomic_int       lost;     /* capture_lost(): pipeline_renegotiate() */
+
+    /* Carried over from before the last renegotiation */
+    uint64_t         dropped_base;
+    pacer_stats_t    pace_base;
+    uint64_t         lost_ns;    /* when the stages were torn down */
+    uint64_t         retry_ns;   /* next capture_reset() attempt, 0 = now */
+
+    /* pacer_stats_t of the capture thread, readable from any thread */
+    atomic_ullong    pace_ticks;
+    atomic_ullong    pace_skipped;
+    atomic_ullong    pace_late_sum;
+    atomic_ullong    pace_late_max;
+
+    stats_hist_t     timing[STAGE_COUNT];
+
+    /* pipeline_set_quality() knobs, and pipeline_activity() counters */
+    atomic_int       rate_div;
+    atomic_int       half_res;
+    atomic_ullong    px_changed;
+    atomic_ullong    px_grabbed;
+};
+
+/* ── Stage threads ─────────────────────────────────────────── */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* Describe a ring buffer's own (packed) pixels, once per buffer. */
+static frame_t *buffer_frame(frame_t *f, uint8_t *data, pix_fmt_t fmt,
+                             int width, int height)
+{
+    if (f->planes[0] != data)
+        frame_init(f, fmt, width, height, data);
+    return f;
+}
+
+/*
+ * Copy only the tiles of src that changed since buffer buf's frame.
+ * Returns how many regions that was (native frames: 1 = all of it).
+ */
+static int update_raw_buffer(pipeline_t *p, const frame_t *src, int buf)
+{
+    frame_t *dst = buffer_frame(&p->raw_frames[buf].frame, fanout_data(p->raw, buf),
+                                p->native ? p->branches[0].format : PIX_FMT_BGRA,
+                                p->src_w, p->src_h);
+    int n = dirty_map_since(&p->changed, p->raw_seq[buf], p->capture_rects);
+
+    /* Converted frames have no per-tile layout worth chasing */
+    if (p->native) {
+        if (n > 0)
+            frame_copy(dst, src);
+        return n;
+    }
+
+    size_t stride = dst->strides[0];
+    for (int i = 0; i < n; i++) {
+        const dirty_rect_t *r = &p->capture_rects[i];
+        uint8_t *out = dst->planes[0] + (size_t)r->y * stride + (size_t)r->x * 4;
+        const uint8_t *in = src->planes[0] + (size_t)r->y * src->strides[0] + (size_t)r->x * 4;
+
+        if (r->w == p->src_w && src->strides[0] == stride) {
+            memcpy(out, in, stride * r->h);
+            continue;
+        }
+        for (int j = 0; j < r->h; j++, out += stride, in += src->strides[0])
+            memcpy(out, in, (size_t)r->w * 4);
+    }
+    return n;
+}
+
+/* The last converter done with a borrowed frame hands it back. */
+static void release_raw(void *arg, int buf)
+{
+    pipeline_t *p = arg;
+    capture_frame_release(&p->raw_frames[buf]);
+}
+
+static void publish_pacing(pipeline_t *p, const pacer_stats_t *s)
+{
+    const pacer_stats_t *b = &p->pace_base;
+    uint64_t late_max = s->late_max_ns > b->late_max_ns ? s->late_max_ns : b->late_max_ns;
+    atomic_store_explicit(&p->pace_ticks, b->ticks + s->ticks, memory_order_relaxed);
+    atomic_store_explicit(&p->pace_skipped, b->skipped + s->skipped, memory_order_relaxed);
+    atomic_store_explicit(&p->pace_late_sum, b->late_sum_ns + s->late_sum_ns,
+                          memory_order_relaxed);
+    atomic_store_explicit(&p->pace_late_max, late_max, memory_order_relaxed);
+}
+
+/* ── Pointer overlay ──────────────────────────────────────── */
+
+static int same_cursor(const cursor_mark_t *a, const cursor_mark_t *b)
+{
+    if (a->visible != b->visible)
+        return 0;
+    return !a->visible || (a->serial == b->serial &&
+                           a->box.x == b->box.x && a->box.y == b->box.y &&
+                           a->box.w == b->box.w && a->box.h == b->box.h);
+}
+
+static void cursor_set(cursor_t *dst, const cursor_t *src)
+{
+    if (src->image)
+        pool_ref(src->image);
+    pool_put(dst->image);
+    *dst = *src;
+}
+
+/*
+ * Where a drawn pointer has to be undone: its box on the frame, with a
+ * margin for scaling and widened to even coordinates as the converters
+ * need.  Returns 0 if nothing of it is on the frame.
+ */
+static int cursor_area(const pipeline_t *p, const cursor_mark_t *m, dirty_rect_t *out)
+{
+    int x0 = (m->box.x - 2) & ~1, y0 = (m->box.y - 2) & ~1;
+    int x1 = (m->box.x + m->box.w + 3) & ~1, y1 = (m->box.y + m->box.h + 3) & ~1;
+    if (x0 < 0) x0 = 0;
+    if (y0 < 0) y0 = 0;
+    if (x1 > p->src_w) x1 = p->src_w;
+    if (y1 > p->src_h) y1 = p->src_h;
+    if (!m->visible || x1 <= x0 || y1 <= y0)
+        return 0;
+    *out = (dirty_rect_t){ x0, y0, x1 - x0, y1 - y0 };
+    return 1;
+}
+
+static int overlaps(const dirty_rect_t *a, const dirty_rect_t *b)
+{
+    return a->x < b->x + b->w && b->x < a->x + a->w &&
+           a->y < b->y + b->h && b->y < a->y + a->h;
+}
+
+/*
+ * Add r to the n rects, growing it over every rect it overlaps instead of
+ * adding an overlap: rects are converted in parallel, and two workers
+ * must never write the same output bytes.  Returns the new count.
+ */
+static int add_rect(dirty_rect_t *rects, int n, dirty_rect_t r)
+{
+    for (int i = 0; i < n; ) {
+        if (!overlaps(&rects[i], &r)) {
+            i++;
+            continue;
+        }
+        int x1 = r.x + r.w > rects[i].x + rects[i].w ? r.x + r.w : rects[i].x + rects[i].w;
+        int y1 = r.y + r.h > rects[i].y + rects[i].h ? r.y + r.h : rects[i].y + rects[i].h;
+        r.x = r.x < rects[i].x ? r.x : rects[i].x;
+        r.y = r.y < rects[i].y ? r.y : rects[i].y;
+        r.w = x1 - r.x;
+        r.h = y1 - r.y;
+        rects[i] = rects[--n];
+        i = 0;   /* the grown rect may now overlap earlier ones */
+    }
+    rects[n++] = r;
+    return n;
+}
+
+/* Draw cursor c over frame pic, whose area maps the captured frame. */
+static void draw_cursor(const pipeline_t *p, const cursor_t *c, frame_t *pic)
+{
+    if (!c->mark.visible || !c->image)
+        return;
+    double sx = (double)pic->width / p->src_w, sy = (double)pic->height / p->src_h;
+    const dirty_rect_t *b = &c->mark.box;
+    int x0 = (int)floor(b->x * sx), y0 = (int)floor(b->y * sy);
+    int x1 = (int)ceil((b->x + b->w) * sx), y1 = (int)ceil((b->y + b->h) * sy);
+    dirty_rect_t box = { x0, y0, x1 - x0, y1 - y0 };
+    frame_blend_cursor(pic, &box, c->image->data, c->image_w, c->image_h);
+}
+
+/*
+ * Read the pointer into p->cursor.  Returns non-zero if it moved, changed
+ * shape, or came or went since the last frame: a new frame even when no
+ * pixel of the screen changed.
+ */
+static int track_cursor(pipeline_t *p)
+{
+    capture_cursor_t c;
+    if (capture_cursor(p->cap, &c) < 0)
+        c.visible = 0;
+
+    cursor_t *cur = &p->cursor;
+    if (c.visible && (!cur->image || c.serial != cur->mark.serial)) {
+        /* A new shape gets a buffer of its own: frames in flight keep theirs */
+        pool_buf_t *img = pool_get((size_t)c.image_w * c.image_h * 4);
+        if (img) {
+            memcpy(img->data, c.image, (size_t)c.image_w * c.image_h * 4);
+            pool_put(cur->image);
+            cur->image   = img;
+            cur->image_w = c.image_w;
+            cur->image_h = c.image_h;
+        } else {
+            c.visible = 0;
+        }
+    }
+
+    cursor_mark_t m = { c.visible, c.box, c.serial };
+    if (!c.visible)
+        m = (cursor_mark_t){ .serial = cur->image ? cur->mark.serial : 0 };
+    int changed = !same_cursor(&m, &cur->mark);
+    cur->mark = m;
+    return changed;
+}
+
+/*
+ * Passthrough: the outputs read raw buffer buf as it is, so the pointer
+ * is drawn into it.  n is what update_raw_buffer() copied from src.
+ */
+static void draw_raw_cursor(pipeline_t *p, const frame_t *src, int buf, int n)
+{
+    cursor_mark_t *drawn = &p->raw_drawn[buf];
+    frame_t *dst = &p->raw_frames[buf].frame;
+    dirty_rect_t r;
+
+    if (n > 0)
+        drawn->visible = 0;   /* copied over whole */
+    if (same_cursor(drawn, &p->cursor.mark))
+        return;
+    if (cursor_area(p, drawn, &r)) {
+        frame_t from, to;
+        frame_crop(src, r.x, r.y, r.w, r.h, &from);
+        frame_crop(dst, r.x, r.y, r.w, r.h, &to);
+        frame_copy(&to, &from);
+    }
+    draw_cursor(p, &p->cursor, dst);
+    *drawn = p->cursor.mark;
+}
+
+static void *capture_main(void *arg)
+{
+    pipeline_t *p = arg;
+    pacer_t pacer;
+    int vsync = p->cfg.vsync;
+    uint32_t seq = 0;
+
+    uint64_t tick = 0;
+
+    pacer_init(&pacer, p->fps, p->cfg.late);
+    while (!atomic_load(&p->stop)) {
+        pacer_wait(&pacer);
+        publish_pacing(p, &pacer.stats);
+
+        /* Outputs slower than the capture skip this one, or all failed */
+        unsigned due = fanout_due(p->raw);
+        if (!due)
+            continue;
+
+        /* At a reduced rate the ticks in between repeat the last frame, so
+         * outputs (and encoders' timestamps) keep their nominal fps.  A
+         * borrowed frame already handed back is grabbed anew instead. */
+        int div = atomic_load_explicit(&p->rate_div, memory_order_relaxed);
+        if (tick++ % (uint64_t)div != 0) {
+            int rc = fanout_repeat(p->raw, due);
+            if (rc < 0)
+                break;
+            if (rc > 0)
+                continue;
+        }
+
+        if (vsync && capture_wait_frame(p->cap, pacer.interval_ns / 2) < 0) {
+            fprintf(stderr, "pipeline: capture backend has no frame events, "
+                            "pacing by wall time\n");
+            vsync = 0;
+        }
+
+        uint64_t t0 = now_ns();
+
+        /* Grab screen */
+        capture_frame_t frame = {0};
+        const frame_t *src = NULL;
+        if (p->borrow)
+            src = capture_acquire(p->cap, &frame) == 0 ? &frame.frame : NULL;
+        else
+            src = capture_grab(p->cap);
+        if (!src) {
+            if (capture_lost(p->cap)) {
+                /* The main thread renegotiates (pipeline_renegotiate) */
+                atomic_store(&p->lost, 1);
+                break;
+            }
+            fprintf(stderr, "screen2cam: capture failed, retrying...\n");
+            usleep(100000);
+            continue;
+        }
+        stats_record(&p->timing[STAGE_GRAB], now_ns() - t0);
+
+        /* Record what this frame changed */
+        const dirty_rect_t *rects;
+        int n = capture_dirty_rects(p->cap, &rects);
+        int moved = p->overlay && track_cursor(p);
+        if (n != 0 || seq == 0 || moved)
+            seq++;   /* a pointer move alone marks no tiles */
+        uint64_t npix = (uint64_t)p->src_w * (uint64_t)p->src_h, changed = 0;
+        if (n < 0) {
+            dirty_map_mark_all(&p->changed, seq);
+            changed = npix;
+        } else {
+            for (int i = 0; i < n; i++) {
+                dirty_map_mark(&p->changed, &rects[i], seq);
+                changed += (uint64_t)rects[i].w * (uint64_t)rects[i].h;
+            }
+        }
+        atomic_fetch_add_explicit(&p->px_changed, changed < npix ? changed : npix,
+                                  memory_order_relaxed);
+        atomic_fetch_add_explicit(&p->px_grabbed, npix, memory_order_relaxed);
+
+        /* Stamp the frame with its capture time unless the backend did */
+        uint64_t ts = src->timestamp_ns ? src->timestamp_ns : t0;
+
+        int buf = fanout_acquire(p->raw);
+        if (buf < 0) {
+            capture_frame_release(&frame);
+            continue;
+        }
+        if (p->borrow) {
+            p->raw_frames[buf] = frame;
+        } else {
+            int copied = update_raw_buffer(p, src, buf);
+            if (p->overlay && p->passthrough)
+                draw_raw_cursor(p, src, buf, copied);
+        }
+        if (p->overlay)
+            cursor_set(&p->raw_cursor[buf], &p->cursor);
+        p->raw_frames[buf].frame.timestamp_ns = ts;
+        dirty_map_copy(&p->raw_maps[buf], &p->changed);
+        p->raw_seq[buf] = seq;
+        if (fanout_publish(p->raw, buf, seq, due) < 0)
+            break;
+    }
+    pacer_free(&pacer);
+    return NULL;
+}
+
+/*
+ * Switch branch b to or from converting at half resolution.  Every
+ * buffer is redone in full afterwards.  Returns 0, or -1 if the half-size
+ * frame cannot be set up (b then stays at full resolution).
+ */
+static int set_half(branch_t *b, int half)
+{
+    pipeline_t *p = b->p;
+    int w = (b->area.w + 1) / 2, h = (b->area.h + 1) / 2;
+
+    if (half && !b->half_buf) {
+        b->half_buf    = pool_get(pix_fmt_frame_size(b->format, w, h));
+        b->half_scaler = scaler_create(p->src_w, p->src_h, w, h);
+        if (!b->half_buf || !b->half_scaler) {
+            pool_put(b->half_buf);
+            scaler_free(b->half_scaler);
+            b->half_buf    = NULL;
+            b->half_scaler = NULL;
+            return -1;
+        }
+        frame_init(&b->half_frame, b->format, w, h, b->half_buf->data);
+    }
+    b->half     = half;
+    b->half_seq = 0;
+    for (int i = 0; i < b->nyuv; i++) {
+        b->yuv_seq[i]   = 0;
+        b->yuv_drawn[i] = (cursor_mark_t){0};
+    }
+    return 0;
+}
+
+/*
+ * Convert BGRA -> YUV (scaling on the way if needed), only where frame
+ * dst (buffer `index`) is behind raw buffer `in`.
+ */
+static void convert_into(branch_t *b, int in, uint64_t seq, frame_t *dst, int index)
+{
+    pipeline_t *p = b->p;
+    const capture_frame_t *frame = &p->raw_frames[in];
+
+    /* The CPU scales from BGRA only, so native frames stay at full size */
+    int half = atomic_load_explicit(&p->half_res, memory_order_relaxed) && !p->native;
+    if (half != b->half && set_half(b, half) < 0) {
+        fprintf(stderr, "\npipeline: cannot convert at half resolution\n");
+        atomic_store(&p->half_res, 0);
+    }
+
+    if (b->letterbox && b->yuv_seq[index] == 0)
+        frame_clear(dst);   /* first use of this buffer: paint the bars */
+
+    frame_t pic;
+    frame_crop(dst, b->area.x, b->area.y, b->area.w, b->area.h, &pic);
+
+    /* The pointer is drawn over the converted picture, never into the tiles */
+    const cursor_t *cur = p->overlay ? &p->raw_cursor[in] : NULL;
+    cursor_mark_t *drawn = &b->yuv_drawn[index];
+
+    if (b->half) {
+        /* Convert what changed into the half-size frame, then enlarge it */
+        int n = dirty_map_since(&p->raw_maps[in], b->half_seq, b->convert_rects);
+        uint64_t t0 = now_ns();
+        if (n > 0) {
+            frame_scale_convert_rects(b->half_scaler, &frame->frame, &b->half_frame,
+                                      b->convert_rects, n);
+            b->half_seq = (uint32_t)seq;
+        }
+        int redraw = cur && !same_cursor(drawn, &cur->mark);
+        if (b->yuv_seq[index] != b->half_seq || redraw) {
+            frame_upscale2x(&b->half_frame, &pic);
+            stats_record(&p->timing[STAGE_CONVERT], now_ns() - t0);
+            if (cur) {
+                draw_cursor(p, cur, &pic);
+                *drawn = cur->mark;
+            }
+        }
+        dst->timestamp_ns = frame->frame.timestamp_ns;
+        b->yuv_seq[index] = b->half_seq;
+        return;
+    }
+
+    int n = dirty_map_since(&p->raw_maps[in], b->yuv_seq[index], b->convert_rects);
+    int redraw = 0;
+    if (cur) {
+        /* Redo the tiles under the old pointer if it moved or they changed;
+         * native frames are copied whole, so any change wipes it */
+        dirty_rect_t under;
+        int had = cursor_area(p, drawn, &under);
+        redraw = !same_cursor(drawn, &cur->mark);
+        for (int i = 0; i < n && had && !redraw; i++)
+            redraw = p->native || overlaps(&b->convert_rects[i], &under);
+        if (redraw && had)
+            n = add_rect(b->convert_rects, n, under);
+    }
+    if (n > 0) {
+        uint64_t t0 = now_ns();
+        if (b->scaler)
+            frame_scale_convert_rects(b->scaler, &frame->frame, &pic, b->convert_rects, n);
+        else
+            frame_convert_rects(&frame->frame, &pic, b->convert_rects, n);
+        stats_record(&p->timing[STAGE_CONVERT], now_ns() - t0);
+    }
+    if (redraw) {
+        draw_cursor(p, cur, &pic);
+        *drawn = cur->mark;
+    }
+    dst->timestamp_ns = frame->frame.timestamp_ns;
+    b->yuv_seq[index] = (uint32_t)seq;
+}
+
+/* Account for one frame handed to sink s, captured at ts. */
+static void frame_sent(sink_t *s, int repeat, uint64_t ts)
+{
+    pipeline_t *p = s->p;
+    if (ts)
+        stats_record(&p->timing[STAGE_LATENCY], now_ns() - ts);
+    if (repeat)
+        atomic_fetch_add(&s->repeated, 1);
+
+    unsigned long frames = (unsigned long)atomic_fetch_add(&s->frames, 1) + 1;
+    if (s->index == 0 && frames % (unsigned long)s->out.fps == 0)
+        fprintf(stderr, "\rscreen2cam: %lu frames sent", frames);
+}
+
+/* Sink s cannot take frames any more; the pipeline ends with the last one. */
+static void sink_failed(sink_t *s, fanout_t *from)
+{
+    pipeline_t *p = s->p;
+    fanout_detach(from, s->consumer);
+    atomic_store(&s->failed, 1);
+    if (atomic_fetch_add(&p->dead, 1) + 1 == p->nsinks)
+        atomic_store(&p->failed, 1);
+    else
+        fprintf(stderr, "\npipeline: output %d failed, the others carry on\n",
+                s->index + 1);
+}
+
+static int branch_alive(const branch_t *b)
+{
+    for (int i = 0; i < b->nsinks; i++) {
+        if (!atomic_load(&b->sinks[i]->failed))
+            return 1;
+    }
+    return 0;
+}
+
+static void *convert_main(void *arg)
+{
+    branch_t *b = arg;
+    pipeline_t *p = b->p;
+    uint64_t seq;
+    int in;
+
+    while ((in = fanout_pop(p->raw, b->consumer, &seq)) >= 0) {
+        unsigned due = fanout_due(b->yuv);
+        int out = due ? fanout_acquire(b->yuv) : -1;
+        if (out < 0) {
+            if (!branch_alive(b)) {
+                fanout_detach(p->raw, b->consumer);
+                break;
+            }
+            continue;
+        }
+
+        convert_into(b, in, seq,
+                     buffer_frame(&b->yuv_frames[out], fanout_data(b->yuv, out),
+                                  b->format, b->width, b->height),
+                     out);
+        fanout_release(p->raw, b->consumer);
+
+        if (fanout_publish(b->yuv, out, seq, due) < 0)
+            break;
+    }
+    return NULL;
+}
+
+static void *output_main(void *arg)
+{
+    sink_t *s = arg;
+    pipeline_t *p = s->p;
+    branch_t *b = s->branch;
+    fanout_t *from = b->yuv ? b->yuv : p->raw;
+    uint64_t last_seq = 0, seq;
+    int in;
+
+    while ((in = fanout_pop(from, s->consumer, &seq)) >= 0) {
+        const frame_t *frame = b->yuv ? &b->yuv_frames[in] : &p->raw_frames[in].frame;
+
+        /* Write to virtual camera */
+        int repeat = seq == last_seq;
+        uint64_t ts = frame->timestamp_ns;
+        uint64_t t0 = now_ns();
+        int rc;
+        if (s->out.encoder) {
+            packet_t pkt;
+            rc = encoder_encode(s->out.encoder, frame, repeat, &pkt);
+            uint64_t t1 = now_ns();
+            stats_record(&p->timing[STAGE_ENCODE], t1 - t0);
+            t0 = t1;
+            if (rc == 0 && pkt.size)
+                rc = vcam_write_packet(s->out.cam, &pkt);
+        } else {
+            rc = repeat ? vcam_repeat(s->out.cam, frame)
+                        : vcam_write(s->out.cam, frame);
+        }
+        if (rc < 0) {
+            sink_failed(s, from);
+            break;
+        }
+        stats_record(&p->timing[STAGE_WRITE], now_ns() - t0);
+        last_seq = seq;
+        fanout_release(from, s->consumer);
+
+        frame_sent(s, repeat, ts);
+    }
+    return NULL;
+}
+
+/* Convert + output for an output that lends out its frame buffers. */
+static void *direct_main(void *arg)
+{
+    branch_t *b = arg;
+    pipeline_t *p = b->p;
+    sink_t *s = b->sinks[0];
+    uint64_t last_seq = 0, seq;
+    int in;
+
+    while ((in = fanout_pop(p->raw, b->consumer, &seq)) >= 0) {
+        int index;
+        frame_t *out = vcam_acquire(s->out.cam, &index);
+        if (!out) {
+            sink_failed(s, p->raw);
+            break;
+        }
+
+        convert_into(b, in, seq, out, index);
+        int repeat = seq == last_seq;
+        last_seq = seq;
+        fanout_release(p->raw, b->consumer);
+
+        uint64_t ts = out->timestamp_ns;
+        uint64_t t0 = now_ns();
+        if (vcam_submit(s->out.cam, repeat) < 0) {
+            sink_failed(s, p->raw);
+            break;
+        }
+        stats_record(&p->timing[STAGE_WRITE], now_ns() - t0);
+        frame_sent(s, repeat, ts);
+    }
+    return NULL;
+}
+
+static int start_stage(pipeline_t *p, void *(*fn)(void *), void *arg)
+{
+    if (pthread_create(&p->threads[p->started], NULL, fn, arg) != 0)
+        return -1;
+    p->started++;
+    return 0;
+}
+
+/* Fit the captured frames into branch b's size; the CPU scales what it must. */
+static int fit_branch(pipeline_t *p, branch_t *b)
+{
+    capture_ctx_t *cap = p->cap;
+
+    scale_fit(p->src_w, p->src_h, b->width, b->height, &b->area);
+    b->letterbox = b->area.w != b->width || b->area.h != b->height;
+    if (b->area.w == p->src_w && b->area.h == p->src_h)
+        return 0;
+
+    /* The backend can only scale for everyone */
+    if (p->nbranches == 1 && p->cfg.capture_convert &&
+        capture_set_size(cap, b->area.w, b->area.h) == 0) {
+        p->src_w = b->area.w;
+        p->src_h = b->area.h;
+    } else {
+        /* The CPU scales from BGRA only */
+        if (p->native) {
+            capture_set_format(cap, PIX_FMT_BGRA);
+            p->native = 0;
+        }
+        b->scaler = scaler_create(p->src_w, p->src_h, b->area.w, b->area.h);
+        if (!b->scaler) {
+            fprintf(stderr, "pipeline: cannot scale %dx%d to %dx%d\n",
+                    p->src_w, p->src_h, b->area.w, b->area.h);
+            return -1;
+        }
+    }
+    fprintf(stderr, "pipeline: scaling %dx%d to %dx%d%s\n",
+            capture_width(cap), capture_height(cap), b->area.w, b->area.h,
+            b->scaler ? "" : " in the capture backend");
+    return 0;
+}
+
+/*
+ * Everything sized by the capture: scalers, rings and dirty maps, then
+ * the stage threads.  Returns 0, or -1; the caller then tears the
+ * partly built stages down (pipeline_stop() or teardown()).
+ */
+static int setup(pipeline_t *p)
+{
+    capture_ctx_t *cap = p->cap;
+    const pipeline_config_t *cfg = &p->cfg;
+    atomic_store(&p->stop, 0);
+
+    /* Let the backend convert (on the GPU) when one format is all we need */
+    branch_t *first = &p->branches[0];
+    p->native = p->nbranches == 1 && first->format != PIX_FMT_BGRA &&
+                cfg->capture_convert && capture_set_format(cap, first->format) == 0;
+    p->borrow = capture_can_borrow(cap);
+
+    p->src_w = capture_width(cap);
+    p->src_h = capture_height(cap);
+    for (int i = 0; i < p->nbranches; i++) {
+        if (fit_branch(p, &p->branches[i]) < 0)
+            return -1;
+    }
+
+    /* Skip the convert stage only if the outputs can read raw buffers as-is */
+    p->passthrough = p->native && !p->borrow && !first->letterbox && !first->direct;
+
+    /* Draw the pointer ourselves if the backend keeps it out of the frames */
+    capture_cursor_t probe;
+    p->overlay = cfg->cursor && capture_cursor(cap, &probe) == 0;
+
+    /* The capture feeds every conversion, or the outputs themselves */
+    int fps[PIPELINE_MAX_OUTPUTS];
+    int nraw = p->passthrough ? first->nsinks : p->nbranches;
+    for (int i = 0; i < nraw; i++) {
+        if (p->passthrough) {
+            first->sinks[i]->consumer = i;
+            fps[i] = first->sinks[i]->out.fps;
+        } else {
+            p->branches[i].consumer = i;
+            fps[i] = p->branches[i].fps;
+        }
+    }
+    size_t npix = (size_t)p->src_w * p->src_h;
+    size_t raw_size = p->borrow ? 0
+                    : p->native ? pix_fmt_frame_size(first->format, p->src_w, p->src_h)
+                    : npix * 4;
+    p->raw = fanout_create(nraw, fps, cfg->depth, raw_size, cfg->policy);
+    if (!p->raw)
+        goto rings;
+    if (p->borrow)
+        fanout_on_drained(p->raw, release_raw, p);
+
+    for (int i = 0; i < p->nbranches && !p->passthrough; i++) {
+        branch_t *b = &p->branches[i];
+        if (b->direct)
+            continue;
+        for (int k = 0; k < b->nsinks; k++) {
+            b->sinks[k]->consumer = k;
+            fps[k] = b->sinks[k]->out.fps;
+        }
+        b->yuv = fanout_create(b->nsinks, fps, cfg->depth, b->frame_size, cfg->policy);
+        if (!b->yuv)
+            goto rings;
+    }
+
+    /* Outputs that failed before a renegotiation stay out */
+    for (int i = 0; i < p->nsinks; i++) {
+        sink_t *s = &p->sinks[i];
+        branch_t *b = s->branch;
+        if (atomic_load(&s->failed))
+            fanout_detach(b->yuv ? b->yuv : p->raw, b->direct ? b->consumer : s->consumer);
+    }
+
+    int nbufs = fanout_buffer_count(p->raw);
+    if (dirty_map_init(&p->changed, p->src_w, p->src_h) < 0)
+        goto nomem;
+    int max_rects = dirty_map_max_rects(&p->changed);
+
+    p->raw_maps      = calloc((size_t)nbufs, sizeof(*p->raw_maps));
+    p->raw_frames    = calloc((size_t)nbufs, sizeof(*p->raw_frames));
+    p->raw_seq       = calloc((size_t)nbufs, sizeof(*p->raw_seq));
+    p->capture_rects = calloc((size_t)max_rects, sizeof(*p->capture_rects));
+    p->raw_cursor    = calloc((size_t)nbufs, sizeof(*p->raw_cursor));
+    p->raw_drawn     = calloc((size_t)nbufs, sizeof(*p->raw_drawn));
+    if (!p->raw_maps || !p->raw_frames || !p->raw_seq || !p->capture_rects ||
+        !p->raw_cursor || !p->raw_drawn)
+        goto nomem;
+    for (int i = 0; i < nbufs; i++) {
+        if (dirty_map_init(&p->raw_maps[i], p->src_w, p->src_h) < 0)
+            goto nomem;
+    }
+    for (int i = 0; i < p->nbranches; i++) {
+        branch_t *b = &p->branches[i];
+        int nyuv = b->direct ? vcam_buffer_count(b->sinks[0]->out.cam)
+                 : b->yuv ? fanout_buffer_count(b->yuv) : 0;
+        b->yuv_frames    = calloc((size_t)nyuv + 1, sizeof(*b->yuv_frames));
+        b->yuv_seq       = calloc((size_t)nyuv + 1, sizeof(*b->yuv_seq));
+        b->convert_rects = calloc((size_t)max_rects + 1, sizeof(*b->convert_rects));
+        b->yuv_drawn     = calloc((size_t)nyuv + 1, sizeof(*b->yuv_drawn));
+        b->nyuv          = nyuv;
+        if (!b->yuv_frames || !b->yuv_seq || !b->convert_rects || !b->yuv_drawn)
+            goto nomem;
+    }
+
+    /* Downstream first, so every stage has a consumer when it starts */
+    for (int i = 0; i < p->nbranches; i++) {
+        branch_t *b = &p->branches[i];
+        if (b->direct) {
+            if (!atomic_load(&b->sinks[0]->failed) && start_stage(p, direct_main, b) < 0)
+                goto fail;
+            continue;
+        }
+        for (int k = 0; k < b->nsinks; k++) {
+            if (!atomic_load(&b->sinks[k]->failed) &&
+                start_stage(p, output_main, b->sinks[k]) < 0)
+                goto fail;
+        }
+        if (b->yuv && start_stage(p, convert_main, b) < 0)
+            goto fail;
+    }
+    if (start_stage(p, capture_main, p) < 0)
+        goto fail;
+    return 0;
+
+fail:
+    fprintf(stderr, "pipeline: cannot start stage threads\n");
+    return -1;
+
+rings:
+    fprintf(stderr, "pipeline: cannot allocate frame rings\n");
+    return -1;
+
+nomem:
+    fprintf(stderr, "pipeline: cannot allocate dirty-tile maps\n");
+    return -1;
+}
+
+/*
+ * Stop and join the stages and free what setup() allocated, keeping the
+ * counters.  Borrowed capture frames are all released afterwards.
+ */
+static void teardown(pipeline_t *p)
+{
+    atomic_store(&p->stop, 1);
+    if (p->raw)
+        fanout_close(p->raw);
+    for (int i = 0; i < p->nbranches; i++) {
+        if (p->branches[i].yuv)
+            fanout_close(p->branches[i].yuv);
+    }
+
+    /* Upstream first: threads were started output first, capture last */
+    while (p->started > 0)
+        pthread_join(p->threads[--p->started], NULL);
+
+    int nbufs = p->raw ? fanout_buffer_count(p->raw) : 0;
+    if (p->raw_maps) {
+        for (int i = 0; i < nbufs; i++)
+            dirty_map_free(&p->raw_maps[i]);
+    }
+    if (p->raw_frames && p->borrow) {
+        for (int i = 0; i < nbufs; i++)
+            capture_frame_release(&p->raw_frames[i]);
+    }
+    if (p->raw_cursor) {
+        for (int i = 0; i < nbufs; i++)
+            pool_put(p->raw_cursor[i].image);
+    }
+    pool_put(p->cursor.image);
+    p->cursor = (cursor_t){0};
+    dirty_map_free(&p->changed);
+    free(p->raw_maps);
+    free(p->raw_frames);
+    free(p->raw_seq);
+    free(p->capture_rects);
+    free(p->raw_cursor);
+    free(p->raw_drawn);
+    p->raw_maps      = NULL;
+    p->raw_frames    = NULL;
+    p->raw_seq       = NULL;
+    p->capture_rects = NULL;
+    p->raw_cursor    = NULL;
+    p->raw_drawn     = NULL;
+
+    p->dropped_base = pipeline_dropped(p);
+    pipeline_pacing(p, &p->pace_base);
+    fanout_free(p->raw);
+    p->raw = NULL;
+    for (int i = 0; i < p->nbranches; i++) {
+        branch_t *b = &p->branches[i];
+        free(b->yuv_frames);
+        free(b->yuv_seq);
+        free(b->convert_rects);
+        free(b->yuv_drawn);
+        fanout_free(b->yuv);
+        scaler_free(b->scaler);
+        scaler_free(b->half_scaler);
+        pool_put(b->half_buf);
+        b->yuv_frames    = NULL;
+        b->yuv_seq       = NULL;
+        b->convert_rects = NULL;
+        b->yuv_drawn     = NULL;
+        b->nyuv          = 0;
+        b->yuv           = NULL;
+        b->scaler        = NULL;
+        b->half_scaler   = NULL;
+        b->half_buf      = NULL;
+        b->half          = 0;
+    }
+}
+
+/* Group the outputs by format and size; a direct output converts alone. */
+static void assign_branches(pipeline_t *p)
+{
+    for (int i = 0; i < p->nsinks; i++) {
+        sink_t *s = &p->sinks[i];
+        int direct = !s->out.encoder && vcam_buffer_count(s->out.cam) > 0;
+
+        branch_t *b = NULL;
+        for (int k = 0; k < p->nbranches && !direct; k++) {
+            branch_t *c = &p->branches[k];
+            if (!c->direct && c->format == s->format &&
+                c->width == s->out.width && c->height == s->out.height)
+                b = c;
+        }
+        if (!b) {
+            b = &p->branches[p->nbranches++];
+            b->p          = p;
+            b->format     = s->format;
+            b->width      = s->out.width;
+            b->height     = s->out.height;
+            b->direct     = direct;
+            b->frame_size = pix_fmt_frame_size(s->format, s->out.width, s->out.height);
+        }
+        b->sinks[b->nsinks++] = s;
+        if (s->out.fps > b->fps)
+            b->fps = s->out.fps;
+        if (s->out.fps > p->fps)
+            p->fps = s->out.fps;
+        s->branch = b;
+    }
+}
+
+/* ── Public interface ──────────────────────────────────────── */
+
+pipeline_t *pipeline_start(capture_ctx_t *cap, const pipeline_config_t *cfg)
+{
+    if (cfg->noutputs < 1 || cfg->noutputs > PIPELINE_MAX_OUTPUTS)
+        return NULL;
+
+    pipeline_t *p = calloc(1, sizeof(*p));
+    if (!p)
+        return NULL;
+
+    p->cap = cap;
+    p->cfg = *cfg;
+    p->cfg.outputs = NULL;   /* copied into sinks[] */
+    p->nsinks = cfg->noutputs;
+    for (int i = 0; i < p->nsinks; i++) {
+        sink_t *s = &p->sinks[i];
+        s->p      = p;
+        s->index  = i;
+        s->out    = cfg->outputs[i];
+        s->format = s->out.encoder ? encoder_format(s->out.encoder) : vcam_format(s->out.cam);
+        atomic_init(&s->failed, 0);
+        atomic_init(&s->frames, 0);
+        atomic_init(&s->repeated, 0);
+    }
+    assign_branches(p);
+    if (p->nsinks > 1)
+        fprintf(stderr, "pipeline: %d outputs, %d conversion%s\n",
+                p->nsinks, p->nbranches, p->nbranches == 1 ? "" : "s");
+
+    atomic_init(&p->stop, 0);
+    atomic_init(&p->failed, 0);
+    atomic_init(&p->dead, 0);
+    atomic_init(&p->lost, 0);
+    atomic_init(&p->pace_ticks, 0);
+    atomic_init(&p->pace_skipped, 0);
+    atomic_init(&p->pace_late_sum, 0);
+    atomic_init(&p->pace_late_max, 0);
+    atomic_init(&p->rate_div, 1);
+    atomic_init(&p->half_res, 0);
+    atomic_init(&p->px_changed, 0);
+    atomic_init(&p->px_grabbed, 0);
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stats_init(&p->timing[i]);
+
+    if (setup(p) < 0) {
+        pipeline_stop(p);
+        return NULL;
+    }
+    return p;
+}
+
+int pipeline_lost(const pipeline_t *p)
+{
+    return atomic_load(&((pipeline_t *)p)->lost);
+}
+
+int pipeline_renegotiate(pipeline_t *p)
+{
+    uint64_t now = now_ns();
+
+    if (p->raw) {
+        fprintf(stderr, "\npipeline: capture source changed, renegotiating\n");
+        teardown(p);
+        p->lost_ns = now;
+    }
+    if (now < p->retry_ns)
+        return -1;
+
+    if (capture_reset(p->cap) < 0) {
+        if (!p->retry_ns)
+            fprintf(stderr, "pipeline: waiting for the capture source to come back\n");
+        p->retry_ns = now + 250000000u;
+        return -1;
+    }
+    p->retry_ns = 0;
+
+    if (setup(p) < 0) {
+        teardown(p);
+        atomic_store(&p->failed, 1);
+        return -1;
+    }
+    pool_trim();   /* old ring buffers the new rings did not reuse */
+    atomic_store(&p->lost, 0);
+    fprintf(stderr, "pipeline: capturing %dx%d again after %.1f ms\n",
+            capture_width(p->cap), capture_height(p->cap),
+            (double)(now_ns() - p->lost_ns) / 1e6);
+    return 0;
+}
+
+int pipeline_ok(const pipeline_t *p)
+{
+    return !atomic_load(&((pipeline_t *)p)->failed);
+}
+
+int pipeline_output_ok(const pipeline_t *p, int output)
+{
+    return !atomic_load(&((pipeline_t *)p)->sinks[output].failed);
+}
+
+uint64_t pipeline_frames(const pipeline_t *p)
+{
+    return pipeline_output_frames(p, 0);
+}
+
+uint64_t pipeline_output_frames(const pipeline_t *p, int output)
+{
+    return atomic_load(&((pipeline_t *)p)->sinks[output].frames);
+}
+
+uint64_t pipeline_repeated(const pipeline_t *p)
+{
+    return atomic_load(&((pipeline_t *)p)->sinks[0].repeated);
+}
+
+uint64_t pipeline_dropped(const pipeline_t *p)
+{
+    uint64_t n = p->dropped_base + (p->raw ? fanout_dropped(p->raw) : 0);
+    for (int i = 0; i < p->nbranches; i++) {
+        if (p->branches[i].yuv)
+            n += fanout_dropped(p->branches[i].yuv);
+    }
+    return n;
+}
+
+void pipeline_pacing(const pipeline_t *p, pacer_stats_t *stats)
+{
+    pipeline_t *q = (pipeline_t *)p;
+    stats->ticks       = atomic_load_explicit(&q->pace_ticks, memory_order_relaxed);
+    stats->skipped     = atomic_load_explicit(&q->pace_skipped, memory_order_relaxed);
+    stats->late_sum_ns = atomic_load_explicit(&q->pace_late_sum, memory_order_relaxed);
+    stats->late_max_ns = atomic_load_explicit(&q->pace_late_max, memory_order_relaxed);
+}
+
+void pipeline_timing(const pipeline_t *p, stats_dist_t timing[STAGE_COUNT])
+{
+    for (int i = 0; i < STAGE_COUNT; i++)
+        stats_read(&p->timing[i], &timing[i]);
+}
+
+void pipeline_set_quality(pipeline_t *p, int rate_div, int half_res)
+{
+    atomic_store(&p->rate_div, rate_div < 1 ? 1 : rate_div);
+    atomic_store(&p->half_res, half_res != 0);
+}
+
+int pipeline_can_halve(const pipeline_t *p)
+{
+    return !p->passthrough && !p->native;
+}
+
+void pipeline_activity(const pipeline_t *p, uint64_t *changed, uint64_t *grabbed)
+{
+    pipeline_t *q = (pipeline_t *)p;
+    *changed = atomic_load_explicit(&q->px_changed, memory_order_relaxed);
+    *grabbed = atomic_load_explicit(&q->px_grabbed, memory_order_relaxed);
+}
+
+void pipeline_stop(pipeline_t *p)
+{
+    if (!p)
+        return;
+    teardown(p);
+    free(p);
+    pool_trim();
+}
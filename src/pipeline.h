@@ -0,0 +1,136 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <stdint.h>
+
+#include "capture.h"
+#include "encode.h"
+#include "pacer.h"
+#include "ring.h"
+#include "stats.h"
+#include "vcam.h"
+
+/*
+ * Three-stage streaming pipeline: capture -> convert -> output.
+ *
+ * Each stage runs on its own thread and hands frames to the next through
+ * rings (see ring.h, fanout.h), so a slow vcam_write() or a full stdout
+ * pipe no longer delays the next capture_grab().  One capture can feed
+ * several outputs.
+ */
+
+/* One output: a virtual camera, pipe or stream (--device), with its own size and rate. */
+typedef struct {
+    vcam_ctx_t   *cam;
+    encoder_t    *encoder;   /* compress before output (vcam_write_packet);
+                                NULL for raw frames.  Borrowed like cam. */
+    int           width;     /* output size; the screen is scaled to fit,
+                                and still is after a renegotiation */
+    int           height;
+    int           fps;       /* this output's rate; the capture runs at the
+                                highest and the others take every n-th frame */
+} pipeline_output_t;
+
+#define PIPELINE_MAX_OUTPUTS 8
+
+typedef struct {
+    const pipeline_output_t *outputs;  /* copied by pipeline_start() */
+    int           noutputs;  /* 1 .. PIPELINE_MAX_OUTPUTS */
+    int           depth;     /* queued frames between stages (>= 1) */
+    ring_policy_t policy;    /* what capture/convert do when the next stage lags;
+                                with several outputs they always drop */
+    pace_late_t   late;      /* capture ticks missed by a whole interval */
+    int           vsync;     /* grab right after the source presents a frame
+                                (capture_wait_frame), not at the bare tick */
+    int           capture_convert;  /* let the backend convert and scale
+                                       (capture_set_format, capture_set_size);
+                                       only used with a single conversion */
+    int           cursor;    /* draw the pointer where the backend reports it
+                                apart from the frames (capture_cursor) */
+} pipeline_config_t;
+
+typedef struct pipeline pipeline_t;
+
+/*
+ * Start the capture, convert and output threads.  Outputs of the same
+ * format and size share one conversion; each then gets its own output
+ * thread, so a slow one drops its own frames without stalling the rest.
+ * The pipeline borrows cap and every output's cam and encoder; they must
+ * outlive pipeline_stop().  Returns NULL on failure.
+ */
+pipeline_t *pipeline_start(capture_ctx_t *cap, const pipeline_config_t *cfg);
+
+/*
+ * Non-zero while the pipeline runs: at least one output has not failed.
+ * A failed output is dropped and the others carry on.
+ */
+int pipeline_ok(const pipeline_t *p);
+
+/* Whether output i (cfg.outputs order) is still being fed. */
+int pipeline_output_ok(const pipeline_t *p, int output);
+
+/*
+ * Frames handed to the first output, how many of those were unchanged
+ * repeats, and frames dropped between stages (all outputs).
+ */
+uint64_t pipeline_frames(const pipeline_t *p);
+uint64_t pipeline_repeated(const pipeline_t *p);
+uint64_t pipeline_dropped(const pipeline_t *p);
+
+/* Frames handed to output i so far. */
+uint64_t pipeline_output_frames(const pipeline_t *p, int output);
+
+/* How well the capture thread kept to its deadlines so far. */
+void pipeline_pacing(const pipeline_t *p, pacer_stats_t *stats);
+
+/*
+ * Per-stage timings so far (STAGE_GRAB ... STAGE_LATENCY, see stats.h),
+ * of all outputs together.  They only grow: subtract an earlier read for
+ * an interval.
+ */
+void pipeline_timing(const pipeline_t *p, stats_dist_t timing[STAGE_COUNT]);
+
+/*
+ * Trade quality for CPU while running: grab only every rate_div-th frame
+ * (the outputs get repeats in between, at their full rate) and, with
+ * half_res, convert at half resolution and enlarge 2x into the output.
+ * pipeline_set_quality(p, 1, 0) is full quality.  Any thread.
+ */
+void pipeline_set_quality(pipeline_t *p, int rate_div, int half_res);
+
+/*
+ * Whether half_res does anything: not when the capture backend converts
+ * (the CPU scales from BGRA only) or the outputs read captured frames as
+ * they are.  May change with pipeline_renegotiate().
+ */
+int pipeline_can_halve(const pipeline_t *p);
+
+/*
+ * Screen activity: pixels the capture reported changed and pixels grabbed
+ * so far.  They only grow; the ratio over an interval is the share of the
+ * screen that moved.
+ */
+void pipeline_activity(const pipeline_t *p, uint64_t *changed, uint64_t *grabbed);
+
+/*
+ * Non-zero once the capture source changed under the pipeline (a mode
+ * change, a resized window, DXGI access lost, see capture_lost()): the
+ * stages have stopped and wait for pipeline_renegotiate().
+ */
+int pipeline_lost(const pipeline_t *p);
+
+/*
+ * Re-open the capture at its new size (capture_reset()) and rebuild the
+ * rings, tile maps and scalers for it.  The outputs (cam, encoder) stay
+ * open at their configured size and format, so consumers stay attached;
+ * counters and timings carry on.  Call from the thread that started the
+ * pipeline.  Returns 0, or -1 if the source is not back yet (call again;
+ * attempts are spaced out so this can be polled) or, with pipeline_ok()
+ * then 0, if the pipeline could not be rebuilt.
+ */
+int pipeline_renegotiate(pipeline_t *p);
+
+/* Stop all stages, join the threads and free the rings. */
+void pipeline_stop(pipeline_t *p);
+
+#endif /* PIPELINE_H */
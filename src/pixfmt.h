@@ -0,0 +1,248 @@
+#ifndef PIXFMT_H
+#define PIXFMT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * Output pixel formats (YUV ones are BT.601, chroma from the top-left pixel).
+ *
+ *   YUV420P  I420: Y plane, then U and V planes at half width/height
+ *   NV12     Y plane, then one half-height plane of interleaved U,V
+ *   YUYV     4:2:2 packed, one plane of Y0 U Y1 V per pixel pair
+ *
+ * Odd sizes round chroma up: the last column and row get a chroma sample
+ * of their own, as in FFmpeg and V4L2 (YUYV's unpaired last pixel has U
+ * only, set to 128).
+ *   BGRA     the capture format itself, passed through without conversion
+ *   RGB24    packed R, G, B (what pyvirtualcam and most RGB consumers take)
+ *   RGBA     packed R, G, B, A: BGRA with red and blue swapped
+ */
+typedef enum {
+    PIX_FMT_AUTO = -1,   /* vcam_open() only: let the consumer decide */
+    PIX_FMT_YUV420P,
+    PIX_FMT_NV12,
+    PIX_FMT_YUYV,
+    PIX_FMT_BGRA,
+    PIX_FMT_RGB24,
+    PIX_FMT_RGBA
+} pix_fmt_t;
+
+/* Bytes in one frame of fmt. */
+static inline size_t pix_fmt_frame_size(pix_fmt_t fmt, int width, int height)
+{
+    size_t luma   = (size_t)width * height;
+    size_t chroma = (size_t)((width + 1) / 2) * ((height + 1) / 2);
+
+    switch (fmt) {
+    case PIX_FMT_YUYV:  return luma * 2;
+    case PIX_FMT_RGB24: return luma * 3;
+    case PIX_FMT_BGRA:
+    case PIX_FMT_RGBA:  return luma * 4;
+    default:            return luma + 2 * chroma;
+    }
+}
+
+static inline const char *pix_fmt_name(pix_fmt_t fmt)
+{
+    switch (fmt) {
+    case PIX_FMT_YUV420P: return "yuv420p";
+    case PIX_FMT_NV12:    return "nv12";
+    case PIX_FMT_YUYV:    return "yuyv";
+    case PIX_FMT_BGRA:    return "bgra";
+    case PIX_FMT_RGB24:   return "rgb24";
+    case PIX_FMT_RGBA:    return "rgba";
+    default:              return "auto";
+    }
+}
+
+static inline int pix_fmt_planes(pix_fmt_t fmt)
+{
+    switch (fmt) {
+    case PIX_FMT_YUV420P: return 3;
+    case PIX_FMT_NV12:    return 2;
+    default:              return 1;
+    }
+}
+
+/*
+ * Where plane `plane` of a packed fmt frame starts, how many bytes of
+ * each row carry pixels and how many rows it has.
+ */
+static inline size_t pix_fmt_plane(pix_fmt_t fmt, int width, int height, int plane,
+                                   size_t *row_bytes, int *rows)
+{
+    size_t luma   = (size_t)width * height;
+    size_t half_w = (size_t)((width + 1) / 2);
+
+    *rows = plane == 0 ? height : (height + 1) / 2;
+    switch (fmt) {
+    case PIX_FMT_YUYV:  *row_bytes = (size_t)width * 2; return 0;
+    case PIX_FMT_RGB24: *row_bytes = (size_t)width * 3; return 0;
+    case PIX_FMT_BGRA:
+    case PIX_FMT_RGBA:  *row_bytes = (size_t)width * 4; return 0;
+    case PIX_FMT_NV12:
+        *row_bytes = plane == 0 ? (size_t)width : half_w * 2;
+        return plane == 0 ? 0 : luma;
+    default:
+        *row_bytes = plane == 0 ? (size_t)width : half_w;
+        return plane == 0 ? 0 : luma + (size_t)(plane - 1) * half_w * ((height + 1) / 2);
+    }
+}
+
+/*
+ * A frame in memory: format, size and where each plane lives.  Rows may
+ * be padded (stride > bytes of pixels), so capture and output buffers can
+ * be described as they are instead of being repacked.  Only the first
+ * pix_fmt_planes(format) planes are used.
+ */
+typedef struct {
+    pix_fmt_t  format;
+    int        width;
+    int        height;
+    uint8_t   *planes[3];
+    size_t     strides[3];     /* bytes from one row to the next */
+    uint64_t   timestamp_ns;   /* capture time (CLOCK_MONOTONIC), 0 = unknown */
+} frame_t;
+
+/* Describe a tightly packed frame (pix_fmt_frame_size() bytes) at data. */
+static inline void frame_init(frame_t *f, pix_fmt_t fmt, int width, int height,
+                              uint8_t *data)
+{
+    memset(f, 0, sizeof(*f));
+    f->format = fmt;
+    f->width  = width;
+    f->height = height;
+    for (int i = 0; i < pix_fmt_planes(fmt); i++) {
+        int rows;
+        f->planes[i] = data + pix_fmt_plane(fmt, width, height, i, &f->strides[i], &rows);
+    }
+}
+
+/*
+ * The single-buffer V4L2 layout: the first plane's rows are `stride`
+ * bytes apart and the chroma planes follow it with proportional strides.
+ * A stride no wider than the pixels means tightly packed.
+ */
+static inline size_t pix_fmt_strided_size(pix_fmt_t fmt, int width, int height,
+                                          size_t stride)
+{
+    size_t row_bytes;
+    int rows;
+    pix_fmt_plane(fmt, width, height, 0, &row_bytes, &rows);
+    if (stride <= row_bytes)
+        return pix_fmt_frame_size(fmt, width, height);
+
+    size_t chroma = fmt == PIX_FMT_NV12 ? stride : stride / 2;
+    return stride * height + chroma * ((height + 1) / 2) * (pix_fmt_planes(fmt) - 1);
+}
+
+/* Describe a frame at data in that layout (pix_fmt_strided_size() bytes). */
+static inline void frame_init_strided(frame_t *f, pix_fmt_t fmt, int width, int height,
+                                      uint8_t *data, size_t stride)
+{
+    size_t row_bytes;
+    int rows;
+    pix_fmt_plane(fmt, width, height, 0, &row_bytes, &rows);
+    frame_init(f, fmt, width, height, data);
+    if (stride <= row_bytes)
+        return;
+
+    size_t off = stride * height;
+    f->strides[0] = stride;
+    for (int i = 1; i < pix_fmt_planes(fmt); i++) {
+        f->planes[i]  = data + off;
+        f->strides[i] = fmt == PIX_FMT_NV12 ? stride : stride / 2;
+        off += f->strides[i] * ((height + 1) / 2);
+    }
+}
+
+/*
+ * Describe the w x h area of f at (x, y) in place: same buffer, same
+ * strides, plane pointers moved to the area's corner.  x and y must be
+ * even so chroma stays aligned.
+ */
+static inline void frame_crop(const frame_t *f, int x, int y, int w, int h, frame_t *out)
+{
+    *out = *f;
+    out->width  = w;
+    out->height = h;
+    switch (f->format) {
+    case PIX_FMT_YUV420P:
+        out->planes[0] += (size_t)y * f->strides[0] + x;
+        out->planes[1] += (size_t)(y / 2) * f->strides[1] + x / 2;
+        out->planes[2] += (size_t)(y / 2) * f->strides[2] + x / 2;
+        break;
+    case PIX_FMT_NV12:
+        out->planes[0] += (size_t)y * f->strides[0] + x;
+        out->planes[1] += (size_t)(y / 2) * f->strides[1] + x;
+        break;
+    case PIX_FMT_YUYV:
+        out->planes[0] += (size_t)y * f->strides[0] + (size_t)x * 2;
+        break;
+    case PIX_FMT_RGB24:
+        out->planes[0] += (size_t)y * f->strides[0] + (size_t)x * 3;
+        break;
+    default:
+        out->planes[0] += (size_t)y * f->strides[0] + (size_t)x * 4;
+        break;
+    }
+}
+
+/* Non-zero if f is laid out exactly as frame_init() would describe it. */
+static inline int frame_is_packed(const frame_t *f)
+{
+    for (int i = 0; i < pix_fmt_planes(f->format); i++) {
+        size_t row_bytes;
+        int rows;
+        size_t off = pix_fmt_plane(f->format, f->width, f->height, i, &row_bytes, &rows);
+        if (f->strides[i] != row_bytes || f->planes[i] != f->planes[0] + off)
+            return 0;
+    }
+    return 1;
+}
+
+/* Copy the pixels of src into dst (same format and size, any strides). */
+static inline void frame_copy(frame_t *dst, const frame_t *src)
+{
+    for (int i = 0; i < pix_fmt_planes(src->format); i++) {
+        size_t row_bytes;
+        int rows;
+        pix_fmt_plane(src->format, src->width, src->height, i, &row_bytes, &rows);
+        if (dst->strides[i] == row_bytes && src->strides[i] == row_bytes) {
+            memcpy(dst->planes[i], src->planes[i], row_bytes * rows);
+            continue;
+        }
+        for (int j = 0; j < rows; j++)
+            memcpy(dst->planes[i] + (size_t)j * dst->strides[i],
+                   src->planes[i] + (size_t)j * src->strides[i], row_bytes);
+    }
+    dst->timestamp_ns = src->timestamp_ns;
+}
+
+/* Parse a --format argument.  Returns 0 on success, -1 if unknown. */
+static inline int pix_fmt_parse(const char *name, pix_fmt_t *fmt)
+{
+    static const pix_fmt_t all[] = {
+        PIX_FMT_AUTO, PIX_FMT_YUV420P, PIX_FMT_NV12, PIX_FMT_YUYV, PIX_FMT_BGRA,
+        PIX_FMT_RGB24, PIX_FMT_RGBA
+    };
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(name, pix_fmt_name(all[i])) == 0) {
+            *fmt = all[i];
+            return 0;
+        }
+    }
+    if (strcmp(name, "i420") == 0) {
+        *fmt = PIX_FMT_YUV420P;
+        return 0;
+    }
+    if (strcmp(name, "rgb") == 0) {
+        *fmt = PIX_FMT_RGB24;
+        return 0;
+    }
+    return -1;
+}
+
+#endif /* PIXFMT_H */
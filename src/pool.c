@@ -0,0 +1,199 @@
+/*
+ * Frame buffer pool
+ *
+ * Buffers are anonymous mappings of their own, rounded up to whole pages
+ * (whole 2 MiB pages from 2 MiB up), so a trimmed buffer really leaves
+ * the process instead of lingering in the malloc heap, and no two frames
+ * share a page.  Idle buffers wait on one list; pool_get() takes the
+ * smallest that fits, but not one more than twice the size asked for, so
+ * a small ring does not pin an 8K frame's worth of memory.
+ *
+ * On Linux a large buffer is tried on reserved huge pages (MAP_HUGETLB,
+ * vm.nr_hugepages) first and otherwise mapped 2 MiB-aligned with
+ * MADV_HUGEPAGE, for transparent huge pages.  macOS and Windows get
+ * plain page-aligned mappings: their large pages need entitlements or
+ * privileges a desktop tool should not ask for.
+ */
+
+#include "pool.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include "platform.h"
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#define HUGE_PAGE ((size_t)2 << 20)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_buf_t     *idle;        /* returned buffers, guarded by lock */
+static size_t          mapped_bytes;
+static size_t          idle_bytes;
+static uint64_t        map_count;
+
+static size_t page_size(void)
+{
+#ifdef _WIN32
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return si.dwPageSize;
+#else
+    return (size_t)sysconf(_SC_PAGESIZE);
+#endif
+}
+
+/* ── Mappings ──────────────────────────────────────────────── */
+
+#ifdef _WIN32
+
+static uint8_t *map_pages(size_t len, int *huge)
+{
+    *huge = 0;
+    return VirtualAlloc(NULL, len, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+}
+
+static void unmap_pages(uint8_t *p, size_t len)
+{
+    (void)len;
+    VirtualFree(p, 0, MEM_RELEASE);
+}
+
+#else
+
+static uint8_t *map_pages(size_t len, int *huge)
+{
+    *huge = 0;
+#ifdef MAP_HUGETLB
+    if (len % HUGE_PAGE == 0) {
+        void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            *huge = 1;
+            return p;
+        }
+    }
+#endif
+#ifdef MADV_HUGEPAGE
+    if (len % HUGE_PAGE == 0) {
+        /* Over-map and cut to a 2 MiB boundary so THP can back every page */
+        uint8_t *p = mmap(NULL, len + HUGE_PAGE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED)
+            return NULL;
+        uint8_t *a = (uint8_t *)(((uintptr_t)p + HUGE_PAGE - 1) & ~(uintptr_t)(HUGE_PAGE - 1));
+        if (a > p)
+            munmap(p, (size_t)(a - p));
+        if (p + HUGE_PAGE > a)
+            munmap(a + len, (size_t)(p + HUGE_PAGE - a));
+        madvise(a, len, MADV_HUGEPAGE);
+        return a;
+    }
+#endif
+    void *p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+static void unmap_pages(uint8_t *p, size_t len)
+{
+    munmap(p, len);
+}
+
+#endif
+
+static void unmap_buf(pool_buf_t *b)
+{
+    unmap_pages(b->data, b->size);
+    free(b);
+}
+
+/* ── Public interface ──────────────────────────────────────── */
+
+pool_buf_t *pool_get(size_t size)
+{
+    if (size == 0)
+        size = 1;
+    size_t unit = size >= HUGE_PAGE ? HUGE_PAGE : page_size();
+    size_t len  = (size + unit - 1) / unit * unit;
+
+    pthread_mutex_lock(&lock);
+    pool_buf_t **best = NULL;
+    for (pool_buf_t **b = &idle; *b; b = &(*b)->next) {
+        size_t have = (*b)->size;
+        if (have >= len && have - len <= len && (!best || have < (*best)->size))
+            best = b;
+    }
+    if (best) {
+        pool_buf_t *b = *best;
+        *best = b->next;
+        idle_bytes -= b->size;
+        pthread_mutex_unlock(&lock);
+        b->next = NULL;
+        atomic_store(&b->refs, 1);
+        return b;
+    }
+    pthread_mutex_unlock(&lock);
+
+    pool_buf_t *b = calloc(1, sizeof(*b));
+    if (!b)
+        return NULL;
+    b->data = map_pages(len, &b->huge);
+    if (!b->data) {
+        free(b);
+        return NULL;
+    }
+    b->size = len;
+    atomic_init(&b->refs, 1);
+
+    pthread_mutex_lock(&lock);
+    mapped_bytes += len;
+    map_count++;
+    pthread_mutex_unlock(&lock);
+    return b;
+}
+
+void pool_ref(pool_buf_t *buf)
+{
+    atomic_fetch_add_explicit(&buf->refs, 1, memory_order_relaxed);
+}
+
+void pool_put(pool_buf_t *buf)
+{
+    if (!buf || atomic_fetch_sub_explicit(&buf->refs, 1, memory_order_acq_rel) != 1)
+        return;
+    pthread_mutex_lock(&lock);
+    buf->next = idle;
+    idle = buf;
+    idle_bytes += buf->size;
+    pthread_mutex_unlock(&lock);
+}
+
+void pool_trim(void)
+{
+    pthread_mutex_lock(&lock);
+    pool_buf_t *list = idle;
+    for (pool_buf_t *b = list; b; b = b->next)
+        mapped_bytes -= b->size;
+    idle = NULL;
+    idle_bytes = 0;
+    pthread_mutex_unlock(&lock);
+
+    while (list) {
+        pool_buf_t *next = list->next;
+        unmap_buf(list);
+        list = next;
+    }
+}
+
+void pool_usage(size_t *mapped, size_t *idle_out, uint64_t *maps)
+{
+    pthread_mutex_lock(&lock);
+    if (mapped)   *mapped   = mapped_bytes;
+    if (idle_out) *idle_out = idle_bytes;
+    if (maps)     *maps     = map_count;
+    pthread_mutex_unlock(&lock);
+}
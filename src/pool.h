@@ -0,0 +1,50 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Process-wide pool of page-aligned frame buffers.
+ *
+ * Rings, the X11 fallback image and V4L2 userptr buffers lease their
+ * memory here instead of calling malloc() per owner.  A buffer whose
+ * last reference is dropped goes back to the pool, not to the system,
+ * so rebuilding the pipeline (pipeline_renegotiate) at the same or a
+ * smaller size reuses it and steady-state streaming maps nothing.
+ * Buffers of 2 MiB and up are huge-page backed where the system allows
+ * it (Linux: reserved hugetlbfs pages, else transparent huge pages),
+ * which saves TLB misses on 4K/8K frames.
+ *
+ * pool_get() and the last pool_put() take a mutex; ref/put otherwise
+ * cost one atomic, so buffers can be handed between threads freely.
+ */
+
+typedef struct pool_buf {
+    uint8_t         *data;    /* page-aligned, at least the requested size */
+    size_t           size;    /* usable bytes */
+    atomic_int       refs;
+    int              huge;    /* backed by huge pages */
+    struct pool_buf *next;    /* pool bookkeeping */
+} pool_buf_t;
+
+/*
+ * Lease a buffer of at least size bytes with one reference.  Contents
+ * are undefined (a reused buffer keeps its old pixels).  NULL on failure.
+ */
+pool_buf_t *pool_get(size_t size);
+
+/* Take another reference. */
+void pool_ref(pool_buf_t *buf);
+
+/* Drop a reference; the last one returns the buffer to the pool.  NULL-safe. */
+void pool_put(pool_buf_t *buf);
+
+/* Unmap every idle buffer, e.g. once a rebuilt pipeline has taken what it needs. */
+void pool_trim(void);
+
+/* Bytes mapped in total and, of those, idle in the pool; maps made so far. */
+void pool_usage(size_t *mapped, size_t *idle, uint64_t *maps);
+
+#endif /* POOL_H */
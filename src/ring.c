@@ -0,0 +1,271 @@
+/*
+ * Lock-free SPSC frame ring
+ *
+ * Buffers never move; only slot indices do.  Two index queues link the
+ * threads:
+ *
+ *   fill  producer -> consumer   filled slots, oldest at tail
+ *   free  consumer -> producer   slots the consumer has finished with
+ *
+ * With depth + 2 slots the producer can always get a free slot after a
+ * successful publish (at most `depth` queued, one held by the consumer).
+ * Under RING_DROP_OLDEST the producer may also pop the fill queue itself;
+ * both sides therefore claim the tail with a CAS, which is the only
+ * read-modify-write on the fast path.  Sleeping uses a condvar, and the
+ * mutex is only taken when a waiter is actually parked on it.
+ */
+
+#include "ring.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+
+struct ring {
+    ring_policy_t   policy;
+    int             depth;
+    int             nslots;
+    ring_slot_t    *slots;
+
+    atomic_int     *fill;          /* depth entries */
+    atomic_uint     fill_head;     /* written by producer */
+    atomic_uint     fill_tail;     /* CAS by consumer (and producer on drop) */
+
+    int            *free_q;        /* nslots entries */
+    atomic_uint     free_head;     /* written by consumer */
+    atomic_uint     free_tail;     /* written by producer */
+
+    int             writer;        /* slot owned by the producer */
+    int             reader;        /* slot owned by the consumer, or -1 */
+
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    atomic_int      waiters;
+    atomic_int      closed;
+    atomic_ullong   dropped;
+};
+
+/* ── Sleep / wake ──────────────────────────────────────────── */
+
+static void ring_notify(ring_t *r)
+{
+    if (atomic_load(&r->waiters) == 0)
+        return;
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+/* Sleep until ready(r) holds or the ring is closed. */
+static void ring_wait(ring_t *r, int (*ready)(ring_t *))
+{
+    pthread_mutex_lock(&r->lock);
+    atomic_fetch_add(&r->waiters, 1);
+    while (!ready(r) && !atomic_load(&r->closed))
+        pthread_cond_wait(&r->cond, &r->lock);
+    atomic_fetch_sub(&r->waiters, 1);
+    pthread_mutex_unlock(&r->lock);
+}
+
+static int fill_has_data(ring_t *r)
+{
+    return atomic_load(&r->fill_head) != atomic_load(&r->fill_tail);
+}
+
+static int fill_has_space(ring_t *r)
+{
+    return atomic_load(&r->fill_head) - atomic_load(&r->fill_tail)
+           < (unsigned)r->depth;
+}
+
+static int free_has_slot(ring_t *r)
+{
+    return atomic_load(&r->free_head) != atomic_load(&r->free_tail);
+}
+
+/* ── Lifecycle ─────────────────────────────────────────────── */
+
+ring_t *ring_create(int depth, size_t slot_size, ring_policy_t policy)
+{
+    if (depth < 1)
+        return NULL;
+
+    ring_t *r = calloc(1, sizeof(*r));
+    if (!r)
+        return NULL;
+
+    r->policy = policy;
+    r->depth  = depth;
+    r->nslots = depth + 2;
+    r->reader = -1;
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->cond, NULL);
+
+    r->slots  = calloc((size_t)r->nslots, sizeof(*r->slots));
+    r->fill   = calloc((size_t)depth, sizeof(*r->fill));
+    r->free_q = calloc((size_t)r->nslots, sizeof(*r->free_q));
+    if (!r->slots || !r->fill || !r->free_q) {
+        ring_free(r);
+        return NULL;
+    }
+
+    for (int i = 0; i < r->nslots; i++) {
+        r->slots[i].size  = slot_size;
+        r->slots[i].index = i;
+        if (!slot_size)
+            continue;
+        r->slots[i].buf = pool_get(slot_size);
+        if (!r->slots[i].buf) {
+            ring_free(r);
+            return NULL;
+        }
+        r->slots[i].data = r->slots[i].buf->data;
+    }
+
+    /* Slot 0 goes to the producer, the rest start on the free queue */
+    r->writer = 0;
+    for (int i = 1; i < r->nslots; i++)
+        r->free_q[i - 1] = i;
+    atomic_init(&r->free_head, (unsigned)(r->nslots - 1));
+    atomic_init(&r->free_tail, 0);
+    atomic_init(&r->fill_head, 0);
+    atomic_init(&r->fill_tail, 0);
+    atomic_init(&r->waiters, 0);
+    atomic_init(&r->closed, 0);
+    atomic_init(&r->dropped, 0);
+    return r;
+}
+
+void ring_close(ring_t *r)
+{
+    atomic_store(&r->closed, 1);
+    pthread_mutex_lock(&r->lock);
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->lock);
+}
+
+void ring_free(ring_t *r)
+{
+    if (!r)
+        return;
+    if (r->slots) {
+        for (int i = 0; i < r->nslots; i++)
+            pool_put(r->slots[i].buf);
+    }
+    pthread_cond_destroy(&r->cond);
+    pthread_mutex_destroy(&r->lock);
+    free(r->slots);
+    free((void *)r->fill);
+    free(r->free_q);
+    free(r);
+}
+
+int ring_slot_count(const ring_t *r)
+{
+    return r->nslots;
+}
+
+uint64_t ring_dropped(const ring_t *r)
+{
+    return atomic_load(&((ring_t *)r)->dropped);
+}
+
+/* ── Producer ──────────────────────────────────────────────── */
+
+ring_slot_t *ring_write_slot(ring_t *r)
+{
+    return &r->slots[r->writer];
+}
+
+int ring_publish(ring_t *r)
+{
+    int stolen = -1;
+
+    for (;;) {
+        if (atomic_load(&r->closed))
+            return -1;
+
+        unsigned h = atomic_load_explicit(&r->fill_head, memory_order_relaxed);
+        unsigned t = atomic_load_explicit(&r->fill_tail, memory_order_acquire);
+        if (h - t < (unsigned)r->depth)
+            break;
+
+        if (r->policy == RING_BLOCK) {
+            ring_wait(r, fill_has_space);
+            continue;
+        }
+
+        /* Drop oldest: claim the tail entry exactly like the consumer does */
+        int idx = atomic_load_explicit(&r->fill[t % (unsigned)r->depth],
+                                       memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&r->fill_tail, &t, t + 1,
+                                                  memory_order_acq_rel,
+                                                  memory_order_relaxed)) {
+            stolen = idx;
+            atomic_fetch_add_explicit(&r->dropped, 1, memory_order_relaxed);
+        }
+    }
+
+    unsigned h = atomic_load_explicit(&r->fill_head, memory_order_relaxed);
+    atomic_store_explicit(&r->fill[h % (unsigned)r->depth], r->writer,
+                          memory_order_relaxed);
+    atomic_store_explicit(&r->fill_head, h + 1, memory_order_seq_cst);
+    ring_notify(r);
+
+    if (stolen >= 0) {
+        r->writer = stolen;
+        return 1;
+    }
+
+    /* Take a free slot; one is always available unless we are closing */
+    while (!free_has_slot(r)) {
+        if (atomic_load(&r->closed))
+            return -1;
+        ring_wait(r, free_has_slot);
+    }
+    unsigned ft = atomic_load_explicit(&r->free_tail, memory_order_relaxed);
+    r->writer = r->free_q[ft % (unsigned)r->nslots];
+    atomic_store_explicit(&r->free_tail, ft + 1, memory_order_release);
+    return 0;
+}
+
+/* ── Consumer ──────────────────────────────────────────────── */
+
+ring_slot_t *ring_pop(ring_t *r)
+{
+    ring_release(r);
+
+    for (;;) {
+        if (atomic_load(&r->closed))
+            return NULL;
+
+        unsigned t = atomic_load_explicit(&r->fill_tail, memory_order_acquire);
+        unsigned h = atomic_load_explicit(&r->fill_head, memory_order_acquire);
+        if (t == h) {
+            ring_wait(r, fill_has_data);
+            continue;
+        }
+
+        int idx = atomic_load_explicit(&r->fill[t % (unsigned)r->depth],
+                                       memory_order_relaxed);
+        if (atomic_compare_exchange_weak_explicit(&r->fill_tail, &t, t + 1,
+                                                  memory_order_seq_cst,
+                                                  memory_order_relaxed)) {
+            r->reader = idx;
+            ring_notify(r);
+            return &r->slots[idx];
+        }
+    }
+}
+
+void ring_release(ring_t *r)
+{
+    if (r->reader < 0)
+        return;
+
+    unsigned fh = atomic_load_explicit(&r->free_head, memory_order_relaxed);
+    r->free_q[fh % (unsigned)r->nslots] = r->reader;
+    atomic_store_explicit(&r->free_head, fh + 1, memory_order_seq_cst);
+    r->reader = -1;
+    ring_notify(r);
+}
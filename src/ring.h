@@ -0,0 +1,75 @@
+#ifndef RING_H
+#define RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pool.h"
+
+/*
+ * Bounded single-producer / single-consumer ring of preallocated frames.
+ *
+ * All frame buffers are leased from the frame pool (pool.h) up front and
+ * returned to it by ring_free(), so a ring rebuilt at the same size costs
+ * no new memory.  The producer always owns one
+ * slot to fill, the consumer owns at most one slot to read, and up to
+ * `depth` filled slots wait in between — so depth + 2 buffers in total
+ * and no allocation or copy while streaming.  Slots move between the two
+ * threads by index through lock-free queues; a mutex/condvar pair is only
+ * touched to sleep when the ring is empty (consumer) or full (producer,
+ * block policy).
+ */
+
+typedef enum {
+    RING_DROP_OLDEST,   /* full ring: discard the oldest queued frame */
+    RING_BLOCK          /* full ring: producer waits for the consumer */
+} ring_policy_t;
+
+typedef struct {
+    uint8_t    *data;     /* buf->data, page-aligned */
+    size_t      size;     /* bytes requested for the slot */
+    pool_buf_t *buf;      /* NULL for an index-only ring */
+    uint64_t    seq;      /* frame number, set by the producer */
+    int         index;    /* 0 .. ring_slot_count() - 1, fixed per buffer */
+} ring_slot_t;
+
+typedef struct ring ring_t;
+
+/*
+ * Returns NULL on failure.  depth >= 1.  slot_size may be 0 for a ring
+ * that only hands out slot indices (data is then NULL).
+ */
+ring_t *ring_create(int depth, size_t slot_size, ring_policy_t policy);
+
+/* Producer: the slot to fill next.  Always available. */
+ring_slot_t *ring_write_slot(ring_t *r);
+
+/*
+ * Producer: queue the filled write slot and take a fresh one.
+ * Returns 1 if an older frame was dropped to make room, 0 if not,
+ * -1 if the ring was closed while waiting.
+ */
+int ring_publish(ring_t *r);
+
+/*
+ * Consumer: wait for the oldest queued slot and take ownership of it.
+ * Any slot still held from the previous call is released first.
+ * Returns NULL once the ring is closed.
+ */
+ring_slot_t *ring_pop(ring_t *r);
+
+/* Consumer: hand the slot from ring_pop() back to the producer. */
+void ring_release(ring_t *r);
+
+/* Wake both sides and make further waits fail.  Use before joining. */
+void ring_close(ring_t *r);
+
+/* Number of buffers (depth + 2), for per-slot side tables. */
+int ring_slot_count(const ring_t *r);
+
+/* Frames discarded by the drop-oldest policy so far. */
+uint64_t ring_dropped(const ring_t *r);
+
+void ring_free(ring_t *r);
+
+#endif /* RING_H */
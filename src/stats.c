@@ -0,0 +1,315 @@
+/*
+ * Per-stage timing histograms and their reports (see stats.h).
+ *
+ * StatsD gets, per interval, the frame rate and counters as gauges and
+ * each stage's p50/p90/p99/max in milliseconds, all in one datagram
+ * (newline-separated, which StatsD, Telegraf and DogStatsD accept).
+ * Quantiles are computed here rather than sent as raw timers, so the
+ * datagram stays the same size whatever the frame rate.
+ */
+
+#include "stats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET sock_t;
+#define close_socket closesocket
+#else
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int sock_t;
+#define INVALID_SOCKET (-1)
+#define close_socket   close
+#endif
+
+#define STATS_UNIT_SHIFT 10   /* buckets count in 1024 ns units */
+
+/* ── Histograms ────────────────────────────────────────────── */
+
+static int bucket_of(uint64_t ns)
+{
+    uint64_t v = ns >> STATS_UNIT_SHIFT;
+    if (v < 8)
+        return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int idx = (msb - 2) * 8 + (int)((v >> (msb - 3)) & 7);
+    return idx < STATS_BUCKETS ? idx : STATS_BUCKETS - 1;
+}
+
+/* Middle of bucket idx, in ns. */
+static uint64_t bucket_value(int idx)
+{
+    if (idx < 8)
+        return ((uint64_t)idx << STATS_UNIT_SHIFT) + (1u << (STATS_UNIT_SHIFT - 1));
+    int shift = idx / 8 - 1;   /* msb - 3 */
+    uint64_t low = (uint64_t)(8 + idx % 8) << shift;
+    return (low << STATS_UNIT_SHIFT) + ((uint64_t)1 << (shift + STATS_UNIT_SHIFT - 1));
+}
+
+void stats_init(stats_hist_t *h)
+{
+    atomic_init(&h->count, 0);
+    atomic_init(&h->sum_ns, 0);
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        atomic_init(&h->buckets[i], 0);
+}
+
+void stats_record(stats_hist_t *h, uint64_t ns)
+{
+    atomic_fetch_add_explicit(&h->buckets[bucket_of(ns)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+    atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+}
+
+void stats_read(const stats_hist_t *h, stats_dist_t *out)
+{
+    stats_hist_t *q = (stats_hist_t *)h;
+    out->count  = atomic_load_explicit(&q->count, memory_order_relaxed);
+    out->sum_ns = atomic_load_explicit(&q->sum_ns, memory_order_relaxed);
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        out->buckets[i] = atomic_load_explicit(&q->buckets[i], memory_order_relaxed);
+}
+
+void stats_sub(stats_dist_t *d, const stats_dist_t *prev)
+{
+    d->count  -= prev->count;
+    d->sum_ns -= prev->sum_ns;
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        d->buckets[i] -= prev->buckets[i];
+}
+
+uint64_t stats_quantile(const stats_dist_t *d, double q)
+{
+    /* Sum the buckets rather than trust count: a read can land between
+       the adds of one stats_record() */
+    uint64_t total = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++)
+        total += d->buckets[i];
+    if (!total)
+        return 0;
+
+    uint64_t rank = (uint64_t)(q * (double)total + 0.5);
+    if (rank < 1)
+        rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += d->buckets[i];
+        if (seen >= rank)
+            return bucket_value(i);
+    }
+    return bucket_value(STATS_BUCKETS - 1);
+}
+
+/* ── Reports ───────────────────────────────────────────────── */
+
+static double ms(uint64_t ns)
+{
+    return (double)ns / 1e6;
+}
+
+static double fps_of(const stats_report_t *r)
+{
+    return r->seconds > 0 ? (double)r->frames / r->seconds : 0;
+}
+
+void stats_print(const stats_report_t *r)
+{
+    char line[512];
+    int n = snprintf(line, sizeof(line),
+                     "stats: %.1f fps, %lu unchanged, %lu dropped, %lu skipped | "
+                     "ms p50/p99/max:",
+                     fps_of(r), (unsigned long)r->repeated, (unsigned long)r->dropped,
+                     (unsigned long)r->skipped);
+    for (int i = 0; i < STAGE_COUNT && n > 0 && (size_t)n < sizeof(line); i++) {
+        const stats_dist_t *d = &r->stage[i];
+        if (!d->count)
+            continue;
+        n += snprintf(line + n, sizeof(line) - (size_t)n, " %s %.2f/%.2f/%.2f",
+                      stats_stage_name((stats_stage_t)i), ms(stats_quantile(d, 0.5)),
+                      ms(stats_quantile(d, 0.99)), ms(stats_quantile(d, 1.0)));
+    }
+    fprintf(stderr, "\r%s\n", line);
+}
+
+struct stats_sink {
+    FILE   *json;        /* JSON lines, or NULL */
+    sock_t  fd;          /* StatsD: connected UDP socket */
+    int     wsa;         /* Windows: WSAStartup() taken */
+    char    buf[1400];
+};
+
+/* Split statsd://HOST:PORT ; HOST may be [IPv6]. */
+static int parse_statsd(const char *url, char *host, size_t hostlen,
+                        char *port, size_t portlen)
+{
+    const char *rest = url + strlen("statsd://");
+    const char *end, *colon;
+    if (*rest == '[') {
+        rest++;
+        end = strchr(rest, ']');
+        if (!end || end[1] != ':')
+            return -1;
+        colon = end + 1;
+    } else {
+        colon = strrchr(rest, ':');
+        if (!colon)
+            return -1;
+        end = colon;
+    }
+
+    size_t n = (size_t)(end - rest);
+    size_t pn = strlen(colon + 1);
+    if (n == 0 || n >= hostlen || pn == 0 || pn >= portlen)
+        return -1;
+    memcpy(host, rest, n);
+    host[n] = '\0';
+    memcpy(port, colon + 1, pn + 1);
+    return 0;
+}
+
+static int open_statsd(stats_sink_t *s, const char *url)
+{
+    char host[256], port[16];
+    if (parse_statsd(url, host, sizeof(host), port, sizeof(port)) < 0) {
+        fprintf(stderr, "stats: bad address '%s' (want statsd://HOST:PORT)\n", url);
+        return -1;
+    }
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        fprintf(stderr, "stats: WSAStartup failed\n");
+        return -1;
+    }
+    s->wsa = 1;
+#endif
+
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "stats: %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+        s->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (s->fd == INVALID_SOCKET)
+            continue;
+        if (connect(s->fd, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+            break;
+        close_socket(s->fd);
+        s->fd = INVALID_SOCKET;
+    }
+    freeaddrinfo(res);
+    if (!ai) {
+        fprintf(stderr, "stats: cannot reach %s:%s\n", host, port);
+        return -1;
+    }
+    return 0;
+}
+
+stats_sink_t *stats_sink_open(const char *dest)
+{
+    stats_sink_t *s = calloc(1, sizeof(*s));
+    if (!s)
+        return NULL;
+    s->fd = INVALID_SOCKET;
+
+    if (strncmp(dest, "statsd://", 9) == 0) {
+        if (open_statsd(s, dest) < 0) {
+            stats_sink_close(s);
+            return NULL;
+        }
+        fprintf(stderr, "stats: sending to StatsD at %s\n", dest + 9);
+        return s;
+    }
+
+    s->json = fopen(dest, "a");
+    if (!s->json) {
+        perror(dest);
+        free(s);
+        return NULL;
+    }
+    fprintf(stderr, "stats: appending JSON to %s\n", dest);
+    return s;
+}
+
+static int send_statsd(stats_sink_t *s, const stats_report_t *r)
+{
+    size_t size = sizeof(s->buf);
+    int n = snprintf(s->buf, size,
+                     "screen2cam.fps:%.2f|g\nscreen2cam.frames:%lu|c\n"
+                     "screen2cam.repeated:%lu|c\nscreen2cam.dropped:%lu|c\n"
+                     "screen2cam.skipped:%lu|c",
+                     fps_of(r), (unsigned long)r->frames, (unsigned long)r->repeated,
+                     (unsigned long)r->dropped, (unsigned long)r->skipped);
+
+    static const struct { const char *name; double q; } qs[] = {
+        { "p50", 0.5 }, { "p90", 0.9 }, { "p99", 0.99 }, { "max", 1.0 }
+    };
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        if (!r->stage[i].count)
+            continue;
+        for (size_t j = 0; j < sizeof(qs) / sizeof(qs[0]) && n > 0 && (size_t)n < size; j++)
+            n += snprintf(s->buf + n, size - (size_t)n, "\nscreen2cam.%s.%s:%.3f|g",
+                          stats_stage_name((stats_stage_t)i), qs[j].name,
+                          ms(stats_quantile(&r->stage[i], qs[j].q)));
+    }
+    if (n < 0 || (size_t)n >= size)
+        n = (int)strlen(s->buf);
+
+    /* Best effort: a collector that is down must not stop the stream */
+    send(s->fd, s->buf, n, 0);
+    return 0;
+}
+
+static int send_json(stats_sink_t *s, const stats_report_t *r)
+{
+    fprintf(s->json,
+            "{\"time\":%lld,\"seconds\":%.3f,\"fps\":%.2f,\"frames\":%lu,"
+            "\"repeated\":%lu,\"dropped\":%lu,\"skipped\":%lu,\"stages\":{",
+            (long long)time(NULL), r->seconds, fps_of(r), (unsigned long)r->frames,
+            (unsigned long)r->repeated, (unsigned long)r->dropped,
+            (unsigned long)r->skipped);
+    for (int i = 0; i < STAGE_COUNT; i++) {
+        const stats_dist_t *d = &r->stage[i];
+        fprintf(s->json,
+                "%s\"%s\":{\"count\":%lu,\"mean_ms\":%.3f,\"p50_ms\":%.3f,"
+                "\"p90_ms\":%.3f,\"p99_ms\":%.3f,\"max_ms\":%.3f}",
+                i ? "," : "", stats_stage_name((stats_stage_t)i), (unsigned long)d->count,
+                d->count ? ms(d->sum_ns) / (double)d->count : 0.0,
+                ms(stats_quantile(d, 0.5)), ms(stats_quantile(d, 0.9)),
+                ms(stats_quantile(d, 0.99)), ms(stats_quantile(d, 1.0)));
+    }
+    fprintf(s->json, "}}\n");
+    return fflush(s->json) == 0 ? 0 : -1;
+}
+
+int stats_sink_send(stats_sink_t *s, const stats_report_t *r)
+{
+    return s->json ? send_json(s, r) : send_statsd(s, r);
+}
+
+void stats_sink_close(stats_sink_t *s)
+{
+    if (!s)
+        return;
+    if (s->json)
+        fclose(s->json);
+    if (s->fd != INVALID_SOCKET)
+        close_socket(s->fd);
+#ifdef _WIN32
+    if (s->wsa)
+        WSACleanup();
+#endif
+    free(s);
+}
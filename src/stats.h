@@ -0,0 +1,89 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * Per-stage timing: lock-free log-linear histograms.
+ *
+ * A stage thread adds each duration with stats_record(): three relaxed
+ * atomic adds, no lock, no allocation, so the histograms stay on in
+ * every run.  Any other thread may read them at any time with
+ * stats_read(); the counts only grow, so the distribution over an
+ * interval is the difference of two reads (stats_sub).
+ *
+ * Buckets are 8 per power of two of 1.024 us units, so a quantile is
+ * within 12.5% of the true value, from 1 us up to about a minute.
+ */
+
+typedef enum {
+    STAGE_GRAB,      /* capture_grab() / capture_acquire() */
+    STAGE_CONVERT,   /* BGRA -> output format (and scale) of one frame */
+    STAGE_ENCODE,    /* encoder_encode(), with --codec */
+    STAGE_WRITE,     /* vcam_write(), vcam_repeat(), vcam_submit(), vcam_write_packet() */
+    STAGE_LATENCY,   /* capture time -> handed to the output, end to end */
+    STAGE_COUNT
+} stats_stage_t;
+
+#define STATS_BUCKETS 208
+
+typedef struct {
+    atomic_ullong count;
+    atomic_ullong sum_ns;
+    atomic_ullong buckets[STATS_BUCKETS];
+} stats_hist_t;
+
+/* A plain copy of a histogram, to compute on. */
+typedef struct {
+    uint64_t count;
+    uint64_t sum_ns;
+    uint64_t buckets[STATS_BUCKETS];
+} stats_dist_t;
+
+/* Counters and stage timings over one reporting interval. */
+typedef struct {
+    double       seconds;    /* length of the interval */
+    uint64_t     frames;     /* handed to the output */
+    uint64_t     repeated;   /* of those, unchanged repeats */
+    uint64_t     dropped;    /* dropped between stages */
+    uint64_t     skipped;    /* frame times the capture thread missed */
+    stats_dist_t stage[STAGE_COUNT];
+} stats_report_t;
+
+static inline const char *stats_stage_name(stats_stage_t stage)
+{
+    switch (stage) {
+    case STAGE_GRAB:    return "grab";
+    case STAGE_CONVERT: return "convert";
+    case STAGE_ENCODE:  return "encode";
+    case STAGE_WRITE:   return "write";
+    default:            return "latency";
+    }
+}
+
+void stats_init(stats_hist_t *h);
+void stats_record(stats_hist_t *h, uint64_t ns);
+void stats_read(const stats_hist_t *h, stats_dist_t *out);
+
+/* d -= prev: what was recorded between the two reads. */
+void stats_sub(stats_dist_t *d, const stats_dist_t *prev);
+
+/* Value below which a fraction q (0-1) of d lies, in ns; 0 if d is empty. */
+uint64_t stats_quantile(const stats_dist_t *d, double q);
+
+/*
+ * Where periodic reports go besides the summary line on stderr:
+ *   statsd://HOST:PORT   StatsD/DogStatsD over UDP (gauges and timers, ms)
+ *   PATH                 one JSON object per interval, appended to PATH
+ */
+typedef struct stats_sink stats_sink_t;
+
+stats_sink_t *stats_sink_open(const char *dest);
+int  stats_sink_send(stats_sink_t *s, const stats_report_t *r);
+void stats_sink_close(stats_sink_t *s);
+
+/* Print r as one summary line on stderr. */
+void stats_print(const stats_report_t *r);
+
+#endif /* STATS_H */
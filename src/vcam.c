@@ -1,4 +1,32 @@
+/*
+ * Linux Virtual Camera Output (v4l2loopback)
+ *
+ * Prefers V4L2 streaming I/O: the pipeline converts straight into driver
+ * buffers (V4L2_MEMORY_MMAP) or into frame pool buffers (pool.h) that the
+ * driver reads in place (V4L2_MEMORY_USERPTR), and frames change hands with
+ * VIDIOC_QBUF / VIDIOC_DQBUF.  That saves the write() copy of every frame
+ * into the kernel.  If the device refuses both, frames go through write().
+ *
+ * The pixel format is I420, NV12 or YUYV.  With --format auto we use the
+ * format already configured on the device (by a consumer or
+ * v4l2loopback-ctl set-caps) if we can produce it, otherwise the best one
+ * VIDIOC_ENUM_FMT lists, so the consumer can skip its own repack.
+ *
+ * Buffers are laid out with the bytesperline the driver reports, and
+ * handed to the pipeline as frame_t descriptors with those strides.
+ *
+ * With --codec the device is set to H.264 or MJPEG instead and every
+ * encoded packet goes out with one write(), which v4l2loopback takes
+ * as one frame of that size.
+ *
+ * --device shm:NAME writes to shared memory instead (vcam_shm.h), for
+ * readers on this host without the kernel module.
+ */
+
 #include "vcam.h"
+#include "pool.h"
+#include "vcam_net.h"
+#include "vcam_shm.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,39 +34,225 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <linux/videodev2.h>
 
+#define VCAM_BUFFERS 4
+
+typedef enum {
+    VCAM_IO_WRITE,     /* write() fallback */
+    VCAM_IO_MMAP,      /* driver-allocated buffers mapped into our space */
+    VCAM_IO_USERPTR    /* our buffers, read by the driver in place */
+} vcam_io_t;
+
 struct vcam_ctx {
     int    fd;
-    int    width;
-    int    height;
-    size_t frame_size;   /* width * height * 3 / 2 for YUV420P */
+    codec_t   codec;       /* CODEC_RAW unless opened with vcam_open_coded() */
+    int       width;
+    int       height;
+    pix_fmt_t format;
+    size_t    stride;      /* bytesperline of the first plane */
+    size_t    frame_size;  /* bytes per frame in the device's layout */
+    pool_buf_t *scratch;   /* write(): frames repacked to the layout */
+    vcam_net_t *net;       /* rtp:// or srt:// device, instead of fd */
+    vcam_shm_t *shm;       /* shm:NAME device, instead of fd */
+
+    /* Streaming I/O */
+    vcam_io_t io;
+    int       nbufs;
+    uint8_t  *bufs[VCAM_BUFFERS];
+    size_t    buf_len[VCAM_BUFFERS];
+    pool_buf_t *leases[VCAM_BUFFERS];  /* userptr: the pool buffers behind bufs */
+    frame_t   frames[VCAM_BUFFERS];  /* descriptors of bufs */
+    int       queued;    /* buffers handed to the driver at least once */
+    int       current;   /* buffer returned by vcam_acquire(), or -1 */
+    int       streaming; /* VIDIOC_STREAMON done */
 };
 
-vcam_ctx_t *vcam_open(const char *device, int width, int height)
+static int xioctl(int fd, unsigned long req, void *arg)
+{
+    int r;
+    do {
+        r = ioctl(fd, req, arg);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+static void release_buffers(vcam_ctx_t *ctx)
+{
+    for (int i = 0; i < ctx->nbufs; i++) {
+        if (!ctx->bufs[i])
+            continue;
+        if (ctx->io == VCAM_IO_MMAP)
+            munmap(ctx->bufs[i], ctx->buf_len[i]);
+        else
+            pool_put(ctx->leases[i]);
+        ctx->bufs[i]   = NULL;
+        ctx->leases[i] = NULL;
+    }
+    ctx->nbufs = 0;
+
+    /* Hand the (possibly partial) allocation back to the driver */
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = ctx->io == VCAM_IO_MMAP ? V4L2_MEMORY_MMAP : V4L2_MEMORY_USERPTR;
+    xioctl(ctx->fd, VIDIOC_REQBUFS, &req);
+    ctx->io = VCAM_IO_WRITE;
+}
+
+/* Negotiate streaming buffers of the given memory type.  Returns 0 on success. */
+static int request_buffers(vcam_ctx_t *ctx, vcam_io_t io)
+{
+    struct v4l2_requestbuffers req;
+    memset(&req, 0, sizeof(req));
+    req.count  = VCAM_BUFFERS;
+    req.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    req.memory = io == VCAM_IO_MMAP ? V4L2_MEMORY_MMAP : V4L2_MEMORY_USERPTR;
+
+    if (xioctl(ctx->fd, VIDIOC_REQBUFS, &req) < 0 || req.count < 2)
+        return -1;
+
+    ctx->io    = io;
+    ctx->nbufs = req.count < VCAM_BUFFERS ? (int)req.count : VCAM_BUFFERS;
+
+    for (int i = 0; i < ctx->nbufs; i++) {
+        if (io == VCAM_IO_MMAP) {
+            struct v4l2_buffer buf;
+            memset(&buf, 0, sizeof(buf));
+            buf.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+            buf.memory = V4L2_MEMORY_MMAP;
+            buf.index  = i;
+            if (xioctl(ctx->fd, VIDIOC_QUERYBUF, &buf) < 0 ||
+                buf.length < ctx->frame_size)
+                goto fail;
+
+            void *p = mmap(NULL, buf.length, PROT_READ | PROT_WRITE,
+                           MAP_SHARED, ctx->fd, buf.m.offset);
+            if (p == MAP_FAILED)
+                goto fail;
+            ctx->bufs[i]    = p;
+            ctx->buf_len[i] = buf.length;
+        } else {
+            pool_buf_t *b = pool_get(ctx->frame_size);
+            if (!b)
+                goto fail;
+            ctx->leases[i]  = b;
+            ctx->bufs[i]    = b->data;
+            ctx->buf_len[i] = b->size;
+        }
+        frame_init_strided(&ctx->frames[i], ctx->format, ctx->width, ctx->height,
+                           ctx->bufs[i], ctx->stride);
+    }
+    return 0;
+
+fail:
+    release_buffers(ctx);
+    return -1;
+}
+
+static uint32_t fourcc_of(pix_fmt_t fmt)
+{
+    switch (fmt) {
+    case PIX_FMT_NV12:  return V4L2_PIX_FMT_NV12;
+    case PIX_FMT_YUYV:  return V4L2_PIX_FMT_YUYV;
+    case PIX_FMT_BGRA:  return V4L2_PIX_FMT_ABGR32;   /* B, G, R, A in memory */
+    case PIX_FMT_RGBA:  return V4L2_PIX_FMT_RGBA32;   /* R, G, B, A in memory */
+    case PIX_FMT_RGB24: return V4L2_PIX_FMT_RGB24;
+    default:            return V4L2_PIX_FMT_YUV420;
+    }
+}
+
+static pix_fmt_t negotiate_format(int fd)
+{
+    /* Preferred when the device leaves the choice to us: smallest first */
+    static const pix_fmt_t prefs[] = { PIX_FMT_NV12, PIX_FMT_YUV420P, PIX_FMT_YUYV };
+    int listed[3] = { 0, 0, 0 };
+
+    struct v4l2_format cur;
+    memset(&cur, 0, sizeof(cur));
+    cur.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    int have_cur = xioctl(fd, VIDIOC_G_FMT, &cur) == 0;
+
+    struct v4l2_fmtdesc desc;
+    memset(&desc, 0, sizeof(desc));
+    desc.type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    for (; xioctl(fd, VIDIOC_ENUM_FMT, &desc) == 0; desc.index++) {
+        for (int i = 0; i < 3; i++) {
+            if (desc.pixelformat == fourcc_of(prefs[i]))
+                listed[i] = 1;
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        if (have_cur && cur.fmt.pix.pixelformat == fourcc_of(prefs[i]))
+            return prefs[i];
+    }
+    for (int i = 0; i < 3; i++) {
+        if (listed[i])
+            return prefs[i];
+    }
+    return PIX_FMT_YUV420P;
+}
+
+static vcam_ctx_t *open_device(const char *device)
 {
     vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
         return NULL;
 
-    ctx->fd = open(device, O_WRONLY);
+    /* Read access is needed to mmap driver buffers */
+    ctx->fd = open(device, O_RDWR);
+    if (ctx->fd < 0)
+        ctx->fd = open(device, O_WRONLY);
     if (ctx->fd < 0) {
         fprintf(stderr, "vcam: cannot open %s: %s\n", device, strerror(errno));
         free(ctx);
         return NULL;
     }
+    ctx->current = -1;
+    return ctx;
+}
+
+vcam_ctx_t *vcam_open(const char *device, int width, int height, pix_fmt_t format)
+{
+    if (vcam_shm_is_name(device)) {
+        vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
+        if (!ctx)
+            return NULL;
+        ctx->fd      = -1;
+        ctx->current = -1;
+        ctx->width   = width;
+        ctx->height  = height;
+        ctx->shm     = vcam_shm_open(device, width, height, format);
+        if (!ctx->shm) {
+            free(ctx);
+            return NULL;
+        }
+        ctx->format  = vcam_shm_format(ctx->shm);
+        return ctx;
+    }
+
+    vcam_ctx_t *ctx = open_device(device);
+    if (!ctx)
+        return NULL;
+
+    if (format == PIX_FMT_AUTO)
+        format = negotiate_format(ctx->fd);
 
     ctx->width      = width;
     ctx->height     = height;
-    ctx->frame_size = (size_t)width * height * 3 / 2;
+    ctx->format     = format;
+    ctx->frame_size = pix_fmt_frame_size(format, width, height);
 
     struct v4l2_format fmt;
     memset(&fmt, 0, sizeof(fmt));
     fmt.type                = V4L2_BUF_TYPE_VIDEO_OUTPUT;
     fmt.fmt.pix.width       = width;
     fmt.fmt.pix.height      = height;
-    fmt.fmt.pix.pixelformat = V4L2_PIX_FMT_YUV420;
+    fmt.fmt.pix.pixelformat = fourcc_of(format);
     fmt.fmt.pix.sizeimage   = ctx->frame_size;
     fmt.fmt.pix.field       = V4L2_FIELD_NONE;
 
@@ -48,19 +262,261 @@ vcam_ctx_t *vcam_open(const char *device, int width, int height)
         free(ctx);
         return NULL;
     }
+    if (fmt.fmt.pix.pixelformat != fourcc_of(format)) {
+        fprintf(stderr, "vcam: %s does not accept %s\n", device, pix_fmt_name(format));
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+    /* v4l2loopback may keep an earlier size (keep_format) or clamp it */
+    if ((int)fmt.fmt.pix.width != width || (int)fmt.fmt.pix.height != height) {
+        fprintf(stderr, "vcam: %s wants %ux%u, not %dx%d (use --size or reload the module)\n",
+                device, fmt.fmt.pix.width, fmt.fmt.pix.height, width, height);
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+
+    /* The driver may pad rows; lay our frames out the way it expects */
+    ctx->stride     = fmt.fmt.pix.bytesperline;
+    ctx->frame_size = pix_fmt_strided_size(format, width, height, ctx->stride);
+    if (fmt.fmt.pix.sizeimage > ctx->frame_size)
+        ctx->frame_size = fmt.fmt.pix.sizeimage;
+
+    struct v4l2_capability cap;
+    memset(&cap, 0, sizeof(cap));
+    if (xioctl(ctx->fd, VIDIOC_QUERYCAP, &cap) == 0) {
+        uint32_t caps = (cap.capabilities & V4L2_CAP_DEVICE_CAPS)
+                        ? cap.device_caps : cap.capabilities;
+        if ((caps & V4L2_CAP_STREAMING) &&
+            request_buffers(ctx, VCAM_IO_MMAP) < 0)
+            request_buffers(ctx, VCAM_IO_USERPTR);
+    }
+
+    static const char *io_names[] = { "write", "mmap", "userptr" };
+    fprintf(stderr, "vcam: opened %s %dx%d %s io=%s\n",
+            device, width, height, pix_fmt_name(format), io_names[ctx->io]);
+    return ctx;
+}
+
+vcam_ctx_t *vcam_open_coded(const char *device, int width, int height, codec_t codec,
+                            int fps, int latency_ms)
+{
+    if (vcam_net_is_url(device)) {
+        vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
+        if (!ctx)
+            return NULL;
+        ctx->fd      = -1;
+        ctx->current = -1;
+        ctx->codec   = codec;
+        ctx->width   = width;
+        ctx->height  = height;
+        ctx->format  = PIX_FMT_AUTO;
+        ctx->net     = vcam_net_open(device, codec, width, height, fps, latency_ms);
+        if (!ctx->net) {
+            free(ctx);
+            return NULL;
+        }
+        return ctx;
+    }
+    if (vcam_shm_is_name(device)) {
+        fprintf(stderr, "vcam: shared memory takes raw frames, drop --codec\n");
+        return NULL;
+    }
+
+    vcam_ctx_t *ctx = open_device(device);
+    if (!ctx)
+        return NULL;
+
+    uint32_t fourcc = codec == CODEC_H264 ? V4L2_PIX_FMT_H264 : V4L2_PIX_FMT_MJPEG;
+    ctx->codec      = codec;
+    ctx->width      = width;
+    ctx->height     = height;
+    ctx->format     = PIX_FMT_AUTO;
+    ctx->frame_size = pix_fmt_frame_size(PIX_FMT_YUV420P, width, height);
+
+    /* sizeimage sizes the loopback buffers: room for the largest packet */
+    struct v4l2_format fmt;
+    memset(&fmt, 0, sizeof(fmt));
+    fmt.type                = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    fmt.fmt.pix.width       = width;
+    fmt.fmt.pix.height      = height;
+    fmt.fmt.pix.pixelformat = fourcc;
+    fmt.fmt.pix.sizeimage   = ctx->frame_size;
+    fmt.fmt.pix.field       = V4L2_FIELD_NONE;
+
+    if (ioctl(ctx->fd, VIDIOC_S_FMT, &fmt) < 0 || fmt.fmt.pix.pixelformat != fourcc) {
+        fprintf(stderr, "vcam: %s does not accept %s\n", device, codec_name(codec));
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+    if ((int)fmt.fmt.pix.width != width || (int)fmt.fmt.pix.height != height) {
+        fprintf(stderr, "vcam: %s wants %ux%u, not %dx%d (use --size or reload the module)\n",
+                device, fmt.fmt.pix.width, fmt.fmt.pix.height, width, height);
+        close(ctx->fd);
+        free(ctx);
+        return NULL;
+    }
+    if (fmt.fmt.pix.sizeimage)
+        ctx->frame_size = fmt.fmt.pix.sizeimage;
 
-    fprintf(stderr, "vcam: opened %s %dx%d yuv420p\n", device, width, height);
+    fprintf(stderr, "vcam: opened %s %dx%d %s io=write\n",
+            device, width, height, codec_name(codec));
     return ctx;
 }
 
-int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+int vcam_write_packet(vcam_ctx_t *ctx, const packet_t *pkt)
+{
+    if (ctx->net)
+        return vcam_net_send(ctx->net, pkt);
+    if (pkt->size > ctx->frame_size) {
+        fprintf(stderr, "vcam: %zu-byte packet exceeds the %zu-byte device buffer\n",
+                pkt->size, ctx->frame_size);
+        return -1;
+    }
+
+    /* One write() per packet: the driver takes it as one frame */
+    size_t written = 0;
+    while (written < pkt->size) {
+        ssize_t n = write(ctx->fd, pkt->data + written, pkt->size - written);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("vcam: write");
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
+pix_fmt_t vcam_format(const vcam_ctx_t *ctx)
+{
+    return ctx->format;
+}
+
+int vcam_buffer_count(const vcam_ctx_t *ctx)
+{
+    if (ctx->shm)
+        return vcam_shm_buffer_count(ctx->shm);
+    return ctx->nbufs;
+}
+
+frame_t *vcam_acquire(vcam_ctx_t *ctx, int *index)
+{
+    if (ctx->shm)
+        return vcam_shm_acquire(ctx->shm, index);
+    if (ctx->io == VCAM_IO_WRITE)
+        return NULL;
+
+    /* Buffers start out owned by us; after that, wait for the driver */
+    if (ctx->queued < ctx->nbufs) {
+        ctx->current = ctx->queued;
+    } else {
+        struct v4l2_buffer buf;
+        memset(&buf, 0, sizeof(buf));
+        buf.type   = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        buf.memory = ctx->io == VCAM_IO_MMAP ? V4L2_MEMORY_MMAP : V4L2_MEMORY_USERPTR;
+        if (xioctl(ctx->fd, VIDIOC_DQBUF, &buf) < 0) {
+            perror("vcam: VIDIOC_DQBUF");
+            return NULL;
+        }
+        ctx->current = (int)buf.index;
+    }
+
+    *index = ctx->current;
+    ctx->frames[ctx->current].timestamp_ns = 0;
+    return &ctx->frames[ctx->current];
+}
+
+int vcam_submit(vcam_ctx_t *ctx, int repeat)
 {
-    if (len < ctx->frame_size)
+    if (ctx->shm)
+        return vcam_shm_submit(ctx->shm, repeat);
+
+    (void)repeat;   /* readers expect a steady stream */
+
+    if (ctx->current < 0)
         return -1;
 
+    struct v4l2_buffer buf;
+    memset(&buf, 0, sizeof(buf));
+    buf.type      = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+    buf.index     = ctx->current;
+    buf.bytesused = ctx->frame_size;
+    buf.field     = V4L2_FIELD_NONE;
+
+    /* Capture time if the pipeline knows it, else now */
+    uint64_t ts = ctx->frames[ctx->current].timestamp_ns;
+    if (!ts) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        ts = (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+    }
+    buf.timestamp.tv_sec  = (time_t)(ts / 1000000000u);
+    buf.timestamp.tv_usec = (suseconds_t)(ts % 1000000000u / 1000);
+
+    if (ctx->io == VCAM_IO_MMAP) {
+        buf.memory    = V4L2_MEMORY_MMAP;
+    } else {
+        buf.memory    = V4L2_MEMORY_USERPTR;
+        buf.m.userptr = (unsigned long)ctx->bufs[ctx->current];
+        buf.length    = ctx->buf_len[ctx->current];
+    }
+
+    if (xioctl(ctx->fd, VIDIOC_QBUF, &buf) < 0) {
+        perror("vcam: VIDIOC_QBUF");
+        return -1;
+    }
+    if (ctx->queued < ctx->nbufs)
+        ctx->queued++;
+    ctx->current = -1;
+
+    if (!ctx->streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        if (xioctl(ctx->fd, VIDIOC_STREAMON, &type) < 0) {
+            perror("vcam: VIDIOC_STREAMON");
+            return -1;
+        }
+        ctx->streaming = 1;
+    }
+    return 0;
+}
+
+int vcam_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    if (ctx->shm || ctx->io != VCAM_IO_WRITE) {
+        int index;
+        frame_t *dst = vcam_acquire(ctx, &index);
+        if (!dst)
+            return -1;
+        frame_copy(dst, frame);
+        return vcam_submit(ctx, 0);
+    }
+
+    /* write() takes one contiguous frame in the device's layout */
+    const uint8_t *data = frame->planes[0];
+    if (!frame_is_packed(frame) ||
+        ctx->frame_size != pix_fmt_frame_size(ctx->format, ctx->width, ctx->height)) {
+        if (!ctx->scratch) {
+            ctx->scratch = pool_get(ctx->frame_size);
+            if (!ctx->scratch) {
+                perror("vcam: scratch frame");
+                return -1;
+            }
+            memset(ctx->scratch->data, 0, ctx->frame_size);   /* row padding */
+        }
+        frame_t dst;
+        frame_init_strided(&dst, ctx->format, ctx->width, ctx->height,
+                           ctx->scratch->data, ctx->stride);
+        frame_copy(&dst, frame);
+        data = ctx->scratch->data;
+    }
+
     size_t written = 0;
     while (written < ctx->frame_size) {
-        ssize_t n = write(ctx->fd, yuv420p + written, ctx->frame_size - written);
+        ssize_t n = write(ctx->fd, data + written, ctx->frame_size - written);
         if (n < 0) {
             if (errno == EINTR)
                 continue;
@@ -72,11 +528,29 @@ int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
     return 0;
 }
 
+int vcam_repeat(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    /* Shared-memory readers keep the latest frame; nothing new to announce */
+    if (ctx->shm)
+        return 0;
+    /* Readers expect a steady stream: send the frame again */
+    return vcam_write(ctx, frame);
+}
+
 void vcam_close(vcam_ctx_t *ctx)
 {
     if (!ctx)
         return;
+    vcam_net_close(ctx->net);
+    vcam_shm_close(ctx->shm);
+    if (ctx->streaming) {
+        int type = V4L2_BUF_TYPE_VIDEO_OUTPUT;
+        xioctl(ctx->fd, VIDIOC_STREAMOFF, &type);
+    }
+    if (ctx->io != VCAM_IO_WRITE)
+        release_buffers(ctx);
     if (ctx->fd >= 0)
         close(ctx->fd);
+    pool_put(ctx->scratch);
     free(ctx);
 }
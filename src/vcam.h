@@ -4,21 +4,71 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#include "encode.h"
+#include "pixfmt.h"
+
 typedef struct vcam_ctx vcam_ctx_t;
 
 /*
- * Open a v4l2loopback device and configure it for YUV420 output.
+ * Open a v4l2loopback device and configure it for output in `format`.
  * device: path like "/dev/video10"
+ * PIX_FMT_AUTO picks the format the consumer side prefers; backends that
+ * want the captured BGRA as-is (macOS shared memory) choose PIX_FMT_BGRA
+ * and the pipeline skips color conversion.
  * Returns NULL on failure.
  */
-vcam_ctx_t *vcam_open(const char *device, int width, int height);
+vcam_ctx_t *vcam_open(const char *device, int width, int height, pix_fmt_t format);
 
 /*
- * Write a YUV420P frame to the virtual camera.
- * data must be (width * height * 3 / 2) bytes.
+ * Open device for a compressed stream instead (codec != CODEC_RAW): one
+ * H.264 access unit or JPEG image per vcam_write_packet().  v4l2loopback
+ * is set to V4L2_PIX_FMT_H264 / V4L2_PIX_FMT_MJPEG; pipes get the bare
+ * Annex-B or concatenated-JPEG stream.  vcam_format() is then
+ * PIX_FMT_AUTO and there are no buffers to lend out.
+ *
+ * An rtp:// or srt:// device streams over the network instead (see
+ * vcam_net.h); fps and latency_ms only matter there.
+ */
+vcam_ctx_t *vcam_open_coded(const char *device, int width, int height, codec_t codec,
+                            int fps, int latency_ms);
+
+/* Write one encoded packet.  Returns 0 on success, -1 on failure. */
+int vcam_write_packet(vcam_ctx_t *ctx, const packet_t *pkt);
+
+/* Format chosen by vcam_open(); never PIX_FMT_AUTO for raw output. */
+pix_fmt_t vcam_format(const vcam_ctx_t *ctx);
+
+/*
+ * Write a frame to the virtual camera.  frame must be in vcam_format(ctx)
+ * at the size given to vcam_open(); its rows may be padded.  A non-zero
+ * timestamp_ns is passed on to consumers that take one.
  * Returns 0 on success, -1 on failure.
  */
-int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len);
+int vcam_write(vcam_ctx_t *ctx, const frame_t *frame);
+
+/*
+ * The frame is unchanged since the last write (frame holds it again).
+ * Stream outputs re-send it to keep the consumer's frame rate; outputs
+ * that announce new frames explicitly (macOS shared memory) skip it.
+ * Returns 0 on success, -1 on failure.
+ */
+int vcam_repeat(vcam_ctx_t *ctx, const frame_t *frame);
+
+/*
+ * Zero-copy output.  Backends that can lend out their own frame memory
+ * (V4L2 streaming I/O) report how many buffers they cycle through; 0 means
+ * use vcam_write() instead.
+ *
+ * vcam_acquire() waits for a free buffer and describes it, with the
+ * device's row strides, setting *index (0 .. count - 1, fixed per buffer)
+ * so the caller can track what the buffer still holds from its last use.
+ * The caller may set the frame's timestamp_ns.  Fill the whole frame, then
+ * vcam_submit() hands it to the consumer; repeat != 0 says it is the same
+ * frame as last time (see vcam_repeat()).  Returns NULL / -1 on failure.
+ */
+int      vcam_buffer_count(const vcam_ctx_t *ctx);
+frame_t *vcam_acquire(vcam_ctx_t *ctx, int *index);
+int      vcam_submit(vcam_ctx_t *ctx, int repeat);
 
 /* Close the device and free resources. */
 void vcam_close(vcam_ctx_t *ctx);
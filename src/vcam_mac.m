@@ -6,10 +6,15 @@
  *
  *   ./screen2cam | ffplay -f rawvideo -pix_fmt yuv420p -video_size WxH -
  *
+ * With --codec the pipe carries the encoder's packets back to back instead
+ * (H.264 Annex-B or concatenated JPEGs), for ffmpeg -f h264 / -f mjpeg.
+ *
  * Uses the same vcam.h interface as the Linux V4L2 implementation.
  */
 
 #include "vcam.h"
+#include "pool.h"
+#include "vcam_net.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -23,10 +28,13 @@ struct vcam_ctx {
     int    fd;
     int    width;
     int    height;
-    size_t frame_size;   /* width * height * 3 / 2 for YUV420P */
+    pix_fmt_t format;
+    size_t    frame_size;
+    pool_buf_t *scratch;  /* packed copy of frames with padded rows */
+    vcam_net_t *net;      /* rtp:// or srt:// device, instead of fd */
 };
 
-vcam_ctx_t *vcam_open(const char *device, int width, int height)
+vcam_ctx_t *vcam_open(const char *device, int width, int height, pix_fmt_t format)
 {
     vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
@@ -34,7 +42,8 @@ vcam_ctx_t *vcam_open(const char *device, int width, int height)
 
     ctx->width      = width;
     ctx->height     = height;
-    ctx->frame_size = (size_t)width * height * 3 / 2;
+    ctx->format     = format == PIX_FMT_AUTO ? PIX_FMT_YUV420P : format;
+    ctx->frame_size = pix_fmt_frame_size(ctx->format, width, height);
 
     if (strcmp(device, "-") == 0 || strcmp(device, "/dev/stdout") == 0) {
         ctx->fd = STDOUT_FILENO;
@@ -50,18 +59,46 @@ vcam_ctx_t *vcam_open(const char *device, int width, int height)
     /* Ignore SIGPIPE so broken-pipe returns EPIPE to write() instead of killing us */
     signal(SIGPIPE, SIG_IGN);
 
-    fprintf(stderr, "vcam: output %dx%d yuv420p -> %s\n", width, height, device);
+    fprintf(stderr, "vcam: output %dx%d %s -> %s\n",
+            width, height, pix_fmt_name(ctx->format), device);
     return ctx;
 }
 
-int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+vcam_ctx_t *vcam_open_coded(const char *device, int width, int height, codec_t codec,
+                            int fps, int latency_ms)
 {
-    if (len < ctx->frame_size)
-        return -1;
+    if (vcam_net_is_url(device)) {
+        vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
+        if (!ctx)
+            return NULL;
+        ctx->fd     = -1;
+        ctx->width  = width;
+        ctx->height = height;
+        ctx->format = PIX_FMT_AUTO;
+        ctx->net    = vcam_net_open(device, codec, width, height, fps, latency_ms);
+        if (!ctx->net) {
+            free(ctx);
+            return NULL;
+        }
+        return ctx;
+    }
+
+    vcam_ctx_t *ctx = vcam_open(device, width, height, PIX_FMT_YUV420P);
+    if (ctx)
+        ctx->format = PIX_FMT_AUTO;   /* packets only, see vcam_write_packet() */
+    return ctx;
+}
 
+pix_fmt_t vcam_format(const vcam_ctx_t *ctx)
+{
+    return ctx->format;
+}
+
+static int write_all(vcam_ctx_t *ctx, const uint8_t *data, size_t size)
+{
     size_t written = 0;
-    while (written < ctx->frame_size) {
-        ssize_t n = write(ctx->fd, yuv420p + written, ctx->frame_size - written);
+    while (written < size) {
+        ssize_t n = write(ctx->fd, data + written, size - written);
         if (n < 0) {
             if (errno == EINTR)
                 continue;
@@ -75,11 +112,67 @@ int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
     return 0;
 }
 
+int vcam_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    /* The pipe carries packed frames; repack padded rows first */
+    const uint8_t *data = frame->planes[0];
+    if (!frame_is_packed(frame)) {
+        if (!ctx->scratch) {
+            ctx->scratch = pool_get(ctx->frame_size);
+            if (!ctx->scratch) {
+                perror("vcam: scratch frame");
+                return -1;
+            }
+        }
+        frame_t dst;
+        frame_init(&dst, ctx->format, ctx->width, ctx->height, ctx->scratch->data);
+        frame_copy(&dst, frame);
+        data = ctx->scratch->data;
+    }
+    return write_all(ctx, data, ctx->frame_size);
+}
+
+int vcam_write_packet(vcam_ctx_t *ctx, const packet_t *pkt)
+{
+    if (ctx->net)
+        return vcam_net_send(ctx->net, pkt);
+    return write_all(ctx, pkt->data, pkt->size);
+}
+
+int vcam_repeat(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    /* Readers expect a steady stream: send the frame again */
+    return vcam_write(ctx, frame);
+}
+
+/* No buffers to lend out: frames go through vcam_write() */
+int vcam_buffer_count(const vcam_ctx_t *ctx)
+{
+    (void)ctx;
+    return 0;
+}
+
+frame_t *vcam_acquire(vcam_ctx_t *ctx, int *index)
+{
+    (void)ctx;
+    (void)index;
+    return NULL;
+}
+
+int vcam_submit(vcam_ctx_t *ctx, int repeat)
+{
+    (void)ctx;
+    (void)repeat;
+    return -1;
+}
+
 void vcam_close(vcam_ctx_t *ctx)
 {
     if (!ctx)
         return;
+    vcam_net_close(ctx->net);
     if (ctx->fd >= 0 && ctx->fd != STDOUT_FILENO)
         close(ctx->fd);
+    pool_put(ctx->scratch);
     free(ctx);
 }
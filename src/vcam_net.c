@@ -0,0 +1,631 @@
+/*
+ * Network Output (RTP / SRT)
+ *
+ * RTP: one UDP datagram per RTP packet, at most NET_MTU bytes.
+ *   - H.264 access units are split at their start codes; NAL units that
+ *     do not fit go out as FU-A fragments (RFC 6184, packetization-mode=1).
+ *     Encoders repeat SPS/PPS on keyframes, so receivers can join late.
+ *   - JPEG images are stripped to their scan data and sent as RFC 2435
+ *     with the quantization tables in-band (Q=255), whichever encoder
+ *     made them.  Baseline 4:2:0 or 4:2:2, no restart markers, and the
+ *     Annex K Huffman tables: RFC 2435 carries none, so receivers assume
+ *     those, and a frame coded with its own is skipped.
+ *   - Timestamps are the frames' capture times on the 90 kHz clock, so a
+ *     receiver's jitter buffer sees when a frame was grabbed, not when
+ *     the encoder finished with it.
+ *
+ * Pacing: a frame's packets are spread over min(half a frame interval,
+ * half the latency budget) instead of leaving in one burst, which at a
+ * keyframe overflows switch and NIC queues and shows up as loss.  Once
+ * behind schedule the rest goes out at once, so pacing never holds a
+ * frame past its window.
+ *
+ * SRT: libsrt's live mode paces and retransmits within SRTO_LATENCY by
+ * itself; the stream is only cut into 1316-byte messages.
+ */
+
+#include "vcam_net.h"
+#include "encode_backend.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include "platform.h"
+typedef SOCKET sock_t;
+#define close_socket closesocket
+#else
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int sock_t;
+#define INVALID_SOCKET (-1)
+#define close_socket   close
+#endif
+
+#ifdef HAVE_SRT
+#include <srt/srt.h>
+#endif
+
+#define NET_MTU      1400   /* bytes per datagram, RTP header included */
+#define RTP_HEADER   12
+#define RTP_PT_H264  96     /* dynamic */
+#define RTP_PT_JPEG  26     /* static, RFC 3551 */
+#define SRT_CHUNK    1316   /* SRT live-mode message size */
+
+typedef enum { NET_RTP, NET_SRT } net_proto_t;
+
+struct vcam_net {
+    net_proto_t proto;
+    codec_t     codec;
+    sock_t      fd;          /* RTP: connected UDP socket */
+#ifdef HAVE_SRT
+    SRTSOCKET   srt;
+#endif
+
+    /* Pacing of the current frame */
+    uint64_t    window_ns;   /* spread one frame over this; 0 = off */
+    uint64_t    pace_start;
+    size_t      pace_total;  /* payload bytes of the frame */
+    size_t      pace_sent;
+
+    /* RTP state */
+    uint16_t    seq;
+    uint32_t    ssrc;
+    uint32_t    rtp_base;
+    uint64_t    first_ns;    /* capture time of the first frame */
+    int         warned;      /* JPEG we cannot packetize, said so once */
+    uint8_t     buf[NET_MTU];
+};
+
+int vcam_net_is_url(const char *device)
+{
+    return strncmp(device, "rtp://", 6) == 0 || strncmp(device, "srt://", 6) == 0;
+}
+
+/* Split SCHEME://HOST:PORT[?...] ; HOST may be [IPv6] or empty. */
+static int parse_url(const char *url, net_proto_t *proto,
+                     char *host, size_t hostlen, char *port, size_t portlen)
+{
+    *proto = strncmp(url, "srt://", 6) == 0 ? NET_SRT : NET_RTP;
+    const char *rest = url + 6;
+
+    const char *end, *colon;
+    if (*rest == '[') {
+        rest++;
+        end = strchr(rest, ']');
+        if (!end || end[1] != ':')
+            return -1;
+        colon = end + 1;
+    } else {
+        colon = strrchr(rest, ':');
+        if (!colon)
+            return -1;
+        end = colon;
+    }
+
+    size_t n = (size_t)(end - rest);
+    size_t pn = strcspn(colon + 1, "?/");
+    if (n >= hostlen || pn == 0 || pn >= portlen)
+        return -1;
+    memcpy(host, rest, n);
+    host[n] = '\0';
+    memcpy(port, colon + 1, pn);
+    port[pn] = '\0';
+    return 0;
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t)
+{
+    uint64_t now = now_ns();
+    if (t <= now + 100000)   /* not worth a sleep under 0.1 ms */
+        return;
+    uint64_t d = t - now;
+    struct timespec ts;
+    ts.tv_sec  = (time_t)(d / 1000000000u);
+    ts.tv_nsec = (long)(d % 1000000000u);
+    nanosleep(&ts, NULL);
+}
+
+/* ── RTP ───────────────────────────────────────────────────── */
+
+/* Errors a receiver that is not listening yet (or a full queue) causes. */
+static int send_error_is_transient(void)
+{
+#ifdef _WIN32
+    int e = WSAGetLastError();
+    if (e == WSAECONNRESET || e == WSAENOBUFS || e == WSAEWOULDBLOCK)
+        return 1;
+    fprintf(stderr, "vcam_net: send failed (error %d)\n", e);
+#else
+    if (errno == ECONNREFUSED || errno == ENOBUFS || errno == EAGAIN || errno == EINTR)
+        return 1;
+    perror("vcam_net: send");
+#endif
+    return 0;
+}
+
+/* Send net->buf with `payload` bytes after the RTP header, paced. */
+static int rtp_send(vcam_net_t *net, size_t payload, uint32_t ts, int marker)
+{
+    uint8_t *h = net->buf;
+    h[0]  = 0x80;   /* version 2 */
+    h[1]  = (uint8_t)((marker ? 0x80 : 0) |
+                      (net->codec == CODEC_H264 ? RTP_PT_H264 : RTP_PT_JPEG));
+    h[2]  = (uint8_t)(net->seq >> 8);
+    h[3]  = (uint8_t)net->seq;
+    h[4]  = (uint8_t)(ts >> 24);
+    h[5]  = (uint8_t)(ts >> 16);
+    h[6]  = (uint8_t)(ts >> 8);
+    h[7]  = (uint8_t)ts;
+    h[8]  = (uint8_t)(net->ssrc >> 24);
+    h[9]  = (uint8_t)(net->ssrc >> 16);
+    h[10] = (uint8_t)(net->ssrc >> 8);
+    h[11] = (uint8_t)net->ssrc;
+    net->seq++;
+
+    if (net->window_ns && net->pace_total) {
+        sleep_until(net->pace_start + net->window_ns * net->pace_sent / net->pace_total);
+        net->pace_sent += payload;
+    }
+
+    if (send(net->fd, (const char *)net->buf, (int)(RTP_HEADER + payload), 0) < 0 &&
+        !send_error_is_transient())
+        return -1;
+    return 0;
+}
+
+/* Next NAL unit of an Annex-B buffer, without start code or trailing zeros. */
+static const uint8_t *next_nal(const uint8_t *p, const uint8_t *end,
+                               const uint8_t **nal, size_t *len)
+{
+    while (p + 3 <= end && !(p[0] == 0 && p[1] == 0 && p[2] == 1))
+        p++;
+    if (p + 3 > end)
+        return NULL;
+    p += 3;
+
+    const uint8_t *q = p;
+    while (q + 3 <= end && !(q[0] == 0 && q[1] == 0 && q[2] == 1))
+        q++;
+    if (q + 3 > end)
+        q = end;
+
+    const uint8_t *e = q;
+    while (e > p && e[-1] == 0)
+        e--;
+    *nal = p;
+    *len = (size_t)(e - p);
+    return q;
+}
+
+static int send_nal(vcam_net_t *net, const uint8_t *nal, size_t len, uint32_t ts, int last)
+{
+    const size_t max = NET_MTU - RTP_HEADER;
+    uint8_t *out = net->buf + RTP_HEADER;
+
+    if (len <= max) {
+        memcpy(out, nal, len);
+        return rtp_send(net, len, ts, last);
+    }
+
+    /* FU-A: the NAL header is split into FU indicator and FU header */
+    uint8_t hdr = nal[0];
+    const uint8_t *d = nal + 1;
+    size_t left = len - 1;
+    for (int first = 1; left; first = 0) {
+        size_t n = left < max - 2 ? left : max - 2;
+        out[0] = (uint8_t)((hdr & 0xe0) | 28);
+        out[1] = (uint8_t)((first ? 0x80 : 0) | (n == left ? 0x40 : 0) | (hdr & 0x1f));
+        memcpy(out + 2, d, n);
+        if (rtp_send(net, n + 2, ts, last && n == left) < 0)
+            return -1;
+        d    += n;
+        left -= n;
+    }
+    return 0;
+}
+
+static int send_h264(vcam_net_t *net, const packet_t *pkt, uint32_t ts)
+{
+    const uint8_t *end = pkt->data + pkt->size;
+    const uint8_t *nal;
+    size_t len;
+
+    /* Look one NAL ahead: the last one of the access unit gets the marker */
+    const uint8_t *p = next_nal(pkt->data, end, &nal, &len);
+    while (p) {
+        const uint8_t *next;
+        size_t next_len;
+        const uint8_t *q = next_nal(p, end, &next, &next_len);
+        if (len && send_nal(net, nal, len, ts, q == NULL) < 0)
+            return -1;
+        p   = q;
+        nal = next;
+        len = next_len;
+    }
+    return 0;
+}
+
+typedef struct {
+    const uint8_t *qt[2];     /* luma, chroma quantization tables (zigzag) */
+    const uint8_t *scan;      /* entropy-coded data */
+    size_t         scan_len;
+    int            type;      /* RFC 2435: 0 = 4:2:2, 1 = 4:2:0 */
+    int            width;
+    int            height;
+} jpeg_info_t;
+
+/* Find what RFC 2435 carries in a baseline JFIF image.  Returns 0 or -1. */
+static int parse_jpeg(const uint8_t *p, size_t size, jpeg_info_t *j)
+{
+    memset(j, 0, sizeof(*j));
+    j->type = -1;
+    if (size < 4 || p[0] != 0xff || p[1] != 0xd8)
+        return -1;
+
+    for (size_t i = 2; i + 4 <= size; ) {
+        if (p[i] != 0xff)
+            return -1;
+        uint8_t m = p[i + 1];
+        if (m == 0xff) {   /* fill byte */
+            i++;
+            continue;
+        }
+        size_t seg = (size_t)p[i + 2] << 8 | p[i + 3];
+        if (seg < 2 || i + 2 + seg > size)
+            return -1;
+        const uint8_t *s = p + i + 4;
+        size_t n = seg - 2;
+
+        if (m == 0xdb) {                          /* DQT, one or more tables */
+            for (size_t k = 0; k < n; k += 65) {
+                int id = s[k] & 15;
+                if ((s[k] >> 4) != 0 || id > 1 || k + 65 > n)
+                    return -1;                    /* 16-bit or extra tables */
+                j->qt[id] = s + k + 1;
+            }
+        } else if (m == 0xc4) {                   /* DHT: receivers use Annex K.3 */
+            for (size_t k = 0; k < n; ) {
+                int len = jpeg_standard_huff_table(s + k, n - k);
+                if (len < 0)
+                    return -1;
+                k += (size_t)len;
+            }
+        } else if (m == 0xc0) {                   /* SOF0 */
+            if (n < 15 || s[5] != 3)
+                return -1;
+            j->height = s[1] << 8 | s[2];
+            j->width  = s[3] << 8 | s[4];
+            if (s[7] == 0x22)
+                j->type = 1;
+            else if (s[7] == 0x21)
+                j->type = 0;
+            if (s[10] != 0x11 || s[13] != 0x11 || s[8] != 0 || s[11] != 1 || s[14] != 1)
+                j->type = -1;
+        } else if (m >= 0xc1 && m <= 0xcf && m != 0xc4 && m != 0xc8 && m != 0xcc) {
+            return -1;                            /* progressive, arithmetic, ... */
+        } else if (m == 0xdd) {                   /* DRI */
+            if (n >= 2 && (s[0] | s[1]))
+                return -1;
+        } else if (m == 0xda) {                   /* SOS: scan runs to EOI */
+            /* Receivers code luma with tables 0, chroma with tables 1 */
+            if (n < 7 || s[0] != 3 || s[2] != 0x00 || s[4] != 0x11 || s[6] != 0x11)
+                return -1;
+            j->scan = s + n;
+            size_t e = size;
+            while (e >= i + 2 + seg + 2 && !(p[e - 2] == 0xff && p[e - 1] == 0xd9))
+                e--;
+            if (e < i + 2 + seg + 2)
+                return -1;                        /* no EOI: truncated */
+            j->scan_len = e - 2 - (i + 2 + seg);
+            if (j->scan_len == 0)
+                return -1;
+            return j->qt[0] && j->qt[1] && j->type >= 0 ? 0 : -1;
+        }
+        i += 2 + seg;
+    }
+    return -1;
+}
+
+static int send_jpeg(vcam_net_t *net, const packet_t *pkt, uint32_t ts)
+{
+    jpeg_info_t j;
+    if (parse_jpeg(pkt->data, pkt->size, &j) < 0 ||
+        (j.width + 7) / 8 > 255 || (j.height + 7) / 8 > 255) {
+        if (!net->warned)
+            fprintf(stderr, "vcam_net: JPEG not sendable as RFC 2435, skipping frames\n");
+        net->warned = 1;
+        return 0;
+    }
+
+    const size_t max = NET_MTU - RTP_HEADER;
+    uint8_t *out = net->buf + RTP_HEADER;
+    for (size_t off = 0; off < j.scan_len || off == 0; ) {
+        out[0] = 0;                               /* type-specific */
+        out[1] = (uint8_t)(off >> 16);            /* fragment offset */
+        out[2] = (uint8_t)(off >> 8);
+        out[3] = (uint8_t)off;
+        out[4] = (uint8_t)j.type;
+        out[5] = 255;                             /* Q: tables in-band */
+        out[6] = (uint8_t)((j.width + 7) / 8);
+        out[7] = (uint8_t)((j.height + 7) / 8);
+        size_t hdr = 8;
+        if (off == 0) {                           /* quantization table header */
+            out[8]  = 0;
+            out[9]  = 0;                          /* 8-bit precision */
+            out[10] = 0;
+            out[11] = 128;
+            memcpy(out + 12, j.qt[0], 64);
+            memcpy(out + 76, j.qt[1], 64);
+            hdr = 140;
+        }
+        size_t n = j.scan_len - off < max - hdr ? j.scan_len - off : max - hdr;
+        memcpy(out + hdr, j.scan + off, n);
+        if (rtp_send(net, hdr + n, ts, off + n == j.scan_len) < 0)
+            return -1;
+        off += n;
+        if (n == 0)
+            break;
+    }
+    return 0;
+}
+
+static int open_rtp(vcam_net_t *net, const char *host, const char *port)
+{
+    if (!*host) {
+        fprintf(stderr, "vcam_net: rtp:// needs a destination host\n");
+        return -1;
+    }
+
+    struct addrinfo hints, *res, *ai;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+    int err = getaddrinfo(host, port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "vcam_net: %s: %s\n", host, gai_strerror(err));
+        return -1;
+    }
+
+    for (ai = res; ai; ai = ai->ai_next) {
+        net->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (net->fd == INVALID_SOCKET)
+            continue;
+        if (connect(net->fd, ai->ai_addr, (int)ai->ai_addrlen) == 0)
+            break;
+        close_socket(net->fd);
+        net->fd = INVALID_SOCKET;
+    }
+    if (!ai) {
+        fprintf(stderr, "vcam_net: cannot reach %s:%s\n", host, port);
+        freeaddrinfo(res);
+        return -1;
+    }
+
+    /* Room for a keyframe burst; mark the traffic as interactive video */
+    int sndbuf = 1 << 20;
+    setsockopt(net->fd, SOL_SOCKET, SO_SNDBUF, (const char *)&sndbuf, sizeof(sndbuf));
+#ifndef _WIN32
+    int tos = 0x88;   /* DSCP AF41 */
+    if (ai->ai_family == AF_INET)
+        setsockopt(net->fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+    else
+        setsockopt(net->fd, IPPROTO_IPV6, IPV6_TCLASS, &tos, sizeof(tos));
+#endif
+
+    /* What a receiver needs to make sense of the stream */
+    char addr[NI_MAXHOST];
+    if (getnameinfo(ai->ai_addr, (int)ai->ai_addrlen, addr, sizeof(addr),
+                    NULL, 0, NI_NUMERICHOST) != 0)
+        snprintf(addr, sizeof(addr), "%s", host);
+    const char *ip = ai->ai_family == AF_INET6 ? "IP6" : "IP4";
+    freeaddrinfo(res);
+
+    fprintf(stderr, "vcam_net: RTP SDP (save as .sdp and open with "
+                    "ffplay -protocol_whitelist file,udp,rtp):\n"
+                    "v=0\no=- 0 0 IN %s %s\ns=screen2cam\nc=IN %s %s\nt=0 0\n",
+            ip, addr, ip, addr);
+    if (net->codec == CODEC_H264)
+        fprintf(stderr, "m=video %s RTP/AVP %d\na=rtpmap:%d H264/90000\n"
+                        "a=fmtp:%d packetization-mode=1\n",
+                port, RTP_PT_H264, RTP_PT_H264, RTP_PT_H264);
+    else
+        fprintf(stderr, "m=video %s RTP/AVP %d\n", port, RTP_PT_JPEG);
+    return 0;
+}
+
+/* ── SRT ───────────────────────────────────────────────────── */
+
+#ifdef HAVE_SRT
+static int open_srt(vcam_net_t *net, const char *host, const char *port, int latency_ms)
+{
+    if (srt_startup() < 0) {
+        fprintf(stderr, "vcam_net: srt_startup: %s\n", srt_getlasterror_str());
+        return -1;
+    }
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = *host ? AF_UNSPEC : AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags    = *host ? 0 : AI_PASSIVE;
+    int err = getaddrinfo(*host ? host : NULL, port, &hints, &res);
+    if (err) {
+        fprintf(stderr, "vcam_net: %s: %s\n", host, gai_strerror(err));
+        srt_cleanup();
+        return -1;
+    }
+
+    SRTSOCKET s = srt_create_socket();
+    if (s == SRT_INVALID_SOCK) {
+        fprintf(stderr, "vcam_net: srt socket: %s\n", srt_getlasterror_str());
+        freeaddrinfo(res);
+        srt_cleanup();
+        return -1;
+    }
+    int live = SRTT_LIVE;
+    srt_setsockflag(s, SRTO_TRANSTYPE, &live, sizeof(live));
+    srt_setsockflag(s, SRTO_LATENCY, &latency_ms, sizeof(latency_ms));
+
+    int rc;
+    if (*host) {
+        rc = srt_connect(s, res->ai_addr, (int)res->ai_addrlen);
+    } else {
+        /* Listener: wait for the receiver to call in */
+        rc = srt_bind(s, res->ai_addr, (int)res->ai_addrlen);
+        if (rc != SRT_ERROR)
+            rc = srt_listen(s, 1);
+        if (rc != SRT_ERROR) {
+            fprintf(stderr, "vcam_net: waiting for an SRT caller on port %s\n", port);
+            SRTSOCKET c = srt_accept(s, NULL, NULL);
+            srt_close(s);
+            s  = c;
+            rc = c == SRT_INVALID_SOCK ? SRT_ERROR : 0;
+        }
+    }
+    freeaddrinfo(res);
+
+    if (rc == SRT_ERROR) {
+        fprintf(stderr, "vcam_net: srt://%s:%s: %s\n", host, port, srt_getlasterror_str());
+        if (s != SRT_INVALID_SOCK)
+            srt_close(s);
+        srt_cleanup();
+        return -1;
+    }
+    net->srt = s;
+    fprintf(stderr, "vcam_net: SRT connected, latency %d ms (receive with ffplay -f %s)\n",
+            latency_ms, net->codec == CODEC_H264 ? "h264" : "mjpeg");
+    return 0;
+}
+
+static int send_srt(vcam_net_t *net, const packet_t *pkt)
+{
+    for (size_t off = 0; off < pkt->size; off += SRT_CHUNK) {
+        size_t n = pkt->size - off < SRT_CHUNK ? pkt->size - off : SRT_CHUNK;
+        if (srt_sendmsg2(net->srt, (const char *)pkt->data + off, (int)n, NULL) == SRT_ERROR) {
+            fprintf(stderr, "vcam_net: srt send: %s\n", srt_getlasterror_str());
+            return -1;
+        }
+    }
+    return 0;
+}
+#endif
+
+/* ── Public interface ──────────────────────────────────────── */
+
+vcam_net_t *vcam_net_open(const char *url, codec_t codec, int width, int height,
+                          int fps, int latency_ms)
+{
+    char host[256], port[16];
+    net_proto_t proto;
+    if (parse_url(url, &proto, host, sizeof(host), port, sizeof(port)) < 0) {
+        fprintf(stderr, "vcam_net: expected rtp://HOST:PORT or srt://[HOST]:PORT, got %s\n", url);
+        return NULL;
+    }
+#ifndef HAVE_SRT
+    if (proto == NET_SRT) {
+        fprintf(stderr, "vcam_net: built without libsrt, use rtp:// instead\n");
+        return NULL;
+    }
+#endif
+    if (proto == NET_RTP && codec == CODEC_MJPEG &&
+        ((width + 7) / 8 > 255 || (height + 7) / 8 > 255)) {
+        fprintf(stderr, "vcam_net: RTP/JPEG is limited to 2040x2040, use --codec h264\n");
+        return NULL;
+    }
+
+    vcam_net_t *net = calloc(1, sizeof(*net));
+    if (!net)
+        return NULL;
+    net->proto = proto;
+    net->codec = codec;
+    net->fd    = INVALID_SOCKET;
+
+    uint64_t interval = 1000000000u / (unsigned)fps;
+    uint64_t budget   = (uint64_t)latency_ms * 1000000u;
+    net->window_ns = (interval < budget ? interval : budget) / 2;
+
+    uint64_t seed  = now_ns();
+    net->ssrc      = (uint32_t)(seed * 2654435761u >> 7);
+    net->seq       = (uint16_t)(seed >> 11);
+    net->rtp_base  = (uint32_t)(seed >> 3);
+
+#ifdef _WIN32
+    WSADATA wsa;
+    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+        fprintf(stderr, "vcam_net: WSAStartup failed\n");
+        free(net);
+        return NULL;
+    }
+#endif
+
+    int rc;
+#ifdef HAVE_SRT
+    if (proto == NET_SRT)
+        rc = open_srt(net, host, port, latency_ms);
+    else
+#endif
+        rc = open_rtp(net, host, port);
+    if (rc < 0) {
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        free(net);
+        return NULL;
+    }
+
+    fprintf(stderr, "vcam_net: %s %dx%d -> %s\n", codec_name(codec), width, height, url);
+    return net;
+}
+
+int vcam_net_send(vcam_net_t *net, const packet_t *pkt)
+{
+#ifdef HAVE_SRT
+    if (net->proto == NET_SRT)
+        return send_srt(net, pkt);
+#endif
+
+    uint64_t ns = pkt->timestamp_ns ? pkt->timestamp_ns : now_ns();
+    if (!net->first_ns || ns < net->first_ns)
+        net->first_ns = ns;
+    uint32_t ts = net->rtp_base + (uint32_t)((ns - net->first_ns) * 9 / 100000);
+
+    net->pace_start = now_ns();
+    net->pace_total = pkt->size;
+    net->pace_sent  = 0;
+
+    return net->codec == CODEC_H264 ? send_h264(net, pkt, ts)
+                                    : send_jpeg(net, pkt, ts);
+}
+
+void vcam_net_close(vcam_net_t *net)
+{
+    if (!net)
+        return;
+#ifdef HAVE_SRT
+    if (net->proto == NET_SRT) {
+        srt_close(net->srt);
+        srt_cleanup();
+    }
+#endif
+    if (net->fd != INVALID_SOCKET)
+        close_socket(net->fd);
+#ifdef _WIN32
+    WSACleanup();
+#endif
+    free(net);
+}
@@ -0,0 +1,36 @@
+#ifndef VCAM_NET_H
+#define VCAM_NET_H
+
+#include "encode.h"
+
+/*
+ * Network output for encoded streams, used by the vcam backends when
+ * --device is a URL:
+ *
+ *   rtp://HOST:PORT   H.264 (RFC 6184) or JPEG (RFC 2435) over RTP/UDP;
+ *                     the SDP a receiver needs is printed on startup
+ *   srt://HOST:PORT   the bare Annex-B / MJPEG stream over SRT in live
+ *                     mode (needs libsrt); srt://:PORT waits for a caller
+ *
+ * HOST may be a name, an IPv4/multicast address or [IPv6].
+ */
+
+typedef struct vcam_net vcam_net_t;
+
+/* Non-zero if device names a network output rather than a file/device. */
+int vcam_net_is_url(const char *device);
+
+/*
+ * Connect to url.  latency_ms is the budget a frame may spend on the
+ * wire: RTP spreads each frame's packets over part of it (pacing), SRT
+ * uses it as the receiver's buffer.  Returns NULL on failure.
+ */
+vcam_net_t *vcam_net_open(const char *url, codec_t codec, int width, int height,
+                          int fps, int latency_ms);
+
+/* Send one access unit / JPEG image.  Returns 0 on success, -1 on failure. */
+int vcam_net_send(vcam_net_t *net, const packet_t *pkt);
+
+void vcam_net_close(vcam_net_t *net);
+
+#endif /* VCAM_NET_H */
@@ -0,0 +1,255 @@
+/*
+ * Shared-Memory Output (Linux)
+ *
+ * The segment is shm_open()ed under a name readers can find, laid out as
+ * protocol v2 (extension/shm_protocol.h), and its slots are lent to the
+ * pipeline, so frames are converted straight into memory the readers
+ * map.  Several readers share it: each holds slots with OFD read locks,
+ * which the kernel drops when it dies, and a frame for which every slot
+ * is held goes to a spare buffer and is dropped, so a stuck reader costs
+ * the others frames but never stalls the host, and a dead one costs
+ * nothing.
+ *
+ * Readers block on a futex in the header; a publish wakes all of them
+ * with one syscall, and none at all while nobody waits.
+ *
+ * A new host replaces the segment instead of resizing it in place:
+ * readers of the old one see version 0 (or, if its host crashed, that
+ * the object was unlinked) and reopen by name.
+ */
+
+#include "vcam_shm.h"
+#include "pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../extension/shm_protocol.h"
+
+#define SHM_NAME_MAX 64
+
+struct vcam_shm {
+    char          name[SHM_NAME_MAX];
+    int           fd;
+    int           width;
+    int           height;
+    pix_fmt_t     format;
+    shm_header_t *hdr;
+    size_t        size;
+    int           slot;       /* slot from vcam_shm_acquire(), SHM_SLOTS for spare, or -1 */
+    frame_t       frame;      /* describes that slot */
+    pool_buf_t   *spare;      /* frames nobody has a free slot for */
+    uint64_t      dropped;
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t fourcc_of(pix_fmt_t fmt)
+{
+    switch (fmt) {
+    case PIX_FMT_NV12:  return SHM_FMT_NV12;
+    case PIX_FMT_YUYV:  return SHM_FMT_YUYV;
+    case PIX_FMT_BGRA:  return SHM_FMT_BGRA;
+    case PIX_FMT_RGB24: return SHM_FMT_RGB24;
+    case PIX_FMT_RGBA:  return SHM_FMT_RGBA;
+    default:            return SHM_FMT_I420;
+    }
+}
+
+/* Object name for device: "shm" -> /screen2cam, "shm:NAME" -> /screen2cam.NAME */
+static int object_name(const char *device, char *out)
+{
+    if (strcmp(device, "shm") == 0) {
+        snprintf(out, SHM_NAME_MAX, "%s", SHM_NAME);
+        return 0;
+    }
+    const char *name = device + 4;
+    if (!*name || strchr(name, '/') || strlen(name) + sizeof(SHM_NAME) + 1 > SHM_NAME_MAX) {
+        fprintf(stderr, "vcam: shm:NAME needs a NAME without '/', at most %zu characters\n",
+                SHM_NAME_MAX - sizeof(SHM_NAME) - 1);
+        return -1;
+    }
+    snprintf(out, SHM_NAME_MAX, "%s.%s", SHM_NAME, name);
+    return 0;
+}
+
+/* Readers of a segment left by an earlier run: tell them it is gone. */
+static void retire_old(const char *name)
+{
+    int fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(shm_header_t)) {
+        shm_header_t *old = mmap(NULL, sizeof(*old), PROT_READ | PROT_WRITE,
+                                 MAP_SHARED, fd, 0);
+        if (old != MAP_FAILED) {
+            if (old->magic == SHM_MAGIC) {
+                old->version = 0;
+                shm_wake_readers(old);
+            }
+            munmap(old, sizeof(*old));
+        }
+    }
+    close(fd);
+    shm_unlink(name);
+}
+
+int vcam_shm_is_name(const char *device)
+{
+    return strcmp(device, "shm") == 0 || strncmp(device, "shm:", 4) == 0;
+}
+
+vcam_shm_t *vcam_shm_open(const char *device, int width, int height, pix_fmt_t format)
+{
+    vcam_shm_t *shm = calloc(1, sizeof(*shm));
+    if (!shm)
+        return NULL;
+    shm->fd     = -1;
+    shm->slot   = -1;
+    shm->width  = width;
+    shm->height = height;
+    shm->format = format == PIX_FMT_AUTO ? PIX_FMT_YUV420P : format;
+    if (object_name(device, shm->name) < 0)
+        goto fail;
+
+    if ((size_t)width > SHM_MAX_WIDTH || (size_t)height > SHM_MAX_HEIGHT) {
+        fprintf(stderr, "vcam: shm output is limited to %dx%d\n", SHM_MAX_WIDTH, SHM_MAX_HEIGHT);
+        goto fail;
+    }
+
+    retire_old(shm->name);
+    shm->size = shm_total_size(width, height);
+    shm->fd   = shm_open(shm->name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm->fd < 0) {
+        fprintf(stderr, "vcam: shm_open(%s): %s\n", shm->name, strerror(errno));
+        goto fail;
+    }
+    if (ftruncate(shm->fd, (off_t)shm->size) < 0) {
+        fprintf(stderr, "vcam: ftruncate: %s\n", strerror(errno));
+        goto fail;
+    }
+    shm->hdr = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+    if (shm->hdr == MAP_FAILED) {
+        shm->hdr = NULL;
+        fprintf(stderr, "vcam: mmap: %s\n", strerror(errno));
+        goto fail;
+    }
+
+    size_t stride;
+    int rows;
+    pix_fmt_plane(shm->format, width, height, 0, &stride, &rows);
+
+    shm_header_t *hdr = shm->hdr;
+    hdr->version = 0;
+    hdr->magic   = SHM_MAGIC;
+    hdr->width   = width;
+    hdr->height  = height;
+    hdr->fps     = 0;   /* frames go out as they come */
+    shm_init_slots(hdr, width, height);
+    for (uint32_t i = 0; i < SHM_SLOTS; i++) {
+        hdr->slots[i].pixel_fmt = fourcc_of(shm->format);
+        hdr->slots[i].width     = width;
+        hdr->slots[i].height    = height;
+        hdr->slots[i].stride    = (uint32_t)stride;
+    }
+    /* Version last: readers ignore the segment until it is complete */
+    atomic_thread_fence(memory_order_release);
+    hdr->version = SHM_VERSION;
+
+    fprintf(stderr, "vcam: output %dx%d %s -> shared memory %s (%d slots)\n",
+            width, height, pix_fmt_name(shm->format), shm->name, SHM_SLOTS);
+    return shm;
+
+fail:
+    vcam_shm_close(shm);
+    return NULL;
+}
+
+pix_fmt_t vcam_shm_format(const vcam_shm_t *shm)
+{
+    return shm->format;
+}
+
+/* One index more than the slots: the spare buffer */
+int vcam_shm_buffer_count(const vcam_shm_t *shm)
+{
+    (void)shm;
+    return SHM_SLOTS + 1;
+}
+
+frame_t *vcam_shm_acquire(vcam_shm_t *shm, int *index)
+{
+    int slot = shm_free_unlocked_slot(shm->hdr, shm->fd);
+    uint8_t *data;
+    if (slot >= 0) {
+        shm_begin_slot(shm->hdr, (uint32_t)slot);
+        data = shm_slot_ptr(shm->hdr, (uint32_t)slot);
+    } else {
+        if (!shm->spare) {
+            shm->spare = pool_get(pix_fmt_frame_size(shm->format, shm->width, shm->height));
+            if (!shm->spare) {
+                perror("vcam: spare frame");
+                return NULL;
+            }
+        }
+        slot = SHM_SLOTS;
+        data = shm->spare->data;
+    }
+
+    shm->slot = slot;
+    *index = slot;
+    frame_init(&shm->frame, shm->format, shm->width, shm->height, data);
+    return &shm->frame;
+}
+
+int vcam_shm_submit(vcam_shm_t *shm, int repeat)
+{
+    if (shm->slot < 0)
+        return -1;
+    if (shm->slot == SHM_SLOTS) {
+        if (!repeat && shm->dropped++ == 0)
+            fprintf(stderr, "\nvcam: shm readers hold every slot, dropping frames\n");
+        shm->slot = -1;
+        return 0;
+    }
+
+    /* A repeat completes the slot but announces nothing new */
+    uint64_t ts = shm->frame.timestamp_ns ? shm->frame.timestamp_ns : now_ns();
+    shm_end_write(shm->hdr, (uint32_t)shm->slot, !repeat, ts);
+    shm->slot = -1;
+    if (!repeat)
+        shm_wake_readers(shm->hdr);
+    return 0;
+}
+
+void vcam_shm_close(vcam_shm_t *shm)
+{
+    if (!shm)
+        return;
+    if (shm->hdr) {
+        /* Readers waiting on the futex notice and reconnect */
+        atomic_thread_fence(memory_order_release);
+        shm->hdr->version = 0;
+        shm_wake_readers(shm->hdr);
+        munmap(shm->hdr, shm->size);
+    }
+    if (shm->fd >= 0) {
+        close(shm->fd);
+        shm_unlink(shm->name);
+    }
+    pool_put(shm->spare);
+    free(shm);
+}
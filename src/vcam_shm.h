@@ -0,0 +1,40 @@
+#ifndef VCAM_SHM_H
+#define VCAM_SHM_H
+
+#include "pixfmt.h"
+
+/*
+ * Shared-memory output on Linux, used by vcam.c when --device is
+ * "shm" or "shm:NAME": frames go into the POSIX shared memory object
+ * /screen2cam.NAME (/screen2cam for plain "shm") in the slot layout of
+ * extension/shm_protocol.h, and any number of local programs read them
+ * in place through extension/linux/shm_reader.h.  No kernel module and
+ * no copy through the kernel; a slow reader holds back nobody.
+ */
+
+typedef struct vcam_shm vcam_shm_t;
+
+/* Non-zero if device names a shared-memory output. */
+int vcam_shm_is_name(const char *device);
+
+/*
+ * Create the segment for frames of format (PIX_FMT_AUTO: yuv420p),
+ * replacing one left by an earlier run.  Returns NULL on failure.
+ */
+vcam_shm_t *vcam_shm_open(const char *device, int width, int height, pix_fmt_t format);
+
+pix_fmt_t vcam_shm_format(const vcam_shm_t *shm);
+
+/*
+ * The slots are lent out as in vcam.h (vcam_acquire / vcam_submit).  If
+ * readers hold every slot, the frame goes to a spare buffer instead and
+ * is dropped on submit.
+ */
+int      vcam_shm_buffer_count(const vcam_shm_t *shm);
+frame_t *vcam_shm_acquire(vcam_shm_t *shm, int *index);
+int      vcam_shm_submit(vcam_shm_t *shm, int repeat);
+
+/* Tell readers the host is gone and remove the segment. */
+void vcam_shm_close(vcam_shm_t *shm);
+
+#endif /* VCAM_SHM_H */
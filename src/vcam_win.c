@@ -1,44 +1,134 @@
 /*
  * Windows Virtual Camera Output
  *
- * Writes raw YUV420P frames to stdout (default) or a file path.
- * Near-identical to vcam_mac.m but uses Windows CRT equivalents:
- *   - _fileno(stdout) instead of STDOUT_FILENO
- *   - _setmode(fd, _O_BINARY) to prevent \n -> \r\n corruption
- *   - _open() / _write() / _close() for file I/O
+ * Two output modes:
  *
- * Designed for piping into ffmpeg/ffplay for preview or encoding:
- *   screen2cam.exe | ffplay -f rawvideo -pix_fmt yuv420p -video_size WxH -
+ *   1. Pipe mode (default / "-" / a path): writes raw YUV420P frames to
+ *      stdout or a file.  Near-identical to vcam_mac.m but uses Windows
+ *      CRT equivalents:
+ *        - _fileno(stdout) instead of STDOUT_FILENO
+ *        - _setmode(fd, _O_BINARY) to prevent \n -> \r\n corruption
+ *        - _open() / _write() / _close() for file I/O
+ *
+ *      Designed for piping into ffmpeg/ffplay for preview or encoding:
+ *        screen2cam.exe | ffplay -f rawvideo -pix_fmt yuv420p -video_size WxH -
+ *
+ *      With --codec the pipe carries the encoder's packets back to back
+ *      instead (H.264 Annex-B or concatenated JPEGs), for ffmpeg -f h264.
+ *
+ *   2. Virtual camera mode ("vcam", Windows 11): registers a camera with
+ *      MFCreateVirtualCamera for as long as we run.  Its media source
+ *      (extension/windows/vcam_source.c, registered once with regsvr32)
+ *      runs inside the Frame Server service and reads NV12 frames from a
+ *      shared-memory ring laid out as in extension/shm_protocol.h.  The
+ *      ring's slots are lent to the pipeline (vcam_acquire), so frames
+ *      are converted straight into memory the camera reads: no pipe, no
+ *      bridge process.
  *
  * Uses the same vcam.h interface as Linux and macOS implementations.
  */
 
+#define COBJMACROS
+#define CINTERFACE
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+
 #include "vcam.h"
+#include "pool.h"
+#include "vcam_net.h"
 
+#include <windows.h>
+#include <sddl.h>
+#include <mfapi.h>
+#include <mfidl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <wchar.h>
 #include <fcntl.h>
 #include <io.h>
 #include <errno.h>
 
+#include "platform.h"
+#include "../extension/shm_protocol.h"
+
+/*
+ * MFCreateVirtualCamera() lives in mfsensorgroup.dll (Windows 11 only) and
+ * mfvirtualcamera.h is missing from older MinGW headers, so the function
+ * is looked up at run time and the interface declared here.  Only the
+ * methods we call are named; IMFAttributes' 30 methods come first.
+ */
+typedef struct vcam_virtual_camera vcam_virtual_camera_t;
+typedef struct {
+    HRESULT (STDMETHODCALLTYPE *QueryInterface)(vcam_virtual_camera_t *, REFIID, void **);
+    ULONG   (STDMETHODCALLTYPE *AddRef)(vcam_virtual_camera_t *);
+    ULONG   (STDMETHODCALLTYPE *Release)(vcam_virtual_camera_t *);
+    void    *attributes[30];
+    void    *AddDeviceSourceInfo;
+    void    *AddProperty;
+    void    *AddRegistryEntry;
+    HRESULT (STDMETHODCALLTYPE *Start)(vcam_virtual_camera_t *, IMFAsyncCallback *);
+    HRESULT (STDMETHODCALLTYPE *Stop)(vcam_virtual_camera_t *);
+    HRESULT (STDMETHODCALLTYPE *Remove)(vcam_virtual_camera_t *);
+    void    *GetMediaSource;
+    void    *SendCameraProperty;
+    void    *SendCameraPropertyWithDataBuffer;
+    HRESULT (STDMETHODCALLTYPE *Shutdown)(vcam_virtual_camera_t *);
+} vcam_virtual_camera_vtbl_t;
+struct vcam_virtual_camera {
+    const vcam_virtual_camera_vtbl_t *lpVtbl;
+};
+
+typedef HRESULT (WINAPI *create_virtual_camera_fn)(
+    int type,           /* MFVirtualCameraType_SoftwareCameraSource = 0 */
+    int lifetime,       /* MFVirtualCameraLifetime_Session = 0 */
+    int access,         /* MFVirtualCameraAccess_CurrentUser = 0 */
+    LPCWSTR friendly_name, LPCWSTR source_id,
+    const GUID *categories, ULONG category_count,
+    vcam_virtual_camera_t **camera);
+
+typedef enum {
+    VCAM_MODE_PIPE,   /* stdout / file */
+    VCAM_MODE_MF      /* MFCreateVirtualCamera + shared-memory ring */
+} vcam_mode_t;
+
 struct vcam_ctx {
+    vcam_mode_t mode;
     int    fd;
     int    is_stdout;
     int    width;
     int    height;
-    size_t frame_size;   /* width * height * 3 / 2 for YUV420P */
+    pix_fmt_t format;
+    size_t    frame_size;
+    pool_buf_t *scratch;  /* packed copy of frames with padded rows */
+    vcam_net_t *net;      /* rtp:// or srt:// device, instead of fd */
+
+    /* Virtual camera mode */
+    HANDLE        file;
+    HANDLE        mapping;
+    shm_header_t *shm_hdr;
+    int           shm_slot;   /* slot from vcam_acquire(), or -1 */
+    frame_t       shm_frame;  /* describes that slot */
+    vcam_virtual_camera_t *camera;
+    HMODULE       sensorgroup;
+    int           mf_started;
 };
 
-vcam_ctx_t *vcam_open(const char *device, int width, int height)
+/* ── Pipe mode ─────────────────────────────────────────────── */
+
+static vcam_ctx_t *pipe_open(const char *device, int width, int height, pix_fmt_t format)
 {
     vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
     if (!ctx)
         return NULL;
 
+    ctx->mode       = VCAM_MODE_PIPE;
     ctx->width      = width;
     ctx->height     = height;
-    ctx->frame_size = (size_t)width * height * 3 / 2;
+    ctx->format     = format == PIX_FMT_AUTO ? PIX_FMT_YUV420P : format;
+    ctx->frame_size = pix_fmt_frame_size(ctx->format, width, height);
 
     if (strcmp(device, "-") == 0) {
         ctx->fd = _fileno(stdout);
@@ -59,19 +149,16 @@ vcam_ctx_t *vcam_open(const char *device, int width, int height)
         }
     }
 
-    fprintf(stderr, "vcam: output %dx%d yuv420p -> %s\n", width, height, device);
+    fprintf(stderr, "vcam: output %dx%d %s -> %s\n",
+            width, height, pix_fmt_name(ctx->format), device);
     return ctx;
 }
 
-int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
+static int write_all(vcam_ctx_t *ctx, const uint8_t *data, size_t size)
 {
-    if (len < ctx->frame_size)
-        return -1;
-
     size_t written = 0;
-    while (written < ctx->frame_size) {
-        int n = _write(ctx->fd, yuv420p + written,
-                       (unsigned int)(ctx->frame_size - written));
+    while (written < size) {
+        int n = _write(ctx->fd, data + written, (unsigned int)(size - written));
         if (n < 0) {
             if (errno == EINTR)
                 continue;
@@ -84,11 +171,321 @@ int vcam_write(vcam_ctx_t *ctx, const uint8_t *yuv420p, size_t len)
     return 0;
 }
 
+static int pipe_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    /* The pipe carries packed frames; repack padded rows first */
+    const uint8_t *data = frame->planes[0];
+    if (!frame_is_packed(frame)) {
+        if (!ctx->scratch) {
+            ctx->scratch = pool_get(ctx->frame_size);
+            if (!ctx->scratch) {
+                perror("vcam: scratch frame");
+                return -1;
+            }
+        }
+        frame_t dst;
+        frame_init(&dst, ctx->format, ctx->width, ctx->height, ctx->scratch->data);
+        frame_copy(&dst, frame);
+        data = ctx->scratch->data;
+    }
+    return write_all(ctx, data, ctx->frame_size);
+}
+
+static void pipe_close(vcam_ctx_t *ctx)
+{
+    if (ctx->fd >= 0 && !ctx->is_stdout)
+        _close(ctx->fd);
+    pool_put(ctx->scratch);
+}
+
+/* ── Virtual camera mode ───────────────────────────────────── */
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Create the ring as a temporary file the Frame Server can open: it runs
+ * as a service account in session 0, where our session's named objects
+ * are invisible and Global\ ones need a privilege users lack.  Temporary
+ * files stay in the cache unless memory runs low, and the file goes away
+ * with the last handle.
+ */
+static int ring_create(vcam_ctx_t *ctx, size_t total)
+{
+    WCHAR path[MAX_PATH];
+    DWORD n = GetEnvironmentVariableW(L"ProgramData", path, MAX_PATH);
+    if (n == 0 || n + 1 + wcslen(SHM_WIN_FILE) >= MAX_PATH) {
+        fprintf(stderr, "vcam: %%ProgramData%% is not set\n");
+        return -1;
+    }
+    wcscat(path, L"\\");
+    wcscat(path, SHM_WIN_DIR);
+    CreateDirectoryW(path, NULL);
+    path[n] = L'\0';
+    wcscat(path, L"\\");
+    wcscat(path, SHM_WIN_FILE);
+
+    /* Owner and the service accounts only */
+    SECURITY_ATTRIBUTES sa = { sizeof(sa), NULL, FALSE };
+    ConvertStringSecurityDescriptorToSecurityDescriptorW(
+        L"D:P(A;;GA;;;SY)(A;;GA;;;OW)(A;;GRGW;;;LS)", SDDL_REVISION_1,
+        &sa.lpSecurityDescriptor, NULL);
+
+    ctx->file = CreateFileW(path, GENERIC_READ | GENERIC_WRITE,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                            sa.lpSecurityDescriptor ? &sa : NULL, CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    LocalFree(sa.lpSecurityDescriptor);
+    if (ctx->file == INVALID_HANDLE_VALUE) {
+        fprintf(stderr, "vcam: cannot create %ls (error %lu)\n", path, GetLastError());
+        ctx->file = NULL;
+        return -1;
+    }
+
+    ctx->mapping = CreateFileMappingW(ctx->file, NULL, PAGE_READWRITE,
+                                      (DWORD)((uint64_t)total >> 32), (DWORD)total, NULL);
+    if (!ctx->mapping) {
+        fprintf(stderr, "vcam: CreateFileMapping failed (error %lu)\n", GetLastError());
+        return -1;
+    }
+    ctx->shm_hdr = MapViewOfFile(ctx->mapping, FILE_MAP_ALL_ACCESS, 0, 0, total);
+    if (!ctx->shm_hdr) {
+        fprintf(stderr, "vcam: MapViewOfFile failed (error %lu)\n", GetLastError());
+        return -1;
+    }
+    return 0;
+}
+
+static int camera_register(vcam_ctx_t *ctx)
+{
+    ctx->sensorgroup = LoadLibraryW(L"mfsensorgroup.dll");
+    create_virtual_camera_fn create = ctx->sensorgroup
+        ? (create_virtual_camera_fn)(void (*)(void))GetProcAddress(ctx->sensorgroup,
+                                                                   "MFCreateVirtualCamera")
+        : NULL;
+    if (!create) {
+        fprintf(stderr, "vcam: virtual cameras need Windows 11 (MFCreateVirtualCamera)\n");
+        return -1;
+    }
+
+    HRESULT hr = CoInitializeEx(NULL, COINIT_MULTITHREADED);
+    if (FAILED(hr) && hr != RPC_E_CHANGED_MODE)
+        return -1;
+    if (FAILED(MFStartup(MF_VERSION, MFSTARTUP_LITE))) {
+        fprintf(stderr, "vcam: MFStartup failed\n");
+        return -1;
+    }
+    ctx->mf_started = 1;
+
+    /* Session lifetime: the camera disappears when we exit */
+    hr = create(0, 0, 0, L"screen2cam", SHM_WIN_CLSID, NULL, 0, &ctx->camera);
+    if (SUCCEEDED(hr))
+        hr = ctx->camera->lpVtbl->Start(ctx->camera, NULL);
+    if (FAILED(hr)) {
+        fprintf(stderr, "vcam: cannot start the virtual camera (0x%08lx); "
+                        "register the media source with "
+                        "'regsvr32 screen2cam_vcam.dll' first\n", (unsigned long)hr);
+        return -1;
+    }
+    return 0;
+}
+
+static void mf_close(vcam_ctx_t *ctx)
+{
+    /* Tell the media source the ring is gone so it stops reading */
+    if (ctx->shm_hdr) {
+        atomic_thread_fence(memory_order_release);
+        ctx->shm_hdr->version = 0;
+    }
+    if (ctx->camera) {
+        ctx->camera->lpVtbl->Remove(ctx->camera);
+        ctx->camera->lpVtbl->Shutdown(ctx->camera);
+        ctx->camera->lpVtbl->Release(ctx->camera);
+    }
+    if (ctx->mf_started)
+        MFShutdown();
+    if (ctx->sensorgroup)
+        FreeLibrary(ctx->sensorgroup);
+    if (ctx->shm_hdr)
+        UnmapViewOfFile(ctx->shm_hdr);
+    if (ctx->mapping)
+        CloseHandle(ctx->mapping);
+    if (ctx->file)
+        CloseHandle(ctx->file);
+}
+
+static vcam_ctx_t *mf_open(int width, int height)
+{
+    vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
+    if (!ctx)
+        return NULL;
+
+    ctx->mode       = VCAM_MODE_MF;
+    ctx->fd         = -1;
+    ctx->width      = width;
+    ctx->height     = height;
+    ctx->format     = PIX_FMT_NV12;   /* what cameras deliver and apps expect */
+    ctx->frame_size = pix_fmt_frame_size(PIX_FMT_NV12, width, height);
+    ctx->shm_slot   = -1;
+
+    if (ring_create(ctx, shm_total_size(width, height)) < 0) {
+        mf_close(ctx);
+        free(ctx);
+        return NULL;
+    }
+
+    shm_header_t *hdr = ctx->shm_hdr;
+    hdr->version = 0;
+    hdr->magic   = SHM_MAGIC;
+    hdr->width   = width;
+    hdr->height  = height;
+    hdr->fps     = 30;   /* advertised rate; frames go out as they come */
+    shm_init_slots(hdr, width, height);
+    for (uint32_t i = 0; i < SHM_SLOTS; i++) {
+        hdr->slots[i].pixel_fmt = SHM_FMT_NV12;
+        hdr->slots[i].width     = width;
+        hdr->slots[i].height    = height;
+        hdr->slots[i].stride    = (uint32_t)width;
+    }
+    /* Version last: readers ignore the segment until it is complete */
+    atomic_thread_fence(memory_order_release);
+    hdr->version = SHM_VERSION;
+
+    /* The ring must exist before the camera, whose source maps it */
+    if (camera_register(ctx) < 0) {
+        mf_close(ctx);
+        free(ctx);
+        return NULL;
+    }
+
+    fprintf(stderr, "vcam: output %dx%d nv12 -> virtual camera \"screen2cam\" (%d slots)\n",
+            width, height, SHM_SLOTS);
+    return ctx;
+}
+
+static frame_t *mf_acquire(vcam_ctx_t *ctx, int *index)
+{
+    ctx->shm_slot = (int)shm_begin_write(ctx->shm_hdr);
+    *index = ctx->shm_slot;
+    frame_init(&ctx->shm_frame, PIX_FMT_NV12, ctx->width, ctx->height,
+               shm_slot_ptr(ctx->shm_hdr, (uint32_t)ctx->shm_slot));
+    return &ctx->shm_frame;
+}
+
+static int mf_submit(vcam_ctx_t *ctx, int repeat)
+{
+    if (ctx->shm_slot < 0)
+        return -1;
+    uint64_t ts = ctx->shm_frame.timestamp_ns ? ctx->shm_frame.timestamp_ns : now_ns();
+    /* A repeat completes the slot; the source re-sends the latest frame itself */
+    shm_end_write(ctx->shm_hdr, (uint32_t)ctx->shm_slot, !repeat, ts);
+    ctx->shm_slot = -1;
+    return 0;
+}
+
+/* ── Public interface (vcam.h) ─────────────────────────────── */
+
+vcam_ctx_t *vcam_open(const char *device, int width, int height, pix_fmt_t format)
+{
+    if (strcmp(device, "vcam") == 0) {
+        if (format != PIX_FMT_AUTO && format != PIX_FMT_NV12)
+            fprintf(stderr, "vcam: virtual camera output is always nv12, ignoring --format\n");
+        return mf_open(width, height);
+    }
+    return pipe_open(device, width, height, format);
+}
+
+vcam_ctx_t *vcam_open_coded(const char *device, int width, int height, codec_t codec,
+                            int fps, int latency_ms)
+{
+    if (vcam_net_is_url(device)) {
+        vcam_ctx_t *ctx = calloc(1, sizeof(*ctx));
+        if (!ctx)
+            return NULL;
+        ctx->fd     = -1;
+        ctx->width  = width;
+        ctx->height = height;
+        ctx->format = PIX_FMT_AUTO;
+        ctx->net    = vcam_net_open(device, codec, width, height, fps, latency_ms);
+        if (!ctx->net) {
+            free(ctx);
+            return NULL;
+        }
+        return ctx;
+    }
+    if (strcmp(device, "vcam") == 0) {
+        fprintf(stderr, "vcam: the virtual camera takes raw frames, drop --codec\n");
+        return NULL;
+    }
+
+    vcam_ctx_t *ctx = pipe_open(device, width, height, PIX_FMT_YUV420P);
+    if (ctx)
+        ctx->format = PIX_FMT_AUTO;   /* packets only, see vcam_write_packet() */
+    return ctx;
+}
+
+pix_fmt_t vcam_format(const vcam_ctx_t *ctx)
+{
+    return ctx->format;
+}
+
+int vcam_write(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    if (ctx->mode == VCAM_MODE_MF) {
+        int index;
+        frame_copy(mf_acquire(ctx, &index), frame);
+        return mf_submit(ctx, 0);
+    }
+    return pipe_write(ctx, frame);
+}
+
+int vcam_write_packet(vcam_ctx_t *ctx, const packet_t *pkt)
+{
+    if (ctx->net)
+        return vcam_net_send(ctx->net, pkt);
+    return write_all(ctx, pkt->data, pkt->size);
+}
+
+int vcam_repeat(vcam_ctx_t *ctx, const frame_t *frame)
+{
+    /* The camera keeps serving its latest frame; pipes need it again */
+    if (ctx->mode == VCAM_MODE_MF)
+        return 0;
+    return pipe_write(ctx, frame);
+}
+
+/* The virtual camera lends out its ring slots; pipes have nothing to lend */
+int vcam_buffer_count(const vcam_ctx_t *ctx)
+{
+    return ctx->mode == VCAM_MODE_MF ? SHM_SLOTS : 0;
+}
+
+frame_t *vcam_acquire(vcam_ctx_t *ctx, int *index)
+{
+    if (ctx->mode != VCAM_MODE_MF)
+        return NULL;
+    return mf_acquire(ctx, index);
+}
+
+int vcam_submit(vcam_ctx_t *ctx, int repeat)
+{
+    if (ctx->mode != VCAM_MODE_MF)
+        return -1;
+    return mf_submit(ctx, repeat);
+}
+
 void vcam_close(vcam_ctx_t *ctx)
 {
     if (!ctx)
         return;
-    if (ctx->fd >= 0 && !ctx->is_stdout)
-        _close(ctx->fd);
+    vcam_net_close(ctx->net);
+    if (ctx->mode == VCAM_MODE_MF)
+        mf_close(ctx);
+    else
+        pipe_close(ctx);
     free(ctx);
 }
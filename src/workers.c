@@ -0,0 +1,228 @@
+/*
+ * Persistent worker pool
+ *
+ * Each job is a set of independent tasks.  workers_run() publishes the
+ * job under the pool mutex and bumps a generation counter; parked
+ * workers wake, claim task indices with an atomic counter, and the last
+ * one to finish signals the caller.  The caller claims tasks too, so a
+ * pool of N threads keeps N cores busy.  Callers on several threads (one
+ * convert thread per output format) take turns: a job holds the pool's
+ * run lock from publish to the last task.
+ *
+ * Uses POSIX threads on every platform (winpthreads on MinGW).
+ */
+
+#include "workers.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <sys/sysctl.h>
+#include <unistd.h>
+#else
+#include <unistd.h>
+#endif
+
+struct workers {
+    pthread_t      *threads;
+    int             nthreads;     /* worker threads (excludes caller) */
+
+    pthread_mutex_t run;          /* one job at a time */
+    pthread_mutex_t lock;
+    pthread_cond_t  wake;         /* caller -> workers: new job */
+    pthread_cond_t  done;         /* workers -> caller: job finished */
+    unsigned long   generation;
+    int             quit;
+
+    /* Current job */
+    workers_fn      fn;
+    void           *arg;
+    int             tasks;
+    atomic_int      next;         /* next unclaimed task index */
+    int             busy;         /* workers still inside the job */
+};
+
+static void run_tasks(workers_t *w)
+{
+    for (;;) {
+        int i = atomic_fetch_add_explicit(&w->next, 1, memory_order_relaxed);
+        if (i >= w->tasks)
+            break;
+        w->fn(w->arg, i, w->tasks);
+    }
+}
+
+static void *worker_main(void *opaque)
+{
+    workers_t *w = opaque;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (!w->quit && w->generation == seen)
+            pthread_cond_wait(&w->wake, &w->lock);
+        if (w->quit)
+            break;
+        seen = w->generation;
+        pthread_mutex_unlock(&w->lock);
+
+        run_tasks(w);
+
+        pthread_mutex_lock(&w->lock);
+        if (--w->busy == 0)
+            pthread_cond_signal(&w->done);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+workers_t *workers_create(int threads)
+{
+    if (threads < 1)
+        threads = 1;
+
+    workers_t *w = calloc(1, sizeof(*w));
+    if (!w)
+        return NULL;
+
+    pthread_mutex_init(&w->run, NULL);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->wake, NULL);
+    pthread_cond_init(&w->done, NULL);
+    atomic_init(&w->next, 0);
+
+    if (threads > 1) {
+        w->threads = calloc((size_t)threads - 1, sizeof(*w->threads));
+        if (!w->threads) {
+            workers_destroy(w);
+            return NULL;
+        }
+    }
+
+    for (int i = 0; i < threads - 1; i++) {
+        if (pthread_create(&w->threads[i], NULL, worker_main, w) != 0) {
+            fprintf(stderr, "workers: pthread_create failed, using %d threads\n",
+                    w->nthreads + 1);
+            break;
+        }
+        w->nthreads++;
+    }
+    return w;
+}
+
+int workers_count(const workers_t *w)
+{
+    return w->nthreads + 1;
+}
+
+void workers_run(workers_t *w, workers_fn fn, void *arg, int tasks)
+{
+    if (w->nthreads == 0 || tasks <= 1) {
+        for (int i = 0; i < tasks; i++)
+            fn(arg, i, tasks);
+        return;
+    }
+
+    pthread_mutex_lock(&w->run);
+    pthread_mutex_lock(&w->lock);
+    w->fn    = fn;
+    w->arg   = arg;
+    w->tasks = tasks;
+    w->busy  = w->nthreads;
+    atomic_store_explicit(&w->next, 0, memory_order_relaxed);
+    w->generation++;
+    pthread_cond_broadcast(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    run_tasks(w);
+
+    pthread_mutex_lock(&w->lock);
+    while (w->busy > 0)
+        pthread_cond_wait(&w->done, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+    pthread_mutex_unlock(&w->run);
+}
+
+void workers_destroy(workers_t *w)
+{
+    if (!w)
+        return;
+
+    pthread_mutex_lock(&w->lock);
+    w->quit = 1;
+    pthread_cond_broadcast(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+
+    for (int i = 0; i < w->nthreads; i++)
+        pthread_join(w->threads[i], NULL);
+
+    pthread_cond_destroy(&w->done);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+    pthread_mutex_destroy(&w->run);
+    free(w->threads);
+    free(w);
+}
+
+/* ── Core count ────────────────────────────────────────────── */
+
+static int physical_cores(void)
+{
+#ifdef _WIN32
+    DWORD len = 0;
+    GetLogicalProcessorInformation(NULL, &len);
+    SYSTEM_LOGICAL_PROCESSOR_INFORMATION *info = malloc(len);
+    if (!info)
+        return 1;
+
+    int cores = 0;
+    if (GetLogicalProcessorInformation(info, &len)) {
+        DWORD n = len / sizeof(*info);
+        for (DWORD i = 0; i < n; i++) {
+            if (info[i].Relationship == RelationProcessorCore)
+                cores++;
+        }
+    }
+    free(info);
+    return cores;
+#elif defined(__APPLE__)
+    int cores = 0;
+    size_t len = sizeof(cores);
+    if (sysctlbyname("hw.physicalcpu", &cores, &len, NULL, 0) != 0)
+        cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return cores;
+#else
+    /* Count each core once: the CPU listed first among its SMT siblings */
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    int cores = 0;
+    for (long cpu = 0; cpu < ncpu; cpu++) {
+        char path[96];
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/cpu/cpu%ld/topology/thread_siblings_list", cpu);
+        FILE *f = fopen(path, "r");
+        if (!f)
+            continue;
+        long first = -1;
+        if (fscanf(f, "%ld", &first) == 1 && first == cpu)
+            cores++;
+        fclose(f);
+    }
+    if (cores == 0)
+        cores = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    return cores;
+#endif
+}
+
+int workers_default_threads(void)
+{
+    int n = physical_cores() - 1;
+    return n < 1 ? 1 : n;
+}
@@ -0,0 +1,39 @@
+#ifndef WORKERS_H
+#define WORKERS_H
+
+/*
+ * Persistent worker pool for splitting per-frame work across cores.
+ *
+ * Threads are created once by workers_create() and parked on a condition
+ * variable between jobs, so dispatching a frame costs a wakeup, not a
+ * thread start.  The calling thread takes part in every job.
+ */
+
+typedef struct workers workers_t;
+
+/* Task callback: index is in [0, count). */
+typedef void (*workers_fn)(void *arg, int index, int count);
+
+/*
+ * Create a pool that runs jobs on `threads` threads in total (the caller
+ * plus threads - 1 workers).  Returns NULL on failure.
+ */
+workers_t *workers_create(int threads);
+
+/* Total threads used per job (including the caller). */
+int workers_count(const workers_t *w);
+
+/*
+ * Run fn(arg, i, tasks) for every i in [0, tasks) and wait until all
+ * tasks have finished.  Safe to call from several threads: jobs run one
+ * at a time, later callers wait for the pool.  Not reentrant from a task.
+ */
+void workers_run(workers_t *w, workers_fn fn, void *arg, int tasks);
+
+/* Stop and join all workers. */
+void workers_destroy(workers_t *w);
+
+/* Physical CPU cores minus one (at least 1). */
+int workers_default_threads(void);
+
+#endif /* WORKERS_H */